@@ -0,0 +1,224 @@
+/*
+Heap allocation guard for verifying allocation-free code paths.
+
+Including this header replaces malloc, calloc, realloc, free and the
+aligned allocation functions of the program with thin wrappers around the
+glibc implementations (__libc_malloc etc.). operator new and the C++
+library allocate through malloc, so they are covered as well. While an
+AllocGuard is armed on a thread, every allocation made by that thread is a
+violation: it is counted, and in abort mode the program is aborted with a
+message.
+
+  AllocGuard guard(AllocGuard::Count);
+  ... code that must not allocate ...
+  guard.disarm();
+  if (guard.violations() > 0) ...
+
+StepLoopGuard packages this for the step loops of the example drivers: it
+reserves a table for the results, arms a guard in the mode selected by
+ALLOC_GUARD_ABORT, and prints the table and the counts after the loop.
+
+  StepLoopGuard<realtype> guard(rows, 2);
+  for (...) { flag = CVode(...); guard.record(t, NV_DATA_S(y)); ... }
+  guard.finish();
+  if (guard.violations() > 0) return(1);
+
+The wrappers define the allocation functions themselves, so include this
+header in exactly one translation unit of a program. It relies on glibc.
+*/
+
+#ifndef ALLOC_GUARD_H
+#define ALLOC_GUARD_H
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <unistd.h>
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *ptr);
+}
+
+class AllocGuard {
+ public:
+  enum Mode { Count, Abort };
+
+  explicit AllocGuard(Mode mode = Count) {
+    state().mode = mode;
+    state().start = violations_total().load();
+    state().frees_start = frees_total().load();
+    state().armed = true;
+  }
+  ~AllocGuard() { disarm(); }
+
+  AllocGuard(const AllocGuard&) = delete;
+  AllocGuard& operator=(const AllocGuard&) = delete;
+
+  void disarm() {
+    if (!state().armed) return;
+    state().armed = false;
+    violations_ = violations_total().load() - state().start;
+    frees_ = frees_total().load() - state().frees_start;
+  }
+
+  // Allocations made while armed. Valid after disarm().
+  long int violations() const { return violations_; }
+  // Frees made while armed. Not a violation by themselves, but they show
+  // memory being released on a path that should not touch the heap.
+  long int frees() const { return frees_; }
+
+  // Called by the allocation wrappers.
+  static void on_alloc(const char *function) {
+    if (!state().armed) return;
+    violations_total()++;
+    if (state().mode == Abort) {
+      // No stdio here: it may allocate.
+      static const char msg[] = "alloc_guard: heap allocation in ";
+      ssize_t ignored = write(2, msg, sizeof(msg) - 1);
+      size_t len = 0;
+      while (function[len]) len++;
+      ignored = write(2, function, len);
+      ignored = write(2, " while armed\n", 13);
+      (void) ignored;
+      abort();
+    }
+  }
+
+  static void on_free() {
+    if (state().armed) frees_total()++;
+  }
+
+ private:
+  struct ThreadState {
+    bool armed = false;
+    Mode mode = Count;
+    long int start = 0;
+    long int frees_start = 0;
+  };
+
+  // Thread local so that other threads, e.g. an MPI progress thread, are
+  // not checked. The counters are shared; concurrent guards on several
+  // threads see each other's violations.
+  static ThreadState &state() {
+    static thread_local ThreadState s;
+    return s;
+  }
+  static std::atomic<long int> &violations_total() {
+    static std::atomic<long int> n(0);
+    return n;
+  }
+  static std::atomic<long int> &frees_total() {
+    static std::atomic<long int> n(0);
+    return n;
+  }
+
+  long int violations_ = 0;
+  long int frees_ = 0;
+};
+
+// Mode of StepLoopGuard: abort on the first allocation when built with
+// -D ALLOC_GUARD_ABORT, count otherwise.
+#ifdef ALLOC_GUARD_ABORT
+#define ALLOC_GUARD_DEFAULT_MODE AllocGuard::Abort
+#else
+#define ALLOC_GUARD_DEFAULT_MODE AllocGuard::Count
+#endif
+
+// Results table of a guarded step loop. Rows of the time and `columns`
+// values are recorded into storage reserved before the guard is armed, and
+// printed by finish() once it is disarmed. Recording more than `rows` rows
+// allocates, and is reported like any other allocation in the loop.
+template <typename Real>
+class StepLoopGuard {
+ public:
+  StepLoopGuard(size_t rows, size_t columns,
+                AllocGuard::Mode mode = ALLOC_GUARD_DEFAULT_MODE)
+      : columns_(columns), table_(reserved(rows * (columns + 1))),
+        guard_(mode) {}
+
+  void record(Real t, const Real *values) {
+    table_.push_back(t);
+    for (size_t j = 0; j < columns_; j++) table_.push_back(values[j]);
+  }
+
+  // Disarms the guard, then prints the table and the counts.
+  void finish() {
+    guard_.disarm();
+    for (size_t i = 0; i < table_.size(); i += columns_ + 1) {
+      std::cout << "t: " << table_[i];
+      std::cout << "\ny:";
+      for (size_t j = 1; j <= columns_; j++)
+        std::cout << (j > 1 ? " " : "") << table_[i + j];
+      std::cout << "\n";
+    }
+    std::cout << "no-alloc: " << guard_.violations() << " heap allocations "
+              << "and " << guard_.frees() << " frees in the step loop\n";
+  }
+
+  // Valid after finish().
+  long int violations() const { return guard_.violations(); }
+
+ private:
+  static std::vector<Real> reserved(size_t n) {
+    std::vector<Real> v;
+    v.reserve(n);
+    return v;
+  }
+
+  size_t columns_;
+  std::vector<Real> table_;
+  AllocGuard guard_;
+};
+
+extern "C" {
+
+void *malloc(size_t size) {
+  AllocGuard::on_alloc("malloc");
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+  AllocGuard::on_alloc("calloc");
+  return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  AllocGuard::on_alloc("realloc");
+  return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+  if (ptr) AllocGuard::on_free();
+  __libc_free(ptr);
+}
+
+void *memalign(size_t alignment, size_t size) {
+  AllocGuard::on_alloc("memalign");
+  return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+  AllocGuard::on_alloc("aligned_alloc");
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+  AllocGuard::on_alloc("posix_memalign");
+  if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0)
+    return EINVAL;
+  void *p = __libc_memalign(alignment, size);
+  if (p == NULL) return ENOMEM;
+  *memptr = p;
+  return 0;
+}
+
+}
+
+#endif
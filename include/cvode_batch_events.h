@@ -0,0 +1,268 @@
+/*
+Batched event functions for ensembles packed into one N_Vector.
+
+When many copies of a small system are integrated together as one CVODE
+problem, registering one scalar event function per member makes every root
+evaluation a chain of indirect calls. The BatchEventEngine instead takes a
+single BatchEventFn that computes the events of all members in one pass
+over the state in structure of arrays form:
+
+  y[c * members + i]     component c of member i
+  gout[k * members + i]  event k of member i
+
+Written as plain loops over i, such a function vectorizes. Its values are
+registered with CVodeRootInit as members * nevents root functions.
+
+advance() returns CV_ROOT_RETURN when members trigger, and triggered()
+lists exactly which ones did: member, event and direction. The caller
+then acts on each member without stopping the others:
+
+ - stop_member(i) freezes member i at the event. Its events are masked,
+   and its error weight is dropped (CVodeSVtolerances), so it no longer
+   limits the step size. The right hand side must multiply the member's
+   derivatives by active()[i], which is 0 from then on. The member's state
+   at the event is kept and written back into y after every call.
+ - reset_member(i, state) replaces the state of member i, and restarts a
+   stopped member. The other members keep their state. All resets made
+   after one return of advance are applied together, with one CVodeReInit
+   at that time, before the next step. CVODE has no way to change the
+   state of some components in place, so this restarts its step history
+   for all members, but not the integration: every member continues from
+   where it is.
+
+As in cvode_events.h, the root function reaches the engine through a
+thread-local pointer set by advance(), so step the problem with advance().
+
+The module is header-only; include it with the include path of the
+repository (-I ../../../include from an example folder).
+*/
+
+#ifndef CVODE_BATCH_EVENTS_H
+#define CVODE_BATCH_EVENTS_H
+
+#include <vector>
+#include <cvode/cvode.h> // prototypes for CVODE fcts., consts.
+#include <nvector/nvector_serial.h>  // access to serial N_Vector
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+#include <sundials_raii.h> // move-only owners and CVodeIntegrator
+#include <cvode_events.h> // EventDirection and EventLog
+
+// The events of all members: writes event k of member i to
+// gout[k * members + i], from the state in structure of arrays form.
+typedef void (*BatchEventFn)(realtype t, const realtype *y,
+                             sunindextype members, realtype *gout,
+                             void *data);
+
+// One member that triggered.
+struct MemberEvent {
+  sunindextype member;
+  int event;
+  int direction; // 1 rising, -1 falling
+};
+
+class BatchEventEngine {
+ public:
+  // cvode_mem must be initialized for members * dim equations with scalar
+  // tolerances reltol and abstol; y receives the solution from CVode.
+  BatchEventEngine(void *cvode_mem, N_Vector y, sunindextype members,
+                   int dim, int nevents, BatchEventFn g, void *data,
+                   realtype reltol, realtype abstol,
+                   size_t log_capacity = 4096)
+      : mem_(cvode_mem), y_(y), members_(members), dim_(dim),
+        nevents_(nevents), g_(g), data_(data), reltol_(reltol),
+        abstol_(abstol), directions_(members * nevents, 0),
+        active_(members, 1), stop_time_(members, 0),
+        frozen_(members * dim, 0), log_(log_capacity) {}
+
+  // Reacts to crossings of event k in this direction only, for all
+  // members. Call before the first advance.
+  void set_direction(int event, EventDirection direction) {
+    for (sunindextype i = 0; i < members_; i++)
+      directions_[event * members_ + i] = (int) direction;
+    armed_ = false;
+  }
+
+  // Same contract as CVode(mem, tout, y, t, CV_NORMAL), except that it
+  // returns CV_ROOT_RETURN with *t at the event when members triggered.
+  int advance(realtype tout, realtype *t) {
+    int flag = prepare();
+    if (flag < 0) return flag;
+    triggered_.clear();
+    Activation active(this);
+    while (true) {
+      flag = CVode(mem_, tout, y_, t, CV_NORMAL);
+      restore_stopped();
+      if (flag < 0) return flag;
+      last_time_ = *t;
+      if (flag != CV_ROOT_RETURN) return flag;
+      flag = CVodeGetRootInfo(mem_, found_.data());
+      if (flag < 0) return flag;
+      const sunindextype n = members_ * nevents_;
+      for (sunindextype j = 0; j < n; j++) {
+        if (found_[j] == 0) continue;
+        sunindextype i = j % members_;
+        // A stopped member's events jump to a constant when it is masked,
+        // which CVODE may report once.
+        if (active_[i] == 0) continue;
+        MemberEvent e = {i, (int) (j / members_), found_[j]};
+        triggered_.push_back(e);
+        log_.push(*t, (uint32_t) j, found_[j]);
+      }
+      if (!triggered_.empty()) return CV_ROOT_RETURN;
+      if (*t >= tout) return CV_SUCCESS;
+    }
+  }
+
+  // The members that triggered in the last advance call.
+  const std::vector<MemberEvent> &triggered() const { return triggered_; }
+
+  // Freezes member i in its state at the last return of advance, e.g. at
+  // its event.
+  void stop_member(sunindextype i) {
+    if (active_[i] == 0) return;
+    const realtype *y = NV_DATA_S(y_);
+    for (int c = 0; c < dim_; c++)
+      frozen_[i * dim_ + c] = y[c * members_ + i];
+    active_[i] = 0;
+    stop_time_[i] = last_time_;
+    stopped_.push_back(i);
+    set_weight(i, 1e30); // error weight 1 / (reltol |y| + 1e30) ~ 0
+  }
+
+  // Gives member i the state (dim values) at the time of the last return of
+  // advance and runs it from there, whether it was stopped or not.
+  void reset_member(sunindextype i, const realtype *state) {
+    realtype *y = NV_DATA_S(y_);
+    for (int c = 0; c < dim_; c++) y[c * members_ + i] = state[c];
+    if (active_[i] == 0) {
+      active_[i] = 1;
+      for (size_t k = 0; k < stopped_.size(); k++) {
+        if (stopped_[k] == i) {
+          stopped_[k] = stopped_.back();
+          stopped_.pop_back();
+          break;
+        }
+      }
+      set_weight(i, abstol_);
+    }
+    reinit_ = true;
+    resets_++;
+  }
+
+  // 1 for running members, 0 for stopped ones. The right hand side
+  // multiplies each member's derivatives by it.
+  const realtype *active() const { return active_.data(); }
+  bool stopped(sunindextype i) const { return active_[i] == 0; }
+  realtype stop_time(sunindextype i) const { return stop_time_[i]; }
+  size_t num_stopped() const { return stopped_.size(); }
+  sunindextype members() const { return members_; }
+  const EventLog &log() const { return log_; }
+  EventLog &log() { return log_; }
+  long int resets() const { return resets_; }
+  long int reinits() const { return reinits_; }
+  long int evaluations() const { return evaluations_; } // batched calls
+
+ private:
+  class Activation {
+   public:
+    explicit Activation(BatchEventEngine *e) : previous_(current()) {
+      current() = e;
+    }
+    ~Activation() { current() = previous_; }
+
+   private:
+    BatchEventEngine *previous_;
+  };
+
+  static BatchEventEngine *&current() {
+    static thread_local BatchEventEngine *engine = NULL;
+    return engine;
+  }
+
+  static int root_fn(realtype t, N_Vector y, realtype *gout, void *) {
+    BatchEventEngine *e = current();
+    if (e == NULL) return -1; // CVode called outside advance()
+    e->evaluate(t, NV_DATA_S(y), gout);
+    return(0);
+  }
+
+  // One call of the batch function, then the events of stopped members
+  // are held at 1, without branches.
+  void evaluate(realtype t, const realtype *y, realtype *gout) {
+    g_(t, y, members_, gout, data_);
+    const realtype *a = active_.data();
+    const sunindextype m = members_;
+    for (int k = 0; k < nevents_; k++) {
+      realtype *gk = gout + k * m;
+      for (sunindextype i = 0; i < m; i++)
+        gk[i] = a[i] * gk[i] + (1 - a[i]);
+    }
+    evaluations_++;
+  }
+
+  // Arms the root functions and applies pending resets and tolerances.
+  int prepare() {
+    int flag;
+    if (!armed_) {
+      const int n = (int) (members_ * nevents_);
+      flag = CVodeRootInit(mem_, n, root_fn);
+      if (flag < 0) return flag;
+      flag = CVodeSetRootDirection(mem_, directions_.data());
+      if (flag < 0) return flag;
+      CVodeSetNoInactiveRootWarn(mem_);
+      found_.assign(n, 0);
+      armed_ = true;
+    }
+    if (weights_changed_) {
+      flag = CVodeSVtolerances(mem_, reltol_, abstol_vector_);
+      if (flag < 0) return flag;
+      weights_changed_ = false;
+    }
+    if (reinit_) {
+      flag = CVodeReInit(mem_, last_time_, y_);
+      if (flag < 0) return flag;
+      reinit_ = false;
+      reinits_++;
+    }
+    return CV_SUCCESS;
+  }
+
+  // CVode keeps integrating the masked members; their output is the frozen
+  // state.
+  void restore_stopped() {
+    realtype *y = NV_DATA_S(y_);
+    for (sunindextype i : stopped_)
+      for (int c = 0; c < dim_; c++)
+        y[c * members_ + i] = frozen_[i * dim_ + c];
+  }
+
+  void set_weight(sunindextype i, realtype abstol) {
+    if (!abstol_vector_) {
+      abstol_vector_.reset(N_VClone(y_));
+      sundials_check(abstol_vector_.get(), "N_VClone");
+      N_VConst(abstol_, abstol_vector_);
+    }
+    realtype *a = NV_DATA_S(abstol_vector_.get());
+    for (int c = 0; c < dim_; c++) a[c * members_ + i] = abstol;
+    weights_changed_ = true;
+  }
+
+  void *mem_;
+  N_Vector y_;
+  sunindextype members_;
+  int dim_, nevents_;
+  BatchEventFn g_;
+  void *data_;
+  realtype reltol_, abstol_;
+  std::vector<int> directions_, found_;
+  std::vector<realtype> active_, stop_time_, frozen_;
+  std::vector<sunindextype> stopped_;
+  std::vector<MemberEvent> triggered_;
+  NVectorOwner abstol_vector_;
+  EventLog log_;
+  realtype last_time_ = 0; // of the last return of CVode
+  bool armed_ = false, weights_changed_ = false, reinit_ = false;
+  long int resets_ = 0, reinits_ = 0, evaluations_ = 0;
+};
+
+#endif
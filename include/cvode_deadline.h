@@ -0,0 +1,124 @@
+/*
+Deadline-bounded stepping for CVODE in real-time loops.
+
+A CVode call in CV_NORMAL mode returns only once it has reached tout, which
+can take arbitrarily long when steps fail around a discontinuity. The
+DeadlineStepper advances with CV_ONE_STEP under a stop time instead, and
+stops taking steps once the wall-clock budget of the call would be
+exceeded. It then returns the partial progress: the time reached and the
+state there. The next call continues from that point.
+
+A step can not be interrupted once started, so the stepper keeps an
+estimate of the wall time of one step and does not start a step that is
+predicted to overrun the budget. It also records deadline misses (calls
+that returned short of tout), overruns (calls that took longer than their
+budget) and the worst-case call latency.
+
+The module is header-only; include it with the include path of the
+repository (-I ../../../include from an example folder).
+*/
+
+#ifndef CVODE_DEADLINE_H
+#define CVODE_DEADLINE_H
+
+#include <chrono>
+#include <cvode/cvode.h> // prototypes for CVODE fcts., consts.
+#include <sundials/sundials_nvector.h> // generic N_Vector
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+
+// The outcome of one DeadlineStepper::advance call.
+struct DeadlineResult {
+  int flag = CV_SUCCESS; // last CVode flag, negative on failure
+  bool reached = false; // true if t == tout
+  realtype t = 0; // time of the returned state
+  long int steps = 0; // internal steps taken by this call
+  double seconds = 0; // wall time of this call
+};
+
+// Statistics over all calls of a DeadlineStepper.
+struct DeadlineStats {
+  long int calls = 0;
+  long int misses = 0; // calls that returned short of tout
+  long int overruns = 0; // calls that took longer than their budget
+  long int failures = 0; // calls that ended with a negative CVode flag
+  long int steps = 0;
+  double total_seconds = 0;
+  double worst_seconds = 0; // worst-case call latency
+};
+
+class DeadlineStepper {
+ public:
+  // cvode_mem must be initialized; y receives the solution from CVode.
+  DeadlineStepper(void *cvode_mem, N_Vector y) : mem_(cvode_mem), y_(y) {}
+
+  // Advances towards tout for at most budget_seconds of wall time and
+  // leaves the state at result.t in y. Returns early, with reached false,
+  // when the next step is predicted to overrun the budget. At least one
+  // step is taken per call, so progress is guaranteed.
+  DeadlineResult advance(realtype tout, double budget_seconds) {
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    DeadlineResult r;
+    CVodeGetCurrentTime(mem_, &r.t);
+
+    if (r.t < tout) {
+      // The stop time keeps CV_ONE_STEP from stepping past tout, so the
+      // state never has to be interpolated back. It is cleared by CVODE
+      // once reached, so it is set again on every call.
+      r.flag = CVodeSetStopTime(mem_, tout);
+      double elapsed = 0;
+      while (r.flag >= 0) {
+        Clock::time_point step_start = Clock::now();
+        r.flag = CVode(mem_, tout, y_, &r.t, CV_ONE_STEP);
+        Clock::time_point step_end = Clock::now();
+        if (r.flag < 0) break;
+        r.steps++;
+        update_step_estimate(
+            std::chrono::duration<double>(step_end - step_start).count());
+        if (r.flag == CV_TSTOP_RETURN || r.t >= tout) break;
+        elapsed = std::chrono::duration<double>(step_end - start).count();
+        if (elapsed + step_estimate_ > budget_seconds) break;
+      }
+    } else {
+      // Nothing to do, but y must still hold the state at r.t.
+      r.flag = CVodeGetDky(mem_, r.t, 0, y_);
+    }
+    r.reached = r.flag >= 0 && r.t >= tout;
+
+    r.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    stats_.calls++;
+    stats_.steps += r.steps;
+    stats_.total_seconds += r.seconds;
+    if (r.seconds > stats_.worst_seconds) stats_.worst_seconds = r.seconds;
+    if (!r.reached) stats_.misses++;
+    if (r.seconds > budget_seconds) stats_.overruns++;
+    if (r.flag < 0) stats_.failures++;
+    return r;
+  }
+
+  // Interpolates the state at time t into yout. t must lie within the last
+  // internal step, i.e. between t_reached - h_last and t_reached.
+  int state_at(realtype t, N_Vector yout) const {
+    return CVodeGetDky(mem_, t, 0, yout);
+  }
+
+  // Wall time predicted for the next step.
+  double step_estimate() const { return step_estimate_; }
+
+  const DeadlineStats& stats() const { return stats_; }
+
+ private:
+  // The estimate follows a slow step at once and decays towards fast ones,
+  // so a run of failing steps makes the stepper cautious right away.
+  void update_step_estimate(double seconds) {
+    if (seconds > step_estimate_) step_estimate_ = seconds;
+    else step_estimate_ = 0.9 * step_estimate_ + 0.1 * seconds;
+  }
+
+  void *mem_;
+  N_Vector y_;
+  double step_estimate_ = 0;
+  DeadlineStats stats_;
+};
+
+#endif
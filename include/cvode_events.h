@@ -0,0 +1,258 @@
+/*
+Event detection on top of CVODE rootfinding.
+
+An event is a function g(t, y) whose zero crossings matter: a threshold, a
+contact, a switching surface. CVODE locates the zeros of all registered g
+in every step (CVodeRootInit) and returns at each one with CV_ROOT_RETURN.
+The EventEngine registers any number of events as the components of one
+root function and handles the returns:
+
+ - direction filters (CVodeSetRootDirection): an event reacts to rising
+   crossings, falling crossings or both.
+ - actions: Log records the event and continues, Stop returns to the
+   caller at the event, and Reset lets a callback change the state, then
+   restarts CVODE from it with CVodeReInit and continues. The reset
+   callback can also stop the integration.
+
+Every event is recorded in an EventLog, a fixed-size ring of 16-byte
+records (time, event id, direction) that keeps the most recent ones, so
+logging never allocates during the integration.
+
+Events are either thresholds, y[component] - level, evaluated in a plain
+loop without calls, or functions called through a pointer.
+
+CVODE passes its user data to the root function, and that is the user
+data of the problem. So the root function finds its engine through a
+thread-local pointer that advance() sets around its CVode calls instead.
+Step the problem with advance(), not CVode, once events are registered.
+
+The module is header-only; include it with the include path of the
+repository (-I ../../../include from an example folder).
+*/
+
+#ifndef CVODE_EVENTS_H
+#define CVODE_EVENTS_H
+
+#include <cstdint>
+#include <vector>
+#include <cvode/cvode.h> // prototypes for CVODE fcts., consts.
+#include <sundials/sundials_nvector.h> // generic N_Vector
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+
+// Crossings an event reacts to, with the values of CVodeSetRootDirection.
+enum class EventDirection : int { Any = 0, Rising = 1, Falling = -1 };
+
+// What happens when an event fires.
+enum class EventAction { Log, Stop, Reset };
+
+// An event function: the event fires where it crosses zero.
+typedef realtype (*EventFn)(realtype t, const realtype *y, void *data);
+
+// Changes the state y at an event of action Reset. Returns false to stop
+// the integration after the reset.
+typedef bool (*EventResetFn)(realtype t, realtype *y, void *data);
+
+// One fired event: its time, id and direction (1 rising, -1 falling).
+struct EventRecord {
+  realtype t;
+  uint32_t event;
+  int32_t direction;
+};
+
+// The most recent events in a ring of fixed capacity.
+class EventLog {
+ public:
+  explicit EventLog(size_t capacity) : records_(capacity) {}
+
+  void push(realtype t, uint32_t event, int32_t direction) {
+    if (!records_.empty()) {
+      EventRecord &r = records_[total_ % records_.size()];
+      r.t = t;
+      r.event = event;
+      r.direction = direction;
+    }
+    total_++;
+  }
+
+  // The i-th oldest record still kept.
+  const EventRecord &operator[](size_t i) const {
+    size_t first = total_ > records_.size() ? total_ % records_.size() : 0;
+    return records_[(first + i) % records_.size()];
+  }
+
+  size_t size() const {
+    return total_ < records_.size() ? (size_t) total_ : records_.size();
+  }
+  size_t capacity() const { return records_.size(); }
+  uint64_t total() const { return total_; } // including overwritten ones
+  uint64_t dropped() const { return total_ - size(); }
+  void clear() { total_ = 0; }
+
+ private:
+  std::vector<EventRecord> records_;
+  uint64_t total_ = 0;
+};
+
+class EventEngine {
+ public:
+  // cvode_mem must be initialized; y receives the solution from CVode.
+  EventEngine(void *cvode_mem, N_Vector y, size_t log_capacity = 4096)
+      : mem_(cvode_mem), y_(y), log_(log_capacity) {}
+
+  // Fires where y[component] crosses level. Returns the event id.
+  int add_threshold(sunindextype component, realtype level,
+                    EventDirection direction = EventDirection::Any,
+                    EventAction action = EventAction::Log,
+                    EventResetFn reset = NULL, void *reset_data = NULL) {
+    Threshold th = {(int) specs_.size(), component, level};
+    thresholds_.push_back(th);
+    return add_spec(direction, action, reset, reset_data);
+  }
+
+  // Fires where g(t, y, data) crosses zero. Returns the event id.
+  int add(EventFn g, void *data,
+          EventDirection direction = EventDirection::Any,
+          EventAction action = EventAction::Log, EventResetFn reset = NULL,
+          void *reset_data = NULL) {
+    Function fn = {(int) specs_.size(), g, data};
+    functions_.push_back(fn);
+    return add_spec(direction, action, reset, reset_data);
+  }
+
+  // Registers the events with CVODE. advance() calls it when events were
+  // added; CVODE starts looking for their roots at its next (re)start, so
+  // add all events before the first advance after CVodeInit or
+  // CVodeReInit.
+  int arm() {
+    int n = (int) specs_.size();
+    int flag = CVodeRootInit(mem_, n, n > 0 ? root_fn : NULL);
+    if (flag < 0) return flag;
+    if (n > 0) {
+      flag = CVodeSetRootDirection(mem_, directions_.data());
+      if (flag < 0) return flag;
+      // Events that sit exactly at zero after a reset are expected.
+      CVodeSetNoInactiveRootWarn(mem_);
+    }
+    found_.assign(n, 0);
+    armed_ = true;
+    return CV_SUCCESS;
+  }
+
+  // Same contract as CVode(mem, tout, y, t, CV_NORMAL), with the events
+  // handled on the way: Log and Reset events continue to tout. Returns
+  // CV_ROOT_RETURN with *t at the event when a Stop event fires or a reset
+  // callback returns false.
+  int advance(realtype tout, realtype *t) {
+    if (!armed_) {
+      int flag = arm();
+      if (flag < 0) return flag;
+    }
+    Activation active(this);
+    while (true) {
+      int flag = CVode(mem_, tout, y_, t, CV_NORMAL);
+      if (flag != CV_ROOT_RETURN) return flag;
+      flag = CVodeGetRootInfo(mem_, found_.data());
+      if (flag < 0) return flag;
+      bool stop = false, reset = false;
+      realtype *y = N_VGetArrayPointer(y_);
+      for (size_t i = 0; i < found_.size(); i++) {
+        if (found_[i] == 0) continue;
+        log_.push(*t, (uint32_t) i, found_[i]);
+        counts_[i]++;
+        const Spec &s = specs_[i];
+        if (s.action == EventAction::Stop) {
+          stop = true;
+        } else if (s.action == EventAction::Reset) {
+          reset = true;
+          if (s.reset != NULL && !s.reset(*t, y, s.reset_data)) stop = true;
+        }
+      }
+      if (reset) {
+        flag = CVodeReInit(mem_, *t, y_);
+        if (flag < 0) return flag;
+        resets_++;
+      }
+      if (stop) return CV_ROOT_RETURN;
+      if (*t >= tout) return CV_SUCCESS;
+    }
+  }
+
+  const EventLog &log() const { return log_; }
+  EventLog &log() { return log_; }
+  size_t size() const { return specs_.size(); }
+  long int count(int id) const { return counts_[id]; } // times it fired
+  long int resets() const { return resets_; }
+  long int evaluations() const { return evaluations_; } // of all events
+
+ private:
+  struct Spec {
+    EventAction action;
+    EventResetFn reset;
+    void *reset_data;
+  };
+  struct Threshold {
+    int slot;
+    sunindextype component;
+    realtype level;
+  };
+  struct Function {
+    int slot;
+    EventFn g;
+    void *data;
+  };
+
+  // Makes an engine the one the root function reaches on this thread for
+  // the lifetime of the object.
+  class Activation {
+   public:
+    explicit Activation(EventEngine *e) : previous_(active()) { active() = e; }
+    ~Activation() { active() = previous_; }
+
+   private:
+    EventEngine *previous_;
+  };
+
+  static EventEngine *&active() {
+    static thread_local EventEngine *engine = NULL;
+    return engine;
+  }
+
+  static int root_fn(realtype t, N_Vector y, realtype *gout, void *) {
+    EventEngine *e = active();
+    if (e == NULL) return -1; // CVode called outside advance()
+    e->evaluate(t, N_VGetArrayPointer(y), gout);
+    return(0);
+  }
+
+  void evaluate(realtype t, const realtype *y, realtype *gout) {
+    for (const Threshold &th : thresholds_)
+      gout[th.slot] = y[th.component] - th.level;
+    for (const Function &fn : functions_) gout[fn.slot] = fn.g(t, y, fn.data);
+    evaluations_ += (long int) specs_.size();
+  }
+
+  int add_spec(EventDirection direction, EventAction action,
+               EventResetFn reset, void *reset_data) {
+    Spec s = {action, reset, reset_data};
+    specs_.push_back(s);
+    directions_.push_back((int) direction);
+    counts_.push_back(0);
+    armed_ = false;
+    return (int) specs_.size() - 1;
+  }
+
+  void *mem_;
+  N_Vector y_;
+  std::vector<Spec> specs_;
+  std::vector<int> directions_;
+  std::vector<Threshold> thresholds_;
+  std::vector<Function> functions_;
+  std::vector<int> found_;
+  std::vector<long int> counts_;
+  EventLog log_;
+  bool armed_ = false;
+  long int resets_ = 0;
+  long int evaluations_ = 0;
+};
+
+#endif
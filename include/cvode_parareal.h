@@ -0,0 +1,247 @@
+/*
+Parareal: parallel in time integration with CVODE.
+
+A single trajectory is integrated strictly step after step, so it can use
+one core. Parareal splits the interval [t0, tend] into time slices and
+integrates all slices at once, from start values that are corrected in a
+few iterations:
+
+  coarse  G  a cheap CVODE propagator, run sequentially over the slices:
+             loose tolerances, and with coarse_order = 1 BDF of order 1,
+             i.e. backward Euler with step size control.
+  fine    F  CVODE at the tolerances of the plain run, run on all slices
+             in parallel, one integrator per thread.
+
+  U[n+1] = G(U_new[n]) + F(U_old[n]) - G(U_old[n])
+
+After iteration k the first k slices are exact (equal to a sequential fine
+run), so at most as many iterations as slices are needed; the speedup comes
+from converging in far fewer. The iteration stops when the slice values
+change by less than tol in the weighted RMS norm of the fine tolerances,
+so tol = 1 means "below the fine tolerance".
+
+The right hand side is called from several threads at once, with the same
+user data; it must only read it.
+
+The module is header-only; include it with the include path of the
+repository (-I ../../../include from an example folder).
+*/
+
+#ifndef CVODE_PARAREAL_H
+#define CVODE_PARAREAL_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+#include <cvode/cvode.h> // prototypes for CVODE fcts., consts.
+#include <nvector/nvector_serial.h>  // access to serial N_Vector
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+#include <sundials_raii.h> // move-only owners and CVodeIntegrator
+
+struct PararealOptions {
+  int slices = 8;
+  int threads = 0; // 0: one per slice, at most the hardware threads
+  int max_iterations = 0; // 0: up to the number of slices
+  realtype tol = 1; // on the change of the slice values, see above
+  realtype fine_reltol = 1e-8, fine_abstol = 1e-8;
+  realtype coarse_reltol = 1e-2, coarse_abstol = 1e-2;
+  int coarse_order = 1; // maximum BDF order of G; 1 is backward Euler
+};
+
+struct PararealStats {
+  int iterations = 0;
+  bool converged = false;
+  realtype change = 0; // of the slice values in the last iteration
+  long int fine_steps = 0; // of all threads
+  long int coarse_steps = 0;
+  double fine_seconds = 0; // wall time of the parallel sweeps
+  double coarse_seconds = 0; // wall time of the sequential corrections
+};
+
+class Parareal {
+ public:
+  // N equations y' = f(t, y). jtv may be NULL for difference quotients.
+  Parareal(sunindextype N, CVRhsFn f, CVSpilsJacTimesVecFn jtv,
+           void *user_data, const PararealOptions &options)
+      : N_(N), options_(options),
+        coarse_(CVodeIntegrator::spgmr(N, f, jtv, options.coarse_reltol,
+                                       options.coarse_abstol, user_data)) {
+    if (options_.slices < 1) options_.slices = 1;
+    if (options_.threads < 1) {
+      options_.threads = (int) std::thread::hardware_concurrency();
+      if (options_.threads < 1) options_.threads = 1;
+    }
+    options_.threads = std::min(options_.threads, options_.slices);
+    if (options_.max_iterations < 1 ||
+        options_.max_iterations > options_.slices)
+      options_.max_iterations = options_.slices;
+    sundials_check(CVodeSetMaxOrd(coarse_.mem(), options_.coarse_order),
+                   "CVodeSetMaxOrd");
+    for (int w = 0; w < options_.threads; w++) {
+      fine_.push_back(CVodeIntegrator::spgmr(N, f, jtv, options.fine_reltol,
+                                             options.fine_abstol,
+                                             user_data));
+      sundials_check(CVodeSetMaxNumSteps(fine_.back().mem(), 100000),
+                     "CVodeSetMaxNumSteps");
+    }
+    const int S = options_.slices;
+    T_.resize(S + 1);
+    U_.resize((S + 1) * N);
+    F_.resize(S * N);
+    G_.resize(S * N);
+  }
+
+  // Integrates from y0 at t0 to tend and writes the solution at each of the
+  // sorted times in (t0, tend] to out, N values per time. The values come
+  // from the last fine run of the slice that contains the time. Throws a
+  // SundialsError when CVODE fails.
+  PararealStats solve(realtype t0, const realtype *y0, realtype tend,
+                      const std::vector<realtype> &times, realtype *out) {
+    typedef std::chrono::steady_clock Clock;
+    const int S = options_.slices;
+    PararealStats stats;
+    for (int n = 0; n <= S; n++) T_[n] = t0 + (tend - t0) * n / S;
+    T_[S] = tend;
+    times_ = &times;
+    out_ = out;
+
+    // Initial guess: one coarse sweep.
+    Clock::time_point start = Clock::now();
+    std::copy(y0, y0 + N_, U_.begin());
+    for (int n = 0; n < S; n++) {
+      stats.coarse_steps += coarse(n, &U_[n * N_], &G_[n * N_]);
+      std::copy(&G_[n * N_], &G_[n * N_] + N_, &U_[(n + 1) * N_]);
+    }
+    stats.coarse_seconds += seconds_since(start);
+
+    std::vector<realtype> g(N_);
+    for (int k = 1; k <= options_.max_iterations; k++) {
+      // The slices before k - 1 start from exact values and do not change.
+      start = Clock::now();
+      stats.fine_steps += fine_sweep(k - 1);
+      stats.fine_seconds += seconds_since(start);
+
+      start = Clock::now();
+      realtype change = 0;
+      for (int n = k - 1; n < S; n++) {
+        realtype *G = &G_[n * N_], *U = &U_[(n + 1) * N_];
+        const realtype *F = &F_[n * N_];
+        // The start value of slice k - 1 did not change in this iteration.
+        if (n > k - 1) {
+          stats.coarse_steps += coarse(n, &U_[n * N_], g.data());
+        } else {
+          std::copy(G, G + N_, g.begin());
+        }
+        realtype sum = 0;
+        for (sunindextype i = 0; i < N_; i++) {
+          realtype u = g[i] + F[i] - G[i];
+          realtype w = options_.fine_reltol * std::fabs(u) +
+                       options_.fine_abstol;
+          sum += (u - U[i]) * (u - U[i]) / (w * w);
+          U[i] = u;
+          G[i] = g[i];
+        }
+        change = std::max(change, std::sqrt(sum / N_));
+      }
+      stats.coarse_seconds += seconds_since(start);
+
+      stats.iterations = k;
+      stats.change = change;
+      if (change <= options_.tol || k == S) {
+        stats.converged = true;
+        break;
+      }
+    }
+    return stats;
+  }
+
+  // The value at the start of slice n, n = 0..slices (slices: at tend).
+  const realtype *slice_value(int n) const { return &U_[n * N_]; }
+  realtype slice_time(int n) const { return T_[n]; }
+  const PararealOptions &options() const { return options_; }
+
+ private:
+  static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start).count();
+  }
+
+  // G over slice n from y to g. Returns the steps taken.
+  long int coarse(int n, const realtype *y, realtype *g) {
+    coarse_.reset(T_[n], y);
+    sundials_check(CVodeSetStopTime(coarse_.mem(), T_[n + 1]),
+                   "CVodeSetStopTime");
+    realtype t;
+    int flag = coarse_.advance(T_[n + 1], &t);
+    if (flag < 0) throw SundialsError("CVode", flag);
+    std::copy(coarse_.y_data(), coarse_.y_data() + N_, g);
+    long int steps = 0;
+    CVodeGetNumSteps(coarse_.mem(), &steps);
+    return steps;
+  }
+
+  // F over the slices first..slices-1 on all threads. Returns the steps.
+  long int fine_sweep(int first) {
+    std::atomic<int> next(first);
+    std::vector<int> flags(fine_.size(), CV_SUCCESS);
+    std::vector<long int> steps(fine_.size(), 0);
+    auto work = [&](size_t w) {
+      int n;
+      while (flags[w] >= 0 && (n = next++) < options_.slices)
+        flags[w] = fine(w, n, &steps[w]);
+    };
+    int used = std::min((int) fine_.size(), options_.slices - first);
+    std::vector<std::thread> threads;
+    for (int w = 1; w < used; w++) threads.emplace_back(work, (size_t) w);
+    work(0);
+    for (std::thread &th : threads) th.join();
+
+    long int total = 0;
+    for (size_t w = 0; w < fine_.size(); w++) {
+      if (flags[w] < 0) throw SundialsError("CVode", flags[w]);
+      total += steps[w];
+    }
+    return total;
+  }
+
+  // F over slice n on integrator w, with the output times inside it.
+  int fine(size_t w, int n, long int *steps) {
+    CVodeIntegrator &cv = fine_[w];
+    cv.reset(T_[n], &U_[n * N_]);
+    int flag = CVodeSetStopTime(cv.mem(), T_[n + 1]);
+    if (flag < 0) return flag;
+    const std::vector<realtype> &times = *times_;
+    size_t j = std::upper_bound(times.begin(), times.end(), T_[n]) -
+               times.begin();
+    realtype t = T_[n];
+    for (; j < times.size() && times[j] <= T_[n + 1]; j++) {
+      flag = cv.advance(times[j], &t);
+      if (flag < 0) return flag;
+      std::copy(cv.y_data(), cv.y_data() + N_, out_ + j * N_);
+    }
+    if (t < T_[n + 1]) {
+      flag = cv.advance(T_[n + 1], &t);
+      if (flag < 0) return flag;
+    }
+    std::copy(cv.y_data(), cv.y_data() + N_, &F_[n * N_]);
+    long int nst = 0;
+    CVodeGetNumSteps(cv.mem(), &nst);
+    *steps += nst;
+    return CV_SUCCESS;
+  }
+
+  sunindextype N_;
+  PararealOptions options_;
+  CVodeIntegrator coarse_;
+  std::vector<CVodeIntegrator> fine_; // one per thread
+  std::vector<realtype> T_; // slice boundaries
+  std::vector<realtype> U_; // values at the boundaries
+  std::vector<realtype> F_, G_; // fine and coarse ends of each slice
+  const std::vector<realtype> *times_ = NULL;
+  realtype *out_ = NULL;
+};
+
+#endif
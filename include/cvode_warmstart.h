@@ -0,0 +1,220 @@
+/*
+Warm starts for repeated CVODE runs with nearby parameters.
+
+Every CVODE run starts cold: order 1, with an initial step estimated from
+the initial condition. CVODE's estimate is conservative, and the step size
+can only grow by a bounded factor per step afterwards, so the first steps
+through a stiff transient are many and tiny.
+
+StepProfileRecorder records the step size and order profile of a run: the
+first accepted step, the error test failures on the way to it, the highest
+order used and the (t, h, q) of the first steps. A StepProfileLibrary keeps
+the profiles of earlier runs, each tagged with the point (parameters,
+initial condition, ...) it was run at. For the next run, warm_start() takes
+the profile nearest to the new point and sets
+
+ - the initial step (CVodeSetInitStep): the first step accepted by the
+   nearest run, doubled if that run accepted its first step without an
+   error test failure. Repeated runs thus grow the initial step until it
+   just passes, and fall back as soon as it does not.
+ - the maximum order (CVodeSetMaxOrd): the highest order the nearest run
+   used, at least 2. CVODE allows lowering and raising it again as long as
+   it stays within the order CVodeInit allocated for.
+
+The module is header-only; include it with the include path of the
+repository (-I ../../../include from an example folder).
+*/
+
+#ifndef CVODE_WARMSTART_H
+#define CVODE_WARMSTART_H
+
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <string>
+#include <vector>
+#include <cvode/cvode.h> // prototypes for CVODE fcts., consts.
+#include <sundials/sundials_nvector.h> // generic N_Vector
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+
+// One internal step: its end time, step size and order.
+struct StepRecord {
+  realtype t;
+  realtype h;
+  int q;
+};
+
+// The step profile of one run.
+struct StepProfile {
+  std::vector<realtype> point; // where the run was made, e.g. parameters
+  realtype h_first = 0; // size of the first accepted step
+  long int first_failures = 0; // error test failures before it
+  int qmax = 0; // highest order used
+  long int startup_steps = 0; // steps to the end of the startup window
+  std::vector<StepRecord> steps; // the first steps of the run
+};
+
+// Records the step profile of a run. It advances with CV_ONE_STEP until
+// window steps are recorded, interpolating to tout like CV_NORMAL, and with
+// CV_NORMAL after that.
+class StepProfileRecorder {
+ public:
+  // cvode_mem must be (re)initialized for the run to be recorded.
+  StepProfileRecorder(void *cvode_mem, N_Vector y,
+                      const std::vector<realtype> &point, size_t window = 64)
+      : mem_(cvode_mem), y_(y), window_(window) {
+    profile_.point = point;
+    profile_.steps.reserve(window);
+  }
+
+  // Same contract as CVode(mem, tout, y, t, CV_NORMAL).
+  int advance(realtype tout, realtype *t) {
+    if (profile_.steps.size() >= window_) {
+      int flag = CVode(mem_, tout, y_, t, CV_NORMAL);
+      record_qmax();
+      return flag;
+    }
+    int flag = CV_SUCCESS;
+    CVodeGetCurrentTime(mem_, t);
+    while (*t < tout && profile_.steps.size() < window_) {
+      flag = CVode(mem_, tout, y_, t, CV_ONE_STEP);
+      if (flag < 0) return flag;
+      StepRecord r;
+      r.t = *t;
+      CVodeGetLastStep(mem_, &r.h);
+      CVodeGetLastOrder(mem_, &r.q);
+      if (profile_.steps.empty()) {
+        profile_.h_first = r.h;
+        CVodeGetNumErrTestFails(mem_, &profile_.first_failures);
+      }
+      if (r.q > profile_.qmax) profile_.qmax = r.q;
+      profile_.steps.push_back(r);
+    }
+    if (*t < tout) return CVode(mem_, tout, y_, t, CV_NORMAL);
+    // The last step went past tout; interpolate back as CV_NORMAL does.
+    if (*t > tout) {
+      flag = CVodeGetDky(mem_, tout, 0, y_);
+      *t = tout;
+    }
+    return flag;
+  }
+
+  // Marks the end of the startup window, e.g. after the first output time.
+  void end_startup() { CVodeGetNumSteps(mem_, &profile_.startup_steps); }
+
+  const StepProfile& profile() {
+    record_qmax();
+    return profile_;
+  }
+
+ private:
+  void record_qmax() {
+    int q;
+    if (CVodeGetLastOrder(mem_, &q) == CV_SUCCESS && q > profile_.qmax)
+      profile_.qmax = q;
+  }
+
+  void *mem_;
+  N_Vector y_;
+  size_t window_;
+  StepProfile profile_;
+};
+
+// Profiles of earlier runs, searched by distance to a new point.
+class StepProfileLibrary {
+ public:
+  void add(const StepProfile &p) { profiles_.push_back(p); }
+  size_t size() const { return profiles_.size(); }
+
+  // The profile with the smallest relative distance to point, or NULL if
+  // none is closer than max_distance. Components are compared relative to
+  // the larger of their magnitudes and scale.
+  const StepProfile *nearest(const std::vector<realtype> &point,
+                             realtype max_distance = 1,
+                             realtype scale = 1e-3) const {
+    const StepProfile *best = NULL;
+    realtype best_d = max_distance;
+    for (const StepProfile &p : profiles_) {
+      if (p.point.size() != point.size()) continue;
+      realtype d = 0;
+      for (size_t i = 0; i < point.size(); i++) {
+        realtype ref = std::fmax(std::fmax(std::fabs(point[i]),
+                                           std::fabs(p.point[i])), scale);
+        realtype e = (point[i] - p.point[i]) / ref;
+        d += e * e;
+      }
+      d = std::sqrt(d);
+      if (d <= best_d) {
+        best_d = d;
+        best = &p;
+      }
+    }
+    return best;
+  }
+
+  // Writes the profiles, without their step records, one per line:
+  // "h_first first_failures qmax startup_steps npoint point...".
+  bool save(const std::string &path) const {
+    FILE *out = fopen(path.c_str(), "w");
+    if (!out) return false;
+    for (const StepProfile &p : profiles_) {
+      fprintf(out, "%.17g %ld %d %ld %zu", (double) p.h_first,
+              p.first_failures, p.qmax, p.startup_steps, p.point.size());
+      for (realtype x : p.point) fprintf(out, " %.17g", (double) x);
+      fprintf(out, "\n");
+    }
+    return fclose(out) == 0;
+  }
+
+  // Adds the profiles of a file written by save. Returns false, and adds
+  // none of them, if the file can not be read or is truncated or malformed.
+  bool load(const std::string &path) {
+    FILE *in = fopen(path.c_str(), "r");
+    if (!in) return false;
+    std::vector<StepProfile> loaded;
+    double h;
+    StepProfile p;
+    size_t n;
+    int fields;
+    bool complete = true;
+    while ((fields = fscanf(in, "%lg %ld %d %ld %zu", &h, &p.first_failures,
+                            &p.qmax, &p.startup_steps, &n)) == 5) {
+      p.h_first = h;
+      p.point.resize(n);
+      for (size_t i = 0; i < n && complete; i++) {
+        double x;
+        complete = fscanf(in, "%lg", &x) == 1;
+        if (complete) p.point[i] = x;
+      }
+      if (!complete) break;
+      loaded.push_back(p);
+    }
+    fclose(in);
+    // Anything but the end of the file after the last profile is an error.
+    if (!complete || fields != EOF) return false;
+    profiles_.insert(profiles_.end(), loaded.begin(), loaded.end());
+    return true;
+  }
+
+ private:
+  std::vector<StepProfile> profiles_;
+};
+
+// Sets the initial step and maximum order of the next run from a profile,
+// or restores CVODE's defaults if p is NULL. Call after CVodeReInit (or
+// CVodeInit). max_order is the order CVODE was initialized with.
+inline int warm_start(void *cvode_mem, const StepProfile *p,
+                      int max_order = 5) {
+  if (p == NULL || p->h_first <= 0) {
+    int flag = CVodeSetInitStep(cvode_mem, 0); // 0 estimates it
+    if (flag < 0) return flag;
+    return CVodeSetMaxOrd(cvode_mem, max_order);
+  }
+  realtype h0 = p->first_failures == 0 ? 2 * p->h_first : p->h_first;
+  int flag = CVodeSetInitStep(cvode_mem, h0);
+  if (flag < 0) return flag;
+  int q = p->qmax < 2 ? 2 : (p->qmax > max_order ? max_order : p->qmax);
+  return CVodeSetMaxOrd(cvode_mem, q);
+}
+
+#endif
@@ -0,0 +1,404 @@
+/*
+Waveform relaxation for weakly coupled subsystems, one CVODE instance each.
+
+A model made of many subsystems that exchange a few boundary values is
+usually integrated as one large system, and on several processors that
+means a synchronization in every right hand side evaluation. Waveform
+relaxation integrates each subsystem on its own, over a time window, with
+the trajectories of its inputs taken from the previous iteration:
+
+  for each window [T, T + H]:
+    guess the input trajectories (constant, from the state at T)
+    repeat
+      integrate every subsystem over the window with its inputs
+      interpolated from the trajectories of the other subsystems
+      exchange the new boundary trajectories
+    until they change by less than tol
+
+The subsystems are spread over threads, and they only synchronize once per
+iteration of a window. Each subsystem records the components the others
+read at samples + 1 equidistant points of the window, as values and
+derivatives taken from CVODE's interpolant (CVodeGetDky) after each
+internal step. Inputs are cubic Hermite interpolants of these samples.
+
+  Jacobi       all subsystems in parallel, all reading the trajectories of
+               the previous iteration.
+  GaussSeidel  red-black order: the even subsystems first, then the odd
+               ones, reading the new trajectories of the even ones. For a
+               chain of subsystems this is Gauss-Seidel with half the
+               parallelism per phase.
+
+The change of the trajectories is measured in the weighted RMS norm of the
+CVODE tolerances, so tol = 1 means "below the integration tolerance".
+
+The module is header-only; include it with the include path of the
+repository (-I ../../../include from an example folder).
+*/
+
+#ifndef CVODE_WAVEFORM_H
+#define CVODE_WAVEFORM_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cvode/cvode.h> // prototypes for CVODE fcts., consts.
+#include <nvector/nvector_serial.h>  // access to serial N_Vector
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+#include <sundials_raii.h> // move-only owners and CVodeIntegrator
+
+// The right hand side of a subsystem. inputs holds its input values at t,
+// in the order of its links.
+typedef int (*SubsystemRhsFn)(realtype t, const realtype *y, realtype *ydot,
+                              const realtype *inputs, void *data);
+
+// An input: component of another subsystem.
+struct WaveformLink {
+  int subsystem;
+  sunindextype component;
+};
+
+enum class WaveformMethod { Jacobi, GaussSeidel };
+
+struct WaveformOptions {
+  WaveformMethod method = WaveformMethod::Jacobi;
+  int threads = 0; // 0: one per subsystem, at most the hardware threads
+  int samples = 16; // intervals of the exchanged trajectories per window
+  int max_iterations = 20; // per window
+  realtype tol = 1; // on the change of the trajectories, see above
+  realtype reltol = 1e-6, abstol = 1e-8;
+};
+
+struct WaveformStats {
+  long int windows = 0;
+  long int iterations = 0; // of all windows
+  int max_iterations = 0; // of one window
+  long int unconverged = 0; // windows that hit max_iterations
+  long int steps = 0; // of all subsystems and iterations
+  long int rhs_evals = 0;
+};
+
+class WaveformRelaxation {
+ public:
+  explicit WaveformRelaxation(const WaveformOptions &options)
+      : options_(options) {
+    if (options_.samples < 1) options_.samples = 1;
+    if (options_.max_iterations < 1) options_.max_iterations = 1;
+  }
+
+  // Adds a subsystem of size equations with the given inputs, integrated
+  // with SPGMR and difference quotient Jacobian-vector products. Its state
+  // is zero until set_state. Returns its id.
+  int add(sunindextype size, SubsystemRhsFn f, void *data,
+          const std::vector<WaveformLink> &inputs) {
+    std::unique_ptr<Subsystem> s(new Subsystem(this, size, f, data));
+    s->cv.reset(new CVodeIntegrator(CVodeIntegrator::spgmr(
+        size, rhs, NULL, options_.reltol, options_.abstol, s.get())));
+    sundials_check(CVodeSetMaxNumSteps(s->cv->mem(), 100000),
+                   "CVodeSetMaxNumSteps");
+    s->links = inputs;
+    s->inputs.resize(inputs.size());
+    s->state.assign(size, 0);
+    s->dky.reset(N_VClone(s->cv->y()));
+    sundials_check(s->dky.get(), "N_VClone");
+    subsystems_.push_back(std::move(s));
+    return (int) subsystems_.size() - 1;
+  }
+
+  void set_state(int s, const realtype *y) {
+    Subsystem &sub = *subsystems_[s];
+    std::copy(y, y + sub.size, sub.state.begin());
+  }
+
+  // The state of subsystem s at the end of the last finished window.
+  const realtype *state(int s) const { return subsystems_[s]->state.data(); }
+  size_t size() const { return subsystems_.size(); }
+
+  // Integrates from t0 to tend in windows of length window. observer, if
+  // set, is called after each window with its end time, and may read the
+  // states. Throws a SundialsError when CVODE fails.
+  WaveformStats solve(realtype t0, realtype tend, realtype window,
+                      const std::function<void(realtype)> &observer =
+                          std::function<void(realtype)>()) {
+    prepare();
+    stats_ = WaveformStats();
+    t0_ = t0;
+    tend_ = tend;
+    window_ = window;
+    windows_ = (long int) std::ceil((tend - t0) / window -
+                                    std::sqrt(UNIT_ROUNDOFF));
+    observer_ = observer;
+    error_ = CV_SUCCESS;
+
+    int nthreads = options_.threads;
+    if (nthreads < 1) nthreads = (int) std::thread::hardware_concurrency();
+    nthreads = std::max(1, std::min(nthreads, (int) subsystems_.size()));
+    barrier_.reset(nthreads);
+    std::vector<std::thread> threads;
+    for (int w = 1; w < nthreads; w++)
+      threads.emplace_back(&WaveformRelaxation::worker, this, w, nthreads);
+    worker(0, nthreads);
+    for (std::thread &th : threads) th.join();
+    if (error_ < 0) throw SundialsError("CVode", error_);
+
+    for (const std::unique_ptr<Subsystem> &s : subsystems_) {
+      stats_.steps += s->steps;
+      stats_.rhs_evals += s->rhs_evals;
+    }
+    stats_.windows = windows_;
+    return stats_;
+  }
+
+ private:
+  // A reusable barrier for the worker threads.
+  class Barrier {
+   public:
+    void reset(int count) {
+      count_ = count;
+      waiting_ = 0;
+      generation_ = 0;
+    }
+
+    void wait() {
+      std::unique_lock<std::mutex> lock(mutex_);
+      long int generation = generation_;
+      if (++waiting_ == count_) {
+        waiting_ = 0;
+        generation_++;
+        cv_.notify_all();
+      } else {
+        cv_.wait(lock, [&] { return generation != generation_; });
+      }
+    }
+
+   private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    int count_ = 1, waiting_ = 0;
+    long int generation_ = 0;
+  };
+
+  struct Subsystem {
+    Subsystem(WaveformRelaxation *owner, sunindextype size, SubsystemRhsFn f,
+              void *data)
+        : owner(owner), size(size), f(f), data(data) {}
+
+    WaveformRelaxation *owner;
+    sunindextype size;
+    SubsystemRhsFn f;
+    void *data;
+    std::unique_ptr<CVodeIntegrator> cv;
+    NVectorOwner dky;
+    std::vector<WaveformLink> links;
+    std::vector<realtype> inputs; // at the current t
+    std::vector<realtype> state; // at the start of the current window
+    std::vector<realtype> end; // at the end of the window
+    std::vector<sunindextype> exports; // components read by others
+    std::vector<realtype> weights; // of the exports, for the change
+    // Input j reads export source_slot[j] of subsystem links[j].subsystem.
+    std::vector<int> source_slot;
+    // Values and derivatives of the exports at the samples of the window,
+    // [point * exports + e], for two iterations.
+    std::vector<realtype> value[2], slope[2];
+    int color = 0;
+    int iteration = 0; // being computed
+    realtype T0 = 0, dt = 1; // start and sample spacing of the window
+    realtype change = 0;
+    long int steps = 0, rhs_evals = 0;
+  };
+
+  // Finds the exported components and sizes the trajectory buffers.
+  void prepare() {
+    for (size_t s = 0; s < subsystems_.size(); s++) {
+      Subsystem &sub = *subsystems_[s];
+      sub.exports.clear();
+      sub.color = options_.method == WaveformMethod::GaussSeidel ?
+                  (int) (s % 2) : 0;
+      sub.steps = sub.rhs_evals = 0;
+    }
+    for (const std::unique_ptr<Subsystem> &s : subsystems_) {
+      s->source_slot.clear();
+      for (const WaveformLink &l : s->links) {
+        if (l.subsystem < 0 || l.subsystem >= (int) subsystems_.size() ||
+            l.component < 0 || l.component >= subsystems_[l.subsystem]->size)
+          throw SundialsError("WaveformRelaxation::solve", CV_ILL_INPUT);
+        std::vector<sunindextype> &e = subsystems_[l.subsystem]->exports;
+        size_t slot = std::find(e.begin(), e.end(), l.component) - e.begin();
+        if (slot == e.size()) e.push_back(l.component);
+        s->source_slot.push_back((int) slot);
+      }
+    }
+    const size_t points = options_.samples + 1;
+    for (const std::unique_ptr<Subsystem> &s : subsystems_) {
+      for (int b = 0; b < 2; b++) {
+        s->value[b].assign(points * s->exports.size(), 0);
+        s->slope[b].assign(points * s->exports.size(), 0);
+      }
+      s->weights.assign(s->exports.size(), 0);
+      s->end.assign(s->size, 0);
+    }
+  }
+
+  void worker(int w, int nthreads) {
+    const int phases = options_.method == WaveformMethod::GaussSeidel ? 2 : 1;
+    for (long int k = 0; k < windows_; k++) {
+      const realtype T0 = t0_ + k * window_;
+      const realtype T1 = k == windows_ - 1 ? tend_ : T0 + window_;
+      for (size_t s = w; s < subsystems_.size(); s += nthreads)
+        guess(*subsystems_[s]);
+      barrier_.wait();
+
+      for (int it = 1; it <= options_.max_iterations; it++) {
+        for (int phase = 0; phase < phases; phase++) {
+          for (size_t s = w; s < subsystems_.size(); s += nthreads) {
+            Subsystem &sub = *subsystems_[s];
+            if (sub.color != phase || error_ < 0) continue;
+            sub.iteration = it;
+            int flag = integrate(sub, T0, T1);
+            if (flag < 0) error_ = flag;
+          }
+          barrier_.wait();
+        }
+        // Every thread takes the same decision from the same values.
+        realtype change = 0;
+        for (const std::unique_ptr<Subsystem> &s : subsystems_)
+          change = std::max(change, s->change);
+        bool done = error_ < 0 || change <= options_.tol ||
+                    it == options_.max_iterations;
+        if (w == 0) {
+          stats_.iterations++;
+          if (done) {
+            stats_.max_iterations = std::max(stats_.max_iterations, it);
+            if (change > options_.tol) stats_.unconverged++;
+          }
+        }
+        barrier_.wait();
+        if (done) break;
+      }
+      if (error_ < 0) return;
+
+      for (size_t s = w; s < subsystems_.size(); s += nthreads) {
+        Subsystem &sub = *subsystems_[s];
+        sub.state = sub.end;
+      }
+      barrier_.wait();
+      if (w == 0 && observer_) observer_(T1);
+    }
+  }
+
+  // The first guess of the window: the exports stay at their values at the
+  // start. Written to the buffer iteration 1 reads.
+  void guess(Subsystem &s) {
+    const size_t ne = s.exports.size();
+    for (size_t e = 0; e < ne; e++) {
+      realtype v = s.state[s.exports[e]];
+      s.weights[e] = 1 / (options_.reltol * std::fabs(v) + options_.abstol);
+      for (int p = 0; p <= options_.samples; p++) {
+        s.value[0][p * ne + e] = v;
+        s.slope[0][p * ne + e] = 0;
+      }
+    }
+  }
+
+  // The buffer a subsystem writes in iteration it.
+  static int buffer(int it) { return it % 2; }
+
+  // Integrates s over [T0, T1] from its state at T0, records its exports and
+  // their change against the previous iteration.
+  int integrate(Subsystem &s, realtype T0, realtype T1) {
+    CVodeIntegrator &cv = *s.cv;
+    cv.reset(T0, s.state.data());
+    int flag = CVodeSetStopTime(cv.mem(), T1);
+    if (flag < 0) return flag;
+    const int samples = options_.samples;
+    const size_t ne = s.exports.size();
+    realtype *value = s.value[buffer(s.iteration)].data();
+    realtype *slope = s.slope[buffer(s.iteration)].data();
+    const realtype dt = (T1 - T0) / samples;
+    s.T0 = T0;
+    s.dt = dt;
+    int next = 0; // next sample point
+    realtype t = T0;
+    while (next <= samples) {
+      if (t < T1) {
+        flag = cv.advance(T1, &t, CV_ONE_STEP);
+        if (flag < 0) return flag;
+      }
+      // The interpolant of the last step covers [t - h, t].
+      for (; next <= samples; next++) {
+        realtype ts = next == samples ? T1 : T0 + next * dt;
+        if (ts > t && t < T1) break;
+        flag = CVodeGetDky(cv.mem(), ts, 0, s.dky);
+        if (flag < 0) return flag;
+        const realtype *d = NV_DATA_S(s.dky.get());
+        for (size_t e = 0; e < ne; e++) value[next * ne + e] = d[s.exports[e]];
+        flag = CVodeGetDky(cv.mem(), ts, 1, s.dky);
+        if (flag < 0) return flag;
+        for (size_t e = 0; e < ne; e++) slope[next * ne + e] = d[s.exports[e]];
+      }
+    }
+    std::copy(cv.y_data(), cv.y_data() + s.size, s.end.begin());
+    long int n;
+    CVodeGetNumSteps(cv.mem(), &n);
+    s.steps += n;
+    CVodeGetNumRhsEvals(cv.mem(), &n);
+    s.rhs_evals += n;
+
+    // Weighted RMS change of the exported trajectories.
+    const realtype *old = s.value[buffer(s.iteration - 1)].data();
+    realtype sum = 0;
+    for (int p = 0; p <= samples; p++) {
+      for (size_t e = 0; e < ne; e++) {
+        realtype d = (value[p * ne + e] - old[p * ne + e]) * s.weights[e];
+        sum += d * d;
+      }
+    }
+    s.change = ne > 0 ? std::sqrt(sum / ((samples + 1) * ne)) : 0;
+    return CV_SUCCESS;
+  }
+
+  // Input values of s at t, from the trajectories of its sources.
+  void interpolate(Subsystem &s, realtype t) {
+    const int samples = options_.samples;
+    const realtype dt = s.dt;
+    realtype x = (t - s.T0) / dt;
+    int p = std::max(0, std::min(samples - 1, (int) std::floor(x)));
+    realtype u = std::max((realtype) 0, std::min((realtype) 1, x - p));
+    // Cubic Hermite basis on [p, p + 1].
+    realtype h00 = (1 + 2 * u) * (1 - u) * (1 - u), h10 = u * (1 - u) * (1 - u);
+    realtype h01 = u * u * (3 - 2 * u), h11 = u * u * (u - 1);
+    for (size_t j = 0; j < s.links.size(); j++) {
+      const Subsystem &r = *subsystems_[s.links[j].subsystem];
+      // Sources earlier in the order already finished this iteration.
+      int it = r.color < s.color ? s.iteration : s.iteration - 1;
+      const realtype *v = r.value[buffer(it)].data();
+      const realtype *d = r.slope[buffer(it)].data();
+      const size_t ne = r.exports.size(), e = s.source_slot[j];
+      s.inputs[j] = h00 * v[p * ne + e] + h10 * dt * d[p * ne + e] +
+                    h01 * v[(p + 1) * ne + e] +
+                    h11 * dt * d[(p + 1) * ne + e];
+    }
+  }
+
+  static int rhs(realtype t, N_Vector y, N_Vector ydot, void *user_data) {
+    Subsystem *s = (Subsystem*) user_data;
+    s->owner->interpolate(*s, t);
+    return s->f(t, NV_DATA_S(y), NV_DATA_S(ydot), s->inputs.data(), s->data);
+  }
+
+  WaveformOptions options_;
+  std::vector<std::unique_ptr<Subsystem>> subsystems_;
+  Barrier barrier_;
+  WaveformStats stats_;
+  std::function<void(realtype)> observer_;
+  realtype t0_ = 0, tend_ = 0, window_ = 1;
+  long int windows_ = 0;
+  std::atomic<int> error_{CV_SUCCESS}; // first CVode failure of any thread
+};
+
+#endif
@@ -0,0 +1,270 @@
+/*
+Convergence tracing and statistics for KINSOL solves.
+
+KinStatsRecorder installs an info handler on a KINSOL object. The handler
+records the solver counters and the residual norm once per nonlinear
+iteration. After a solve, end_solve collects the final KINSOL counters, and
+the KINSpils counters if an iterative linear solver is attached, into a
+KinSolveStats record. KinStatsEnsemble aggregates the records of many
+solves, e.g. an ensemble or multi-start run, and exports them as JSON.
+
+The module is header-only so every example can include it without changing
+its Makefile beyond the include path.
+*/
+
+#ifndef KINSOL_STATS_H
+#define KINSOL_STATS_H
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <kinsol/kinsol.h> // access to KINSOL func., consts.
+#include <kinsol/kinsol_spils.h> // access to KINSpils interface
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+
+// True if a KINSol return value means u is a root. The other non-negative
+// flags, such as KIN_STEP_LT_STPTOL, mean KINSOL stopped short of the
+// residual tolerance.
+inline bool kin_converged(int flag) {
+  return flag == KIN_SUCCESS || flag == KIN_INITIAL_GUESS_OK;
+}
+
+// Solver state after one nonlinear iteration. The counters are cumulative
+// over the solve.
+struct KinIterRecord {
+  long int nni = 0; // nonlinear iterations
+  long int nfe = 0; // function evaluations
+  long int nli = 0; // linear iterations, 0 with a direct linear solver
+  long int nbacktr = 0; // line search backtracks
+  realtype fnorm = 0; // scaled residual norm
+  realtype step_length = 0; // scaled length of the last Newton step
+};
+
+// Statistics of one KINSol call.
+struct KinSolveStats {
+  int flag = 0; // return value of KINSol
+  double seconds = 0; // wall time of the solve
+  long int nni = 0; // nonlinear iterations
+  long int nfe = 0; // function evaluations
+  long int nbacktr = 0; // line search backtracks
+  long int nbcfails = 0; // beta condition failures
+  realtype fnorm = 0; // final scaled residual norm
+  bool iterative = false; // a KINSpils linear solver was attached
+  // KINSpils counters, left at 0 when iterative is false.
+  long int nli = 0; // linear iterations
+  long int npe = 0; // preconditioner evaluations
+  long int nps = 0; // preconditioner solves
+  long int nlcf = 0; // linear convergence failures
+  long int njv = 0; // Jacobian-times-vector evaluations
+  long int nfe_ls = 0; // function evaluations for difference quotients
+  std::vector<KinIterRecord> trace; // one record per nonlinear iteration
+};
+
+// Collects a KinSolveStats record for every solve of one KINSOL object.
+// Create the recorder after KINCreate and keep it alive while the KINSOL
+// object is used. Not thread safe; use one recorder per KINSOL object.
+//
+// iterative tells whether the linear solver is attached with
+// KINSpilsSetLinearSolver. The KINSpilsGet functions of SUNDIALS 3.x take
+// the linear solver memory to be KINSpils memory without checking, so they
+// must not be called with a KINDls solver attached.
+class KinStatsRecorder {
+ public:
+  // Installs the info handler. KINSOL only calls it for print levels of 1
+  // and above, so the print level is raised to 1.
+  KinStatsRecorder(void *kin_mem, bool iterative)
+      : kin_mem_(kin_mem), iterative_(iterative) {
+    KINSetInfoHandlerFn(kin_mem_, info_handler, this);
+    KINSetPrintLevel(kin_mem_, 1);
+  }
+
+  KinStatsRecorder(const KinStatsRecorder&) = delete;
+  KinStatsRecorder& operator=(const KinStatsRecorder&) = delete;
+
+  // Call right before KINSol.
+  void begin_solve() {
+    stats_ = KinSolveStats();
+    stats_.iterative = iterative_;
+    start_ = std::chrono::steady_clock::now();
+  }
+
+  // Call right after KINSol with its return value. Returns the record of the
+  // solve.
+  const KinSolveStats& end_solve(int flag) {
+    auto stop = std::chrono::steady_clock::now();
+    stats_.flag = flag;
+    stats_.seconds = std::chrono::duration<double>(stop - start_).count();
+
+    KINGetNumNonlinSolvIters(kin_mem_, &stats_.nni);
+    KINGetNumFuncEvals(kin_mem_, &stats_.nfe);
+    KINGetNumBacktrackOps(kin_mem_, &stats_.nbacktr);
+    KINGetNumBetaCondFails(kin_mem_, &stats_.nbcfails);
+    KINGetFuncNorm(kin_mem_, &stats_.fnorm);
+
+    if (!iterative_) return stats_;
+    KINSpilsGetNumLinIters(kin_mem_, &stats_.nli);
+    KINSpilsGetNumPrecEvals(kin_mem_, &stats_.npe);
+    KINSpilsGetNumPrecSolves(kin_mem_, &stats_.nps);
+    KINSpilsGetNumConvFails(kin_mem_, &stats_.nlcf);
+    KINSpilsGetNumJtimesEvals(kin_mem_, &stats_.njv);
+    KINSpilsGetNumFuncEvals(kin_mem_, &stats_.nfe_ls);
+
+    return stats_;
+  }
+
+  const KinSolveStats& stats() const { return stats_; }
+
+ private:
+  // KINSOL reports the iteration progress from KINSol once per nonlinear
+  // iteration (and once for the initial guess). Rather than parsing the
+  // message, the counters are read back through the KINGet functions.
+  static void info_handler(const char *module, const char *function,
+                           char *msg, void *ih_data) {
+    KinStatsRecorder *self = (KinStatsRecorder*) ih_data;
+    if (std::strcmp(function, "KINSol") != 0) return;
+    if (std::strncmp(msg, "nni", 3) != 0) return;
+
+    KinIterRecord rec;
+    KINGetNumNonlinSolvIters(self->kin_mem_, &rec.nni);
+    std::vector<KinIterRecord> &trace = self->stats_.trace;
+    if (!trace.empty() && trace.back().nni == rec.nni) return;
+
+    KINGetNumFuncEvals(self->kin_mem_, &rec.nfe);
+    KINGetNumBacktrackOps(self->kin_mem_, &rec.nbacktr);
+    KINGetFuncNorm(self->kin_mem_, &rec.fnorm);
+    KINGetStepLength(self->kin_mem_, &rec.step_length);
+    if (self->iterative_) KINSpilsGetNumLinIters(self->kin_mem_, &rec.nli);
+    trace.push_back(rec);
+  }
+
+  void *kin_mem_;
+  bool iterative_;
+  KinSolveStats stats_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+// Prints a KinSolveStats record, with the per-iteration trace if requested.
+inline void print_kin_stats(std::ostream &os, const KinSolveStats &s,
+                            bool with_trace) {
+  os << "KINSol returned " << s.flag << " in " << s.seconds * 1e3 << " ms\n"
+     << "  nonlinear iterations:          " << s.nni << "\n"
+     << "  function evaluations:          " << s.nfe << "\n"
+     << "  line search backtracks:        " << s.nbacktr << "\n"
+     << "  beta condition failures:       " << s.nbcfails << "\n"
+     << "  final residual norm:           " << s.fnorm << "\n";
+  if (s.iterative)
+    os << "  linear iterations:             " << s.nli << "\n"
+       << "  linear convergence failures:   " << s.nlcf << "\n"
+       << "  preconditioner evals/solves:   " << s.npe << " / " << s.nps
+       << "\n"
+       << "  Jacobian-vector products:      " << s.njv << "\n"
+       << "  function evals for DQ Jv:      " << s.nfe_ls << "\n";
+  else
+    os << "  linear solver:                 direct\n";
+  if (!with_trace) return;
+  os << "  nni      nfe      nli  nbacktr                  fnorm"
+        "            step\n";
+  for (const KinIterRecord &r : s.trace) {
+    char line[128];
+    snprintf(line, sizeof(line), "  %3ld %8ld %8ld %8ld %22.14e %15.6e\n",
+             r.nni, r.nfe, r.nli, r.nbacktr, (double) r.fnorm,
+             (double) r.step_length);
+    os << line;
+  }
+}
+
+// Aggregates the records of many solves and writes them as JSON.
+class KinStatsEnsemble {
+ public:
+  void add(const KinSolveStats &s) { solves_.push_back(s); }
+
+  size_t size() const { return solves_.size(); }
+
+  // Writes the totals, per-counter min/mean/max over the solves and, if
+  // with_solves is set, every solve record including its trace.
+  void write_json(std::ostream &os, bool with_solves) const {
+    long int converged = 0;
+    double seconds = 0;
+    for (const KinSolveStats &s : solves_) {
+      if (kin_converged(s.flag)) converged++;
+      seconds += s.seconds;
+    }
+
+    os << "{\n"
+       << "  \"solves\": " << solves_.size() << ",\n"
+       << "  \"converged\": " << converged << ",\n"
+       << "  \"failed\": " << (long int) solves_.size() - converged << ",\n"
+       << "  \"seconds\": " << seconds << ",\n"
+       << "  \"counters\": {\n";
+    write_counter(os, "nni", &KinSolveStats::nni, false);
+    write_counter(os, "nfe", &KinSolveStats::nfe, false);
+    write_counter(os, "nbacktr", &KinSolveStats::nbacktr, false);
+    write_counter(os, "nbcfails", &KinSolveStats::nbcfails, false);
+    write_counter(os, "nli", &KinSolveStats::nli, false);
+    write_counter(os, "npe", &KinSolveStats::npe, false);
+    write_counter(os, "nps", &KinSolveStats::nps, false);
+    write_counter(os, "nlcf", &KinSolveStats::nlcf, false);
+    write_counter(os, "njv", &KinSolveStats::njv, false);
+    write_counter(os, "nfe_ls", &KinSolveStats::nfe_ls, true);
+    os << "  }";
+
+    if (with_solves) {
+      os << ",\n  \"records\": [";
+      for (size_t i = 0; i < solves_.size(); i++) {
+        const KinSolveStats &s = solves_[i];
+        os << (i ? ",\n" : "\n")
+           << "    {\"flag\": " << s.flag << ", \"seconds\": " << s.seconds
+           << ", \"nni\": " << s.nni << ", \"nfe\": " << s.nfe
+           << ", \"nbacktr\": " << s.nbacktr << ", \"nbcfails\": "
+           << s.nbcfails << ", \"fnorm\": " << json_number(s.fnorm)
+           << ", \"iterative\": " << (s.iterative ? "true" : "false")
+           << ", \"nli\": " << s.nli << ", \"npe\": " << s.npe
+           << ", \"nps\": " << s.nps << ", \"nlcf\": " << s.nlcf
+           << ", \"njv\": " << s.njv << ", \"nfe_ls\": " << s.nfe_ls
+           << ", \"trace\": [";
+        for (size_t k = 0; k < s.trace.size(); k++) {
+          const KinIterRecord &r = s.trace[k];
+          os << (k ? ", " : "") << "[" << r.nni << ", " << r.nfe << ", "
+             << r.nli << ", " << r.nbacktr << ", " << json_number(r.fnorm)
+             << ", " << json_number(r.step_length) << "]";
+        }
+        os << "]}";
+      }
+      os << "\n  ],\n"
+         << "  \"trace_fields\": [\"nni\", \"nfe\", \"nli\", \"nbacktr\", "
+            "\"fnorm\", \"step_length\"]";
+    }
+    os << "\n}\n";
+  }
+
+ private:
+  void write_counter(std::ostream &os, const char *name,
+                     long int KinSolveStats::*field, bool last) const {
+    long int lo = 0, hi = 0, sum = 0;
+    for (size_t i = 0; i < solves_.size(); i++) {
+      long int v = solves_[i].*field;
+      if (i == 0 || v < lo) lo = v;
+      if (i == 0 || v > hi) hi = v;
+      sum += v;
+    }
+    double mean = solves_.empty() ? 0 : (double) sum / solves_.size();
+    os << "    \"" << name << "\": {\"total\": " << sum << ", \"min\": " << lo
+       << ", \"mean\": " << mean << ", \"max\": " << hi << "}"
+       << (last ? "\n" : ",\n");
+  }
+
+  // JSON has no representation for inf or nan, write those as null.
+  static std::string json_number(realtype x) {
+    if (x != x || x > BIG_REAL || x < -BIG_REAL) return "null";
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.17g", (double) x);
+    return buf;
+  }
+
+  std::vector<KinSolveStats> solves_;
+};
+
+#endif
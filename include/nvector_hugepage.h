@@ -0,0 +1,238 @@
+/*
+Serial N_Vector with its data on 2 MB huge pages.
+
+A large CVODE problem with SPGMR keeps dozens of vectors of the size of the
+state: the Nordsieck history array, the error weights, the Krylov basis and
+work vectors. At tens of millions of equations they span gigabytes, and
+every sweep over a vector with 4 kB pages needs a new TLB entry every 4 kB;
+a TLB of about 1500 entries covers 6 MB of small pages, but 3 GB of huge
+ones.
+
+N_VNew_HugePage(n) returns a serial N_Vector: the same content, vector ID
+and operations as N_VNew_Serial, so the serial macros (NV_DATA_S, ...) and
+all solvers work with it. Only its data is mapped differently, and its
+clone operation does the same, so every vector that CVODE and the linear
+solver clone from it is on huge pages too. The pages come from the first
+of these that works:
+
+  hugetlb      mmap with MAP_HUGETLB, from the pool the administrator
+               reserved in /proc/sys/vm/nr_hugepages
+  transparent  an ordinary mapping aligned to 2 MB with
+               madvise(MADV_HUGEPAGE), when transparent huge pages are not
+               disabled in /sys/kernel/mm/transparent_hugepage/enabled
+  small        the aligned mapping with ordinary pages
+
+hugepage_set_mode() restricts the choice for comparisons; HugePageMode::Off
+asks for small pages with MADV_NOHUGEPAGE, even where transparent huge pages
+are always on. Vectors shorter than one huge page are allocated with malloc,
+so small problems do not pay 2 MB per vector. hugepage_stats() counts where
+the vectors went. On systems without these flags (not Linux), every large
+vector ends up on small pages.
+
+Do not replace the data of these vectors with N_VSetArrayPointer: their
+destroy operation unmaps it.
+
+The module is header-only; include it with the include path of the
+repository (-I ../../../include from an example folder).
+*/
+
+#ifndef NVECTOR_HUGEPAGE_H
+#define NVECTOR_HUGEPAGE_H
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include <nvector/nvector_serial.h>  // access to serial N_Vector
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+#include <sundials_raii.h> // NVectorOwner, sundials_check
+
+enum class HugePageMode {
+  Auto, // hugetlb, then transparent, then small pages
+  HugeTLB, // hugetlb or small pages
+  Transparent, // transparent or small pages
+  Off // small pages only
+};
+
+// Vectors by where their data went, since the start or the last
+// hugepage_clear_stats().
+struct HugePageStats {
+  long int hugetlb = 0;
+  long int transparent = 0;
+  long int small = 0; // mapped, but on small pages
+  long int heap = 0; // shorter than a huge page, from malloc
+  size_t huge_bytes = 0; // on hugetlb or transparent pages
+};
+
+namespace hugepage_detail {
+
+const size_t huge_size = 2 << 20;
+
+struct Counters {
+  std::atomic<int> mode{(int) HugePageMode::Auto};
+  std::atomic<long int> hugetlb{0}, transparent{0}, small{0}, heap{0};
+  std::atomic<size_t> huge_bytes{0};
+};
+
+inline Counters &counters() {
+  static Counters c;
+  return c;
+}
+
+// Whether madvise(MADV_HUGEPAGE) can have an effect: the selected value in
+// the sysfs file is "always" or "madvise", not "never".
+inline bool transparent_enabled() {
+  static const bool enabled = [] {
+    FILE *f = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+    if (f == NULL) return false;
+    char line[128] = "";
+    bool never = fgets(line, sizeof(line), f) != NULL &&
+                 strstr(line, "[never]") != NULL;
+    fclose(f);
+    return !never;
+  }();
+  return enabled;
+}
+
+// Maps bytes, a multiple of huge_size. Returns NULL if nothing could be
+// mapped.
+inline void *map(size_t bytes) {
+  Counters &c = counters();
+  const HugePageMode mode = (HugePageMode) c.mode.load();
+#ifdef MAP_HUGETLB
+  if (mode == HugePageMode::Auto || mode == HugePageMode::HugeTLB) {
+    void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+      c.hugetlb++;
+      c.huge_bytes += bytes;
+      return p;
+    }
+  }
+#endif
+  // One huge page more than needed, so that the start can be aligned to a
+  // huge page boundary; the rest is unmapped again.
+  const size_t span = bytes + huge_size;
+  void *raw = mmap(NULL, span, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (raw == MAP_FAILED) return NULL;
+  char *start = (char*) raw;
+  char *p = (char*) (((size_t) start + huge_size - 1) & ~(huge_size - 1));
+  if (p > start) munmap(start, p - start);
+  if (start + span > p + bytes) munmap(p + bytes, start + span - (p + bytes));
+
+  bool huge = false;
+#ifdef MADV_HUGEPAGE
+  if ((mode == HugePageMode::Auto || mode == HugePageMode::Transparent) &&
+      transparent_enabled())
+    huge = madvise(p, bytes, MADV_HUGEPAGE) == 0;
+#endif
+#ifdef MADV_NOHUGEPAGE
+  if (mode == HugePageMode::Off) madvise(p, bytes, MADV_NOHUGEPAGE);
+#endif
+  if (huge) {
+    c.transparent++;
+    c.huge_bytes += bytes;
+  } else {
+    c.small++;
+  }
+  return p;
+}
+
+// The data of a vector of length n, and its release. Which of the two
+// allocators was used follows from n alone.
+inline realtype *allocate(sunindextype n) {
+  const size_t bytes = (size_t) n * sizeof(realtype);
+  if (bytes < huge_size) {
+    counters().heap++;
+    return (realtype*) malloc(bytes > 0 ? bytes : 1);
+  }
+  return (realtype*) map((bytes + huge_size - 1) & ~(huge_size - 1));
+}
+
+inline void release(realtype *data, sunindextype n) {
+  if (data == NULL) return;
+  const size_t bytes = (size_t) n * sizeof(realtype);
+  if (bytes < huge_size)
+    free(data);
+  else
+    munmap(data, (bytes + huge_size - 1) & ~(huge_size - 1));
+}
+
+inline void destroy(N_Vector v) {
+  if (v == NULL) return;
+  release(NV_DATA_S(v), NV_LENGTH_S(v));
+  NV_DATA_S(v) = NULL;
+  // Frees the content and the operations table; the data is not owned.
+  N_VDestroy_Serial(v);
+}
+
+// N_VCloneEmpty_Serial copies the operations table, and with it clone and
+// destroy, so the clones of a clone stay on huge pages.
+inline N_Vector clone(N_Vector w) {
+  N_Vector v = N_VCloneEmpty_Serial(w);
+  if (v == NULL) return NULL;
+  realtype *data = allocate(NV_LENGTH_S(w));
+  if (data == NULL) {
+    N_VDestroy_Serial(v);
+    return NULL;
+  }
+  NV_DATA_S(v) = data;
+  NV_OWN_DATA_S(v) = SUNFALSE;
+  return v;
+}
+
+}  // namespace hugepage_detail
+
+// A serial N_Vector of length n on huge pages, or NULL if the memory could
+// not be mapped. Free it with N_VDestroy.
+inline N_Vector N_VNew_HugePage(sunindextype n) {
+  N_Vector v = N_VNewEmpty_Serial(n);
+  if (v == NULL) return NULL;
+  realtype *data = hugepage_detail::allocate(n);
+  if (data == NULL) {
+    N_VDestroy_Serial(v);
+    return NULL;
+  }
+  NV_DATA_S(v) = data;
+  NV_OWN_DATA_S(v) = SUNFALSE;
+  // Every serial vector has its own operations table.
+  v->ops->nvclone = hugepage_detail::clone;
+  v->ops->nvdestroy = hugepage_detail::destroy;
+  return v;
+}
+
+// The same with an owner, for CVodeIntegrator::spgmr and friends.
+inline NVectorOwner make_hugepage_vector(sunindextype n) {
+  NVectorOwner v(N_VNew_HugePage(n));
+  sundials_check(v.get(), "N_VNew_HugePage");
+  return v;
+}
+
+// Where the following vectors (and their clones) get their pages from.
+inline void hugepage_set_mode(HugePageMode mode) {
+  hugepage_detail::counters().mode = (int) mode;
+}
+
+inline HugePageStats hugepage_stats() {
+  const hugepage_detail::Counters &c = hugepage_detail::counters();
+  HugePageStats s;
+  s.hugetlb = c.hugetlb;
+  s.transparent = c.transparent;
+  s.small = c.small;
+  s.heap = c.heap;
+  s.huge_bytes = c.huge_bytes;
+  return s;
+}
+
+inline void hugepage_clear_stats() {
+  hugepage_detail::Counters &c = hugepage_detail::counters();
+  c.hugetlb = 0;
+  c.transparent = 0;
+  c.small = 0;
+  c.heap = 0;
+  c.huge_bytes = 0;
+}
+
+#endif
@@ -0,0 +1,430 @@
+/*
+Content-addressed on-disk cache of integration results.
+
+A result (a row-major table of output rows, optional extra values such as a
+gradient, and a work counter) is stored under a key that describes
+everything it depends on: problem id, parameters, initial condition,
+tolerances, solver configuration and the SUNDIALS version. The key is built
+with CacheKey and hashed into the file name; the full key is stored in the
+file as well and compared on lookup, so a hash collision is a miss, never a
+wrong result.
+
+  ResultCache cache("/tmp/sundials-cache", 256 << 20);
+  CacheKey key;
+  key.add("stiff2d").add(reltol).add(y0, 2);
+  CachedResult hit;
+  if (cache.lookup(key, &hit)) ... hit.data() ...
+  else cache.store(key, columns, rows, nrows, extra, nextra, work);
+
+Lookups map the file read-only; the returned CachedResult points straight
+into the mapping, so a hit costs an open, an mmap and a key comparison.
+
+Many processes can share a cache directory:
+ - Files are written under a temporary name and renamed into place, so a
+   reader sees either no file or a complete one. A mapping stays valid when
+   the file is replaced or evicted.
+ - The total size is tracked in a shared counter (the mapped file .usage).
+   When it exceeds the limit, one process at a time (flock on .lock) evicts
+   the least recently used files down to 90% of the limit. Lookups set the
+   access time of a file explicitly, so LRU order works on relatime and
+   noatime mounts too. The counter is recomputed on each eviction.
+   Writers rename their file into place under the same lock and add the
+   difference to the size of a file they replace, so the counter matches
+   the directory whenever the lock is free.
+
+The module is header-only and POSIX only; include it with the include path
+of the repository.
+*/
+
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <utility>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <sundials/sundials_config.h> // SUNDIALS_VERSION
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+
+// Canonical byte string of everything a result depends on. Values are
+// appended in their binary form, strings with their length, so different
+// sequences of add calls can not produce the same bytes.
+class CacheKey {
+ public:
+  // Every key starts with the library version and the size of realtype.
+  CacheKey() {
+    add(SUNDIALS_VERSION);
+    add((int64_t) sizeof(realtype));
+  }
+
+  CacheKey& add(const char *s) { return add(std::string(s)); }
+  CacheKey& add(const std::string &s) {
+    add((int64_t) s.size());
+    bytes_.append(s);
+    return *this;
+  }
+  CacheKey& add(int64_t x) { return append(&x, sizeof(x)); }
+  CacheKey& add(int x) { return add((int64_t) x); }
+  CacheKey& add(realtype x) { return append(&x, sizeof(x)); }
+  CacheKey& add(const realtype *x, size_t n) {
+    add((int64_t) n);
+    return append(x, n * sizeof(realtype));
+  }
+
+  const std::string& bytes() const { return bytes_; }
+
+  // 64-bit FNV-1a hash of the key, as 16 hex digits.
+  std::string hash() const {
+    uint64_t h = 1469598103934665603ULL;
+    for (unsigned char c : bytes_) {
+      h ^= c;
+      h *= 1099511628211ULL;
+    }
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long) h);
+    return hex;
+  }
+
+ private:
+  CacheKey& append(const void *p, size_t n) {
+    bytes_.append((const char*) p, n);
+    return *this;
+  }
+
+  std::string bytes_;
+};
+
+// Layout of a cache file: the header, the key bytes, padding up to the
+// alignment of realtype, rows * columns values, then extra values.
+struct ResultFileHeader {
+  char magic[8]; // "SUNRES01"
+  int64_t key_size;
+  int64_t rows;
+  int64_t columns;
+  int64_t extra;
+  int64_t work; // solver work counter, e.g. steps
+};
+
+// A cached result, mapped read-only. Move-only; unmaps on destruction.
+class CachedResult {
+ public:
+  CachedResult() {}
+  ~CachedResult() { reset(); }
+
+  CachedResult(const CachedResult&) = delete;
+  CachedResult& operator=(const CachedResult&) = delete;
+  CachedResult(CachedResult &&other) noexcept { *this = std::move(other); }
+  CachedResult& operator=(CachedResult &&other) noexcept {
+    if (this != &other) {
+      reset();
+      std::swap(map_, other.map_);
+      std::swap(size_, other.size_);
+      std::swap(data_, other.data_);
+    }
+    return *this;
+  }
+
+  int64_t rows() const { return header()->rows; }
+  int64_t columns() const { return header()->columns; }
+  const realtype *data() const { return data_; }
+  int64_t extra_size() const { return header()->extra; }
+  const realtype *extra() const { return data_ + rows() * columns(); }
+  int64_t work() const { return header()->work; }
+
+ private:
+  friend class ResultCache;
+
+  const ResultFileHeader *header() const {
+    return (const ResultFileHeader*) map_;
+  }
+
+  void reset() {
+    if (map_) munmap(map_, size_);
+    map_ = NULL;
+    size_ = 0;
+    data_ = NULL;
+  }
+
+  void *map_ = NULL;
+  size_t size_ = 0;
+  const realtype *data_ = NULL;
+};
+
+// Counters of one ResultCache object.
+struct ResultCacheStats {
+  long int hits = 0;
+  long int misses = 0;
+  long int stores = 0;
+  long int evictions = 0; // files removed by this object
+};
+
+class ResultCache {
+ public:
+  // Creates dir if needed. max_bytes limits the total size of the files.
+  ResultCache(const std::string &dir, int64_t max_bytes)
+      : dir_(dir), max_bytes_(max_bytes) {
+    mkdir(dir_.c_str(), 0777);
+    int fd = open((dir_ + "/.usage").c_str(), O_RDWR | O_CREAT, 0666);
+    if (fd < 0) return;
+    // Growing the file to 8 bytes zero-fills it; a second process doing the
+    // same is harmless.
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        (st.st_size < (off_t) sizeof(int64_t) &&
+         ftruncate(fd, sizeof(int64_t)) != 0)) {
+      close(fd);
+      return;
+    }
+    void *p = mmap(NULL, sizeof(int64_t), PROT_READ | PROT_WRITE, MAP_SHARED,
+                   fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return;
+    usage_ = (std::atomic<int64_t>*) p;
+    // A fresh counter next to existing files, e.g. after .usage was removed.
+    if (usage_->load() == 0) evict(false);
+  }
+
+  ~ResultCache() {
+    if (usage_) munmap((void*) usage_, sizeof(int64_t));
+  }
+
+  ResultCache(const ResultCache&) = delete;
+  ResultCache& operator=(const ResultCache&) = delete;
+
+  // False if the cache directory could not be set up; all lookups miss and
+  // all stores fail then.
+  bool ok() const { return usage_ != NULL; }
+
+  // Maps the result stored under key into out. Thread safe.
+  bool lookup(const CacheKey &key, CachedResult *out) {
+    if (ok() && map(key, out)) {
+      hits_++;
+      return true;
+    }
+    misses_++;
+    return false;
+  }
+
+  // Stores a result under key, replacing any previous one. Thread safe.
+  bool store(const CacheKey &key, int64_t columns, const realtype *rows,
+             int64_t nrows, const realtype *extra = NULL, int64_t nextra = 0,
+             int64_t work = 0) {
+    if (!ok()) return false;
+    ResultFileHeader h;
+    std::memcpy(h.magic, magic(), sizeof(h.magic));
+    h.key_size = key.bytes().size();
+    h.rows = nrows;
+    h.columns = columns;
+    h.extra = nextra;
+    h.work = work;
+    const size_t offset = data_offset(h.key_size);
+    const size_t values = (nrows * columns + nextra) * sizeof(realtype);
+    if ((int64_t) (offset + values) > max_bytes_) return false;
+
+    // Unique per process and call, so concurrent writers never share a file.
+    static std::atomic<long int> counter(0);
+    std::string tmp = dir_ + "/" + key.hash() + "." +
+                      std::to_string((long int) getpid()) + "." +
+                      std::to_string(counter++) + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+    if (fd < 0) return false;
+    static const char zeros[alignof(realtype)] = {};
+    size_t padding = offset - sizeof(h) - h.key_size;
+    bool written = write_all(fd, &h, sizeof(h)) &&
+                   write_all(fd, key.bytes().data(), h.key_size) &&
+                   write_all(fd, zeros, padding) &&
+                   write_all(fd, rows, nrows * columns * sizeof(realtype)) &&
+                   write_all(fd, extra, nextra * sizeof(realtype));
+    if (close(fd) != 0 || !written) {
+      unlink(tmp.c_str());
+      return false;
+    }
+
+    // The size of a replaced file is read under the lock, so that neither
+    // a concurrent writer of the same key nor an eviction scan can come
+    // between it and the update of the counter.
+    int lock = lock_directory(LOCK_EX);
+    if (lock < 0) {
+      unlink(tmp.c_str());
+      return false;
+    }
+    struct stat st;
+    const int64_t replaced =
+        stat(path(key).c_str(), &st) == 0 ? (int64_t) st.st_size : 0;
+    const int64_t added = (int64_t) (offset + values) - replaced;
+    bool renamed = rename(tmp.c_str(), path(key).c_str()) == 0;
+    int64_t total = renamed ? usage_->fetch_add(added) + added : 0;
+    unlock_directory(lock);
+    if (!renamed) {
+      unlink(tmp.c_str());
+      return false;
+    }
+    stores_++;
+    if (total > max_bytes_) evict(true);
+    return true;
+  }
+
+  ResultCacheStats stats() const {
+    ResultCacheStats s;
+    s.hits = hits_;
+    s.misses = misses_;
+    s.stores = stores_;
+    s.evictions = evictions_;
+    return s;
+  }
+
+  // Total size of the cache files as tracked by the shared counter.
+  int64_t usage() const { return usage_ ? usage_->load() : 0; }
+
+ private:
+  static const char *magic() { return "SUNRES01"; }
+
+  static size_t data_offset(int64_t key_size) {
+    const size_t a = alignof(realtype);
+    return (sizeof(ResultFileHeader) + key_size + a - 1) / a * a;
+  }
+
+  std::string path(const CacheKey &key) const {
+    return dir_ + "/" + key.hash() + ".res";
+  }
+
+  bool map(const CacheKey &key, CachedResult *out) {
+    int fd = open(path(key).c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t) sizeof(ResultFileHeader))
+      p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p != MAP_FAILED) {
+      // Mark the file as recently used for the LRU eviction.
+      struct timespec times[2] = {{0, UTIME_NOW}, {0, UTIME_OMIT}};
+      futimens(fd, times);
+    }
+    close(fd);
+    if (p == MAP_FAILED) return false;
+
+    CachedResult r;
+    r.map_ = p;
+    r.size_ = st.st_size;
+    const ResultFileHeader *h = r.header();
+    const std::string &k = key.bytes();
+    if (std::memcmp(h->magic, magic(), sizeof(h->magic)) != 0 ||
+        h->key_size != (int64_t) k.size() || h->rows < 0 || h->columns < 0 ||
+        h->extra < 0)
+      return false;
+    const size_t offset = data_offset(h->key_size);
+    if ((size_t) st.st_size != offset + (h->rows * h->columns + h->extra) *
+                                            sizeof(realtype))
+      return false;
+    if (std::memcmp((const char*) p + sizeof(*h), k.data(), k.size()) != 0)
+      return false;
+    r.data_ = (const realtype*) ((const char*) p + offset);
+    *out = std::move(r);
+    return true;
+  }
+
+  static bool write_all(int fd, const void *p, size_t n) {
+    const char *c = (const char*) p;
+    while (n > 0) {
+      ssize_t w = write(fd, c, n);
+      if (w < 0 && errno == EINTR) continue;
+      if (w <= 0) return false;
+      c += w;
+      n -= w;
+    }
+    return true;
+  }
+
+  // Recomputes the total size and, if trim is set, removes the least
+  // recently used files until the total is below 90% of the limit. Only one
+  // process evicts at a time; the others skip. Stores wait for the lock, so
+  // none of them lands between the scan and the update of the counter.
+  void evict(bool trim) {
+    int lock = lock_directory(LOCK_EX | LOCK_NB);
+    if (lock < 0) return;
+
+    struct Entry {
+      std::string name;
+      int64_t size;
+      struct timespec atime;
+    };
+    std::vector<Entry> entries;
+    int64_t total = 0;
+    time_t now = time(NULL);
+    if (DIR *d = opendir(dir_.c_str())) {
+      while (struct dirent *e = readdir(d)) {
+        std::string name = e->d_name;
+        struct stat st;
+        if (stat((dir_ + "/" + name).c_str(), &st) != 0) continue;
+        if (ends_with(name, ".res")) {
+          entries.push_back({name, (int64_t) st.st_size, st.st_atim});
+          total += st.st_size;
+        } else if (ends_with(name, ".tmp") && now - st.st_mtime > 3600) {
+          // Left behind by a writer that died before the rename.
+          unlink((dir_ + "/" + name).c_str());
+        }
+      }
+      closedir(d);
+    }
+
+    if (trim && total > max_bytes_) {
+      std::sort(entries.begin(), entries.end(),
+                [](const Entry &a, const Entry &b) {
+                  if (a.atime.tv_sec != b.atime.tv_sec)
+                    return a.atime.tv_sec < b.atime.tv_sec;
+                  return a.atime.tv_nsec < b.atime.tv_nsec;
+                });
+      const int64_t target = max_bytes_ / 10 * 9;
+      for (const Entry &e : entries) {
+        if (total <= target) break;
+        if (unlink((dir_ + "/" + e.name).c_str()) == 0) {
+          total -= e.size;
+          evictions_++;
+        }
+      }
+    }
+    usage_->store(total);
+    unlock_directory(lock);
+  }
+
+  // Opens .lock and flocks it with operation; -1 if either fails. The lock
+  // belongs to the open file, so threads of one process exclude each other
+  // too.
+  int lock_directory(int operation) const {
+    int fd = open((dir_ + "/.lock").c_str(), O_RDWR | O_CREAT, 0666);
+    if (fd >= 0 && flock(fd, operation) != 0) {
+      close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+  static void unlock_directory(int fd) {
+    flock(fd, LOCK_UN);
+    close(fd);
+  }
+
+  static bool ends_with(const std::string &s, const char *suffix) {
+    size_t n = std::strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+  }
+
+  std::string dir_;
+  int64_t max_bytes_;
+  std::atomic<int64_t> *usage_ = NULL; // shared between processes
+  std::atomic<long int> hits_{0}, misses_{0}, stores_{0}, evictions_{0};
+};
+
+#endif
@@ -0,0 +1,258 @@
+/*
+Strang operator splitting for reaction-diffusion on a 1d grid.
+
+A reaction-diffusion system of two species on n grid points couples every
+point to its neighbours through diffusion, and the two species at each
+point through a stiff reaction. Integrated as one system, every Newton
+iteration solves the coupled problem. Splitting integrates the two parts
+one after the other over each step h, in Strang order,
+
+  R(h/2) D(h) R(h/2)     (reaction first, the default), or
+  D(h/2) R(h) D(h/2)
+
+which is second order in h when both stages are at least second order:
+
+  D  diffusion y_t = d_c y_xx for each species c, zero flux at both ends,
+     by Crank-Nicolson steps. Each step is a tridiagonal solve per species
+     (Thomas algorithm), factorized once per step length.
+  R  the reaction, an independent tiny stiff system at every point, by
+     steps of the L-stable two stage SDIRK method of order 2. The Newton
+     iterations of all points run in lockstep over the whole grid with the
+     2x2 Jacobian inverted in closed form, so the loops vectorize. They
+     stop when the largest update is below newton_tol, or after
+     newton_iterations, which counts as a failure in the stats.
+
+Both stages can be split into substeps. The state is interleaved, species
+c of point i at y[2 * i + c], as for a banded CVODE problem.
+
+The module is header-only; include it with the include path of the
+repository (-I ../../../include from an example folder).
+*/
+
+#ifndef STRANG_SPLITTING_H
+#define STRANG_SPLITTING_H
+
+#include <cmath>
+#include <vector>
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+
+// The reaction at n points: from y (2 values per point) writes the rates to
+// rate (2 per point) and, if J is not NULL, the Jacobian of each point to
+// J[4 i .. 4 i + 3] as d0/dy0, d0/dy1, d1/dy0, d1/dy1.
+typedef void (*BatchReactionFn)(sunindextype n, const realtype *y,
+                                realtype *rate, realtype *J, void *data);
+
+struct SplittingOptions {
+  bool reaction_first = true; // R(h/2) D(h) R(h/2), else D(h/2) R(h) D(h/2)
+  int reaction_substeps = 1; // SDIRK steps per reaction stage
+  int diffusion_substeps = 1; // Crank-Nicolson steps per diffusion stage
+  int newton_iterations = 10; // at most, per SDIRK stage
+  // Newton stops once |update| <= newton_tol (1 + |Y|) at every point.
+  realtype newton_tol = std::sqrt(UNIT_ROUNDOFF);
+};
+
+struct SplittingStats {
+  long int steps = 0; // Strang steps
+  long int reaction_evals = 0; // batched calls, over the whole grid
+  long int diffusion_solves = 0; // tridiagonal solves, per species
+  long int factorizations = 0;
+  long int newton_failures = 0; // SDIRK stages that hit newton_iterations
+};
+
+class StrangSplitting {
+ public:
+  // n points of spacing dx, diffusion coefficients d[0] and d[1].
+  StrangSplitting(sunindextype n, realtype dx, const realtype d[2],
+                  BatchReactionFn reaction, void *data,
+                  const SplittingOptions &options = SplittingOptions())
+      : n_(n), dx_(dx), reaction_(reaction), data_(data), options_(options),
+        y1_(2 * n), y2_(2 * n), rate_(2 * n), base_(2 * n), J_(4 * n),
+        rhs_(n), sol_(n) {
+    d_[0] = d[0];
+    d_[1] = d[1];
+    if (options_.reaction_substeps < 1) options_.reaction_substeps = 1;
+    if (options_.diffusion_substeps < 1) options_.diffusion_substeps = 1;
+    if (options_.newton_iterations < 1) options_.newton_iterations = 1;
+    if (!(options_.newton_tol > 0))
+      options_.newton_tol = std::sqrt(UNIT_ROUNDOFF);
+  }
+
+  // Advances y from t0 to t1 in Strang steps of at most h. Returns false if
+  // the Newton iterations of a reaction stage did not converge; the steps
+  // are taken all the same, and counted in stats().newton_failures.
+  bool advance(realtype *y, realtype t0, realtype t1, realtype h) {
+    long int steps =
+        (long int) std::ceil((t1 - t0) / h - std::sqrt(UNIT_ROUNDOFF));
+    if (steps < 1) steps = 1;
+    const realtype dt = (t1 - t0) / steps;
+    bool ok = true;
+    for (long int k = 0; k < steps; k++) ok = step(y, dt) && ok;
+    return ok;
+  }
+
+  // One Strang step of length h. Returns false as advance does.
+  bool step(realtype *y, realtype h) {
+    bool ok;
+    if (options_.reaction_first) {
+      ok = react(y, h / 2);
+      diffuse(y, h);
+      ok = react(y, h / 2) && ok;
+    } else {
+      diffuse(y, h / 2);
+      ok = react(y, h);
+      diffuse(y, h / 2);
+    }
+    stats_.steps++;
+    return ok;
+  }
+
+  // The reaction stage alone, over h. Returns false as advance does.
+  bool react(realtype *y, realtype h) {
+    const int m = options_.reaction_substeps;
+    bool ok = true;
+    for (int k = 0; k < m; k++) ok = sdirk2(y, h / m) && ok;
+    return ok;
+  }
+
+  // The diffusion stage alone, over h.
+  void diffuse(realtype *y, realtype h) {
+    const int m = options_.diffusion_substeps;
+    const realtype dt = h / m;
+    for (int c = 0; c < 2; c++) {
+      if (d_[c] == 0) continue;
+      const Factors &f = factors(c, dt);
+      for (int k = 0; k < m; k++) crank_nicolson(y, c, f);
+    }
+  }
+
+  const SplittingStats &stats() const { return stats_; }
+  void clear_stats() { stats_ = SplittingStats(); }
+
+ private:
+  // The Thomas factorization of I - dt/2 d L for one species and step.
+  struct Factors {
+    int species;
+    realtype dt;
+    realtype r; // dt d / (2 dx^2)
+    std::vector<realtype> c, m; // modified superdiagonal, 1 / pivot
+  };
+
+  static realtype sdirk_gamma() { return 1 - 1 / std::sqrt((realtype) 2); }
+
+  // Y = base + h gamma f(Y) at every point, by Newton iterations in
+  // lockstep, starting from Y. Returns false if the updates were still
+  // above newton_tol after newton_iterations.
+  bool solve_stage(realtype *Y, const realtype *base, realtype hg) {
+    for (int it = 0; it < options_.newton_iterations; it++) {
+      reaction_(n_, Y, rate_.data(), J_.data(), data_);
+      stats_.reaction_evals++;
+      const realtype *r = rate_.data(), *J = J_.data();
+      realtype change = 0; // largest update relative to 1 + |Y|
+      for (sunindextype i = 0; i < n_; i++) {
+        // G = Y - base - hg f(Y), dG = I - hg J.
+        realtype g0 = Y[2 * i] - base[2 * i] - hg * r[2 * i];
+        realtype g1 = Y[2 * i + 1] - base[2 * i + 1] - hg * r[2 * i + 1];
+        realtype a = 1 - hg * J[4 * i], b = -hg * J[4 * i + 1];
+        realtype c = -hg * J[4 * i + 2], d = 1 - hg * J[4 * i + 3];
+        realtype inv = 1 / (a * d - b * c);
+        realtype d0 = inv * (d * g0 - b * g1);
+        realtype d1 = inv * (a * g1 - c * g0);
+        Y[2 * i] -= d0;
+        Y[2 * i + 1] -= d1;
+        change = std::fmax(change, std::fabs(d0) / (1 + std::fabs(Y[2 * i])));
+        change = std::fmax(change,
+                           std::fabs(d1) / (1 + std::fabs(Y[2 * i + 1])));
+      }
+      if (change <= options_.newton_tol) return true;
+    }
+    stats_.newton_failures++;
+    return false;
+  }
+
+  // One step of the L-stable SDIRK method of order 2 (Alexander):
+  //   Y1 = y + h gamma f(Y1)
+  //   Y2 = y + h (1 - gamma) f(Y1) + h gamma f(Y2),  y_new = Y2
+  // Returns false if a stage did not converge.
+  bool sdirk2(realtype *y, realtype h) {
+    const realtype g = sdirk_gamma();
+    const sunindextype N = 2 * n_;
+    realtype *Y1 = y1_.data(), *Y2 = y2_.data(), *base = base_.data();
+    for (sunindextype i = 0; i < N; i++) Y1[i] = y[i];
+    bool ok = solve_stage(Y1, y, h * g);
+    if (ok) {
+      // f(Y1) = (Y1 - y) / (h gamma) once the stage equation holds, without
+      // another evaluation.
+      const realtype w = (1 - g) / g;
+      for (sunindextype i = 0; i < N; i++) base[i] = y[i] + w * (Y1[i] - y[i]);
+    } else {
+      reaction_(n_, Y1, rate_.data(), NULL, data_);
+      stats_.reaction_evals++;
+      const realtype w = h * (1 - g);
+      for (sunindextype i = 0; i < N; i++) base[i] = y[i] + w * rate_[i];
+    }
+    for (sunindextype i = 0; i < N; i++) Y2[i] = Y1[i];
+    ok = solve_stage(Y2, base, h * g) && ok;
+    for (sunindextype i = 0; i < N; i++) y[i] = Y2[i];
+    return ok;
+  }
+
+  const Factors &factors(int c, realtype dt) {
+    for (const Factors &f : factors_)
+      if (f.species == c && f.dt == dt) return f;
+    // Steps of a few lengths recur; keep the latest ones.
+    if (factors_.size() >= 8) factors_.erase(factors_.begin());
+    Factors f;
+    f.species = c;
+    f.dt = dt;
+    f.r = dt * d_[c] / (2 * dx_ * dx_);
+    f.c.resize(n_);
+    f.m.resize(n_);
+    // Rows of I - r L, L with mirrored ghost points: the first row is
+    // (1 + 2r, -2r), the last (-2r, 1 + 2r), the others (-r, 1 + 2r, -r).
+    const realtype r = f.r;
+    for (sunindextype i = 0; i < n_; i++) {
+      realtype lower = i == 0 ? 0 : (i == n_ - 1 ? -2 * r : -r);
+      realtype upper = i == n_ - 1 ? 0 : (i == 0 ? -2 * r : -r);
+      realtype pivot = 1 + 2 * r - (i > 0 ? lower * f.c[i - 1] : 0);
+      f.m[i] = 1 / pivot;
+      f.c[i] = upper * f.m[i];
+    }
+    factors_.push_back(f);
+    stats_.factorizations++;
+    return factors_.back();
+  }
+
+  // (I - r L) y_new = (I + r L) y for species c.
+  void crank_nicolson(realtype *y, int c, const Factors &f) {
+    const sunindextype n = n_;
+    const realtype r = f.r;
+    realtype *rhs = rhs_.data(), *x = sol_.data();
+    if (n == 1) return; // nothing to diffuse
+    rhs[0] = (1 - 2 * r) * y[c] + 2 * r * y[2 + c];
+    for (sunindextype i = 1; i < n - 1; i++)
+      rhs[i] = r * y[2 * (i - 1) + c] + (1 - 2 * r) * y[2 * i + c] +
+               r * y[2 * (i + 1) + c];
+    rhs[n - 1] = 2 * r * y[2 * (n - 2) + c] +
+                 (1 - 2 * r) * y[2 * (n - 1) + c];
+    // Forward sweep, then back substitution.
+    x[0] = rhs[0] * f.m[0];
+    for (sunindextype i = 1; i < n; i++) {
+      realtype lower = i == n - 1 ? -2 * r : -r;
+      x[i] = (rhs[i] - lower * x[i - 1]) * f.m[i];
+    }
+    for (sunindextype i = n - 2; i >= 0; i--) x[i] -= f.c[i] * x[i + 1];
+    for (sunindextype i = 0; i < n; i++) y[2 * i + c] = x[i];
+    stats_.diffusion_solves++;
+  }
+
+  sunindextype n_;
+  realtype dx_, d_[2];
+  BatchReactionFn reaction_;
+  void *data_;
+  SplittingOptions options_;
+  std::vector<realtype> y1_, y2_, rate_, base_, J_, rhs_, sol_;
+  std::vector<Factors> factors_;
+  SplittingStats stats_;
+};
+
+#endif
@@ -0,0 +1,53 @@
+/*
+Helpers for drivers that build against SUNDIALS in any precision.
+
+SUNDIALS is configured with SUNDIALS_PRECISION single, double or extended,
+and realtype is float, double or long double accordingly. A driver stays
+generic over the three if it declares its state as realtype, passes
+realtype to printf through a (double) cast, and uses these helpers where
+the precision shows through:
+
+  precision_name()       "single", "double" or "extended", for reports
+  feasible_tolerance(t)  t, raised to what the precision can resolve, for
+                         tight reference runs written with double in mind
+  MPI_REALTYPE           the MPI datatype of realtype, when mpi.h is
+                         included before this header
+
+The module is header-only; include it with the include path of the
+repository (-I ../../../include from an example folder).
+*/
+
+#ifndef SUNDIALS_PRECISION_H
+#define SUNDIALS_PRECISION_H
+
+#include <cmath>
+#include <sundials/sundials_types.h>  // defs. of realtype, UNIT_ROUNDOFF
+
+#if defined(SUNDIALS_SINGLE_PRECISION)
+#define SUNDIALS_PRECISION_NAME "single"
+#elif defined(SUNDIALS_EXTENDED_PRECISION)
+#define SUNDIALS_PRECISION_NAME "extended"
+#else
+#define SUNDIALS_PRECISION_NAME "double"
+#endif
+
+#ifdef MPI_VERSION
+#if defined(SUNDIALS_SINGLE_PRECISION)
+#define MPI_REALTYPE MPI_FLOAT
+#elif defined(SUNDIALS_EXTENDED_PRECISION)
+#define MPI_REALTYPE MPI_LONG_DOUBLE
+#else
+#define MPI_REALTYPE MPI_DOUBLE
+#endif
+#endif
+
+inline const char *precision_name() { return SUNDIALS_PRECISION_NAME; }
+
+// The smallest relative tolerance asked of the solvers: a hundred units of
+// roundoff, about 1e-5 in single and 2e-14 in double precision. Below it
+// CVODE gives up with CV_TOO_MUCH_ACC and KINSOL never converges.
+inline realtype feasible_tolerance(realtype tol) {
+  return std::fmax(tol, 100 * UNIT_ROUNDOFF);
+}
+
+#endif
@@ -0,0 +1,260 @@
+/*
+Move-only owners for SUNDIALS objects and a reusable CVODE integrator.
+
+SunOwner<T, Free> holds one N_Vector, SUNMatrix, SUNLinearSolver or solver
+memory block and releases it when it goes out of scope, so the Create/Free
+pairs of the examples can not get out of sync. The owners have the size of
+the raw handle and convert to it implicitly, so they can be passed straight
+to the C API.
+
+CVodeIntegrator bundles the state vector, the optional matrix, the linear
+solver and the CVODE memory of one problem. reset() reinitializes it with
+CVodeReInit, so every allocation is reused by the next run.
+
+Setup errors are thrown as SundialsError. The stepping call advance() is a
+plain inline forward to CVode that returns its flag: no virtual dispatch,
+no allocation and no exception handling on the stepping path.
+
+The module is header-only; include it with the include path of the
+repository (-I ../../../include from an example folder). CVODES has the
+CVODE API as a subset; define SUNDIALS_RAII_CVODES before including the
+header to build against the CVODES headers and library instead.
+*/
+
+#ifndef SUNDIALS_RAII_H
+#define SUNDIALS_RAII_H
+
+#include <stdexcept>
+#include <string>
+#include <utility>
+#ifdef SUNDIALS_RAII_CVODES
+#include <cvodes/cvodes.h> // prototypes for CVODES fcts., consts.
+#include <cvodes/cvodes_spils.h> // access to CVSpils interface
+#include <cvodes/cvodes_direct.h> // access to CVDls interface
+#else
+#include <cvode/cvode.h> // prototypes for CVODE fcts., consts.
+#include <cvode/cvode_spils.h> // access to CVSpils interface
+#include <cvode/cvode_direct.h> // access to CVDls interface
+#endif
+#include <nvector/nvector_serial.h>  // access to serial N_Vector
+#include <sunmatrix/sunmatrix_dense.h> // access to dense SUNMatrix
+#include <sunmatrix/sunmatrix_band.h> // access to band SUNMatrix
+#include <sunlinsol/sunlinsol_dense.h> // access to dense SUNLinearSolver
+#include <sunlinsol/sunlinsol_band.h> // access to band SUNLinearSolver
+#include <sunlinsol/sunlinsol_spgmr.h>  //access to SPGMR SUNLinearSolver
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+
+// Thrown when a SUNDIALS setup call fails.
+class SundialsError : public std::runtime_error {
+ public:
+  SundialsError(const char *funcname, int flag)
+      : std::runtime_error(std::string(funcname) + "() failed with flag = " +
+                           std::to_string(flag)),
+        flag_(flag) {}
+
+  int flag() const { return flag_; }
+
+ private:
+  int flag_;
+};
+
+// Throws SundialsError for a negative return flag, mirroring check_flag with
+// opt == 1 in the examples.
+inline void sundials_check(int flag, const char *funcname) {
+  if (flag < 0) throw SundialsError(funcname, flag);
+}
+
+// Throws SundialsError for a NULL pointer, mirroring check_flag with opt == 0.
+inline void sundials_check(const void *ptr, const char *funcname) {
+  if (ptr == NULL) throw SundialsError(funcname, 0);
+}
+
+// Move-only owner of a SUNDIALS handle. Free is a function object that
+// releases a non-NULL handle.
+template <typename T, typename Free>
+class SunOwner {
+ public:
+  SunOwner() : p_(NULL) {}
+  explicit SunOwner(T p) : p_(p) {}
+  ~SunOwner() { if (p_) Free()(p_); }
+
+  SunOwner(const SunOwner&) = delete;
+  SunOwner& operator=(const SunOwner&) = delete;
+
+  SunOwner(SunOwner &&other) noexcept : p_(other.p_) { other.p_ = NULL; }
+  SunOwner& operator=(SunOwner &&other) noexcept {
+    if (this != &other) reset(other.release());
+    return *this;
+  }
+
+  T get() const { return p_; }
+  operator T() const { return p_; }
+  explicit operator bool() const { return p_ != NULL; }
+
+  // Gives up ownership without freeing.
+  T release() {
+    T p = p_;
+    p_ = NULL;
+    return p;
+  }
+
+  // Frees the current handle and takes ownership of p.
+  void reset(T p = NULL) {
+    if (p_) Free()(p_);
+    p_ = p;
+  }
+
+ private:
+  T p_;
+};
+
+struct NVectorFree {
+  void operator()(N_Vector v) const { N_VDestroy(v); }
+};
+struct SUNMatrixFree {
+  void operator()(SUNMatrix A) const { SUNMatDestroy(A); }
+};
+struct SUNLinearSolverFree {
+  void operator()(SUNLinearSolver LS) const { SUNLinSolFree(LS); }
+};
+struct CVodeMemFree {
+  void operator()(void *mem) const { CVodeFree(&mem); }
+};
+
+typedef SunOwner<N_Vector, NVectorFree> NVectorOwner;
+typedef SunOwner<SUNMatrix, SUNMatrixFree> SUNMatrixOwner;
+typedef SunOwner<SUNLinearSolver, SUNLinearSolverFree> SUNLinearSolverOwner;
+typedef SunOwner<void*, CVodeMemFree> CVodeMemOwner;
+
+// A serial N_Vector of length N.
+inline NVectorOwner make_serial_vector(sunindextype N) {
+  NVectorOwner v(N_VNew_Serial(N));
+  sundials_check(v.get(), "N_VNew_Serial");
+  return v;
+}
+
+// A BDF/Newton CVODE problem with its state vector, linear solver and
+// optional matrix. Construct it with one of the factories, set further
+// options through mem(), then alternate reset() and advance() for each run.
+class CVodeIntegrator {
+ public:
+  // SPGMR without preconditioning. jtv may be NULL for difference quotients.
+  static CVodeIntegrator spgmr(sunindextype N, CVRhsFn f,
+                               CVSpilsJacTimesVecFn jtv, realtype reltol,
+                               realtype abstol, void *user_data = NULL,
+                               int maxl = 0) {
+    return spgmr(make_serial_vector(N), f, jtv, reltol, abstol, user_data,
+                 maxl);
+  }
+
+  // The same on a state vector of the caller's kind, a serial vector whose
+  // data is placed differently (include/nvector_hugepage.h). CVODE and SPGMR
+  // clone their work vectors from it.
+  static CVodeIntegrator spgmr(NVectorOwner y, CVRhsFn f,
+                               CVSpilsJacTimesVecFn jtv, realtype reltol,
+                               realtype abstol, void *user_data = NULL,
+                               int maxl = 0) {
+    CVodeIntegrator cv(std::move(y), f, reltol, abstol, user_data);
+    cv.LS_.reset(SUNSPGMR(cv.y_, PREC_NONE, maxl));
+    sundials_check(cv.LS_.get(), "SUNSPGMR");
+    sundials_check(CVSpilsSetLinearSolver(cv.mem_, cv.LS_),
+                   "CVSpilsSetLinearSolver");
+    if (jtv != NULL) {
+      sundials_check(CVSpilsSetJacTimes(cv.mem_, NULL, jtv),
+                     "CVSpilsSetJacTimes");
+    }
+    return cv;
+  }
+
+  // Dense direct solver. jac may be NULL for difference quotients.
+  static CVodeIntegrator dense(sunindextype N, CVRhsFn f, CVDlsJacFn jac,
+                               realtype reltol, realtype abstol,
+                               void *user_data = NULL) {
+    CVodeIntegrator cv(N, f, reltol, abstol, user_data);
+    cv.A_.reset(SUNDenseMatrix(N, N));
+    sundials_check(cv.A_.get(), "SUNDenseMatrix");
+    cv.LS_.reset(SUNDenseLinearSolver(cv.y_, cv.A_));
+    sundials_check(cv.LS_.get(), "SUNDenseLinearSolver");
+    sundials_check(CVDlsSetLinearSolver(cv.mem_, cv.LS_, cv.A_),
+                   "CVDlsSetLinearSolver");
+    if (jac != NULL) {
+      sundials_check(CVDlsSetJacFn(cv.mem_, jac), "CVDlsSetJacFn");
+    }
+    return cv;
+  }
+
+  // Band direct solver with upper and lower half-bandwidths mu and ml. jac
+  // may be NULL for difference quotients.
+  static CVodeIntegrator band(sunindextype N, CVRhsFn f, CVDlsJacFn jac,
+                              sunindextype mu, sunindextype ml,
+                              realtype reltol, realtype abstol,
+                              void *user_data = NULL) {
+    CVodeIntegrator cv(N, f, reltol, abstol, user_data);
+    // The LU factorization fills in up to mu + ml superdiagonals.
+    cv.A_.reset(SUNBandMatrix(N, mu, ml, mu + ml));
+    sundials_check(cv.A_.get(), "SUNBandMatrix");
+    cv.LS_.reset(SUNBandLinearSolver(cv.y_, cv.A_));
+    sundials_check(cv.LS_.get(), "SUNBandLinearSolver");
+    sundials_check(CVDlsSetLinearSolver(cv.mem_, cv.LS_, cv.A_),
+                   "CVDlsSetLinearSolver");
+    if (jac != NULL) {
+      sundials_check(CVDlsSetJacFn(cv.mem_, jac), "CVDlsSetJacFn");
+    }
+    return cv;
+  }
+
+  CVodeIntegrator(CVodeIntegrator&&) = default;
+  CVodeIntegrator& operator=(CVodeIntegrator&&) = default;
+
+  // Restarts the problem at t0 from y0 (N values), reusing all memory. The
+  // solver options and the linear solver stay attached.
+  void reset(realtype t0, const realtype *y0) {
+    realtype *y = NV_DATA_S(y_.get());
+    for (sunindextype i = 0; i < N_; i++) y[i] = y0[i];
+    sundials_check(CVodeReInit(mem_, t0, y_), "CVodeReInit");
+  }
+
+  // Advances to tout and leaves the solution in y(). Returns the CVode flag.
+  int advance(realtype tout, realtype *t, int itask = CV_NORMAL) {
+    return CVode(mem_, tout, y_, t, itask);
+  }
+
+  N_Vector y() const { return y_; }
+  realtype *y_data() const { return NV_DATA_S(y_.get()); }
+  sunindextype size() const { return N_; }
+  void *mem() const { return mem_; }
+  SUNLinearSolver linear_solver() const { return LS_; }
+  SUNMatrix matrix() const { return A_; }
+
+ private:
+  // The state vector is zero until the first reset(); CVodeInit only needs
+  // it for its length and the vector operations.
+  CVodeIntegrator(sunindextype N, CVRhsFn f, realtype reltol,
+                  realtype abstol, void *user_data)
+      : CVodeIntegrator(make_serial_vector(N), f, reltol, abstol,
+                        user_data) {}
+
+  CVodeIntegrator(NVectorOwner y, CVRhsFn f, realtype reltol,
+                  realtype abstol, void *user_data)
+      : N_(NV_LENGTH_S(y.get())), y_(std::move(y)) {
+    N_VConst(0, y_);
+    mem_.reset(CVodeCreate(CV_BDF, CV_NEWTON));
+    sundials_check(mem_.get(), "CVodeCreate");
+    sundials_check(CVodeInit(mem_, f, 0, y_), "CVodeInit");
+    sundials_check(CVodeSStolerances(mem_, reltol, abstol),
+                   "CVodeSStolerances");
+    if (user_data != NULL) {
+      sundials_check(CVodeSetUserData(mem_, user_data), "CVodeSetUserData");
+    }
+  }
+
+  // Destroyed in reverse order: the CVODE memory goes before the linear
+  // solver and matrix it refers to.
+  sunindextype N_;
+  NVectorOwner y_;
+  SUNMatrixOwner A_;
+  SUNLinearSolverOwner LS_;
+  CVodeMemOwner mem_;
+};
+
+#endif
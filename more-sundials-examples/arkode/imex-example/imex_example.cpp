@@ -0,0 +1,270 @@
+/*
+The user data example with ARKode's additive Runge-Kutta (ARK-IMEX) methods,
+compared with CVODE BDF over a sweep of tolerances.
+
+The right hand side of the user data example is split into a stiff linear
+part, treated implicitly, and a nonstiff part, treated explicitly,
+
+  y0' = [-101 y0 - 100 y1]  +  [c0]
+  y1' = [y0]                +  [c1 - a y1^3]
+         fi (implicit)          fe (explicit)
+
+The cubic damping a y1^3 stands for the nonstiff nonlinear terms of the
+scaled problems; with a = 0 the system is the one of the user data example.
+ARKode is told that fi is linear (ARKodeSetLinear), so every implicit stage
+takes a single Newton iteration with the Jacobian-vector product of the
+linear part only. CVODE integrates f = fi + fe with BDF, and its Newton
+iteration has to handle the nonlinear term too.
+
+For each tolerance both are integrated from y = (2, 1) to t = 50 with
+output every 0.5, and compared with a CVODE run at tolerance 1e-12: time,
+steps, evaluations of fi and fe, Newton iterations, linear solver setups
+and the maximum error over the output grid. Run as
+"./executable [a] [runs]".
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <arkode/arkode.h> // prototypes for ARKode fcts., consts.
+#include <arkode/arkode_spils.h> // access to ARKSpils interface
+#include <cvode/cvode.h> // prototypes for CVODE fcts., consts.
+#include <nvector/nvector_serial.h>  // access to serial N_Vector
+#include <sunlinsol/sunlinsol_spgmr.h>  //access to SPGMR SUNLinearSolver
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+#include <sundials_raii.h> // move-only owners and CVodeIntegrator
+#include <sundials_precision.h> // feasible_tolerance, precision_name
+
+// Struct for holding the nessesary additional variables for the problem.
+struct UserData {
+  realtype coeffs[2];
+  realtype a; // cubic damping of y1, in the nonstiff part
+};
+
+struct ARKodeMemFree {
+  void operator()(void *mem) const { ARKodeFree(&mem); }
+};
+typedef SunOwner<void*, ARKodeMemFree> ARKodeMemOwner;
+
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data);
+static int fi(realtype t, N_Vector u, N_Vector u_dot, void *user_data);
+static int fe(realtype t, N_Vector u, N_Vector u_dot, void *user_data);
+static int jtv(N_Vector v, N_Vector Jv, realtype t, N_Vector u, N_Vector fu,
+               void *user_data, N_Vector tmp);
+static int jtv_i(N_Vector v, N_Vector Jv, realtype t, N_Vector u,
+                 N_Vector fu, void *user_data, N_Vector tmp);
+
+static const realtype end_time = 50;
+static const realtype step_length = 0.5;
+static const realtype y_init[2] = {2, 1};
+
+typedef std::chrono::steady_clock Clock;
+
+// What one run cost, and its solution on the output grid.
+struct RunStats {
+  int flag = 0;
+  double seconds = 0; // fastest of the runs
+  long int steps = 0;
+  long int nfi = 0, nfe = 0; // implicit / explicit rhs evaluations
+  long int newton = 0; // nonlinear iterations
+  long int setups = 0; // linear solver setups
+  std::vector<realtype> y; // at every output time
+};
+
+static RunStats run_cvode(UserData *data, realtype tol, int runs) {
+  RunStats r;
+  CVodeIntegrator cv = CVodeIntegrator::spgmr(2, f, jtv, tol, tol, data);
+  sundials_check(CVodeSetMaxNumSteps(cv.mem(), 100000),
+                 "CVodeSetMaxNumSteps");
+  r.seconds = 1e30;
+  for (int run = 0; run < runs; run++) {
+    Clock::time_point start = Clock::now();
+    cv.reset(0, y_init);
+    r.y.clear();
+    realtype t;
+    for (int k = 1; k * step_length <= end_time; k++) {
+      r.flag = cv.advance(k * step_length, &t);
+      if (r.flag < 0) return r;
+      r.y.push_back(cv.y_data()[0]);
+      r.y.push_back(cv.y_data()[1]);
+    }
+    r.seconds = std::fmin(r.seconds, std::chrono::duration<double>(
+                                         Clock::now() - start).count());
+  }
+  CVodeGetNumSteps(cv.mem(), &r.steps);
+  CVodeGetNumRhsEvals(cv.mem(), &r.nfi);
+  CVodeGetNumNonlinSolvIters(cv.mem(), &r.newton);
+  CVodeGetNumLinSolvSetups(cv.mem(), &r.setups);
+  return r;
+}
+
+static RunStats run_arkode(UserData *data, realtype tol, int runs) {
+  RunStats r;
+  // Set vector of initial values.
+  NVectorOwner y = make_serial_vector(2);
+  NV_DATA_S(y.get())[0] = y_init[0];
+  NV_DATA_S(y.get())[1] = y_init[1];
+
+  // Create and initialize ARKode with both parts: ARK-IMEX.
+  ARKodeMemOwner mem(ARKodeCreate());
+  sundials_check(mem.get(), "ARKodeCreate");
+  sundials_check(ARKodeInit(mem, fe, fi, 0, y), "ARKodeInit");
+  sundials_check(ARKodeSStolerances(mem, tol, tol), "ARKodeSStolerances");
+  sundials_check(ARKodeSetUserData(mem, data), "ARKodeSetUserData");
+  sundials_check(ARKodeSetMaxNumSteps(mem, 100000), "ARKodeSetMaxNumSteps");
+  // fi is linear and does not depend on t: one Newton iteration per stage,
+  // and the Jacobian information is kept.
+  sundials_check(ARKodeSetLinear(mem, 0), "ARKodeSetLinear");
+
+  // SPGMR on the implicit part only.
+  SUNLinearSolverOwner LS(SUNSPGMR(y, PREC_NONE, 0));
+  sundials_check(LS.get(), "SUNSPGMR");
+  sundials_check(ARKSpilsSetLinearSolver(mem, LS), "ARKSpilsSetLinearSolver");
+  sundials_check(ARKSpilsSetJacTimes(mem, NULL, jtv_i), "ARKSpilsSetJacTimes");
+
+  r.seconds = 1e30;
+  for (int run = 0; run < runs; run++) {
+    Clock::time_point start = Clock::now();
+    NV_DATA_S(y.get())[0] = y_init[0];
+    NV_DATA_S(y.get())[1] = y_init[1];
+    r.flag = ARKodeReInit(mem, fe, fi, 0, y);
+    if (r.flag < 0) return r;
+    r.y.clear();
+    realtype t;
+    for (int k = 1; k * step_length <= end_time; k++) {
+      r.flag = ARKode(mem, k * step_length, y, &t, ARK_NORMAL);
+      if (r.flag < 0) return r;
+      r.y.push_back(NV_DATA_S(y.get())[0]);
+      r.y.push_back(NV_DATA_S(y.get())[1]);
+    }
+    r.seconds = std::fmin(r.seconds, std::chrono::duration<double>(
+                                         Clock::now() - start).count());
+  }
+  ARKodeGetNumSteps(mem, &r.steps);
+  ARKodeGetNumRhsEvals(mem, &r.nfe, &r.nfi);
+  ARKodeGetNumNonlinSolvIters(mem, &r.newton);
+  ARKodeGetNumLinSolvSetups(mem, &r.setups);
+  return r;
+}
+
+static realtype max_error(const std::vector<realtype> &a,
+                          const std::vector<realtype> &b) {
+  realtype e = 0;
+  for (size_t i = 0; i < a.size() && i < b.size(); i++)
+    e = std::fmax(e, std::fabs(a[i] - b[i]));
+  return e;
+}
+
+static void print_run(const char *name, realtype tol, const RunStats &r,
+                      const RunStats &reference) {
+  printf("%-10s  %6.0e  %9.3f ms  %6ld  %7ld  %7ld  %7ld  %6ld  %9.2e\n",
+         name, (double) tol, 1e3 * r.seconds, r.steps, r.nfi, r.nfe,
+         r.newton, r.setups, (double) max_error(r.y, reference.y));
+}
+
+int main(int argc, char *argv[]) {
+  UserData data = {{0.01, 0.02}, 0.5};
+  if (argc > 1) data.a = atof(argv[1]);
+  int runs = argc > 2 ? atoi(argv[2]) : 20;
+  if (runs < 1) runs = 1;
+
+  try {
+    const realtype ref_tol = feasible_tolerance(1e-12);
+    RunStats reference = run_cvode(&data, ref_tol, 1);
+    if (reference.flag < 0) {
+      fprintf(stderr, "\nSUNDIALS_ERROR: CVode() failed with flag = %d\n\n",
+              reference.flag);
+      return(1);
+    }
+    printf("a = %g, t = 0 .. %g, error against CVODE at %g\n\n",
+           (double) data.a, (double) end_time, (double) ref_tol);
+    printf("%-10s  %6s  %12s  %6s  %7s  %7s  %7s  %6s  %9s\n", "solver",
+           "tol", "time", "steps", "fi / f", "fe", "newton", "setups",
+           "max error");
+    const realtype tols[] = {1e-3, 1e-4, 1e-5, 1e-6, 1e-7, 1e-8};
+    for (realtype tol : tols) {
+      RunStats bdf = run_cvode(&data, tol, runs);
+      RunStats ark = run_arkode(&data, tol, runs);
+      if (bdf.flag < 0 || ark.flag < 0) {
+        fprintf(stderr, "\nSUNDIALS_ERROR: %s() failed with flag = %d\n\n",
+                bdf.flag < 0 ? "CVode" : "ARKode",
+                bdf.flag < 0 ? bdf.flag : ark.flag);
+        return(1);
+      }
+      print_run("cvode bdf", tol, bdf, reference);
+      print_run("ark imex", tol, ark, reference);
+    }
+  } catch (const SundialsError &e) {
+    fprintf(stderr, "\nSUNDIALS_ERROR: %s\n\n", e.what());
+    return(1);
+  }
+  return(0);
+}
+
+// Simple function that calculates the differential equation, both parts.
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data) {
+  // N_VGetArrayPointer returns a pointer to the data in the N_Vector class.
+  realtype *udata  = N_VGetArrayPointer(u); // pointer u vector data
+  realtype *dudata = N_VGetArrayPointer(u_dot); // pointer to udot vector data
+
+  // Access inforation in user_data.
+  UserData *u_data = (UserData*) user_data;
+  realtype y1 = udata[1];
+
+  dudata[0] = -101.0 * udata[0] - 100.0 * y1 + u_data->coeffs[0];
+  dudata[1] = udata[0] + u_data->coeffs[1] - u_data->a * y1 * y1 * y1;
+
+  return(0);
+}
+
+// The stiff linear part, treated implicitly.
+static int fi(realtype t, N_Vector u, N_Vector u_dot, void *user_data) {
+  realtype *udata  = N_VGetArrayPointer(u);
+  realtype *dudata = N_VGetArrayPointer(u_dot);
+
+  dudata[0] = -101.0 * udata[0] - 100.0 * udata[1];
+  dudata[1] = udata[0];
+
+  return(0);
+}
+
+// The nonstiff part, treated explicitly.
+static int fe(realtype t, N_Vector u, N_Vector u_dot, void *user_data) {
+  realtype *udata  = N_VGetArrayPointer(u);
+  realtype *dudata = N_VGetArrayPointer(u_dot);
+  UserData *u_data = (UserData*) user_data;
+  realtype y1 = udata[1];
+
+  dudata[0] = u_data->coeffs[0];
+  dudata[1] = u_data->coeffs[1] - u_data->a * y1 * y1 * y1;
+
+  return(0);
+}
+
+// Jacobian function vector routine of f.
+static int jtv(N_Vector v, N_Vector Jv, realtype t, N_Vector u, N_Vector fu,
+               void *user_data, N_Vector tmp) {
+  realtype *vdata  = N_VGetArrayPointer(v);
+  realtype *Jvdata = N_VGetArrayPointer(Jv);
+  realtype *udata  = N_VGetArrayPointer(u);
+  UserData *u_data = (UserData*) user_data;
+
+  Jvdata[0] = -101.0 * vdata[0] + -100.0 * vdata[1];
+  Jvdata[1] = vdata[0] - 3.0 * u_data->a * udata[1] * udata[1] * vdata[1];
+
+  return(0);
+}
+
+// Jacobian function vector routine of fi.
+static int jtv_i(N_Vector v, N_Vector Jv, realtype t, N_Vector u,
+                 N_Vector fu, void *user_data, N_Vector tmp) {
+  realtype *vdata  = N_VGetArrayPointer(v);
+  realtype *Jvdata = N_VGetArrayPointer(Jv);
+
+  Jvdata[0] = -101.0 * vdata[0] + -100.0 * vdata[1];
+  Jvdata[1] = vdata[0];
+
+  return(0);
+}
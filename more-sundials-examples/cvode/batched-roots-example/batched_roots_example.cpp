@@ -0,0 +1,328 @@
+/*
+Batched event functions for an ensemble integrated as one CVODE problem
+(include/cvode_batch_events.h).
+
+The ensemble consists of many copies of the 2d system of the simple CVODE
+example, each member i with its own coefficients,
+
+  y0' = -101 y0 - 100 y1 + c0_i
+  y1' = y0 + c1_i
+
+packed into one N_Vector in structure of arrays form: first y0 of all
+members, then y1 of all members. Each member has two events:
+
+  0  y1 falls through its own level in (0.3, 0.6)   - logged
+  1  y1 falls through 0.05                          - see below
+
+Part 1 compares the cost of root evaluation. The same ensemble is
+integrated from y = (2, 1) to t = 50 with output every 0.5, once with one
+scalar event function per member and event (cvode_events.h), and once with
+a single batched function that computes all events in one vectorizable
+pass. The events are only logged. Both runs must find the same events at
+the same times.
+
+Part 2 acts on single members. At event 1 a member is reset to its
+initial state the first two times, and stopped the third time, while the
+rest of the ensemble keeps running. It prints how many members were
+stopped, when, and how many CVodeReInit calls the resets took.
+
+Run as "./executable [members] [runs]".
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <cvode/cvode.h> // prototypes for CVODE fcts., consts.
+#include <nvector/nvector_serial.h>  // access to serial N_Vector
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+#include <sundials_raii.h> // move-only owners and CVodeIntegrator
+#include <cvode_events.h> // scalar event functions
+#include <cvode_batch_events.h> // batched event functions
+
+// The ensemble in structure of arrays form.
+struct Ensemble {
+  sunindextype members;
+  std::vector<realtype> c0, c1, level;
+  const realtype *active; // 1 for running members, 0 for stopped ones
+};
+
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data);
+static int jtv(N_Vector v, N_Vector Jv, realtype t, N_Vector u, N_Vector fu,
+               void *user_data, N_Vector tmp);
+
+static const realtype reltol = 1e-5;
+static const realtype abstol = 1e-5;
+static const realtype end_time = 50;
+static const realtype step_length = 0.5;
+static const realtype low_level = 0.05;
+static const int nevents = 2;
+
+// Both events of all members in one pass.
+static void events_batch(realtype t, const realtype *y, sunindextype m,
+                         realtype *gout, void *data) {
+  const Ensemble *e = (const Ensemble*) data;
+  const realtype *Y1 = y + m, *L = e->level.data();
+  realtype *G0 = gout, *G1 = gout + m;
+  for (sunindextype i = 0; i < m; i++) {
+    G0[i] = Y1[i] - L[i];
+    G1[i] = Y1[i] - low_level;
+  }
+}
+
+// One event of one member, for the scalar comparison.
+struct ScalarEvent {
+  const Ensemble *ensemble;
+  sunindextype member;
+  int event;
+};
+
+static realtype event_scalar(realtype t, const realtype *y, void *data) {
+  const ScalarEvent *s = (const ScalarEvent*) data;
+  realtype y1 = y[s->ensemble->members + s->member];
+  if (s->event == 0) return y1 - s->ensemble->level[s->member];
+  return y1 - low_level;
+}
+
+static Ensemble make_ensemble(sunindextype m, const realtype *active) {
+  Ensemble e;
+  e.members = m;
+  e.c0.resize(m);
+  e.c1.resize(m);
+  e.level.resize(m);
+  for (sunindextype i = 0; i < m; i++) {
+    e.c0[i] = 0.01 * std::sin(0.1 * i);
+    e.c1[i] = 0.02 * ((i % 7) / 7.0 - 0.5);
+    e.level[i] = 0.3 + 0.3 * i / m;
+  }
+  e.active = active;
+  return e;
+}
+
+static void initial_state(realtype *y, sunindextype m) {
+  for (sunindextype i = 0; i < m; i++) {
+    y[i] = 2;
+    y[m + i] = 1;
+  }
+}
+
+// The outcome of one part 1 run.
+struct RunResult {
+  int flag = CV_SUCCESS;
+  double seconds = 0; // per run
+  long int steps = 0;
+  long int evaluations = 0; // root function calls per run
+  std::vector<EventRecord> events; // of the last run
+};
+
+static RunResult run_scalar(sunindextype m, int runs) {
+  RunResult r;
+  std::vector<realtype> ones(m, 1);
+  Ensemble e = make_ensemble(m, ones.data());
+  CVodeIntegrator cv = CVodeIntegrator::spgmr(2 * m, f, jtv, reltol, abstol,
+                                              &e);
+  EventEngine events(cv.mem(), cv.y(), 4 * m);
+  // Slot k * m + i, as in the batched layout.
+  std::vector<ScalarEvent> scalars(nevents * m);
+  for (int k = 0; k < nevents; k++) {
+    for (sunindextype i = 0; i < m; i++) {
+      ScalarEvent &s = scalars[k * m + i];
+      s.ensemble = &e;
+      s.member = i;
+      s.event = k;
+      events.add(event_scalar, &s, EventDirection::Falling);
+    }
+  }
+  std::vector<realtype> y0(2 * m);
+  initial_state(y0.data(), m);
+
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point start = Clock::now();
+  for (int run = 0; run < runs; run++) {
+    cv.reset(0, y0.data());
+    events.log().clear();
+    realtype t;
+    for (int k = 1; k * step_length <= end_time; k++) {
+      r.flag = events.advance(k * step_length, &t);
+      if (r.flag < 0) return r;
+    }
+  }
+  r.seconds = std::chrono::duration<double>(Clock::now() - start).count() /
+              runs;
+  CVodeGetNumSteps(cv.mem(), &r.steps);
+  // One root function call evaluates all nevents * m events.
+  r.evaluations = events.evaluations() / (nevents * m) / runs;
+  for (size_t i = 0; i < events.log().size(); i++)
+    r.events.push_back(events.log()[i]);
+  return r;
+}
+
+static RunResult run_batched(sunindextype m, int runs) {
+  RunResult r;
+  std::vector<realtype> ones(m, 1);
+  Ensemble e = make_ensemble(m, ones.data());
+  CVodeIntegrator cv = CVodeIntegrator::spgmr(2 * m, f, jtv, reltol, abstol,
+                                              &e);
+  std::vector<realtype> y0(2 * m);
+  initial_state(y0.data(), m);
+
+  BatchEventEngine events(cv.mem(), cv.y(), m, 2, nevents, events_batch, &e,
+                          reltol, abstol, 4 * m);
+  events.set_direction(0, EventDirection::Falling);
+  events.set_direction(1, EventDirection::Falling);
+
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point start = Clock::now();
+  for (int run = 0; run < runs; run++) {
+    cv.reset(0, y0.data());
+    events.log().clear();
+    realtype t;
+    for (int k = 1; k * step_length <= end_time; k++) {
+      do {
+        r.flag = events.advance(k * step_length, &t);
+      } while (r.flag == CV_ROOT_RETURN);
+      if (r.flag < 0) return r;
+    }
+  }
+  r.seconds = std::chrono::duration<double>(Clock::now() - start).count() /
+              runs;
+  CVodeGetNumSteps(cv.mem(), &r.steps);
+  r.evaluations = events.evaluations() / runs;
+  for (size_t i = 0; i < events.log().size(); i++)
+    r.events.push_back(events.log()[i]);
+  return r;
+}
+
+// Part 2: reset members twice at event 1, then stop them.
+static int run_policy(sunindextype m) {
+  std::vector<realtype> placeholder(m, 1);
+  Ensemble e = make_ensemble(m, placeholder.data());
+  CVodeIntegrator cv = CVodeIntegrator::spgmr(2 * m, f, jtv, reltol, abstol,
+                                              &e);
+  std::vector<realtype> y0(2 * m);
+  initial_state(y0.data(), m);
+  cv.reset(0, y0.data());
+  BatchEventEngine events(cv.mem(), cv.y(), m, 2, nevents, events_batch, &e,
+                          reltol, abstol, 4 * m);
+  e.active = events.active();
+  events.set_direction(0, EventDirection::Falling);
+  events.set_direction(1, EventDirection::Falling);
+
+  std::vector<int> resets(m, 0);
+  long int level_crossings = 0, event_returns = 0;
+  const realtype kick[2] = {2, 1};
+  realtype t = 0;
+  int flag = CV_SUCCESS;
+  for (int k = 1; k * step_length <= end_time; k++) {
+    while ((flag = events.advance(k * step_length, &t)) == CV_ROOT_RETURN) {
+      event_returns++;
+      for (const MemberEvent &ev : events.triggered()) {
+        if (ev.event == 0) {
+          level_crossings++;
+        } else if (resets[ev.member] < 2) {
+          resets[ev.member]++;
+          events.reset_member(ev.member, kick);
+        } else {
+          events.stop_member(ev.member);
+        }
+      }
+    }
+    if (flag < 0) {
+      fprintf(stderr, "\nSUNDIALS_ERROR: CVode() failed with flag = %d\n\n",
+              flag);
+      return(1);
+    }
+  }
+
+  realtype first = end_time, last = 0;
+  for (sunindextype i = 0; i < m; i++) {
+    if (!events.stopped(i)) continue;
+    first = std::fmin(first, events.stop_time(i));
+    last = std::fmax(last, events.stop_time(i));
+  }
+  printf("members stopped: %zu of %ld", events.num_stopped(), (long int) m);
+  if (events.num_stopped() > 0)
+    printf(", between t = %.3f and t = %.3f", (double) first, (double) last);
+  printf("\nlevel crossings logged: %ld\n", level_crossings);
+  printf("member resets: %ld in %ld CVodeReInit calls (%ld event returns)\n",
+         events.resets(), events.reinits(), event_returns);
+  return(0);
+}
+
+int main(int argc, char *argv[]) {
+  long int members = argc > 1 ? atol(argv[1]) : 1000;
+  int runs = argc > 2 ? atoi(argv[2]) : 5;
+  if (members < 1) members = 1;
+  if (runs < 1) runs = 1;
+
+  try {
+    RunResult scalar = run_scalar(members, runs);
+    RunResult batched = run_batched(members, runs);
+    if (scalar.flag < 0 || batched.flag < 0) {
+      fprintf(stderr, "\nSUNDIALS_ERROR: CVode() failed with flag = %d\n\n",
+              scalar.flag < 0 ? scalar.flag : batched.flag);
+      return(1);
+    }
+    bool same = scalar.events.size() == batched.events.size();
+    realtype max_dt = 0;
+    for (size_t i = 0; same && i < scalar.events.size(); i++) {
+      same = scalar.events[i].event == batched.events[i].event;
+      max_dt = std::fmax(max_dt, std::fabs(scalar.events[i].t -
+                                           batched.events[i].t));
+    }
+
+    printf("%ld members, %d events each, %d runs\n\n", members, nevents,
+           runs);
+    printf("root functions  time/run     steps  evaluations  events\n");
+    printf("scalar        %9.3f ms  %7ld  %11ld  %6zu\n",
+           1e3 * scalar.seconds, scalar.steps, scalar.evaluations,
+           scalar.events.size());
+    printf("batched       %9.3f ms  %7ld  %11ld  %6zu\n",
+           1e3 * batched.seconds, batched.steps, batched.evaluations,
+           batched.events.size());
+    printf("speedup %.2fx, same events: %s (max time difference %g)\n\n",
+           scalar.seconds / batched.seconds, same ? "yes" : "no",
+           (double) max_dt);
+
+    if (run_policy(members) != 0) return(1);
+  } catch (const SundialsError &e) {
+    fprintf(stderr, "\nSUNDIALS_ERROR: %s\n\n", e.what());
+    return(1);
+  }
+  return(0);
+}
+
+// The differential equation of all members in one pass. Stopped members
+// have a zero derivative.
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data) {
+  const Ensemble *e = (const Ensemble*) user_data;
+  const sunindextype m = e->members;
+  const realtype *Y0 = N_VGetArrayPointer(u), *Y1 = Y0 + m;
+  realtype *D0 = N_VGetArrayPointer(u_dot), *D1 = D0 + m;
+  const realtype *C0 = e->c0.data(), *C1 = e->c1.data(), *A = e->active;
+
+  for (sunindextype i = 0; i < m; i++) {
+    D0[i] = A[i] * (-101.0 * Y0[i] - 100.0 * Y1[i] + C0[i]);
+    D1[i] = A[i] * (Y0[i] + C1[i]);
+  }
+
+  return(0);
+}
+
+// Jacobian function vector routine, block by block.
+static int jtv(N_Vector v, N_Vector Jv, realtype t, N_Vector u, N_Vector fu,
+               void *user_data, N_Vector tmp) {
+  const Ensemble *e = (const Ensemble*) user_data;
+  const sunindextype m = e->members;
+  const realtype *V0 = N_VGetArrayPointer(v), *V1 = V0 + m;
+  realtype *J0 = N_VGetArrayPointer(Jv), *J1 = J0 + m;
+  const realtype *A = e->active;
+
+  for (sunindextype i = 0; i < m; i++) {
+    J0[i] = A[i] * (-101.0 * V0[i] + -100.0 * V1[i]);
+    J1[i] = A[i] * V0[i];
+  }
+
+  return(0);
+}
@@ -0,0 +1,193 @@
+/*
+A simulated 1 kHz control loop around CVODE, comparing blocking CVode calls
+with deadline-bounded stepping (include/cvode_deadline.h).
+
+The plant is the 2d system of the user data example with the first
+coefficient as control input u:
+
+  y0' = -101 y0 - 100 y1 + u
+  y1' = y0 + c1
+
+Every tick (1 ms of simulated time) a controller reads the state, sets u to
+track a square-wave reference for y1, and asks the integrator to advance to
+the next tick. The jumps of the reference make CVODE fail and shrink steps,
+which is where a blocking CVode(..., CV_NORMAL) call stalls the loop.
+
+The right hand side spins for rhs_cost microseconds to stand in for an
+expensive plant model; with the bare 2d system every call would finish far
+within any budget. Run as "./executable [budget_us] [rhs_cost_us] [ticks]".
+*/
+
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cvode/cvode.h> // prototypes for CVODE fcts., consts.
+#include <nvector/nvector_serial.h>  // access to serial N_Vector
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+#include <sundials/sundials_math.h>  // contains the macros ABS, SUNSQR, EXP
+#include <sundials_raii.h> // move-only owners and CVodeIntegrator
+#include <cvode_deadline.h> // deadline-bounded stepping
+
+
+// Struct for holding the nessesary additional variables for the problem.
+struct UserData {
+  realtype coeffs[2]; // coeffs[0] is the control input u
+  double rhs_cost_us; // artificial cost of one right hand side evaluation
+};
+
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data);
+static int jtv(N_Vector v, N_Vector Jv, realtype t, N_Vector u, N_Vector fu,
+               void *user_data, N_Vector tmp);
+
+static const realtype tick = 1e-3; // simulated time per control period
+static const realtype reltol = 1e-5;
+static const realtype abstol = 1e-5;
+
+// Square wave between 0 and 1 with a period of 0.5 s.
+static realtype reference(realtype t) {
+  return std::fmod(t, 0.5) < 0.25 ? 0 : 1;
+}
+
+// Feedforward for the equilibrium y1 = ref plus proportional feedback.
+static realtype control(realtype t, const realtype *y, realtype c1) {
+  realtype ref = reference(t);
+  return 100 * ref - 101 * c1 + 50 * (ref - y[1]);
+}
+
+// Latency statistics of one run of the loop.
+struct LoopReport {
+  long int ticks = 0;
+  long int misses = 0; // ticks whose call did not reach the tick time
+  long int overruns = 0; // ticks whose call exceeded the budget
+  double worst_us = 0; // worst-case call latency
+  double mean_us = 0;
+  realtype max_lag = 0; // largest gap between tick time and state time
+  realtype tracking_error = 0; // RMS of ref - y1 over the ticks
+};
+
+static void print_report(const char *mode, const LoopReport &r) {
+  printf("%-10s %7ld %9ld %10.1f %10.1f %12.2e %10.4f\n", mode, r.misses,
+         r.overruns, r.mean_us, r.worst_us, (double) r.max_lag,
+         (double) r.tracking_error);
+}
+
+// Blocking mode: one CVode(..., CV_NORMAL) call per tick. A tick counts as
+// missed when the call takes longer than the budget.
+static LoopReport run_blocking(CVodeIntegrator &cv, UserData &data,
+                               long int ticks, double budget) {
+  const realtype y0[2] = {0, 0};
+  cv.reset(0, y0);
+  LoopReport rep;
+  realtype t = 0, err2 = 0;
+  for (long int k = 1; k <= ticks; k++) {
+    data.coeffs[0] = control(t, cv.y_data(), data.coeffs[1]);
+    auto start = std::chrono::steady_clock::now();
+    int flag = cv.advance(k * tick, &t);
+    double s = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    if (flag < 0) break;
+    rep.ticks++;
+    rep.mean_us += s * 1e6;
+    if (s * 1e6 > rep.worst_us) rep.worst_us = s * 1e6;
+    if (s > budget) {
+      rep.misses++;
+      rep.overruns++;
+    }
+    realtype e = reference(t) - cv.y_data()[1];
+    err2 += e * e;
+  }
+  if (rep.ticks) rep.mean_us /= rep.ticks;
+  rep.tracking_error = std::sqrt(err2 / SUNMAX(rep.ticks, 1));
+  return rep;
+}
+
+// Deadline mode: each tick advances as far as the budget allows. The
+// controller acts on the state at the time actually reached.
+static LoopReport run_deadline(CVodeIntegrator &cv, UserData &data,
+                               long int ticks, double budget) {
+  const realtype y0[2] = {0, 0};
+  cv.reset(0, y0);
+  DeadlineStepper stepper(cv.mem(), cv.y());
+  LoopReport rep;
+  realtype t = 0, err2 = 0;
+  for (long int k = 1; k <= ticks; k++) {
+    data.coeffs[0] = control(t, cv.y_data(), data.coeffs[1]);
+    DeadlineResult r = stepper.advance(k * tick, budget);
+    if (r.flag < 0) break;
+    t = r.t;
+    rep.ticks++;
+    realtype lag = k * tick - t;
+    if (lag > rep.max_lag) rep.max_lag = lag;
+    realtype e = reference(t) - cv.y_data()[1];
+    err2 += e * e;
+  }
+  const DeadlineStats &s = stepper.stats();
+  rep.misses = s.misses;
+  rep.overruns = s.overruns;
+  rep.worst_us = s.worst_seconds * 1e6;
+  rep.mean_us = s.calls ? s.total_seconds * 1e6 / s.calls : 0;
+  rep.tracking_error = std::sqrt(err2 / SUNMAX(rep.ticks, 1));
+  return rep;
+}
+
+int main(int argc, char *argv[]) {
+  double budget_us = argc > 1 ? atof(argv[1]) : 200;
+  double rhs_cost_us = argc > 2 ? atof(argv[2]) : 5;
+  long int ticks = argc > 3 ? atol(argv[3]) : 5000;
+  if (budget_us <= 0 || rhs_cost_us < 0 || ticks < 1) {
+    fprintf(stderr, "usage: %s [budget_us] [rhs_cost_us] [ticks]\n", argv[0]);
+    return(1);
+  }
+
+  UserData data = {{0, 0.02}, rhs_cost_us};
+  try {
+    CVodeIntegrator cv = CVodeIntegrator::spgmr(2, f, jtv, reltol, abstol,
+                                                &data);
+    printf("%ld ticks of %g ms, budget %.0f us per tick, rhs cost %.1f us\n\n",
+           ticks, (double) tick * 1e3, budget_us, rhs_cost_us);
+    printf("mode        misses  overruns  mean [us] worst [us]      max lag"
+           "  rms error\n");
+    print_report("blocking", run_blocking(cv, data, ticks, budget_us * 1e-6));
+    print_report("deadline", run_deadline(cv, data, ticks, budget_us * 1e-6));
+  } catch (const SundialsError &e) {
+    fprintf(stderr, "\nSUNDIALS_ERROR: %s\n\n", e.what());
+    return(1);
+  }
+  return(0);
+}
+
+// Simple function that calculates the differential equation.
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data) {
+  // N_VGetArrayPointer returns a pointer to the data in the N_Vector class.
+  realtype *udata  = N_VGetArrayPointer(u); // pointer u vector data
+  realtype *dudata = N_VGetArrayPointer(u_dot); // pointer to udot vector data
+
+  // Access inforation in user_data.
+  UserData *u_data = (UserData*) user_data;
+
+  dudata[0] = -101.0 * udata[0] - 100.0 * udata[1] + u_data->coeffs[0];
+  dudata[1] = udata[0] + u_data->coeffs[1];
+
+  // Stand-in for an expensive model evaluation.
+  if (u_data->rhs_cost_us > 0) {
+    auto until = std::chrono::steady_clock::now() +
+                 std::chrono::nanoseconds((long) (u_data->rhs_cost_us * 1e3));
+    while (std::chrono::steady_clock::now() < until) {}
+  }
+
+  return(0);
+}
+
+// Jacobian function vector routine.
+static int jtv(N_Vector v, N_Vector Jv, realtype t, N_Vector u, N_Vector fu,
+               void *user_data, N_Vector tmp) {
+  realtype *vdata  = N_VGetArrayPointer(v);
+  realtype *Jvdata = N_VGetArrayPointer(Jv);
+
+  Jvdata[0] = -101.0 * vdata[0] + -100.0 * vdata[1];
+  Jvdata[1] = vdata[0];
+
+  return(0);
+}
@@ -0,0 +1,232 @@
+/*
+Event detection with CVODE rootfinding (include/cvode_events.h).
+
+Part 1 is a bouncing ball,
+
+  h' = v
+  v' = -9.81
+
+with three events: the ground contact (h falls through 0) resets the
+velocity to -0.8 v and stops once the rebound is slower than 0.5 m/s, the
+apex (v falls through 0) is only logged, and a time limit stops the run
+at t = 20 in any case. The event log is printed at the end.
+
+Part 2 measures the cost of events on the 2d system of the user data
+example,
+
+  y0' = -101 y0 - 100 y1 + c0
+  y1' = y0 + c1
+
+integrated from y = (2, 1) to t = 50 with output every 0.5. There are 1,
+100 or 10,000 events at levels spread over (0, 0.9) that fire when y1
+falls through them, once as thresholds and once as event functions. Every
+event fires once per run. For each count, the time per run, the internal
+steps, the event evaluations and the events logged are compared with a
+run without events. Run as "./executable [runs]".
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <cvode/cvode.h> // prototypes for CVODE fcts., consts.
+#include <nvector/nvector_serial.h>  // access to serial N_Vector
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+#include <sundials_raii.h> // move-only owners and CVodeIntegrator
+#include <cvode_events.h> // event functions, actions and log
+
+// Struct for holding the nessesary additional variables for the problem.
+struct UserData {
+  realtype coeffs[2];
+};
+
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data);
+static int jtv(N_Vector v, N_Vector Jv, realtype t, N_Vector u, N_Vector fu,
+               void *user_data, N_Vector tmp);
+static int ball(realtype t, N_Vector u, N_Vector u_dot, void *user_data);
+
+static const realtype reltol = 1e-5;
+static const realtype abstol = 1e-5;
+static const realtype end_time = 50;
+static const realtype step_length = 0.5;
+
+// Ground contact: reflect the ball, stop when it barely bounces.
+static bool bounce(realtype t, realtype *y, void *data) {
+  y[0] = 0;
+  y[1] = -0.8 * y[1];
+  return y[1] > 0.5;
+}
+
+static realtype time_limit(realtype t, const realtype *y, void *data) {
+  return *(const realtype*) data - t;
+}
+
+// y1 - level as an event function, for comparison with a threshold.
+static realtype y1_below(realtype t, const realtype *y, void *data) {
+  return y[1] - *(const realtype*) data;
+}
+
+static int bouncing_ball() {
+  CVodeIntegrator cv = CVodeIntegrator::dense(2, ball, NULL, 1e-8, 1e-8);
+  const realtype y0[2] = {10, 0};
+  cv.reset(0, y0);
+
+  EventEngine events(cv.mem(), cv.y());
+  realtype limit = 20;
+  int ground = events.add_threshold(0, 0, EventDirection::Falling,
+                                    EventAction::Reset, bounce);
+  int apex = events.add_threshold(1, 0, EventDirection::Falling);
+  int timeout = events.add(time_limit, &limit, EventDirection::Falling,
+                           EventAction::Stop);
+  const char *names[] = {"ground", "apex", "time limit"};
+
+  realtype t = 0;
+  int flag = CV_SUCCESS;
+  for (int k = 1; k * step_length <= limit + step_length; k++) {
+    flag = events.advance(k * step_length, &t);
+    if (flag != CV_SUCCESS) break;
+  }
+  if (flag < 0) {
+    fprintf(stderr, "\nSUNDIALS_ERROR: CVode() failed with flag = %d\n\n",
+            flag);
+    return(1);
+  }
+
+  printf("bouncing ball: stopped at t = %.4f after %ld bounces and %ld "
+         "apexes\n", (double) t, events.count(ground), events.count(apex));
+  if (events.count(timeout) > 0) printf("(time limit reached)\n");
+  const EventLog &log = events.log();
+  for (size_t i = 0; i < log.size(); i++) {
+    if (i == 6 && log.size() > 12) {
+      printf("  ...\n");
+      i = log.size() - 6;
+    }
+    printf("  t = %8.4f  %-10s %s\n", (double) log[i].t,
+           names[log[i].event], log[i].direction > 0 ? "rising" : "falling");
+  }
+  printf("\n");
+  return(0);
+}
+
+// The cost of one configuration of the benchmark.
+struct BenchResult {
+  int flag = CV_SUCCESS;
+  double seconds = 0; // per run
+  long int steps = 0; // per run
+  long int evaluations = 0; // event evaluations per run
+  uint64_t fired = 0; // events logged per run
+};
+
+// Runs the user data problem runs times with nevents events on y1.
+static BenchResult bench(int nevents, bool as_functions, int runs) {
+  BenchResult r;
+  UserData data = {{0, 0}};
+  CVodeIntegrator cv = CVodeIntegrator::spgmr(2, f, jtv, reltol, abstol,
+                                              &data);
+  EventEngine events(cv.mem(), cv.y(), 16384);
+  std::vector<realtype> levels(nevents);
+  for (int i = 0; i < nevents; i++) {
+    levels[i] = 0.9 * (i + 0.5) / nevents;
+    if (as_functions)
+      events.add(y1_below, &levels[i], EventDirection::Falling);
+    else
+      events.add_threshold(1, levels[i], EventDirection::Falling);
+  }
+
+  const realtype y0[2] = {2, 1};
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point start = Clock::now();
+  for (int run = 0; run < runs; run++) {
+    cv.reset(0, y0);
+    events.log().clear();
+    realtype t;
+    for (int k = 1; k * step_length <= end_time; k++) {
+      r.flag = events.advance(k * step_length, &t);
+      if (r.flag < 0) return r;
+    }
+  }
+  r.seconds = std::chrono::duration<double>(Clock::now() - start).count() /
+              runs;
+  CVodeGetNumSteps(cv.mem(), &r.steps);
+  r.evaluations = events.evaluations() / runs;
+  r.fired = events.log().total();
+  return r;
+}
+
+int main(int argc, char *argv[]) {
+  int runs = argc > 1 ? atoi(argv[1]) : 20;
+  if (runs < 1) runs = 1;
+
+  try {
+    if (bouncing_ball() != 0) return(1);
+
+    BenchResult none = bench(0, false, runs);
+    if (none.flag < 0) {
+      fprintf(stderr, "\nSUNDIALS_ERROR: CVode() failed with flag = %d\n\n",
+              none.flag);
+      return(1);
+    }
+    printf("events  kind        time/run    vs none    steps   "
+           "evaluations   fired\n");
+    printf("%6d  %-9s %9.3f ms  %8s  %7ld  %12ld  %6llu\n", 0, "-",
+           1e3 * none.seconds, "", none.steps, 0L, 0ULL);
+    const int counts[] = {1, 100, 10000};
+    for (int nevents : counts) {
+      for (int as_functions = 0; as_functions < 2; as_functions++) {
+        BenchResult r = bench(nevents, as_functions != 0,
+                              nevents >= 10000 ? 1 : runs);
+        if (r.flag < 0) {
+          fprintf(stderr, "\nSUNDIALS_ERROR: CVode() failed with flag = "
+                  "%d\n\n", r.flag);
+          return(1);
+        }
+        printf("%6d  %-9s %9.3f ms  %7.1fx  %7ld  %12ld  %6llu\n", nevents,
+               as_functions ? "function" : "threshold", 1e3 * r.seconds,
+               r.seconds / none.seconds, r.steps, r.evaluations,
+               (unsigned long long) r.fired);
+      }
+    }
+  } catch (const SundialsError &e) {
+    fprintf(stderr, "\nSUNDIALS_ERROR: %s\n\n", e.what());
+    return(1);
+  }
+  return(0);
+}
+
+// Simple function that calculates the differential equation.
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data) {
+  // N_VGetArrayPointer returns a pointer to the data in the N_Vector class.
+  realtype *udata  = N_VGetArrayPointer(u); // pointer u vector data
+  realtype *dudata = N_VGetArrayPointer(u_dot); // pointer to udot vector data
+
+  // Access inforation in user_data.
+  UserData *u_data = (UserData*) user_data;
+
+  dudata[0] = -101.0 * udata[0] - 100.0 * udata[1] + u_data->coeffs[0];
+  dudata[1] = udata[0] + u_data->coeffs[1];
+
+  return(0);
+}
+
+// Jacobian function vector routine.
+static int jtv(N_Vector v, N_Vector Jv, realtype t, N_Vector u, N_Vector fu,
+               void *user_data, N_Vector tmp) {
+  realtype *vdata  = N_VGetArrayPointer(v);
+  realtype *Jvdata = N_VGetArrayPointer(Jv);
+
+  Jvdata[0] = -101.0 * vdata[0] + -100.0 * vdata[1];
+  Jvdata[1] = vdata[0];
+
+  return(0);
+}
+
+// The bouncing ball between contacts: height and velocity.
+static int ball(realtype t, N_Vector u, N_Vector u_dot, void *user_data) {
+  realtype *udata  = N_VGetArrayPointer(u);
+  realtype *dudata = N_VGetArrayPointer(u_dot);
+
+  dudata[0] = udata[1];
+  dudata[1] = -9.81;
+
+  return(0);
+}
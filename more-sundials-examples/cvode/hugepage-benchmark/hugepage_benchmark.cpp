@@ -0,0 +1,310 @@
+/*
+Benchmark of CVODE with SPGMR on vectors backed by 2 MB huge pages
+(include/nvector_hugepage.h) against ordinary serial vectors.
+
+The problem is the ensemble of the precision benchmark: copies of the 2d
+system of the user data example, each copy i with its own coefficients,
+
+  y0_i' = -101 y0_i - 100 y1_i + c0_i
+  y1_i' = y0_i + c1_i
+
+integrated as one system from y = (2, 1) to t = 50. With millions of copies
+CVODE and SPGMR hold a few dozen vectors of tens of megabytes each, and
+every step sweeps through most of them, so a 4 kB page takes a TLB miss for
+every 512 doubles touched.
+
+The same integration runs with the state vector from
+
+  serial       N_VNew_Serial, malloc
+  small        N_VNew_HugePage with HugePageMode::Off (MADV_NOHUGEPAGE)
+  transparent  N_VNew_HugePage with HugePageMode::Transparent
+  hugetlb      N_VNew_HugePage with HugePageMode::HugeTLB
+  auto         N_VNew_HugePage with HugePageMode::Auto
+
+and every vector CVODE and SPGMR clone from it. For each the table lists
+where the vectors got their pages, the memory on transparent huge pages
+(AnonHugePages in /proc/self/smaps_rollup), the best wall time of the runs,
+and the dTLB load and store misses of that run from perf_event_open. The
+counters read n/a where the kernel does not allow them
+(/proc/sys/kernel/perf_event_paranoid) or the CPU has no such event. The
+last column checks that all variants compute the same solution.
+
+Run as "./executable [copies] [runs]".
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cvode/cvode.h> // prototypes for CVODE fcts., consts.
+#include <nvector/nvector_serial.h>  // access to serial N_Vector
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+#include <sundials_raii.h> // move-only owners and CVodeIntegrator
+#include <nvector_hugepage.h> // N_Vector on huge pages
+
+// Struct for holding the nessesary additional variables for the problem.
+struct UserData {
+  sunindextype copies;
+  std::vector<realtype> c0, c1; // coefficients of every copy
+};
+
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data);
+static int jtv(N_Vector v, N_Vector Jv, realtype t, N_Vector u, N_Vector fu,
+               void *user_data, N_Vector tmp);
+
+static const realtype end_time = 50;
+static const realtype step_length = 5;
+static const realtype tol = 1e-5;
+
+typedef std::chrono::steady_clock Clock;
+
+// A hardware event counter of this process in user mode. value() is -1 if
+// the counter could not be opened.
+class EventCounter {
+ public:
+  EventCounter(uint32_t type, uint64_t config) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd_ = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+  ~EventCounter() { if (fd_ >= 0) close(fd_); }
+
+  EventCounter(const EventCounter&) = delete;
+  EventCounter& operator=(const EventCounter&) = delete;
+
+  void start() {
+    if (fd_ < 0) return;
+    ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  void stop() {
+    if (fd_ >= 0) ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+  }
+  long long value() const {
+    long long count;
+    if (fd_ < 0 || read(fd_, &count, sizeof(count)) != sizeof(count))
+      return -1;
+    return count;
+  }
+
+ private:
+  int fd_;
+};
+
+static uint64_t dtlb_miss(uint64_t op) {
+  return PERF_COUNT_HW_CACHE_DTLB | (op << 8) |
+         ((uint64_t) PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+// The number on a "Name: value" line of a file in /proc, or -1.
+static double proc_value(const char *file, const char *name) {
+  FILE *fp = fopen(file, "r");
+  if (fp == NULL) return -1;
+  char line[256];
+  double value = -1;
+  const size_t len = strlen(name);
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    if (strncmp(line, name, len) == 0 && line[len] == ':') {
+      value = atof(line + len + 1);
+      break;
+    }
+  }
+  fclose(fp);
+  return value;
+}
+
+struct RunResult {
+  double seconds = 1e30; // fastest of the runs
+  long long load_misses = -1, store_misses = -1; // of the fastest run
+  long int steps = 0;
+  HugePageStats pages;
+  double thp_mb = -1; // on transparent huge pages while the vectors live
+  std::vector<realtype> y; // solution at end_time
+};
+
+// Integrates with the state vector y and its clones; y is NULL for plain
+// serial vectors.
+static RunResult run(UserData &data, NVectorOwner y, int runs) {
+  RunResult r;
+  const sunindextype N = 2 * data.copies;
+  hugepage_clear_stats();
+  CVodeIntegrator cv = y ? CVodeIntegrator::spgmr(std::move(y), f, jtv, tol,
+                                                  tol, &data)
+                         : CVodeIntegrator::spgmr(N, f, jtv, tol, tol,
+                                                  &data);
+  sundials_check(CVodeSetMaxNumSteps(cv.mem(), 100000),
+                 "CVodeSetMaxNumSteps");
+  std::vector<realtype> y0(N);
+  for (sunindextype i = 0; i < data.copies; i++) {
+    y0[2 * i] = 2;
+    y0[2 * i + 1] = 1;
+  }
+
+  EventCounter loads(PERF_TYPE_HW_CACHE,
+                     dtlb_miss(PERF_COUNT_HW_CACHE_OP_READ));
+  EventCounter stores(PERF_TYPE_HW_CACHE,
+                      dtlb_miss(PERF_COUNT_HW_CACHE_OP_WRITE));
+  for (int k = 0; k < runs; k++) {
+    // The first run also faults the pages in; later runs find them mapped.
+    cv.reset(0, y0.data());
+    realtype t;
+    loads.start();
+    stores.start();
+    Clock::time_point start = Clock::now();
+    for (int j = 1; j * step_length <= end_time; j++) {
+      int flag = cv.advance(j * step_length, &t);
+      if (flag < 0) throw SundialsError("CVode", flag);
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() -
+                                                   start).count();
+    loads.stop();
+    stores.stop();
+    if (seconds < r.seconds) {
+      r.seconds = seconds;
+      r.load_misses = loads.value();
+      r.store_misses = stores.value();
+    }
+  }
+  CVodeGetNumSteps(cv.mem(), &r.steps);
+  r.pages = hugepage_stats();
+  double kb = proc_value("/proc/self/smaps_rollup", "AnonHugePages");
+  if (kb >= 0) r.thp_mb = kb / 1024;
+  r.y.assign(cv.y_data(), cv.y_data() + N);
+  return r;
+}
+
+static void print_count(long long count) {
+  if (count < 0)
+    printf("  %11s", "n/a");
+  else
+    printf("  %11.4g", (double) count);
+}
+
+int main(int argc, char *argv[]) {
+  long int copies = argc > 1 ? atol(argv[1]) : 2000000;
+  int runs = argc > 2 ? atoi(argv[2]) : 3;
+  if (copies < 1) copies = 1;
+  if (runs < 1) runs = 1;
+
+  UserData data;
+  data.copies = copies;
+  data.c0.resize(copies);
+  data.c1.resize(copies);
+  for (sunindextype i = 0; i < copies; i++) {
+    data.c0[i] = 0.01 * (1 + 0.5 * std::sin(0.1 * i));
+    data.c1[i] = 0.02 * (1 + 0.5 * std::cos(0.1 * i));
+  }
+
+  const double mb = 2.0 * copies * sizeof(realtype) / (1 << 20);
+  printf("%ld copies (%ld equations, %.1f MB per vector), best of %d runs\n",
+         copies, 2 * copies, mb, runs);
+  FILE *fp = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+  char thp[128] = "unavailable\n";
+  if (fp != NULL) {
+    if (fgets(thp, sizeof(thp), fp) == NULL) strcpy(thp, "unknown\n");
+    fclose(fp);
+  }
+  printf("transparent huge pages: %s", thp);
+  const double pages = proc_value("/proc/meminfo", "HugePages_Total");
+  if (pages >= 0) {
+    const double page_mb = proc_value("/proc/meminfo", "Hugepagesize") / 1024;
+    printf("hugetlb pool: %.0f MB free of %.0f MB\n", page_mb *
+           proc_value("/proc/meminfo", "HugePages_Free"), page_mb * pages);
+  }
+  printf("\n");
+
+  struct Variant {
+    const char *name;
+    bool hugepage;
+    HugePageMode mode;
+  };
+  const Variant variants[] = {
+    {"serial", false, HugePageMode::Auto},
+    {"small", true, HugePageMode::Off},
+    {"transparent", true, HugePageMode::Transparent},
+    {"hugetlb", true, HugePageMode::HugeTLB},
+    {"auto", true, HugePageMode::Auto},
+  };
+
+  printf("%-11s  %15s  %7s  %12s  %11s  %11s  %6s  %9s\n", "vectors",
+         "hugetlb/thp/4k", "THP MB", "time", "dTLB ld mis",
+         "dTLB st mis", "steps", "max diff");
+  try {
+    std::vector<realtype> first;
+    for (const Variant &v : variants) {
+      hugepage_set_mode(v.mode);
+      NVectorOwner y;
+      if (v.hugepage) y = make_hugepage_vector(2 * copies);
+      RunResult r = run(data, std::move(y), runs);
+      if (first.empty()) first = r.y;
+      realtype diff = 0;
+      for (size_t i = 0; i < r.y.size(); i++)
+        diff = std::fmax(diff, std::fabs(r.y[i] - first[i]));
+
+      char pages[32] = "-";
+      if (v.hugepage)
+        snprintf(pages, sizeof(pages), "%ld/%ld/%ld", r.pages.hugetlb,
+                 r.pages.transparent, r.pages.small + r.pages.heap);
+      printf("%-11s  %15s", v.name, pages);
+      if (r.thp_mb < 0)
+        printf("  %7s", "n/a");
+      else
+        printf("  %7.0f", r.thp_mb);
+      printf("  %9.3f ms", 1e3 * r.seconds);
+      print_count(r.load_misses);
+      print_count(r.store_misses);
+      printf("  %6ld  %9.2e\n", r.steps, (double) diff);
+    }
+  } catch (const SundialsError &e) {
+    fprintf(stderr, "\nSUNDIALS_ERROR: %s\n\n", e.what());
+    return(1);
+  }
+  return(0);
+}
+
+// Simple function that calculates the differential equation.
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data) {
+  // N_VGetArrayPointer returns a pointer to the data in the N_Vector class.
+  realtype *udata  = N_VGetArrayPointer(u); // pointer u vector data
+  realtype *dudata = N_VGetArrayPointer(u_dot); // pointer to udot vector data
+
+  // Access inforation in user_data.
+  const UserData *u_data = (const UserData*) user_data;
+  const realtype *c0 = u_data->c0.data(), *c1 = u_data->c1.data();
+
+  for (sunindextype i = 0; i < u_data->copies; i++) {
+    realtype y0 = udata[2 * i], y1 = udata[2 * i + 1];
+    dudata[2 * i] = RCONST(-101.0) * y0 - RCONST(100.0) * y1 + c0[i];
+    dudata[2 * i + 1] = y0 + c1[i];
+  }
+
+  return(0);
+}
+
+// Jacobian function vector routine.
+static int jtv(N_Vector v, N_Vector Jv, realtype t, N_Vector u, N_Vector fu,
+               void *user_data, N_Vector tmp) {
+  realtype *vdata  = N_VGetArrayPointer(v);
+  realtype *Jvdata = N_VGetArrayPointer(Jv);
+  const UserData *u_data = (const UserData*) user_data;
+
+  for (sunindextype i = 0; i < u_data->copies; i++) {
+    realtype v0 = vdata[2 * i], v1 = vdata[2 * i + 1];
+    Jvdata[2 * i] = RCONST(-101.0) * v0 - RCONST(100.0) * v1;
+    Jvdata[2 * i + 1] = v0;
+  }
+
+  return(0);
+}
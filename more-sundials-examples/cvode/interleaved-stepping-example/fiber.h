@@ -0,0 +1,82 @@
+/*
+A minimal stackful coroutine (fiber) on top of ucontext.
+
+CVODE calls the right hand side from deep inside CVode, through C stack
+frames that a stackless C++20 coroutine can not suspend. A fiber has its own
+stack, so the right hand side callback can yield to the scheduler in the
+middle of a CVode call and be resumed later with the result.
+
+A Fiber is resumed by its owner and yields back with Fiber::yield() from
+anywhere inside its body. It must not be moved once created (the saved
+context points into the object), so hold it by pointer. Exceptions must
+not leave the body.
+*/
+
+#ifndef FIBER_H
+#define FIBER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <ucontext.h>
+
+class Fiber {
+ public:
+  Fiber(std::function<void()> body, size_t stack_size)
+      : body_(std::move(body)), stack_(new char[stack_size]) {
+    getcontext(&context_);
+    context_.uc_stack.ss_sp = stack_.get();
+    context_.uc_stack.ss_size = stack_size;
+    context_.uc_link = NULL;
+    // makecontext only passes int arguments, so the pointer is split.
+    uint64_t self = (uint64_t) (uintptr_t) this;
+    makecontext(&context_, (void (*)()) trampoline, 2,
+                (unsigned) (self & 0xffffffffu), (unsigned) (self >> 32));
+  }
+
+  Fiber(const Fiber&) = delete;
+  Fiber& operator=(const Fiber&) = delete;
+
+  // Runs the body until its next yield or its end. Returns false once the
+  // body has finished.
+  bool resume() {
+    if (finished_) return false;
+    Fiber *outer = current();
+    current() = this;
+    swapcontext(&caller_, &context_);
+    current() = outer;
+    return !finished_;
+  }
+
+  bool finished() const { return finished_; }
+
+  // Suspends the running fiber and returns to the resume() that started it.
+  static void yield() {
+    Fiber *self = current();
+    swapcontext(&self->context_, &self->caller_);
+  }
+
+ private:
+  static void trampoline(unsigned lo, unsigned hi) {
+    Fiber *self = (Fiber*) (uintptr_t) (((uint64_t) hi << 32) | lo);
+    self->body_();
+    self->finished_ = true;
+    swapcontext(&self->context_, &self->caller_);
+  }
+
+  std::function<void()> body_;
+  std::unique_ptr<char[]> stack_;
+  ucontext_t context_;
+  ucontext_t caller_;
+  bool finished_ = false;
+
+  // The fiber running on this thread, NULL outside of any fiber.
+  static Fiber *&current() {
+    static thread_local Fiber *running = NULL;
+    return running;
+  }
+};
+
+#endif
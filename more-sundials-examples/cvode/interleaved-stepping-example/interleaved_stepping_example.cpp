@@ -0,0 +1,305 @@
+/*
+Interleaved stepping of many CVODE integrators in lockstep, with their right
+hand side evaluations batched.
+
+Each agent is a copy of the 2d system of the user data example with its own
+coefficients and initial condition. All agents are advanced to a shared
+sequence of sync times (0.5, 1.0, ..., 50). Two schedules are compared:
+
+  blocking     - for each sync time, one CVode(..., CV_NORMAL) call per agent;
+                 the right hand side is evaluated per agent as usual
+  interleaved  - every agent runs as a coroutine on its own fiber (fiber.h).
+                 Its right hand side callback does not compute anything: it
+                 posts (t, y) and yields. The scheduler collects the pending
+                 evaluations of all agents, packs them into structure of
+                 arrays form, evaluates them in one vectorizable loop and
+                 resumes the agents. An agent also yields when it reaches
+                 the sync time.
+
+The agents take identical steps under both schedules, which is checked on
+the final states. Run as "./executable [agents]".
+*/
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cvode/cvode.h> // prototypes for CVODE fcts., consts.
+#include <nvector/nvector_serial.h>  // access to serial N_Vector
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+#include <sundials_raii.h> // move-only owners and CVodeIntegrator
+#include "fiber.h"
+
+
+// Struct for holding the nessesary additional variables for the problem.
+struct UserData {
+  realtype coeffs[2];
+};
+
+// Where a coroutine agent stopped when it yielded.
+enum class YieldPoint { Rhs, Output, Done, Failed };
+
+// One agent of the interleaved schedule. The CVODE user data is the agent
+// itself, so f_yield can post the pending evaluation into it.
+struct Agent {
+  UserData data;
+  CVodeIntegrator cv;
+  std::unique_ptr<Fiber> fiber;
+  YieldPoint at = YieldPoint::Rhs;
+  int flag = CV_SUCCESS;
+  // The pending right hand side evaluation while at == YieldPoint::Rhs.
+  realtype rhs_t = 0;
+  const realtype *rhs_y = NULL;
+  realtype *rhs_ydot = NULL;
+
+  Agent(const UserData &d, realtype reltol, realtype abstol);
+};
+
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data);
+static int f_yield(realtype t, N_Vector u, N_Vector u_dot, void *user_data);
+static int jtv(N_Vector v, N_Vector Jv, realtype t, N_Vector u, N_Vector fu,
+               void *user_data, N_Vector tmp);
+
+Agent::Agent(const UserData &d, realtype reltol, realtype abstol)
+    : data(d),
+      cv(CVodeIntegrator::spgmr(2, f_yield, jtv, reltol, abstol, this)) {}
+
+// Right hand sides of all pending agents in structure of arrays form. The
+// loop has no dependencies between iterations and vectorizes.
+struct RhsBatch {
+  std::vector<Agent*> agents;
+  std::vector<realtype> y0, y1, c0, c1, d0, d1;
+
+  explicit RhsBatch(size_t capacity) {
+    agents.reserve(capacity);
+    for (std::vector<realtype> *v : {&y0, &y1, &c0, &c1, &d0, &d1})
+      v->resize(capacity);
+  }
+
+  void evaluate() {
+    const size_t n = agents.size();
+    for (size_t i = 0; i < n; i++) {
+      const Agent *a = agents[i];
+      y0[i] = a->rhs_y[0];
+      y1[i] = a->rhs_y[1];
+      c0[i] = a->data.coeffs[0];
+      c1[i] = a->data.coeffs[1];
+    }
+    const realtype *Y0 = y0.data(), *Y1 = y1.data();
+    const realtype *C0 = c0.data(), *C1 = c1.data();
+    realtype *D0 = d0.data(), *D1 = d1.data();
+    for (size_t i = 0; i < n; i++) {
+      D0[i] = -101.0 * Y0[i] - 100.0 * Y1[i] + C0[i];
+      D1[i] = Y0[i] + C1[i];
+    }
+    for (size_t i = 0; i < n; i++) {
+      agents[i]->rhs_ydot[0] = d0[i];
+      agents[i]->rhs_ydot[1] = d1[i];
+    }
+  }
+};
+
+// Scheduler statistics of the interleaved run.
+struct ScheduleStats {
+  long int batches = 0; // batched right hand side evaluations
+  long int evaluations = 0; // agent right hand sides in all batches
+  long int resumes = 0; // coroutine switches into an agent
+};
+
+// The coefficients and initial condition of agent i, spread around the
+// values of the user data example.
+static UserData agent_data(int i) {
+  UserData d = {{(realtype) (0.01 * (1 + i % 7)),
+                 (realtype) (0.02 * (1 + i % 5))}};
+  return d;
+}
+static void agent_y0(int i, realtype y0[2]) {
+  y0[0] = 2.0 + 0.001 * (i % 13);
+  y0[1] = 1.0 - 0.001 * (i % 11);
+}
+
+static const realtype reltol = 1e-5;
+static const realtype abstol = 1e-5;
+static const realtype end_time = 50;
+static const realtype step_length = 0.5;
+static const size_t fiber_stack = 64 * 1024;
+
+// Blocking schedule: one CVode call per agent and sync time.
+static int run_blocking(int nagents, std::vector<realtype> &y_end) {
+  std::vector<UserData> data(nagents);
+  std::vector<CVodeIntegrator> cvs;
+  cvs.reserve(nagents);
+  for (int i = 0; i < nagents; i++) {
+    data[i] = agent_data(i);
+    realtype y0[2];
+    agent_y0(i, y0);
+    cvs.push_back(CVodeIntegrator::spgmr(2, f, jtv, reltol, abstol,
+                                         &data[i]));
+    cvs.back().reset(0, y0);
+  }
+
+  realtype t;
+  for (realtype tout = step_length; tout <= end_time; tout += step_length) {
+    for (int i = 0; i < nagents; i++) {
+      int flag = cvs[i].advance(tout, &t);
+      if (flag < 0) {
+        fprintf(stderr, "\nSUNDIALS_ERROR: CVode() failed with flag = %d"
+                " for agent %d\n\n", flag, i);
+        return(1);
+      }
+    }
+  }
+  for (int i = 0; i < nagents; i++) {
+    y_end[2 * i] = cvs[i].y_data()[0];
+    y_end[2 * i + 1] = cvs[i].y_data()[1];
+  }
+  return(0);
+}
+
+// Interleaved schedule: agents are coroutines, right hand sides are batched.
+static int run_interleaved(int nagents, std::vector<realtype> &y_end,
+                           ScheduleStats *stats) {
+  std::vector<realtype> sync_times;
+  for (realtype tout = step_length; tout <= end_time; tout += step_length)
+    sync_times.push_back(tout);
+
+  std::vector<std::unique_ptr<Agent>> agents;
+  for (int i = 0; i < nagents; i++) {
+    agents.emplace_back(new Agent(agent_data(i), reltol, abstol));
+    Agent *a = agents.back().get();
+    realtype y0[2];
+    agent_y0(i, y0);
+    a->cv.reset(0, y0);
+    // The coroutine body: advance to every sync time and yield there.
+    a->fiber.reset(new Fiber([a, &sync_times] {
+      realtype t;
+      for (realtype tout : sync_times) {
+        a->flag = a->cv.advance(tout, &t);
+        if (a->flag < 0) {
+          a->at = YieldPoint::Failed;
+          return;
+        }
+        a->at = YieldPoint::Output;
+        Fiber::yield();
+      }
+      a->at = YieldPoint::Done;
+    }, fiber_stack));
+  }
+
+  RhsBatch batch(nagents);
+  std::vector<Agent*> pending;
+  pending.reserve(nagents);
+  for (size_t k = 0; k < sync_times.size(); k++) {
+    // Start every agent towards the sync time, then keep serving their
+    // right hand side requests in batches until all of them got there.
+    pending.clear();
+    for (std::unique_ptr<Agent> &a : agents) pending.push_back(a.get());
+    while (!pending.empty()) {
+      batch.agents.clear();
+      for (Agent *a : pending) {
+        a->fiber->resume();
+        stats->resumes++;
+        if (a->at == YieldPoint::Rhs) batch.agents.push_back(a);
+        else if (a->at == YieldPoint::Failed) {
+          fprintf(stderr, "\nSUNDIALS_ERROR: CVode() failed with flag = %d\n\n",
+                  a->flag);
+          return(1);
+        }
+      }
+      if (batch.agents.empty()) break;
+      batch.evaluate();
+      stats->batches++;
+      stats->evaluations += batch.agents.size();
+      pending.swap(batch.agents);
+    }
+  }
+
+  for (int i = 0; i < nagents; i++) {
+    y_end[2 * i] = agents[i]->cv.y_data()[0];
+    y_end[2 * i + 1] = agents[i]->cv.y_data()[1];
+  }
+  return(0);
+}
+
+int main(int argc, char *argv[]) {
+  int nagents = argc > 1 ? atoi(argv[1]) : 1000;
+  if (nagents < 1) nagents = 1;
+
+  std::vector<realtype> y_blocking(2 * nagents), y_interleaved(2 * nagents);
+  ScheduleStats stats;
+  double t_blocking, t_interleaved;
+  try {
+    auto start = std::chrono::steady_clock::now();
+    if (run_blocking(nagents, y_blocking)) return(1);
+    auto mid = std::chrono::steady_clock::now();
+    if (run_interleaved(nagents, y_interleaved, &stats)) return(1);
+    auto stop = std::chrono::steady_clock::now();
+    t_blocking = std::chrono::duration<double>(mid - start).count();
+    t_interleaved = std::chrono::duration<double>(stop - mid).count();
+  } catch (const SundialsError &e) {
+    fprintf(stderr, "\nSUNDIALS_ERROR: %s\n\n", e.what());
+    return(1);
+  }
+
+  realtype max_diff = 0;
+  for (int i = 0; i < 2 * nagents; i++)
+    max_diff = std::fmax(max_diff, std::fabs(y_blocking[i] - y_interleaved[i]));
+
+  printf("%d agents, %d sync times\n\n", nagents,
+         (int) (end_time / step_length));
+  printf("schedule       time [s]\n");
+  printf("blocking     %10.4f\n", t_blocking);
+  printf("interleaved  %10.4f\n\n", t_interleaved);
+  printf("rhs batches %ld, mean batch size %.1f, coroutine resumes %ld\n",
+         stats.batches,
+         stats.batches ? (double) stats.evaluations / stats.batches : 0.0,
+         stats.resumes);
+  printf("scheduling overhead per resume: %.3f us\n",
+         stats.resumes ? (t_interleaved - t_blocking) * 1e6 / stats.resumes
+                       : 0.0);
+  printf("max difference of the final states: %g\n", (double) max_diff);
+  return max_diff == 0 ? 0 : 1;
+}
+
+// Simple function that calculates the differential equation.
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data) {
+  // N_VGetArrayPointer returns a pointer to the data in the N_Vector class.
+  realtype *udata  = N_VGetArrayPointer(u); // pointer u vector data
+  realtype *dudata = N_VGetArrayPointer(u_dot); // pointer to udot vector data
+
+  // Access inforation in user_data.
+  UserData *u_data = (UserData*) user_data;
+
+  dudata[0] = -101.0 * udata[0] - 100.0 * udata[1] + u_data->coeffs[0];
+  dudata[1] = udata[0] + u_data->coeffs[1];
+
+  return(0);
+}
+
+// Right hand side of a coroutine agent: post the evaluation and yield. The
+// scheduler has filled u_dot when the agent is resumed.
+static int f_yield(realtype t, N_Vector u, N_Vector u_dot, void *user_data) {
+  Agent *a = (Agent*) user_data;
+  a->rhs_t = t;
+  a->rhs_y = N_VGetArrayPointer(u);
+  a->rhs_ydot = N_VGetArrayPointer(u_dot);
+  a->at = YieldPoint::Rhs;
+  Fiber::yield();
+  return(0);
+}
+
+// Jacobian function vector routine. The Jacobian is constant, so this is
+// cheap enough to evaluate inline rather than through the scheduler.
+static int jtv(N_Vector v, N_Vector Jv, realtype t, N_Vector u, N_Vector fu,
+               void *user_data, N_Vector tmp) {
+  realtype *vdata  = N_VGetArrayPointer(v);
+  realtype *Jvdata = N_VGetArrayPointer(Jv);
+
+  Jvdata[0] = -101.0 * vdata[0] + -100.0 * vdata[1];
+  Jvdata[1] = vdata[0];
+
+  return(0);
+}
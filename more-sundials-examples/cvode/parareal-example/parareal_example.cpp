@@ -0,0 +1,209 @@
+/*
+Parareal integration of one long trajectory on several threads
+(include/cvode_parareal.h).
+
+The system is the 2d system of the user data example, repeated for a number
+of copies with different coefficients so that one trajectory is worth
+parallelizing,
+
+  y0' = -101 y0 - 100 y1 + c0_i
+  y1' = y0 + c1_i
+
+integrated from y = (2, 1) to t = 50 with output every 0.5. The same output
+grid is computed
+
+  plain     - by one CVode run at the fine tolerances
+  parareal  - with the interval split into time slices, fine CVODE runs on
+              all slices in parallel, and a coarse propagator for the
+              corrections: either CVODE at loose tolerances, or backward
+              Euler (BDF of order 1) at looser ones.
+
+Both are compared with a reference run at tight tolerances, so the speedup
+is measured at matched accuracy. Run as
+"./executable [threads] [copies] [runs]".
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include <cvode/cvode.h> // prototypes for CVODE fcts., consts.
+#include <nvector/nvector_serial.h>  // access to serial N_Vector
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+#include <sundials_raii.h> // move-only owners and CVodeIntegrator
+#include <sundials_precision.h> // feasible_tolerance, precision_name
+#include <cvode_parareal.h> // parallel in time driver
+
+// Struct for holding the nessesary additional variables for the problem.
+struct UserData {
+  sunindextype copies;
+  std::vector<realtype> coeffs; // c0 and c1 of each copy
+};
+
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data);
+static int jtv(N_Vector v, N_Vector Jv, realtype t, N_Vector u, N_Vector fu,
+               void *user_data, N_Vector tmp);
+
+static const realtype fine_tol = 1e-8;
+static const realtype end_time = 50;
+static const realtype step_length = 0.5;
+
+typedef std::chrono::steady_clock Clock;
+
+// Plain sequential CVode over the output grid at tol. Returns the seconds
+// of the fastest of runs runs.
+static double plain(UserData &data, realtype tol, int runs,
+                    const std::vector<realtype> &times, realtype *out,
+                    long int *steps) {
+  const sunindextype N = 2 * data.copies;
+  CVodeIntegrator cv = CVodeIntegrator::spgmr(N, f, jtv, tol, tol, &data);
+  sundials_check(CVodeSetMaxNumSteps(cv.mem(), 100000),
+                 "CVodeSetMaxNumSteps");
+  std::vector<realtype> y0(N);
+  for (sunindextype i = 0; i < data.copies; i++) {
+    y0[2 * i] = 2;
+    y0[2 * i + 1] = 1;
+  }
+  double best = 1e30;
+  for (int run = 0; run < runs; run++) {
+    Clock::time_point start = Clock::now();
+    cv.reset(0, y0.data());
+    realtype t;
+    for (size_t j = 0; j < times.size(); j++) {
+      int flag = cv.advance(times[j], &t);
+      if (flag < 0) throw SundialsError("CVode", flag);
+      std::copy(cv.y_data(), cv.y_data() + N, out + j * N);
+    }
+    best = std::fmin(best, std::chrono::duration<double>(Clock::now() -
+                                                          start).count());
+  }
+  CVodeGetNumSteps(cv.mem(), steps);
+  return best;
+}
+
+static realtype max_error(const std::vector<realtype> &a,
+                          const std::vector<realtype> &b) {
+  realtype e = 0;
+  for (size_t i = 0; i < a.size(); i++)
+    e = std::fmax(e, std::fabs(a[i] - b[i]));
+  return e;
+}
+
+int main(int argc, char *argv[]) {
+  int threads = argc > 1 ? atoi(argv[1]) : 0;
+  long int copies = argc > 2 ? atol(argv[2]) : 2000;
+  int runs = argc > 3 ? atoi(argv[3]) : 3;
+  if (threads < 1) threads = (int) std::thread::hardware_concurrency();
+  if (threads < 1) threads = 1;
+  if (copies < 1) copies = 1;
+  if (runs < 1) runs = 1;
+
+  UserData data;
+  data.copies = copies;
+  data.coeffs.resize(2 * copies);
+  for (long int i = 0; i < copies; i++) {
+    data.coeffs[2 * i] = 0.01 * (1 + 0.5 * std::sin(0.1 * i));
+    data.coeffs[2 * i + 1] = 0.02 * (1 + 0.5 * std::cos(0.1 * i));
+  }
+  const sunindextype N = 2 * copies;
+  std::vector<realtype> times;
+  for (int k = 1; k * step_length <= end_time; k++)
+    times.push_back(k * step_length);
+  std::vector<realtype> y0(N);
+  for (long int i = 0; i < copies; i++) {
+    y0[2 * i] = 2;
+    y0[2 * i + 1] = 1;
+  }
+
+  try {
+    std::vector<realtype> reference(times.size() * N), out(times.size() * N);
+    long int steps;
+    const realtype ref_tol = feasible_tolerance(1e-12);
+    plain(data, ref_tol, 1, times, reference.data(), &steps);
+    double plain_seconds = plain(data, fine_tol, runs, times, out.data(),
+                                 &steps);
+    realtype plain_error = max_error(out, reference);
+
+    printf("%ld copies (%ld equations), %d threads, t = 0 .. %g\n\n", copies,
+           (long int) N, threads, (double) end_time);
+    printf("method    coarse   slices  iter   time/run    speedup  "
+           "fine steps  coarse steps   max error\n");
+    printf("plain     -        %6d  %4s  %8.3f ms  %8s  %10ld  %12s  %10.2e\n",
+           1, "-", 1e3 * plain_seconds, "", steps, "-", (double) plain_error);
+
+    struct Coarse {
+      const char *name;
+      int order;
+      realtype tol;
+    };
+    const Coarse coarse[] = {{"loose", 5, 1e-4}, {"euler", 1, 1e-2}};
+    const int slice_factors[] = {1, 2, 4};
+    for (const Coarse &c : coarse) {
+      for (int factor : slice_factors) {
+        PararealOptions options;
+        options.slices = factor * threads;
+        options.threads = threads;
+        options.fine_reltol = options.fine_abstol = fine_tol;
+        options.coarse_reltol = options.coarse_abstol = c.tol;
+        options.coarse_order = c.order;
+        Parareal parareal(N, f, jtv, &data, options);
+
+        PararealStats stats;
+        double best = 1e30;
+        for (int run = 0; run < runs; run++) {
+          Clock::time_point start = Clock::now();
+          stats = parareal.solve(0, y0.data(), end_time, times, out.data());
+          best = std::fmin(best, std::chrono::duration<double>(
+                                     Clock::now() - start).count());
+        }
+        printf("parareal  %-7s  %6d  %4d%s %8.3f ms  %7.2fx  %10ld  %12ld  "
+               "%10.2e\n", c.name, options.slices, stats.iterations,
+               stats.converged ? " " : "*", 1e3 * best, plain_seconds / best,
+               stats.fine_steps, stats.coarse_steps,
+               (double) max_error(out, reference));
+      }
+    }
+    printf("\n(* not converged)  max error: against a run at tolerance "
+           "%g over the output grid\n", (double) ref_tol);
+  } catch (const SundialsError &e) {
+    fprintf(stderr, "\nSUNDIALS_ERROR: %s\n\n", e.what());
+    return(1);
+  }
+  return(0);
+}
+
+// Simple function that calculates the differential equation.
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data) {
+  // N_VGetArrayPointer returns a pointer to the data in the N_Vector class.
+  realtype *udata  = N_VGetArrayPointer(u); // pointer u vector data
+  realtype *dudata = N_VGetArrayPointer(u_dot); // pointer to udot vector data
+
+  // Access inforation in user_data.
+  const UserData *u_data = (const UserData*) user_data;
+  const realtype *c = u_data->coeffs.data();
+
+  for (sunindextype i = 0; i < 2 * u_data->copies; i += 2) {
+    dudata[i] = -101.0 * udata[i] - 100.0 * udata[i + 1] + c[i];
+    dudata[i + 1] = udata[i] + c[i + 1];
+  }
+
+  return(0);
+}
+
+// Jacobian function vector routine.
+static int jtv(N_Vector v, N_Vector Jv, realtype t, N_Vector u, N_Vector fu,
+               void *user_data, N_Vector tmp) {
+  realtype *vdata  = N_VGetArrayPointer(v);
+  realtype *Jvdata = N_VGetArrayPointer(Jv);
+  const UserData *u_data = (const UserData*) user_data;
+
+  for (sunindextype i = 0; i < 2 * u_data->copies; i += 2) {
+    Jvdata[i] = -101.0 * vdata[i] + -100.0 * vdata[i + 1];
+    Jvdata[i + 1] = vdata[i];
+  }
+
+  return(0);
+}
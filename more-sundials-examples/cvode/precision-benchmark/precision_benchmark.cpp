@@ -0,0 +1,191 @@
+/*
+Benchmark of one driver built against SUNDIALS in single, double and
+extended precision (realtype float, double or long double).
+
+The problem is a large ensemble of copies of the 2d system of the user
+data example, each copy i with its own coefficients,
+
+  y0_i' = -101 y0_i - 100 y1_i + c0_i
+  y1_i' = y0_i + c1_i
+
+integrated as one system with SPGMR from y = (2, 1) to t = 50. With
+hundreds of thousands of copies every step streams vectors far larger than
+the caches, so the run is bound by memory bandwidth, and realtype sets how
+many bytes each vector operation moves. The system is linear with
+eigenvalues -1 and -100, so every copy has a closed form solution; the
+errors are measured against it in long double at every output time,
+whatever the precision of the build.
+
+Tolerances below what the precision can resolve are raised to
+feasible_tolerance (include/sundials_precision.h) and marked with a *.
+Build the three variants and compare them with "make compare", or run one
+as "./executable [copies] [runs]".
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <cvode/cvode.h> // prototypes for CVODE fcts., consts.
+#include <nvector/nvector_serial.h>  // access to serial N_Vector
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+#include <sundials_raii.h> // move-only owners and CVodeIntegrator
+#include <sundials_precision.h> // feasible_tolerance, precision_name
+
+// Struct for holding the nessesary additional variables for the problem.
+struct UserData {
+  sunindextype copies;
+  std::vector<realtype> c0, c1; // coefficients of every copy
+};
+
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data);
+static int jtv(N_Vector v, N_Vector Jv, realtype t, N_Vector u, N_Vector fu,
+               void *user_data, N_Vector tmp);
+
+static const realtype end_time = 50;
+static const realtype step_length = 5;
+
+typedef std::chrono::steady_clock Clock;
+
+// The exact solution of copy i at t, in long double. With A the matrix of
+// the system, y* = -A^-1 c and
+//   exp(A t) = ((A + 100 I) e^-t - (A + I) e^-100t) / 99.
+static void exact(const UserData &data, sunindextype i, long double t,
+                  long double y[2]) {
+  const long double c0 = data.c0[i], c1 = data.c1[i];
+  const long double s0 = -c1, s1 = (c0 + 101 * c1) / 100;
+  const long double d0 = 2 - s0, d1 = 1 - s1;
+  const long double e1 = std::exp(-t) / 99, e100 = std::exp(-100 * t) / 99;
+  y[0] = s0 + e1 * (-d0 - 100 * d1) - e100 * (-100 * d0 - 100 * d1);
+  y[1] = s1 + e1 * (d0 + 100 * d1) - e100 * (d0 + d1);
+}
+
+struct RunResult {
+  double seconds = 1e30; // fastest of the runs, CVode calls only
+  long int steps = 0, rhs_evals = 0;
+  long double max_error = 0; // max norm over all copies and output times
+};
+
+static RunResult run(UserData &data, realtype tol, int runs) {
+  RunResult r;
+  const sunindextype N = 2 * data.copies;
+  CVodeIntegrator cv = CVodeIntegrator::spgmr(N, f, jtv, tol, tol, &data);
+  sundials_check(CVodeSetMaxNumSteps(cv.mem(), 100000),
+                 "CVodeSetMaxNumSteps");
+  std::vector<realtype> y0(N);
+  for (sunindextype i = 0; i < data.copies; i++) {
+    y0[2 * i] = 2;
+    y0[2 * i + 1] = 1;
+  }
+
+  for (int k = 0; k < runs; k++) {
+    cv.reset(0, y0.data());
+    double seconds = 0;
+    realtype t;
+    for (int j = 1; j * step_length <= end_time; j++) {
+      Clock::time_point start = Clock::now();
+      int flag = cv.advance(j * step_length, &t);
+      seconds += std::chrono::duration<double>(Clock::now() - start).count();
+      if (flag < 0) throw SundialsError("CVode", flag);
+      if (k > 0) continue;
+      // The error check is not timed, and one run is enough for it.
+      const realtype *y = cv.y_data();
+      for (sunindextype i = 0; i < data.copies; i++) {
+        long double ye[2];
+        exact(data, i, t, ye);
+        long double e0 = std::fabs(y[2 * i] - ye[0]);
+        long double e1 = std::fabs(y[2 * i + 1] - ye[1]);
+        if (e0 > r.max_error) r.max_error = e0;
+        if (e1 > r.max_error) r.max_error = e1;
+      }
+    }
+    r.seconds = std::fmin(r.seconds, seconds);
+  }
+  CVodeGetNumSteps(cv.mem(), &r.steps);
+  CVodeGetNumRhsEvals(cv.mem(), &r.rhs_evals);
+  return r;
+}
+
+int main(int argc, char *argv[]) {
+  long int copies = argc > 1 ? atol(argv[1]) : 250000;
+  int runs = argc > 2 ? atoi(argv[2]) : 3;
+  if (copies < 1) copies = 1;
+  if (runs < 1) runs = 1;
+
+  UserData data;
+  data.copies = copies;
+  data.c0.resize(copies);
+  data.c1.resize(copies);
+  for (sunindextype i = 0; i < copies; i++) {
+    data.c0[i] = 0.01 * (1 + 0.5 * std::sin(0.1 * i));
+    data.c1[i] = 0.02 * (1 + 0.5 * std::cos(0.1 * i));
+  }
+
+  const double mb = 2.0 * copies * sizeof(realtype) / (1 << 20);
+  printf("%s precision: realtype of %d bytes, unit roundoff %.2e\n",
+         precision_name(), (int) sizeof(realtype), (double) UNIT_ROUNDOFF);
+  printf("%ld copies (%ld equations, %.1f MB per vector), best of %d runs"
+         "\n\n", copies, 2 * copies, mb, runs);
+  printf("%-9s  %8s  %12s  %6s  %9s  %10s  %9s  %9s\n", "precision",
+         "tol", "time", "steps", "rhs evals", "ns/eq/step", "max error",
+         "error/tol");
+
+  try {
+    const realtype tols[] = {1e-3, 1e-4, 1e-5, 1e-6, 1e-8};
+    realtype previous = 0;
+    for (realtype wanted : tols) {
+      realtype tol = feasible_tolerance(wanted);
+      if (tol == previous) continue;
+      previous = tol;
+      RunResult r = run(data, tol, runs);
+      printf("%-9s  %7.1e%s  %9.3f ms  %6ld  %9ld  %10.2f  %9.2e  %9.2f\n",
+             precision_name(), (double) tol, tol != wanted ? "*" : " ",
+             1e3 * r.seconds, r.steps, r.rhs_evals,
+             1e9 * r.seconds / ((double) r.steps * 2 * copies),
+             (double) r.max_error, (double) (r.max_error / tol));
+    }
+  } catch (const SundialsError &e) {
+    fprintf(stderr, "\nSUNDIALS_ERROR: %s\n\n", e.what());
+    return(1);
+  }
+  return(0);
+}
+
+// Simple function that calculates the differential equation.
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data) {
+  // N_VGetArrayPointer returns a pointer to the data in the N_Vector class.
+  realtype *udata  = N_VGetArrayPointer(u); // pointer u vector data
+  realtype *dudata = N_VGetArrayPointer(u_dot); // pointer to udot vector data
+
+  // Access inforation in user_data.
+  const UserData *u_data = (const UserData*) user_data;
+  const realtype *c0 = u_data->c0.data(), *c1 = u_data->c1.data();
+
+  // RCONST gives the literals the type of realtype, so a single precision
+  // build does not compute in double.
+
+  for (sunindextype i = 0; i < u_data->copies; i++) {
+    realtype y0 = udata[2 * i], y1 = udata[2 * i + 1];
+    dudata[2 * i] = RCONST(-101.0) * y0 - RCONST(100.0) * y1 + c0[i];
+    dudata[2 * i + 1] = y0 + c1[i];
+  }
+
+  return(0);
+}
+
+// Jacobian function vector routine.
+static int jtv(N_Vector v, N_Vector Jv, realtype t, N_Vector u, N_Vector fu,
+               void *user_data, N_Vector tmp) {
+  realtype *vdata  = N_VGetArrayPointer(v);
+  realtype *Jvdata = N_VGetArrayPointer(Jv);
+  const UserData *u_data = (const UserData*) user_data;
+
+  for (sunindextype i = 0; i < u_data->copies; i++) {
+    realtype v0 = vdata[2 * i], v1 = vdata[2 * i + 1];
+    Jvdata[2 * i] = RCONST(-101.0) * v0 - RCONST(100.0) * v1;
+    Jvdata[2 * i + 1] = v0;
+  }
+
+  return(0);
+}
@@ -0,0 +1,257 @@
+/*
+Benchmark of the RAII wrapper in include/sundials_raii.h against the raw C
+API on the stiff 2d ODE of src/simple_cvode_example.cpp.
+
+The problem is integrated over the same output grid (0.5, 1.0, ..., 50) many
+times in three ways:
+
+  raw/create  - CVodeCreate ... CVodeFree around every run, as the examples do
+  raw/reinit  - one set of raw objects, CVodeReInit before every run
+  wrapper     - one CVodeIntegrator, reset() before every run
+
+raw/reinit and wrapper do the same work and should take the same time; the
+difference to raw/create is what reusing the allocations saves. The final
+states of all three are compared to check they take identical steps.
+
+Run as "./executable [runs]".
+*/
+
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cvode/cvode.h> // prototypes for CVODE fcts., consts.
+#include <nvector/nvector_serial.h>  // access to serial N_Vector
+#include <sunlinsol/sunlinsol_spgmr.h>  //access to SPGMR SUNLinearSolver
+#include <cvode/cvode_spils.h> // access to CVSpils interface
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+#include <sundials_raii.h> // move-only owners and CVodeIntegrator
+
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data);
+static int jtv(N_Vector v, N_Vector Jv, realtype t, N_Vector u, N_Vector fu,
+               void *user_data, N_Vector tmp);
+static int check_flag(void *flagvalue, const char *funcname, int opt);
+
+static const sunindextype N = 2;
+static const realtype y_0[N] = {2.0, 1.0};
+static const realtype reltol = 1e-5;
+static const realtype abstol = 1e-5;
+static const realtype end_time = 50;
+static const realtype step_length = 0.5;
+
+// The outcome of one variant: best time per run over the rounds, steps of
+// the last run and its final state.
+struct VariantResult {
+  double seconds_per_run = 1e30;
+  long int nsteps = 0;
+  realtype y_end[N] = {0, 0};
+};
+
+// Integrates over the output grid; returns the last CVode flag.
+template <typename Advance>
+static int integrate(Advance advance) {
+  int flag = CV_SUCCESS;
+  realtype t = 0;
+  for (realtype tout = step_length; tout <= end_time; tout += step_length) {
+    flag = advance(tout, &t);
+    if (flag < 0) break;
+  }
+  return flag;
+}
+
+// raw/create: the full setup of the examples around every run.
+static int run_raw_create(int runs, VariantResult *result) {
+  int flag;
+  for (int r = 0; r < runs; r++) {
+    N_Vector y = N_VNew_Serial(N);
+    if (check_flag((void *)y, "N_VNew_Serial", 0)) return(1);
+    for (sunindextype i = 0; i < N; i++) NV_Ith_S(y, i) = y_0[i];
+    void *cvode_mem = CVodeCreate(CV_BDF, CV_NEWTON);
+    if (check_flag((void *)cvode_mem, "CVodeCreate", 0)) return(1);
+    flag = CVodeInit(cvode_mem, f, 0, y);
+    if (check_flag(&flag, "CVodeInit", 1)) return(1);
+    flag = CVodeSStolerances(cvode_mem, reltol, abstol);
+    if (check_flag(&flag, "CVodeSStolerances", 1)) return(1);
+    SUNLinearSolver LS = SUNSPGMR(y, 0, 0);
+    if (check_flag((void *)LS, "SUNSPGMR", 0)) return(1);
+    flag = CVSpilsSetLinearSolver(cvode_mem, LS);
+    if (check_flag(&flag, "CVSpilsSetLinearSolver", 1)) return(1);
+    flag = CVSpilsSetJacTimes(cvode_mem, NULL, jtv);
+    if (check_flag(&flag, "CVSpilsSetJacTimes", 1)) return(1);
+
+    flag = integrate([&](realtype tout, realtype *t) {
+      return CVode(cvode_mem, tout, y, t, CV_NORMAL);
+    });
+    if (check_flag(&flag, "CVode", 1)) return(1);
+
+    if (r == runs - 1) {
+      CVodeGetNumSteps(cvode_mem, &result->nsteps);
+      for (sunindextype i = 0; i < N; i++) result->y_end[i] = NV_Ith_S(y, i);
+    }
+    N_VDestroy(y);
+    CVodeFree(&cvode_mem);
+    SUNLinSolFree(LS);
+  }
+  return(0);
+}
+
+// raw/reinit: one setup, CVodeReInit before every run.
+static int run_raw_reinit(int runs, VariantResult *result) {
+  int flag;
+  N_Vector y = N_VNew_Serial(N);
+  if (check_flag((void *)y, "N_VNew_Serial", 0)) return(1);
+  for (sunindextype i = 0; i < N; i++) NV_Ith_S(y, i) = y_0[i];
+  void *cvode_mem = CVodeCreate(CV_BDF, CV_NEWTON);
+  if (check_flag((void *)cvode_mem, "CVodeCreate", 0)) return(1);
+  flag = CVodeInit(cvode_mem, f, 0, y);
+  if (check_flag(&flag, "CVodeInit", 1)) return(1);
+  flag = CVodeSStolerances(cvode_mem, reltol, abstol);
+  if (check_flag(&flag, "CVodeSStolerances", 1)) return(1);
+  SUNLinearSolver LS = SUNSPGMR(y, 0, 0);
+  if (check_flag((void *)LS, "SUNSPGMR", 0)) return(1);
+  flag = CVSpilsSetLinearSolver(cvode_mem, LS);
+  if (check_flag(&flag, "CVSpilsSetLinearSolver", 1)) return(1);
+  flag = CVSpilsSetJacTimes(cvode_mem, NULL, jtv);
+  if (check_flag(&flag, "CVSpilsSetJacTimes", 1)) return(1);
+
+  for (int r = 0; r < runs; r++) {
+    for (sunindextype i = 0; i < N; i++) NV_Ith_S(y, i) = y_0[i];
+    flag = CVodeReInit(cvode_mem, 0, y);
+    if (check_flag(&flag, "CVodeReInit", 1)) return(1);
+    flag = integrate([&](realtype tout, realtype *t) {
+      return CVode(cvode_mem, tout, y, t, CV_NORMAL);
+    });
+    if (check_flag(&flag, "CVode", 1)) return(1);
+  }
+
+  CVodeGetNumSteps(cvode_mem, &result->nsteps);
+  for (sunindextype i = 0; i < N; i++) result->y_end[i] = NV_Ith_S(y, i);
+  N_VDestroy(y);
+  CVodeFree(&cvode_mem);
+  SUNLinSolFree(LS);
+  return(0);
+}
+
+// wrapper: one CVodeIntegrator, reset() before every run. Cleanup is done by
+// the destructors.
+static int run_wrapper(int runs, VariantResult *result) {
+  try {
+    CVodeIntegrator cv = CVodeIntegrator::spgmr(N, f, jtv, reltol, abstol);
+    for (int r = 0; r < runs; r++) {
+      cv.reset(0, y_0);
+      int flag = integrate([&](realtype tout, realtype *t) {
+        return cv.advance(tout, t);
+      });
+      if (check_flag(&flag, "CVode", 1)) return(1);
+    }
+    CVodeGetNumSteps(cv.mem(), &result->nsteps);
+    for (sunindextype i = 0; i < N; i++) result->y_end[i] = cv.y_data()[i];
+  } catch (const SundialsError &e) {
+    fprintf(stderr, "\nSUNDIALS_ERROR: %s\n\n", e.what());
+    return(1);
+  }
+  return(0);
+}
+
+int main(int argc, char *argv[]) {
+  int runs = argc > 1 ? atoi(argv[1]) : 2000;
+  if (runs < 1) runs = 1;
+  const int rounds = 5;
+
+  const char *names[] = {"raw/create", "raw/reinit", "wrapper"};
+  int (*variants[])(int, VariantResult*) = {run_raw_create, run_raw_reinit,
+                                            run_wrapper};
+  VariantResult results[3];
+
+  // The variants are interleaved within each round so that frequency scaling
+  // and other machine noise hits all of them alike; the best round counts.
+  for (int round = 0; round < rounds; round++) {
+    for (int v = 0; v < 3; v++) {
+      auto start = std::chrono::steady_clock::now();
+      if (variants[v](runs, &results[v])) return(1);
+      auto stop = std::chrono::steady_clock::now();
+      double s = std::chrono::duration<double>(stop - start).count() / runs;
+      if (s < results[v].seconds_per_run) results[v].seconds_per_run = s;
+    }
+  }
+
+  printf("%d runs x %d rounds, %ld steps per run\n\n", runs, rounds,
+         results[0].nsteps);
+  printf("variant      time/run [us]  time/step [ns]  vs raw/reinit\n");
+  for (int v = 0; v < 3; v++) {
+    const VariantResult &r = results[v];
+    printf("%-12s %14.2f %15.1f %13.3f\n", names[v], r.seconds_per_run * 1e6,
+           r.seconds_per_run * 1e9 / r.nsteps,
+           r.seconds_per_run / results[1].seconds_per_run);
+  }
+
+  bool identical = true;
+  for (int v = 1; v < 3; v++) {
+    if (results[v].nsteps != results[0].nsteps) identical = false;
+    for (sunindextype i = 0; i < N; i++) {
+      if (results[v].y_end[i] != results[0].y_end[i]) identical = false;
+    }
+  }
+  printf("\nfinal states %s\n", identical ? "identical" : "DIFFER");
+  return identical ? 0 : 1;
+}
+
+// Simple function that calculates the differential equation.
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data) {
+  // N_VGetArrayPointer returns a pointer to the data in the N_Vector class.
+  realtype *udata  = N_VGetArrayPointer(u); // pointer u vector data
+  realtype *dudata = N_VGetArrayPointer(u_dot); // pointer to udot vector data
+
+  dudata[0] = -101.0 * udata[0] - 100.0 * udata[1];
+  dudata[1] = udata[0];
+
+  return(0);
+}
+
+// Jacobian function vector routine.
+static int jtv(N_Vector v, N_Vector Jv, realtype t, N_Vector u, N_Vector fu,
+               void *user_data, N_Vector tmp) {
+  realtype *vdata  = N_VGetArrayPointer(v);
+  realtype *Jvdata = N_VGetArrayPointer(Jv);
+
+  Jvdata[0] = -101.0 * vdata[0] + -100.0 * vdata[1];
+  Jvdata[1] = vdata[0];
+
+  return(0);
+}
+
+// check_flag function is from the cvDiurnals_ky.c example from the CVODE
+// package.
+/* Check function return value...
+     opt == 0 means SUNDIALS function allocates memory so check if
+              returned NULL pointer
+     opt == 1 means SUNDIALS function returns a flag so check if
+              flag >= 0
+     opt == 2 means function allocates memory so check if returned
+              NULL pointer */
+static int check_flag(void *flagvalue, const char *funcname, int opt) {
+  int *errflag;
+
+  /* Check if SUNDIALS function returned NULL pointer - no memory allocated */
+  if (opt == 0 && flagvalue == NULL) {
+    fprintf(stderr, "\nSUNDIALS_ERROR: %s() failed - returned NULL pointer\n\n",
+            funcname);
+    return(1); }
+
+  /* Check if flag < 0 */
+  else if (opt == 1) {
+    errflag = (int *) flagvalue;
+    if (*errflag < 0) {
+      fprintf(stderr, "\nSUNDIALS_ERROR: %s() failed with flag = %d\n\n",
+              funcname, *errflag);
+      return(1); }}
+
+  /* Check if function returned NULL pointer - no memory allocated */
+  else if (opt == 2 && flagvalue == NULL) {
+    fprintf(stderr, "\nMEMORY_ERROR: %s() failed - returned NULL pointer\n\n",
+            funcname);
+    return(1); }
+
+  return(0);
+}
@@ -11,6 +11,7 @@ as a stiff system.
 #include <cvode/cvode_spils.h> // access to CVSpils interface
 #include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
 #include <sundials/sundials_math.h>  // contains the macros ABS, SUNSQR, EXP
+#include <sundials_precision.h>  // MPI_REALTYPE, the MPI type of realtype
 
 // This macro gives access to the individual components of the data array of an
 // N Vector.
@@ -194,7 +195,8 @@ static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data) {
 
   // Puting the calculations together.
   MPI_Barrier(MPI_COMM_WORLD);
-  MPI_Allgather(&send_data, 1, MPI_DOUBLE, dudata, 1, MPI_DOUBLE, MPI_COMM_WORLD);
+  MPI_Allgather(&send_data, 1, MPI_REALTYPE, dudata, 1, MPI_REALTYPE,
+                MPI_COMM_WORLD);
 
   return(0);
 }
@@ -221,7 +223,8 @@ static int jtv(N_Vector v, N_Vector Jv, realtype t, N_Vector u, N_Vector fu,
 
   // Puting the calculations together.
   MPI_Barrier(MPI_COMM_WORLD);
-  MPI_Allgather(&send_data, 1, MPI_DOUBLE, Jvdata, 1, MPI_DOUBLE, MPI_COMM_WORLD);
+  MPI_Allgather(&send_data, 1, MPI_REALTYPE, Jvdata, 1, MPI_REALTYPE,
+                MPI_COMM_WORLD);
 
   fudata[0] = 0;
   fudata[1] = 0;
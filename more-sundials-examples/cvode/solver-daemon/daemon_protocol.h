@@ -0,0 +1,98 @@
+/*
+Binary protocol of the solver daemon.
+
+All integers and doubles are sent in host byte order; the daemon and its
+clients run on the same machine, as a Unix domain socket requires.
+
+A client sends requests, each a RequestHeader followed by n_times doubles
+with the output times. Requests may be pipelined: the client does not have
+to wait for a reply before sending the next one.
+
+The daemon answers with frames, each a FrameHeader followed by a payload
+that depends on the kind:
+
+  FRAME_ROWS   count rows of (t, y[0], y[1]), streamed while integrating
+  FRAME_END    one EndRecord, the last frame of a finished request
+  FRAME_ERROR  no payload, count holds the error code; the request is done
+  FRAME_STATS  one StatsRecord, the reply to a REQUEST_STATS
+
+Frames of different requests can interleave; the id in every frame tells
+them apart.
+*/
+
+#ifndef DAEMON_PROTOCOL_H
+#define DAEMON_PROTOCOL_H
+
+#include <cstdint>
+
+const uint32_t request_magic = 0x51524453; // "SDRQ"
+const uint32_t frame_magic = 0x53524453; // "SDRS"
+
+// Upper limit on the output times of one request.
+const uint32_t max_output_times = 1u << 20;
+
+enum RequestKind : uint32_t {
+  REQUEST_INTEGRATE = 0, // integrate the problem, reply with ROWS... END
+  REQUEST_STATS = 1 // reply with the latency statistics of the daemon
+};
+
+enum FrameKind : uint32_t {
+  FRAME_ROWS = 0,
+  FRAME_END = 1,
+  FRAME_ERROR = 2,
+  FRAME_STATS = 3
+};
+
+// Error codes of FRAME_ERROR. CVODE failures are reported in the EndRecord.
+enum ErrorCode : uint32_t {
+  ERROR_BAD_REQUEST = 1, // unknown kind or too many output times
+  ERROR_BAD_TOLERANCES = 2, // CVodeSStolerances rejected the tolerances
+  ERROR_REINIT = 3 // CVodeReInit failed
+};
+
+// The problem is the 2d system of the user data example,
+//   y0' = -101 y0 - 100 y1 + params[0]
+//   y1' = y0 + params[1],
+// integrated from (t0, y0) to each of the output times.
+struct RequestHeader {
+  uint32_t magic;
+  uint32_t kind; // RequestKind
+  uint32_t id; // echoed in every frame of the reply
+  uint32_t n_times; // number of output times following the header
+  double params[2];
+  double y0[2];
+  double t0;
+  double reltol;
+  double abstol;
+};
+
+struct FrameHeader {
+  uint32_t magic;
+  uint32_t kind; // FrameKind
+  uint32_t id;
+  uint32_t count; // rows for FRAME_ROWS, error code for FRAME_ERROR
+};
+
+struct EndRecord {
+  int32_t flag; // last CVode flag, negative on failure
+  uint32_t rows; // rows sent for this request
+  int64_t nsteps; // internal CVODE steps
+  double queue_us; // time spent waiting for a worker
+  double solve_us; // time from the start of the solve until this record is
+                   // built, before the frames are written
+};
+
+struct StatsRecord {
+  uint64_t requests; // integrations answered, with error frames
+  uint64_t failed; // of which ended with an error or a negative flag
+  // Latency from the arrival of a request to the write of its END frame,
+  // over the requests that got one
+  double p50_us;
+  double p90_us;
+  double p99_us;
+  double max_us;
+  double mean_queue_us;
+  double mean_solve_us;
+};
+
+#endif
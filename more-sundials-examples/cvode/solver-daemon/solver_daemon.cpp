@@ -0,0 +1,710 @@
+/*
+A resident solver daemon for the 2d ODE of the user data example, and a load
+generator for it.
+
+Running the example binaries once per query pays process startup, dynamic
+linking and the CVODE setup every time. The daemon pays them once: it keeps
+a pool of worker threads, each with a CVODE object that is set up at start
+and only reinitialized with CVodeReInit per request.
+
+  ./executable serve <socket> [workers]
+  ./executable load <socket> [clients] [requests] [depth] [times]
+
+serve listens on a Unix domain socket for the binary protocol described in
+daemon_protocol.h and runs until SIGINT or SIGTERM. Each connection has a
+reader thread that parses requests into a shared queue. Workers take up to
+max_batch queued requests at a time and stream the rows back as they are
+computed, coalescing the frames of a batch into few writes per connection.
+
+load connects clients, each keeping up to depth requests in flight, and
+reports the throughput and the round-trip latency percentiles next to the
+latency measured inside the daemon and the cost of a cold in-process setup.
+*/
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <cerrno>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cvode/cvode.h> // prototypes for CVODE fcts., consts.
+#include <nvector/nvector_serial.h>  // access to serial N_Vector
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+#include <sundials_raii.h> // move-only owners and CVodeIntegrator
+#include "daemon_protocol.h"
+
+
+// Struct for holding the nessesary additional variables for the problem. A
+// fixed array instead of a std::vector, as it is rewritten per request.
+struct UserData {
+  realtype coeffs[2];
+};
+
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data);
+static int jtv(N_Vector v, N_Vector Jv, realtype t, N_Vector u, N_Vector fu,
+               void *user_data, N_Vector tmp);
+static int serve(const char *path, int nworkers);
+static int load(const char *path, int nclients, int nrequests, int depth,
+                int ntimes);
+
+// Requests a worker takes from the queue at once, and the queue length at
+// which the connection readers stop reading.
+static const size_t max_batch = 16;
+static const size_t max_queued = 4096;
+// A worker writes its output buffer once it holds this many bytes, which
+// streams long output grids instead of holding them back until the end.
+static const size_t flush_bytes = 64 * 1024;
+
+
+int main(int argc, char *argv[]) {
+  if (argc >= 3 && strcmp(argv[1], "serve") == 0) {
+    int nworkers = argc > 3 ? atoi(argv[3])
+                            : (int) std::thread::hardware_concurrency();
+    return serve(argv[2], nworkers > 0 ? nworkers : 1);
+  }
+  if (argc >= 3 && strcmp(argv[1], "load") == 0) {
+    int nclients = argc > 3 ? atoi(argv[3]) : 4;
+    int nrequests = argc > 4 ? atoi(argv[4]) : 2000;
+    int depth = argc > 5 ? atoi(argv[5]) : 8;
+    int ntimes = argc > 6 ? atoi(argv[6]) : 100;
+    if (nclients < 1 || nrequests < 1 || depth < 1 || ntimes < 1) {
+      fprintf(stderr, "load: all counts must be positive\n");
+      return(1);
+    }
+    return load(argv[2], nclients, nrequests, depth, ntimes);
+  }
+  fprintf(stderr, "usage: %s serve <socket> [workers]\n"
+                  "       %s load <socket> [clients] [requests] [depth]"
+                  " [times]\n", argv[0], argv[0]);
+  return(1);
+}
+
+
+// Socket helpers ------------------------------------------------------------
+
+// Reads exactly n bytes; false on EOF or error.
+static bool read_full(int fd, void *buf, size_t n) {
+  char *p = (char*) buf;
+  while (n > 0) {
+    ssize_t r = read(fd, p, n);
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) return false;
+    p += r;
+    n -= r;
+  }
+  return true;
+}
+
+// Writes exactly n bytes; false on error.
+static bool write_full(int fd, const void *buf, size_t n) {
+  const char *p = (const char*) buf;
+  while (n > 0) {
+    ssize_t w = send(fd, p, n, MSG_NOSIGNAL);
+    if (w < 0 && errno == EINTR) continue;
+    if (w <= 0) return false;
+    p += w;
+    n -= w;
+  }
+  return true;
+}
+
+static bool make_address(const char *path, sockaddr_un *addr) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr->sun_path)) {
+    fprintf(stderr, "socket path too long: %s\n", path);
+    return false;
+  }
+  strcpy(addr->sun_path, path);
+  return true;
+}
+
+template <typename T>
+static void append(std::vector<char> &buf, const T &value) {
+  const char *p = (const char*) &value;
+  buf.insert(buf.end(), p, p + sizeof(T));
+}
+
+// Sets the count of the frame header starting at buf[at].
+static void patch_count(std::vector<char> &buf, size_t at, uint32_t count) {
+  memcpy(&buf[at] + offsetof(FrameHeader, count), &count, sizeof(count));
+}
+
+
+// Latency histogram ---------------------------------------------------------
+
+// Log-scale histogram from 1 us to 100 s with 20 buckets per decade, so the
+// percentiles are accurate to about 12% at a fixed memory cost however long
+// the daemon runs. add() is lock free and may be called from any thread.
+class LatencyHistogram {
+ public:
+  LatencyHistogram() {
+    for (int i = 0; i < nbuckets; i++) counts_[i] = 0;
+  }
+
+  void add(double us) {
+    int b = us <= 1 ? 0 : (int) (std::log10(us) * per_decade) + 1;
+    if (b >= nbuckets) b = nbuckets - 1;
+    counts_[b].fetch_add(1, std::memory_order_relaxed);
+    total_.fetch_add(1, std::memory_order_relaxed);
+    double m = max_.load(std::memory_order_relaxed);
+    while (us > m && !max_.compare_exchange_weak(m, us)) {}
+  }
+
+  uint64_t count() const { return total_.load(); }
+  double max() const { return max_.load(); }
+
+  // Upper edge of the bucket holding the p-th percentile (0 < p < 100),
+  // capped by the largest latency seen.
+  double percentile(double p) const {
+    uint64_t total = count();
+    if (total == 0) return 0;
+    uint64_t rank = (uint64_t) std::ceil(p / 100 * total), seen = 0;
+    for (int b = 0; b < nbuckets; b++) {
+      seen += counts_[b].load(std::memory_order_relaxed);
+      if (seen >= rank)
+        return std::min(std::pow(10.0, (double) b / per_decade), max());
+    }
+    return max();
+  }
+
+ private:
+  static const int per_decade = 20;
+  static const int nbuckets = 8 * per_decade + 1;
+  std::atomic<uint64_t> counts_[nbuckets];
+  std::atomic<uint64_t> total_{0};
+  std::atomic<double> max_{0};
+};
+
+
+// Server --------------------------------------------------------------------
+
+typedef std::chrono::steady_clock Clock;
+
+static volatile sig_atomic_t stop_requested = 0;
+static void on_signal(int) { stop_requested = 1; }
+
+// One client connection. Frames may be written by the reader (stats
+// replies) and by any worker, so writes are serialized by write_mutex. The
+// socket is closed when the reader and the last queued job let go of it.
+struct Connection {
+  int fd;
+  std::mutex write_mutex;
+  std::atomic<bool> broken{false};
+
+  explicit Connection(int fd) : fd(fd) {}
+  ~Connection() { close(fd); }
+
+  void write(const std::vector<char> &buf) {
+    if (buf.empty() || broken) return;
+    std::lock_guard<std::mutex> lock(write_mutex);
+    if (!write_full(fd, buf.data(), buf.size())) broken = true;
+  }
+};
+
+struct Job {
+  std::shared_ptr<Connection> conn;
+  RequestHeader req;
+  std::vector<double> times;
+  Clock::time_point arrival;
+  bool solved = false; // ran to its END frame rather than an error frame
+};
+
+// State shared by the acceptor, the connection readers and the workers.
+struct Server {
+  std::mutex mutex;
+  std::condition_variable has_jobs;
+  std::condition_variable has_room;
+  std::deque<Job> queue;
+  bool closing = false;
+
+  LatencyHistogram latency; // arrival to the write of the END frame
+  std::atomic<uint64_t> requests{0}; // jobs answered, error frames included
+  std::atomic<uint64_t> failed{0};
+  std::atomic<uint64_t> queue_ns{0};
+  std::atomic<uint64_t> solve_ns{0};
+  std::atomic<int> readers{0};
+
+  StatsRecord stats() const {
+    StatsRecord s;
+    s.requests = requests;
+    s.failed = failed;
+    const uint64_t solved = latency.count();
+    s.p50_us = latency.percentile(50);
+    s.p90_us = latency.percentile(90);
+    s.p99_us = latency.percentile(99);
+    s.max_us = latency.max();
+    s.mean_queue_us = solved ? queue_ns * 1e-3 / solved : 0;
+    s.mean_solve_us = solved ? solve_ns * 1e-3 / solved : 0;
+    return s;
+  }
+};
+
+static void append_frame(std::vector<char> &buf, uint32_t kind, uint32_t id,
+                         uint32_t count) {
+  FrameHeader h = {frame_magic, kind, id, count};
+  append(buf, h);
+}
+
+// Reads requests from one connection until it closes and queues them.
+static void connection_reader(Server *server,
+                              std::shared_ptr<Connection> conn) {
+  RequestHeader req;
+  std::vector<char> reply;
+  while (read_full(conn->fd, &req, sizeof(req))) {
+    Clock::time_point arrival = Clock::now();
+    if (req.magic != request_magic) break; // out of sync, drop the client
+
+    if (req.kind == REQUEST_STATS) {
+      reply.clear();
+      append_frame(reply, FRAME_STATS, req.id, 0);
+      append(reply, server->stats());
+      conn->write(reply);
+      continue;
+    }
+    if (req.kind != REQUEST_INTEGRATE || req.n_times > max_output_times) {
+      reply.clear();
+      append_frame(reply, FRAME_ERROR, req.id, ERROR_BAD_REQUEST);
+      conn->write(reply);
+      break; // the output times that follow can not be skipped safely
+    }
+
+    Job job;
+    job.conn = conn;
+    job.req = req;
+    job.times.resize(req.n_times);
+    if (!read_full(conn->fd, job.times.data(), req.n_times * sizeof(double)))
+      break;
+    job.arrival = arrival;
+
+    std::unique_lock<std::mutex> lock(server->mutex);
+    server->has_room.wait(lock, [&] {
+      return server->queue.size() < max_queued || server->closing;
+    });
+    if (server->closing) break;
+    server->queue.push_back(std::move(job));
+    lock.unlock();
+    server->has_jobs.notify_one();
+  }
+  server->readers--;
+}
+
+// Runs one request on the worker's integrator and appends its frames to out.
+// Full buffers are written out on the way, so long grids are streamed. The
+// latency is added by the worker once the END frame is written.
+static void run_job(Server *server, CVodeIntegrator &cv, UserData &data,
+                    Job &job, std::vector<char> &out) {
+  const RequestHeader &req = job.req;
+  Clock::time_point start = Clock::now();
+
+  data.coeffs[0] = req.params[0];
+  data.coeffs[1] = req.params[1];
+  if (CVodeSStolerances(cv.mem(), req.reltol, req.abstol) < 0) {
+    append_frame(out, FRAME_ERROR, req.id, ERROR_BAD_TOLERANCES);
+    server->failed++;
+    return;
+  }
+  // The wire format is double whatever the precision of realtype.
+  const realtype y0[2] = {(realtype) req.y0[0], (realtype) req.y0[1]};
+  try {
+    cv.reset(req.t0, y0);
+  } catch (const SundialsError&) {
+    append_frame(out, FRAME_ERROR, req.id, ERROR_REINIT);
+    server->failed++;
+    return;
+  }
+
+  // Rows go out in frames of at most rows_per_frame; the header of the open
+  // frame is patched with its row count once the frame is closed.
+  const uint32_t rows_per_frame = 256;
+  size_t frame_at = 0;
+  uint32_t in_frame = 0, rows = 0;
+  int flag = CV_SUCCESS;
+  realtype t = req.t0;
+  const realtype *y = cv.y_data();
+  for (uint32_t k = 0; k < req.n_times; k++) {
+    flag = cv.advance(job.times[k], &t);
+    if (flag < 0) break;
+    if (in_frame == 0) {
+      frame_at = out.size();
+      append_frame(out, FRAME_ROWS, req.id, 0);
+    }
+    double row[3] = {(double) t, (double) y[0], (double) y[1]};
+    append(out, row);
+    rows++;
+    if (++in_frame == rows_per_frame || out.size() >= flush_bytes) {
+      patch_count(out, frame_at, in_frame);
+      in_frame = 0;
+      if (out.size() >= flush_bytes) {
+        job.conn->write(out);
+        out.clear();
+      }
+    }
+  }
+  if (in_frame > 0) patch_count(out, frame_at, in_frame);
+
+  long int nsteps = 0;
+  CVodeGetNumSteps(cv.mem(), &nsteps);
+  Clock::time_point end = Clock::now();
+  EndRecord rec;
+  rec.flag = flag;
+  rec.rows = rows;
+  rec.nsteps = nsteps;
+  rec.queue_us = std::chrono::duration<double, std::micro>(
+      start - job.arrival).count();
+  rec.solve_us = std::chrono::duration<double, std::micro>(end - start).count();
+  append_frame(out, FRAME_END, req.id, 0);
+  append(out, rec);
+
+  job.solved = true;
+  server->queue_ns += (uint64_t) (rec.queue_us * 1e3);
+  server->solve_ns += (uint64_t) (rec.solve_us * 1e3);
+  if (flag < 0) server->failed++;
+}
+
+// A worker owns one CVODE object for its whole life. It takes batches of
+// jobs and writes the frames of consecutive jobs of the same connection
+// with a single write.
+static void worker(Server *server, CVodeIntegrator *cv, UserData *data) {
+  std::vector<Job> batch;
+  std::vector<char> out;
+  out.reserve(2 * flush_bytes);
+  for (;;) {
+    batch.clear();
+    {
+      std::unique_lock<std::mutex> lock(server->mutex);
+      server->has_jobs.wait(lock, [&] {
+        return !server->queue.empty() || server->closing;
+      });
+      if (server->queue.empty()) return; // closing and drained
+      while (!server->queue.empty() && batch.size() < max_batch) {
+        batch.push_back(std::move(server->queue.front()));
+        server->queue.pop_front();
+      }
+    }
+    server->has_room.notify_all();
+
+    // first is the first job whose frames are not written yet.
+    size_t first = 0;
+    for (size_t i = 0; i < batch.size(); i++) {
+      run_job(server, *cv, *data, batch[i], out);
+      server->requests++; // before the write, so a client that got its
+                          // reply sees it counted
+      bool last = i + 1 == batch.size();
+      if (last || batch[i + 1].conn != batch[i].conn) {
+        batch[i].conn->write(out);
+        out.clear();
+        // The latency runs to the write, so it includes the time a result
+        // waits behind the later jobs of its write.
+        Clock::time_point written = Clock::now();
+        for (; first <= i; first++) {
+          if (batch[first].solved)
+            server->latency.add(std::chrono::duration<double, std::micro>(
+                written - batch[first].arrival).count());
+        }
+      }
+    }
+  }
+}
+
+static int serve(const char *path, int nworkers) {
+  // 1. Initialize parallel or multi-threaded environment, if appropriate.
+  // ---------------------------------------------------------------------------
+  // Every worker gets its own CVODE object, set up once here. Requests only
+  // rewrite the user data and reinitialize the solver.
+  std::vector<std::unique_ptr<UserData>> data;
+  std::vector<CVodeIntegrator> integrators;
+  try {
+    for (int i = 0; i < nworkers; i++) {
+      data.emplace_back(new UserData());
+      integrators.push_back(CVodeIntegrator::spgmr(2, f, jtv, 1e-5, 1e-5,
+                                                   data.back().get()));
+    }
+  } catch (const SundialsError &e) {
+    fprintf(stderr, "\nSUNDIALS_ERROR: %s\n\n", e.what());
+    return(1);
+  }
+  // ---------------------------------------------------------------------------
+
+  sockaddr_un addr;
+  if (!make_address(path, &addr)) return(1);
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd < 0) { perror("socket"); return(1); }
+  unlink(path);
+  if (bind(listen_fd, (sockaddr*) &addr, sizeof(addr)) < 0 ||
+      listen(listen_fd, 64) < 0) {
+    perror("bind/listen");
+    close(listen_fd);
+    return(1);
+  }
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_signal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  Server server;
+  std::vector<std::thread> pool;
+  for (int i = 0; i < nworkers; i++)
+    pool.emplace_back(worker, &server, &integrators[i], data[i].get());
+  printf("serving on %s with %d workers\n", path, nworkers);
+  fflush(stdout);
+
+  // Accept until a signal arrives. The poll timeout bounds how long a signal
+  // can go unnoticed.
+  std::vector<std::weak_ptr<Connection>> connections;
+  while (!stop_requested) {
+    pollfd pfd = {listen_fd, POLLIN, 0};
+    if (poll(&pfd, 1, 200) <= 0) continue;
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) continue;
+    std::shared_ptr<Connection> conn(new Connection(fd));
+    connections.erase(
+        std::remove_if(connections.begin(), connections.end(),
+                       [](const std::weak_ptr<Connection> &w) {
+                         return w.expired();
+                       }),
+        connections.end());
+    connections.push_back(conn);
+    server.readers++;
+    std::thread(connection_reader, &server, conn).detach();
+  }
+
+  // Shut down: stop the readers by shutting down their sockets, let the
+  // workers drain the queue, then report.
+  close(listen_fd);
+  unlink(path);
+  {
+    std::lock_guard<std::mutex> lock(server.mutex);
+    server.closing = true;
+  }
+  server.has_jobs.notify_all();
+  server.has_room.notify_all();
+  for (std::thread &t : pool) t.join();
+  for (std::weak_ptr<Connection> &w : connections) {
+    std::shared_ptr<Connection> conn = w.lock();
+    if (conn) shutdown(conn->fd, SHUT_RDWR);
+  }
+  while (server.readers > 0)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+  StatsRecord s = server.stats();
+  printf("\n%llu requests, %llu failed\n", (unsigned long long) s.requests,
+         (unsigned long long) s.failed);
+  printf("latency [us]  p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n", s.p50_us,
+         s.p90_us, s.p99_us, s.max_us);
+  printf("mean queue wait %.1f us, mean solve %.1f us\n", s.mean_queue_us,
+         s.mean_solve_us);
+  return(0);
+}
+
+
+// Load generator ------------------------------------------------------------
+
+struct ClientResult {
+  long int completed = 0;
+  long int failed = 0;
+  long int rows = 0;
+  bool protocol_error = false;
+};
+
+// One client connection with up to depth requests in flight. Round-trip
+// latencies go into the shared histogram.
+static void client(const char *path, int nrequests, int depth, int ntimes,
+                   unsigned seed, LatencyHistogram *rtt, ClientResult *result) {
+  sockaddr_un addr;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || !make_address(path, &addr) ||
+      connect(fd, (sockaddr*) &addr, sizeof(addr)) < 0) {
+    perror("connect");
+    result->protocol_error = true;
+    if (fd >= 0) close(fd);
+    return;
+  }
+
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<double> coeff(0.0, 0.05);
+  std::uniform_real_distribution<double> start(0.5, 2.0);
+
+  // The message of one request: header plus the output grid of the examples
+  // (step 0.5), stretched to ntimes points.
+  std::vector<char> msg(sizeof(RequestHeader) + ntimes * sizeof(double));
+  double *times = (double*) (msg.data() + sizeof(RequestHeader));
+  for (int k = 0; k < ntimes; k++) times[k] = 0.5 * (k + 1);
+
+  std::vector<Clock::time_point> sent(nrequests);
+  std::vector<uint32_t> rows(nrequests, 0);
+  int next = 0, in_flight = 0;
+  auto send_next = [&]() -> bool {
+    RequestHeader h = {request_magic, REQUEST_INTEGRATE, (uint32_t) next,
+                       (uint32_t) ntimes, {coeff(gen), coeff(gen)},
+                       {2 * start(gen), start(gen)}, 0, 1e-5, 1e-5};
+    memcpy(msg.data(), &h, sizeof(h));
+    sent[next] = Clock::now();
+    next++;
+    in_flight++;
+    return write_full(fd, msg.data(), msg.size());
+  };
+
+  bool ok = true;
+  while (ok && next < nrequests && in_flight < depth) ok = send_next();
+  std::vector<double> payload;
+  while (ok && in_flight > 0) {
+    FrameHeader h;
+    if (!read_full(fd, &h, sizeof(h)) || h.magic != frame_magic ||
+        h.id >= (uint32_t) nrequests) {
+      ok = false;
+      break;
+    }
+    if (h.kind == FRAME_ROWS) {
+      payload.resize(3 * h.count);
+      ok = read_full(fd, payload.data(), payload.size() * sizeof(double));
+      rows[h.id] += h.count;
+      continue;
+    }
+    if (h.kind == FRAME_END) {
+      EndRecord rec;
+      ok = read_full(fd, &rec, sizeof(rec));
+      if (rec.flag < 0 || rows[h.id] != rec.rows ||
+          rec.rows != (uint32_t) ntimes) result->failed++;
+      result->rows += rows[h.id];
+    } else if (h.kind == FRAME_ERROR) {
+      result->failed++;
+    } else {
+      ok = false;
+      break;
+    }
+    rtt->add(std::chrono::duration<double, std::micro>(
+        Clock::now() - sent[h.id]).count());
+    result->completed++;
+    in_flight--;
+    if (ok && next < nrequests) ok = send_next();
+  }
+  if (!ok) result->protocol_error = true;
+  close(fd);
+}
+
+// Asks the daemon for its latency statistics.
+static bool query_stats(const char *path, StatsRecord *s) {
+  sockaddr_un addr;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return false;
+  bool ok = make_address(path, &addr) &&
+            connect(fd, (sockaddr*) &addr, sizeof(addr)) == 0;
+  RequestHeader req;
+  memset(&req, 0, sizeof(req));
+  req.magic = request_magic;
+  req.kind = REQUEST_STATS;
+  FrameHeader h;
+  ok = ok && write_full(fd, &req, sizeof(req)) &&
+       read_full(fd, &h, sizeof(h)) && h.kind == FRAME_STATS &&
+       read_full(fd, s, sizeof(*s));
+  close(fd);
+  return ok;
+}
+
+// Time of one request without the daemon: a fresh CVODE setup and solve in
+// this process, which is still less than a separate process would pay.
+static double cold_request_us(int ntimes, int samples) {
+  UserData data = {{0.01, 0.02}};
+  const realtype y0[2] = {2.0, 1.0};
+  auto start = Clock::now();
+  for (int s = 0; s < samples; s++) {
+    CVodeIntegrator cv = CVodeIntegrator::spgmr(2, f, jtv, 1e-5, 1e-5, &data);
+    cv.reset(0, y0);
+    realtype t;
+    for (int k = 0; k < ntimes; k++) cv.advance(0.5 * (k + 1), &t);
+  }
+  return std::chrono::duration<double, std::micro>(Clock::now() - start)
+      .count() / samples;
+}
+
+static int load(const char *path, int nclients, int nrequests, int depth,
+                int ntimes) {
+  LatencyHistogram rtt;
+  std::vector<ClientResult> results(nclients);
+  std::vector<std::thread> clients;
+  auto start = Clock::now();
+  for (int c = 0; c < nclients; c++)
+    clients.emplace_back(client, path, nrequests, depth, ntimes, 1234u + c,
+                         &rtt, &results[c]);
+  for (std::thread &t : clients) t.join();
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  long int completed = 0, failed = 0, rows = 0;
+  bool protocol_error = false;
+  for (const ClientResult &r : results) {
+    completed += r.completed;
+    failed += r.failed;
+    rows += r.rows;
+    protocol_error = protocol_error || r.protocol_error;
+  }
+  printf("%d clients x %d requests, depth %d, %d output times each\n",
+         nclients, nrequests, depth, ntimes);
+  printf("completed %ld, failed %ld, rows %ld%s\n", completed, failed, rows,
+         protocol_error ? ", PROTOCOL ERRORS" : "");
+  printf("throughput %.0f requests/s\n", completed / seconds);
+  printf("round trip [us]  p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n",
+         rtt.percentile(50), rtt.percentile(90), rtt.percentile(99),
+         rtt.max());
+
+  StatsRecord s;
+  if (query_stats(path, &s)) {
+    printf("daemon     [us]  p50 %.1f  p90 %.1f  p99 %.1f  max %.1f"
+           "  (%llu requests since start)\n", s.p50_us, s.p90_us, s.p99_us,
+           s.max_us, (unsigned long long) s.requests);
+  }
+  try {
+    printf("cold in-process setup + solve: %.1f us per request\n",
+           cold_request_us(ntimes, 200));
+  } catch (const SundialsError &e) {
+    fprintf(stderr, "\nSUNDIALS_ERROR: %s\n\n", e.what());
+  }
+  return protocol_error || failed > 0 ? 1 : 0;
+}
+
+
+// Simple function that calculates the differential equation.
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data) {
+  // N_VGetArrayPointer returns a pointer to the data in the N_Vector class.
+  realtype *udata  = N_VGetArrayPointer(u); // pointer u vector data
+  realtype *dudata = N_VGetArrayPointer(u_dot); // pointer to udot vector data
+
+  // Access inforation in user_data.
+  UserData *u_data = (UserData*) user_data;
+
+  dudata[0] = -101.0 * udata[0] - 100.0 * udata[1] + u_data->coeffs[0];
+  dudata[1] = udata[0] + u_data->coeffs[1];
+
+  return(0);
+}
+
+// Jacobian function vector routine.
+static int jtv(N_Vector v, N_Vector Jv, realtype t, N_Vector u, N_Vector fu,
+               void *user_data, N_Vector tmp) {
+  realtype *vdata  = N_VGetArrayPointer(v);
+  realtype *Jvdata = N_VGetArrayPointer(Jv);
+
+  Jvdata[0] = -101.0 * vdata[0] + -100.0 * vdata[1];
+  Jvdata[1] = vdata[0];
+
+  return(0);
+}
@@ -0,0 +1,308 @@
+/*
+Benchmark of cache-blocked stencil kernels (include/grid_stencil.h) for a
+2d reaction-diffusion generalization of the stiff system of
+src/simple_cvode_example.cpp,
+
+  y0_t = -101 y0 - 100 y1 + c0 + d0 (y0_xx + y0_yy)
+  y1_t = y0 - q y0 y1 + c1     + d1 (y1_xx + y1_yy)
+
+on an nx by ny grid with zero flux at the edges.
+
+The first table is a roofline report of the kernels alone. It measures the
+two ceilings of this machine, the memory bandwidth of a triad loop over
+arrays far larger than the caches and the flop rate of independent
+multiply-add chains, and then times each kernel over the whole grid:
+
+  naive          reaction and each species' diffusion in separate sweeps
+  blocked        one sweep in blocks (the default options)
+  prefetch       the same with software prefetch of the row after next
+  f, jtv         rhs() and jtv() one after the other
+  fused          f and J v in one sweep (evaluate() with options.fuse)
+
+For each it lists the time per sweep, the flop rate, the traffic rate from
+the compulsory bytes of the kernel (StencilCost), the arithmetic intensity,
+the roofline bound min(peak flops, intensity * bandwidth), and the share of
+the bound reached. All kernels are checked against the naive ones.
+
+The second table integrates the system with CVODE and SPGMR from a smooth
+profile to t = 10, with the naive and the blocked kernels in the f and jtv
+callbacks. Run as "./executable [nx] [ny] [sweeps]".
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <cvode/cvode.h> // prototypes for CVODE fcts., consts.
+#include <cvode/cvode_spils.h> // access to CVSpils interface
+#include <nvector/nvector_serial.h>  // access to serial N_Vector
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+#include <sundials_raii.h> // move-only owners and CVodeIntegrator
+#include <grid_stencil.h> // blocked reaction-diffusion kernels
+
+// Struct for holding the nessesary additional variables for the problem.
+struct UserData {
+  const GridStencil *stencil;
+  bool naive; // the row-by-row kernels instead of the blocked ones
+};
+
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data);
+static int jtv(N_Vector v, N_Vector Jv, realtype t, N_Vector u, N_Vector fu,
+               void *user_data, N_Vector tmp);
+
+static const realtype end_time = 10;
+static const realtype step_length = 1;
+static const realtype pi = 3.14159265358979323846;
+
+typedef std::chrono::steady_clock Clock;
+
+// Best time of runs calls of fn.
+template <typename Fn>
+static double best_time(int runs, Fn fn) {
+  double best = 1e30;
+  for (int k = 0; k < runs; k++) {
+    Clock::time_point start = Clock::now();
+    fn();
+    best = std::min(best, std::chrono::duration<double>(Clock::now() -
+                                                        start).count());
+  }
+  return best;
+}
+
+// Bytes per second of a[i] = b[i] + s c[i] over arrays of 64 MB, counting
+// the write of a twice as in StencilCost.
+static double triad_bandwidth() {
+  const size_t n = (64 << 20) / sizeof(realtype);
+  std::vector<realtype> a(n, 0), b(n, 1), c(n, 2);
+  const realtype s = 0.5;
+  double seconds = best_time(5, [&] {
+    realtype *STENCIL_RESTRICT pa = a.data();
+    const realtype *STENCIL_RESTRICT pb = b.data();
+    const realtype *STENCIL_RESTRICT pc = c.data();
+    STENCIL_SIMD
+    for (size_t i = 0; i < n; i++) pa[i] = pb[i] + s * pc[i];
+  });
+  if (a[n / 2] != 2) printf("triad check failed\n");
+  return 4.0 * n * sizeof(realtype) / seconds;
+}
+
+// Flops per second of independent multiply-add chains on data in L1,
+// eight steps of each chain per load and store.
+static double peak_flops() {
+  const int width = 64, iterations = 100000;
+  realtype x[width];
+  for (int k = 0; k < width; k++) x[k] = 1 + k * RCONST(1e-3);
+  const realtype a = RCONST(0.999999), b = RCONST(1e-7);
+  double seconds = best_time(5, [&] {
+    for (int it = 0; it < iterations; it++) {
+      STENCIL_SIMD
+      for (int k = 0; k < width; k++) {
+        realtype y = x[k];
+        y = a * y + b; y = a * y + b; y = a * y + b; y = a * y + b;
+        y = a * y + b; y = a * y + b; y = a * y + b; y = a * y + b;
+        x[k] = y;
+      }
+    }
+  });
+  realtype sum = 0;
+  for (int k = 0; k < width; k++) sum += x[k];
+  if (!(sum > 0)) printf("flops check failed\n");
+  return 16.0 * width * iterations / seconds;
+}
+
+static realtype max_diff(const std::vector<realtype> &a,
+                         const std::vector<realtype> &b) {
+  realtype e = 0;
+  for (size_t i = 0; i < a.size(); i++)
+    e = std::fmax(e, std::fabs(a[i] - b[i]));
+  return e;
+}
+
+static void initial_state(const GridStencil &s, std::vector<realtype> &y) {
+  const sunindextype nx = s.nx(), ny = s.ny(), np = nx * ny;
+  y.resize(2 * np);
+  for (sunindextype j = 0; j < ny; j++) {
+    for (sunindextype i = 0; i < nx; i++) {
+      realtype x = (realtype) i / (nx - 1), z = (realtype) j / (ny - 1);
+      y[j * nx + i] = 2 + std::cos(pi * x) * std::cos(pi * z);
+      y[np + j * nx + i] = 1 + 0.5 * std::cos(2 * pi * x);
+    }
+  }
+}
+
+struct Roofline {
+  double bandwidth, flops; // ceilings, per second
+};
+
+static void report(const char *name, const GridStencil &s, double seconds,
+                   StencilCost cost, const Roofline &roof, realtype diff) {
+  const double points = (double) s.nx() * s.ny();
+  const double gflops = cost.flops * points / seconds / 1e9;
+  const double gbytes = cost.bytes * points / seconds / 1e9;
+  const double intensity = cost.flops / cost.bytes;
+  const double bound = std::min(roof.flops, intensity * roof.bandwidth) /
+                       1e9;
+  printf("%-18s  %6ld  %9.3f ms  %7.2f  %7.2f  %6.3f  %7.2f  %5.1f%%  "
+         "%9.2e\n", name, (long int) s.options().block_x, 1e3 * seconds,
+         gflops, gbytes, intensity, bound, 100 * gflops / bound,
+         (double) diff);
+}
+
+// Integrates with CVODE and SPGMR; returns the seconds.
+static double integrate(const GridStencil &s, bool naive,
+                        std::vector<realtype> &y, long int *steps,
+                        long int *rhs_evals, long int *jtv_evals) {
+  UserData data;
+  data.stencil = &s;
+  data.naive = naive;
+  CVodeIntegrator cv = CVodeIntegrator::spgmr(s.size(), f, jtv, 1e-5, 1e-5,
+                                              &data);
+  sundials_check(CVodeSetMaxNumSteps(cv.mem(), 100000),
+                 "CVodeSetMaxNumSteps");
+  std::vector<realtype> y0;
+  initial_state(s, y0);
+  cv.reset(0, y0.data());
+  Clock::time_point start = Clock::now();
+  realtype t;
+  for (int k = 1; k * step_length <= end_time; k++) {
+    int flag = cv.advance(k * step_length, &t);
+    if (flag < 0) throw SundialsError("CVode", flag);
+  }
+  double seconds = std::chrono::duration<double>(Clock::now() -
+                                                 start).count();
+  CVodeGetNumSteps(cv.mem(), steps);
+  CVodeGetNumRhsEvals(cv.mem(), rhs_evals);
+  CVSpilsGetNumJtimesEvals(cv.mem(), jtv_evals);
+  y.assign(cv.y_data(), cv.y_data() + s.size());
+  return seconds;
+}
+
+int main(int argc, char *argv[]) {
+  long int nx = argc > 1 ? atol(argv[1]) : 1024;
+  long int ny = argc > 2 ? atol(argv[2]) : nx;
+  int sweeps = argc > 3 ? atoi(argv[3]) : 10;
+  if (nx < 2) nx = 2;
+  if (ny < 2) ny = 2;
+  if (sweeps < 1) sweeps = 1;
+
+  const realtype d[2] = {0.01, 0.001};
+  const realtype c[2] = {0.01, 0.02};
+  const realtype q = 0.1;
+  const realtype dx = 1.0 / (nx - 1), dy = 1.0 / (ny - 1);
+  StencilOptions options;
+  GridStencil stencil(nx, ny, dx, dy, d, c, q, options);
+  options.prefetch = true;
+  GridStencil prefetch(nx, ny, dx, dy, d, c, q, options);
+  options.prefetch = false;
+  options.fuse = false;
+  GridStencil separate(nx, ny, dx, dy, d, c, q, options);
+
+  const sunindextype N = stencil.size();
+  printf("%ld x %ld grid, %ld equations, %.1f MB per vector, best of %d "
+         "sweeps\n", nx, ny, (long int) N,
+         (double) N * sizeof(realtype) / (1 << 20), sweeps);
+  Roofline roof;
+  roof.bandwidth = triad_bandwidth();
+  roof.flops = peak_flops();
+  printf("ceilings: %.2f GB/s (triad), %.2f GFLOP/s (multiply-add), "
+         "ridge at %.2f flop/byte\n\n", roof.bandwidth / 1e9,
+         roof.flops / 1e9, roof.flops / roof.bandwidth);
+
+  std::vector<realtype> u, v(N), fu(N), Jv(N), fu_ref(N), Jv_ref(N);
+  initial_state(stencil, u);
+  for (sunindextype i = 0; i < N; i++) v[i] = std::sin(RCONST(0.001) * i);
+
+  printf("%-18s  %6s  %12s  %7s  %7s  %6s  %7s  %6s  %9s\n", "kernel",
+         "block", "time", "GFLOP/s", "GB/s", "flop/B", "bound", "of it",
+         "max diff");
+  double t;
+  t = best_time(sweeps, [&] { stencil.rhs_naive(u.data(), fu_ref.data()); });
+  report("f naive", stencil, t, GridStencil::rhs_cost(), roof, 0);
+  t = best_time(sweeps, [&] { stencil.rhs(u.data(), fu.data()); });
+  report("f blocked", stencil, t, GridStencil::rhs_cost(), roof,
+         max_diff(fu, fu_ref));
+  t = best_time(sweeps, [&] { prefetch.rhs(u.data(), fu.data()); });
+  report("f prefetch", prefetch, t, GridStencil::rhs_cost(), roof,
+         max_diff(fu, fu_ref));
+
+  t = best_time(sweeps, [&] {
+    stencil.jtv_naive(u.data(), v.data(), Jv_ref.data());
+  });
+  report("jtv naive", stencil, t, GridStencil::jtv_cost(), roof, 0);
+  t = best_time(sweeps, [&] { stencil.jtv(u.data(), v.data(), Jv.data()); });
+  report("jtv blocked", stencil, t, GridStencil::jtv_cost(), roof,
+         max_diff(Jv, Jv_ref));
+  t = best_time(sweeps, [&] {
+    prefetch.jtv(u.data(), v.data(), Jv.data());
+  });
+  report("jtv prefetch", prefetch, t, GridStencil::jtv_cost(), roof,
+         max_diff(Jv, Jv_ref));
+
+  // Both at the same u: the separate sweeps move the bytes of both costs.
+  const StencilCost both = {GridStencil::fused_cost().flops,
+                            GridStencil::rhs_cost().bytes +
+                                GridStencil::jtv_cost().bytes};
+  t = best_time(sweeps, [&] {
+    separate.evaluate(u.data(), v.data(), fu.data(), Jv.data());
+  });
+  report("f, jtv", separate, t, both, roof,
+         std::max(max_diff(fu, fu_ref), max_diff(Jv, Jv_ref)));
+  t = best_time(sweeps, [&] {
+    stencil.evaluate(u.data(), v.data(), fu.data(), Jv.data());
+  });
+  report("f + jtv fused", stencil, t, GridStencil::fused_cost(), roof,
+         std::max(max_diff(fu, fu_ref), max_diff(Jv, Jv_ref)));
+
+  printf("\n%-18s  %12s  %6s  %9s  %9s  %9s\n", "cvode kernels", "time",
+         "steps", "rhs evals", "jtv evals", "max diff");
+  try {
+    std::vector<realtype> y_ref, y;
+    long int steps, rhs_evals, jtv_evals;
+    const bool naive[] = {true, false};
+    for (bool n : naive) {
+      double seconds = integrate(stencil, n, n ? y_ref : y, &steps,
+                                 &rhs_evals, &jtv_evals);
+      printf("%-18s  %9.3f ms  %6ld  %9ld  %9ld  %9.2e\n",
+             n ? "naive" : "blocked", 1e3 * seconds, steps, rhs_evals,
+             jtv_evals, n ? 0.0 : (double) max_diff(y, y_ref));
+    }
+  } catch (const SundialsError &e) {
+    fprintf(stderr, "\nSUNDIALS_ERROR: %s\n\n", e.what());
+    return(1);
+  }
+  return(0);
+}
+
+// Simple function that calculates the differential equation.
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data) {
+  // N_VGetArrayPointer returns a pointer to the data in the N_Vector class.
+  realtype *udata  = N_VGetArrayPointer(u); // pointer u vector data
+  realtype *dudata = N_VGetArrayPointer(u_dot); // pointer to udot vector data
+
+  // Access inforation in user_data.
+  const UserData *u_data = (const UserData*) user_data;
+  if (u_data->naive)
+    u_data->stencil->rhs_naive(udata, dudata);
+  else
+    u_data->stencil->rhs(udata, dudata);
+
+  return(0);
+}
+
+// Jacobian function vector routine.
+static int jtv(N_Vector v, N_Vector Jv, realtype t, N_Vector u, N_Vector fu,
+               void *user_data, N_Vector tmp) {
+  realtype *udata  = N_VGetArrayPointer(u);
+  realtype *vdata  = N_VGetArrayPointer(v);
+  realtype *Jvdata = N_VGetArrayPointer(Jv);
+  const UserData *u_data = (const UserData*) user_data;
+
+  if (u_data->naive)
+    u_data->stencil->jtv_naive(udata, vdata, Jvdata);
+  else
+    u_data->stencil->jtv(udata, vdata, Jvdata);
+
+  return(0);
+}
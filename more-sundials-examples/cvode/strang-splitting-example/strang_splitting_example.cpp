@@ -0,0 +1,222 @@
+/*
+Strang splitting of a 1d reaction-diffusion system, compared with fully
+coupled CVODE (include/strang_splitting.h).
+
+The reaction at every grid point is the 2d system of the user data example,
+and both species diffuse on [0, 1] with zero flux at the ends,
+
+  y0_t = -101 y0 - 100 y1 + c0 + d0 y0_xx
+  y1_t = y0 + c1 + d1 y1_xx
+
+discretized with second differences on n points. It is integrated from a
+smooth profile to t = 50 with output every 0.5:
+
+  cvode  - the whole system with CVODE BDF and a band direct solver, at
+           two tolerances
+  strang - R(h/2) D(h) R(h/2) and D(h/2) R(h) D(h/2) for a range of h,
+           diffusion by Crank-Nicolson tridiagonal solves, reactions by
+           a batched SDIRK solver over all points
+
+All runs are compared with CVODE at tolerance 1e-10 over the output grid;
+the order column is the observed order of the splitting between two
+successive h. Run as "./executable [n] [substeps]".
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <cvode/cvode.h> // prototypes for CVODE fcts., consts.
+#include <nvector/nvector_serial.h>  // access to serial N_Vector
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+#include <sundials_raii.h> // move-only owners and CVodeIntegrator
+#include <sundials_precision.h> // feasible_tolerance, precision_name
+#include <strang_splitting.h> // splitting driver
+
+// Struct for holding the nessesary additional variables for the problem.
+struct UserData {
+  sunindextype n;
+  realtype dx;
+  realtype d[2]; // diffusion coefficients
+  realtype coeffs[2];
+};
+
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data);
+static void reaction(sunindextype n, const realtype *y, realtype *rate,
+                     realtype *J, void *data);
+
+static const realtype end_time = 50;
+static const realtype step_length = 0.5;
+static const realtype pi = 3.14159265358979323846;
+
+typedef std::chrono::steady_clock Clock;
+
+static void initial_state(const UserData &data, std::vector<realtype> &y) {
+  y.resize(2 * data.n);
+  for (sunindextype i = 0; i < data.n; i++) {
+    realtype x = i * data.dx;
+    y[2 * i] = 2 + std::cos(pi * x);
+    y[2 * i + 1] = 1 + 0.5 * std::cos(2 * pi * x);
+  }
+}
+
+// The coupled system with CVODE; returns the seconds, out gets the output
+// grid.
+static double coupled(UserData &data, realtype tol,
+                      std::vector<realtype> &out, long int *steps) {
+  const sunindextype N = 2 * data.n;
+  CVodeIntegrator cv = CVodeIntegrator::band(N, f, NULL, 2, 2, tol, tol,
+                                             &data);
+  sundials_check(CVodeSetMaxNumSteps(cv.mem(), 100000),
+                 "CVodeSetMaxNumSteps");
+  std::vector<realtype> y0;
+  initial_state(data, y0);
+  Clock::time_point start = Clock::now();
+  cv.reset(0, y0.data());
+  out.clear();
+  realtype t;
+  for (int k = 1; k * step_length <= end_time; k++) {
+    int flag = cv.advance(k * step_length, &t);
+    if (flag < 0) throw SundialsError("CVode", flag);
+    out.insert(out.end(), cv.y_data(), cv.y_data() + N);
+  }
+  double seconds = std::chrono::duration<double>(Clock::now() -
+                                                 start).count();
+  CVodeGetNumSteps(cv.mem(), steps);
+  return seconds;
+}
+
+// The same with Strang splitting of step h.
+static double split(UserData &data, realtype h, bool reaction_first,
+                    int substeps, std::vector<realtype> &out,
+                    SplittingStats *stats) {
+  SplittingOptions options;
+  options.reaction_first = reaction_first;
+  options.reaction_substeps = substeps;
+  options.diffusion_substeps = substeps;
+  StrangSplitting strang(data.n, data.dx, data.d, reaction, &data, options);
+  std::vector<realtype> y;
+  initial_state(data, y);
+  Clock::time_point start = Clock::now();
+  out.clear();
+  for (int k = 1; k * step_length <= end_time; k++) {
+    strang.advance(y.data(), (k - 1) * step_length, k * step_length, h);
+    out.insert(out.end(), y.begin(), y.end());
+  }
+  double seconds = std::chrono::duration<double>(Clock::now() -
+                                                 start).count();
+  *stats = strang.stats();
+  return seconds;
+}
+
+static realtype max_error(const std::vector<realtype> &a,
+                          const std::vector<realtype> &b) {
+  realtype e = 0;
+  for (size_t i = 0; i < a.size() && i < b.size(); i++)
+    e = std::fmax(e, std::fabs(a[i] - b[i]));
+  return e;
+}
+
+int main(int argc, char *argv[]) {
+  long int n = argc > 1 ? atol(argv[1]) : 1000;
+  int substeps = argc > 2 ? atoi(argv[2]) : 1;
+  if (n < 2) n = 2;
+  if (substeps < 1) substeps = 1;
+
+  UserData data;
+  data.n = n;
+  data.dx = 1.0 / (n - 1);
+  data.d[0] = 0.01;
+  data.d[1] = 0.001;
+  data.coeffs[0] = 0.01;
+  data.coeffs[1] = 0.02;
+
+  try {
+    std::vector<realtype> reference, out;
+    long int steps;
+    coupled(data, feasible_tolerance(1e-10), reference, &steps);
+
+    printf("%ld points, d = (%g, %g), t = 0 .. %g, %d substeps\n\n", n,
+           (double) data.d[0], (double) data.d[1], (double) end_time,
+           substeps);
+    printf("method   order         h / tol       time     steps  "
+           "max error  order\n");
+    const realtype tols[] = {1e-4, 1e-6};
+    for (realtype tol : tols) {
+      double seconds = coupled(data, tol, out, &steps);
+      printf("cvode    band          %7.0e  %9.3f ms  %8ld  %9.2e\n",
+             (double) tol, 1e3 * seconds, steps,
+             (double) max_error(out, reference));
+    }
+
+    const realtype hs[] = {0.1, 0.05, 0.025, 0.0125};
+    for (int first = 1; first >= 0; first--) {
+      realtype previous = 0;
+      for (size_t j = 0; j < sizeof(hs) / sizeof(hs[0]); j++) {
+        SplittingStats stats;
+        double seconds = split(data, hs[j], first != 0, substeps, out,
+                               &stats);
+        realtype error = max_error(out, reference);
+        printf("strang   %-12s  %7.4f  %9.3f ms  %8ld  %9.2e",
+               first ? "R(h/2)D(h)" : "D(h/2)R(h)", (double) hs[j],
+               1e3 * seconds, stats.steps, (double) error);
+        if (j > 0 && error > 0)
+          printf("  %5.2f", (double) std::log2(previous / error));
+        if (stats.newton_failures > 0)
+          printf("  (%ld SDIRK stages did not converge)",
+                 stats.newton_failures);
+        printf("\n");
+        previous = error;
+      }
+    }
+  } catch (const SundialsError &e) {
+    fprintf(stderr, "\nSUNDIALS_ERROR: %s\n\n", e.what());
+    return(1);
+  }
+  return(0);
+}
+
+// Simple function that calculates the differential equation: reaction and
+// diffusion at every point.
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data) {
+  // N_VGetArrayPointer returns a pointer to the data in the N_Vector class.
+  realtype *udata  = N_VGetArrayPointer(u); // pointer u vector data
+  realtype *dudata = N_VGetArrayPointer(u_dot); // pointer to udot vector data
+
+  // Access inforation in user_data.
+  UserData *u_data = (UserData*) user_data;
+  const sunindextype n = u_data->n;
+
+  reaction(n, udata, dudata, NULL, u_data);
+  for (int c = 0; c < 2; c++) {
+    const realtype k = u_data->d[c] / (u_data->dx * u_data->dx);
+    for (sunindextype i = 0; i < n; i++) {
+      // Mirrored ghost points at both ends: zero flux.
+      realtype left = udata[2 * (i > 0 ? i - 1 : 1) + c];
+      realtype right = udata[2 * (i < n - 1 ? i + 1 : n - 2) + c];
+      dudata[2 * i + c] += k * (left - 2 * udata[2 * i + c] + right);
+    }
+  }
+
+  return(0);
+}
+
+// The reaction of the user data example at every point, with its Jacobian.
+static void reaction(sunindextype n, const realtype *y, realtype *rate,
+                     realtype *J, void *data) {
+  const UserData *u_data = (const UserData*) data;
+  const realtype c0 = u_data->coeffs[0], c1 = u_data->coeffs[1];
+
+  for (sunindextype i = 0; i < n; i++) {
+    rate[2 * i] = -101.0 * y[2 * i] - 100.0 * y[2 * i + 1] + c0;
+    rate[2 * i + 1] = y[2 * i] + c1;
+  }
+  if (J == NULL) return;
+  for (sunindextype i = 0; i < n; i++) {
+    J[4 * i] = -101.0;
+    J[4 * i + 1] = -100.0;
+    J[4 * i + 2] = 1.0;
+    J[4 * i + 3] = 0.0;
+  }
+}
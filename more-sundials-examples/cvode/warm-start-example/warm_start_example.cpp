@@ -0,0 +1,184 @@
+/*
+Warm-started CVODE runs over a sweep of nearby parameters, using the step
+profiles of earlier runs (include/cvode_warmstart.h).
+
+The system is the 2d system of the user data example,
+
+  y0' = -101 y0 - 100 y1 + c0
+  y1' = y0 + c1
+
+integrated from y = (2, 1) to t = 50. The sweep walks through nearby
+coefficient pairs. Every point is run twice on the same integrator:
+
+  cold  - CVODE's defaults: estimated initial step, maximum order 5
+  warm  - initial step and maximum order from the profile of the nearest
+          earlier run
+
+The startup window is the first output interval, where the fast mode of the
+system decays. For each point the steps taken in it and over the whole run
+are compared. Run as "./executable [runs] [profile file]"; with a profile
+file, the library is loaded from it first and saved to it afterwards, so a
+later sweep starts warm right away.
+*/
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cvode/cvode.h> // prototypes for CVODE fcts., consts.
+#include <nvector/nvector_serial.h>  // access to serial N_Vector
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+#include <sundials_raii.h> // move-only owners and CVodeIntegrator
+#include <cvode_warmstart.h> // step profiles and warm starts
+
+
+// Struct for holding the nessesary additional variables for the problem.
+struct UserData {
+  realtype coeffs[2];
+};
+
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data);
+static int jtv(N_Vector v, N_Vector Jv, realtype t, N_Vector u, N_Vector fu,
+               void *user_data, N_Vector tmp);
+
+static const realtype reltol = 1e-5;
+static const realtype abstol = 1e-5;
+static const realtype end_time = 50;
+static const realtype step_length = 0.5;
+
+// What one run cost.
+struct RunStats {
+  int flag = CV_SUCCESS;
+  long int startup_steps = 0; // steps in the first output interval
+  long int steps = 0; // steps of the whole run
+  long int failures = 0; // error test failures of the whole run
+  realtype h0 = 0; // initial step actually used
+  realtype y_end[2] = {0, 0};
+};
+
+// Integrates from t = 0 with the given profile (NULL for a cold start) and
+// returns the profile of this run in *out.
+static RunStats run(CVodeIntegrator &cv, const std::vector<realtype> &point,
+                    const StepProfile *warm, StepProfile *out) {
+  RunStats s;
+  const realtype y0[2] = {2, 1};
+  cv.reset(0, y0);
+  s.flag = warm_start(cv.mem(), warm);
+  if (s.flag < 0) return s;
+
+  StepProfileRecorder recorder(cv.mem(), cv.y(), point);
+  realtype t;
+  for (int k = 1; k * step_length <= end_time; k++) {
+    s.flag = recorder.advance(k * step_length, &t);
+    if (s.flag < 0) return s;
+    if (k == 1) recorder.end_startup();
+  }
+  *out = recorder.profile();
+  s.startup_steps = out->startup_steps;
+  CVodeGetNumSteps(cv.mem(), &s.steps);
+  CVodeGetNumErrTestFails(cv.mem(), &s.failures);
+  CVodeGetActualInitStep(cv.mem(), &s.h0);
+  s.y_end[0] = cv.y_data()[0];
+  s.y_end[1] = cv.y_data()[1];
+  return s;
+}
+
+int main(int argc, char *argv[]) {
+  int runs = argc > 1 ? atoi(argv[1]) : 40;
+  std::string profile_file = argc > 2 ? argv[2] : "";
+  if (runs < 1) runs = 1;
+
+  StepProfileLibrary library;
+  if (!profile_file.empty() && library.load(profile_file))
+    printf("loaded %zu profiles from %s\n\n", library.size(),
+           profile_file.c_str());
+
+  UserData data = {{0, 0}};
+  long int startup_cold = 0, startup_warm = 0, steps_cold = 0, steps_warm = 0;
+  realtype max_diff = 0;
+  try {
+    CVodeIntegrator cv = CVodeIntegrator::spgmr(2, f, jtv, reltol, abstol,
+                                                &data);
+    printf("  run      c0      c1   h0 cold   h0 warm  startup cold/warm"
+           "    steps cold/warm\n");
+    for (int i = 0; i < runs; i++) {
+      // A slow walk through parameter space, as in a fit or a sweep.
+      data.coeffs[0] = 0.01 * (1 + 0.05 * i);
+      data.coeffs[1] = 0.02 * (1 + 0.03 * std::sin(0.3 * i));
+      std::vector<realtype> point(data.coeffs, data.coeffs + 2);
+
+      StepProfile cold_profile, warm_profile;
+      RunStats cold = run(cv, point, NULL, &cold_profile);
+      const StepProfile *nearest = library.nearest(point);
+      RunStats warm = run(cv, point, nearest, &warm_profile);
+      if (cold.flag < 0 || warm.flag < 0) {
+        fprintf(stderr, "\nSUNDIALS_ERROR: CVode() failed with flag = %d\n\n",
+                cold.flag < 0 ? cold.flag : warm.flag);
+        return(1);
+      }
+      // The warm run carries the initial step forward for the next point.
+      library.add(nearest ? warm_profile : cold_profile);
+
+      printf("%5d  %6.4f  %6.4f  %8.2e  %8.2e  %9ld / %-6ld  %9ld / %-6ld\n",
+             i, (double) data.coeffs[0], (double) data.coeffs[1],
+             (double) cold.h0, (double) warm.h0, cold.startup_steps,
+             warm.startup_steps, cold.steps, warm.steps);
+      startup_cold += cold.startup_steps;
+      startup_warm += warm.startup_steps;
+      steps_cold += cold.steps;
+      steps_warm += warm.steps;
+      for (int j = 0; j < 2; j++)
+        max_diff = std::fmax(max_diff,
+                             std::fabs(cold.y_end[j] - warm.y_end[j]));
+    }
+  } catch (const SundialsError &e) {
+    fprintf(stderr, "\nSUNDIALS_ERROR: %s\n\n", e.what());
+    return(1);
+  }
+
+  printf("\nstartup steps: cold %ld, warm %ld, saved %ld (%.1f per run)\n",
+         startup_cold, startup_warm, startup_cold - startup_warm,
+         (double) (startup_cold - startup_warm) / runs);
+  printf("total steps:   cold %ld, warm %ld, saved %ld\n", steps_cold,
+         steps_warm, steps_cold - steps_warm);
+  printf("max difference of the final states: %g\n", (double) max_diff);
+
+  if (!profile_file.empty()) {
+    if (!library.save(profile_file)) {
+      fprintf(stderr, "can not write %s\n", profile_file.c_str());
+      return(1);
+    }
+    printf("saved %zu profiles to %s\n", library.size(),
+           profile_file.c_str());
+  }
+  return(0);
+}
+
+// Simple function that calculates the differential equation.
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data) {
+  // N_VGetArrayPointer returns a pointer to the data in the N_Vector class.
+  realtype *udata  = N_VGetArrayPointer(u); // pointer u vector data
+  realtype *dudata = N_VGetArrayPointer(u_dot); // pointer to udot vector data
+
+  // Access inforation in user_data.
+  UserData *u_data = (UserData*) user_data;
+
+  dudata[0] = -101.0 * udata[0] - 100.0 * udata[1] + u_data->coeffs[0];
+  dudata[1] = udata[0] + u_data->coeffs[1];
+
+  return(0);
+}
+
+// Jacobian function vector routine.
+static int jtv(N_Vector v, N_Vector Jv, realtype t, N_Vector u, N_Vector fu,
+               void *user_data, N_Vector tmp) {
+  realtype *vdata  = N_VGetArrayPointer(v);
+  realtype *Jvdata = N_VGetArrayPointer(Jv);
+
+  Jvdata[0] = -101.0 * vdata[0] + -100.0 * vdata[1];
+  Jvdata[1] = vdata[0];
+
+  return(0);
+}
@@ -0,0 +1,257 @@
+/*
+Waveform relaxation of weakly coupled subsystems on threads
+(include/cvode_waveform.h).
+
+The model is a chain of copies of the 2d system of the user data example,
+each copy i with its own coefficients and weakly coupled to its neighbours
+through y1,
+
+  y0_i' = -101 y0_i - 100 y1_i + c0_i + eps (y1_{i-1} - 2 y1_i + y1_{i+1})
+  y1_i' = y0_i + c1_i
+
+The chain is cut into blocks of copies. Each block is a subsystem with its
+own CVODE instance, and its inputs are y1 of the last copy of the block
+before and of the first copy of the block after it. The model is
+integrated from y = (2, 1) to t = 50 with a window per output interval
+of 0.5,
+
+  monolithic    - as one system by one CVode run, as the parallel example
+                  would, which couples all blocks in every rhs evaluation
+  jacobi        - waveform relaxation, all blocks in parallel
+  gauss-seidel  - waveform relaxation, even blocks first, then odd ones
+
+and every result is compared with a monolithic run at tolerance 1e-10.
+Run as "./executable [blocks] [copies per block] [threads]".
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <cvode/cvode.h> // prototypes for CVODE fcts., consts.
+#include <nvector/nvector_serial.h>  // access to serial N_Vector
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+#include <sundials_raii.h> // move-only owners and CVodeIntegrator
+#include <sundials_precision.h> // feasible_tolerance, precision_name
+#include <cvode_waveform.h> // waveform relaxation driver
+
+// The coefficients of the chain of copies.
+struct Chain {
+  sunindextype copies;
+  realtype eps;
+  std::vector<realtype> c0, c1;
+};
+
+// One block of the chain: copies first .. first + size - 1.
+struct Block {
+  const Chain *chain;
+  sunindextype first, size;
+  bool left, right; // has a neighbour block; inputs in this order
+};
+
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data);
+static int block_rhs(realtype t, const realtype *y, realtype *ydot,
+                     const realtype *inputs, void *data);
+
+static const realtype reltol = 1e-6;
+static const realtype abstol = 1e-8;
+static const realtype end_time = 50;
+static const realtype step_length = 0.5;
+
+typedef std::chrono::steady_clock Clock;
+
+// The equations of copy i, given the y1 of its neighbours.
+static inline void copy_rhs(const Chain &c, sunindextype i, realtype y0,
+                            realtype y1, realtype left, realtype right,
+                            realtype *dy) {
+  dy[0] = -101.0 * y0 - 100.0 * y1 + c.c0[i] +
+          c.eps * (left - 2 * y1 + right);
+  dy[1] = y0 + c.c1[i];
+}
+
+// The whole chain as one system. Returns the seconds; out receives the
+// state at every output time.
+static double monolithic(Chain &chain, realtype tol, std::vector<realtype> &out,
+                         long int *steps, long int *rhs_evals) {
+  const sunindextype N = 2 * chain.copies;
+  CVodeIntegrator cv = CVodeIntegrator::spgmr(N, f, NULL, tol, tol * 1e-2,
+                                              &chain);
+  sundials_check(CVodeSetMaxNumSteps(cv.mem(), 100000),
+                 "CVodeSetMaxNumSteps");
+  std::vector<realtype> y0(N);
+  for (sunindextype i = 0; i < chain.copies; i++) {
+    y0[2 * i] = 2;
+    y0[2 * i + 1] = 1;
+  }
+  Clock::time_point start = Clock::now();
+  cv.reset(0, y0.data());
+  out.clear();
+  realtype t;
+  for (int k = 1; k * step_length <= end_time; k++) {
+    int flag = cv.advance(k * step_length, &t);
+    if (flag < 0) throw SundialsError("CVode", flag);
+    out.insert(out.end(), cv.y_data(), cv.y_data() + N);
+  }
+  double seconds = std::chrono::duration<double>(Clock::now() -
+                                                 start).count();
+  CVodeGetNumSteps(cv.mem(), steps);
+  CVodeGetNumRhsEvals(cv.mem(), rhs_evals);
+  return seconds;
+}
+
+// The chain as blocks coupled by waveform relaxation.
+static double relaxation(Chain &chain, sunindextype per_block, int threads,
+                         WaveformMethod method, std::vector<realtype> &out,
+                         WaveformStats *stats) {
+  WaveformOptions options;
+  options.method = method;
+  options.threads = threads;
+  options.reltol = reltol;
+  options.abstol = abstol;
+  WaveformRelaxation wr(options);
+
+  const sunindextype nblocks = (chain.copies + per_block - 1) / per_block;
+  std::vector<Block> blocks(nblocks);
+  for (sunindextype b = 0; b < nblocks; b++) {
+    Block &blk = blocks[b];
+    blk.chain = &chain;
+    blk.first = b * per_block;
+    blk.size = std::min(per_block, chain.copies - blk.first);
+    blk.left = b > 0;
+    blk.right = b < nblocks - 1;
+    std::vector<WaveformLink> inputs;
+    if (blk.left) {
+      WaveformLink l = {(int) b - 1, 2 * blocks[b - 1].size - 1};
+      inputs.push_back(l);
+    }
+    if (blk.right) {
+      WaveformLink l = {(int) b + 1, 1};
+      inputs.push_back(l);
+    }
+    wr.add(2 * blk.size, block_rhs, &blk, inputs);
+    std::vector<realtype> y0(2 * blk.size);
+    for (sunindextype k = 0; k < blk.size; k++) {
+      y0[2 * k] = 2;
+      y0[2 * k + 1] = 1;
+    }
+    wr.set_state((int) b, y0.data());
+  }
+
+  out.clear();
+  Clock::time_point start = Clock::now();
+  *stats = wr.solve(0, end_time, step_length, [&](realtype) {
+    for (sunindextype b = 0; b < nblocks; b++)
+      out.insert(out.end(), wr.state((int) b),
+                 wr.state((int) b) + 2 * blocks[b].size);
+  });
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static realtype max_error(const std::vector<realtype> &a,
+                          const std::vector<realtype> &b) {
+  realtype e = 0;
+  for (size_t i = 0; i < a.size() && i < b.size(); i++)
+    e = std::fmax(e, std::fabs(a[i] - b[i]));
+  return e;
+}
+
+int main(int argc, char *argv[]) {
+  long int nblocks = argc > 1 ? atol(argv[1]) : 8;
+  long int per_block = argc > 2 ? atol(argv[2]) : 250;
+  int threads = argc > 3 ? atoi(argv[3]) : 0;
+  if (nblocks < 1) nblocks = 1;
+  if (per_block < 1) per_block = 1;
+
+  Chain chain;
+  chain.copies = nblocks * per_block;
+  chain.eps = 1;
+  chain.c0.resize(chain.copies);
+  chain.c1.resize(chain.copies);
+  for (sunindextype i = 0; i < chain.copies; i++) {
+    chain.c0[i] = 0.01 * (1 + 0.5 * std::sin(0.1 * i));
+    chain.c1[i] = 0.02 * (1 + 0.5 * std::cos(0.1 * i));
+  }
+
+  try {
+    std::vector<realtype> reference, out;
+    long int steps, rhs_evals;
+    monolithic(chain, feasible_tolerance(1e-10), reference, &steps,
+               &rhs_evals);
+
+    printf("%ld blocks of %ld copies (%ld equations), windows of %g\n\n",
+           nblocks, per_block, (long int) (2 * chain.copies),
+           (double) step_length);
+    printf("method         time      iterations/window  steps     "
+           "rhs evals  syncs  max error\n");
+    double seconds = monolithic(chain, reltol, out, &steps, &rhs_evals);
+    printf("monolithic    %8.3f ms  %8s %8s  %8ld  %10ld  %5ld  %9.2e\n",
+           1e3 * seconds, "-", "", steps, rhs_evals, rhs_evals,
+           (double) max_error(out, reference));
+
+    const WaveformMethod methods[] = {WaveformMethod::Jacobi,
+                                      WaveformMethod::GaussSeidel};
+    for (WaveformMethod m : methods) {
+      WaveformStats stats;
+      seconds = relaxation(chain, per_block, threads, m, out, &stats);
+      char iterations[32];
+      snprintf(iterations, sizeof(iterations), "%.2f (max %d)",
+               (double) stats.iterations / stats.windows,
+               stats.max_iterations);
+      printf("%-12s  %8.3f ms  %17s  %8ld  %10ld  %5ld  %9.2e\n",
+             m == WaveformMethod::Jacobi ? "jacobi" : "gauss-seidel",
+             1e3 * seconds, iterations, stats.steps, stats.rhs_evals,
+             stats.iterations, (double) max_error(out, reference));
+      if (stats.unconverged > 0)
+        printf("  %ld windows did not converge\n", stats.unconverged);
+    }
+    printf("\nsyncs: points where the blocks exchange values (for the "
+           "monolithic run, rhs evaluations)\n");
+  } catch (const SundialsError &e) {
+    fprintf(stderr, "\nSUNDIALS_ERROR: %s\n\n", e.what());
+    return(1);
+  }
+  return(0);
+}
+
+// Simple function that calculates the differential equation of the whole
+// chain.
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data) {
+  // N_VGetArrayPointer returns a pointer to the data in the N_Vector class.
+  realtype *udata  = N_VGetArrayPointer(u); // pointer u vector data
+  realtype *dudata = N_VGetArrayPointer(u_dot); // pointer to udot vector data
+
+  // Access inforation in user_data.
+  const Chain *c = (const Chain*) user_data;
+  const sunindextype n = c->copies;
+
+  for (sunindextype i = 0; i < n; i++) {
+    realtype y1 = udata[2 * i + 1];
+    realtype left = i > 0 ? udata[2 * i - 1] : y1;
+    realtype right = i < n - 1 ? udata[2 * i + 3] : y1;
+    copy_rhs(*c, i, udata[2 * i], y1, left, right, dudata + 2 * i);
+  }
+
+  return(0);
+}
+
+// The differential equation of one block, with the y1 of the neighbouring
+// blocks as inputs.
+static int block_rhs(realtype t, const realtype *y, realtype *ydot,
+                     const realtype *inputs, void *data) {
+  const Block *b = (const Block*) data;
+  const sunindextype n = b->size;
+  realtype outer_left = b->left ? inputs[0] : y[1];
+  realtype outer_right = b->right ? inputs[b->left ? 1 : 0] : y[2 * n - 1];
+
+  for (sunindextype k = 0; k < n; k++) {
+    realtype y1 = y[2 * k + 1];
+    realtype left = k > 0 ? y[2 * k - 1] : outer_left;
+    realtype right = k < n - 1 ? y[2 * k + 3] : outer_right;
+    copy_rhs(*b->chain, b->first + k, y[2 * k], y1, left, right,
+             ydot + 2 * k);
+  }
+
+  return(0);
+}
@@ -267,9 +267,11 @@ int main() {
   CVodeFree(&cvode_mem);
   // ---------------------------------------------------------------------------
 
-  // 31. Free linear solver and matrix memory for the backward problem.
+  // 31. Free linear solver and matrix memory for the forward and backward
+  // problems.
   // ---------------------------------------------------------------------------
   SUNLinSolFree(LS);
+  SUNLinSolFree(LSB);
   // ---------------------------------------------------------------------------
 
   // 32. Finalize MPI, if used.
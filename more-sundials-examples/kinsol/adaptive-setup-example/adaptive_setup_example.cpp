@@ -0,0 +1,397 @@
+/*
+An example using the KINSOL library with a preconditioner whose rebuild
+frequency is chosen by the driver during the solve, instead of the fixed
+schedule given by KINSetMaxSetupCalls (msbset).
+
+The problem is a 1D Bratu problem with a nonlocal (integral) term,
+
+  u'' + lambda * exp(u) + mu * integral(u) = 0,   u(0) = u(1) = 0,
+
+discretized with central differences. The integral term makes the Jacobian
+dense, so the preconditioner (a dense LU factorization of the Jacobian) is
+expensive to build and cheap to apply.
+*/
+
+#include <iostream>
+#include <chrono>
+#include <kinsol/kinsol.h> // access to KINSOL func., consts.
+#include <kinsol/kinsol_spils.h> // access to KINSpils interface
+#include <nvector/nvector_serial.h>  // access to serial N_Vector
+#include <sunlinsol/sunlinsol_spgmr.h>  //access to SPGMR SUNLinearSolver
+#include <sundials/sundials_dense.h>  // use generic dense solver in precond
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+#include <sundials/sundials_math.h>  // contains the macros ABS, SUNSQR, EXP
+#include <sundials_precision.h> // feasible_tolerance
+
+// This macro gives access to the individual components of the data array of an
+// N Vector.
+#define NV_Ith_S(v,i) ( NV_DATA_S(v)[i] )
+
+
+// Driver-level policy deciding whether a preconditioner setup requested by
+// KINSOL actually rebuilds the factorization or reuses the previous one.
+//
+// KINSOL is told to request a setup on every nonlinear iteration
+// (msbset = 1) and the policy rebuilds only when
+//  - the residual norm dropped by less than rate_max since the last request,
+//  - the GMRES iterations per Newton iteration grew past lin_growth times
+//    the count seen right after the last rebuild, or
+//  - the time spent iterating since the last rebuild exceeds the time the
+//    rebuild itself took, so a stale preconditioner never costs more than a
+//    fresh one would have.
+struct SetupPolicy {
+  bool adaptive = true; // false rebuilds on every setup KINSOL requests
+  realtype rate_max = 0.5;
+  realtype lin_growth = 2.0;
+
+  // State of the current solve.
+  void *kin_mem = NULL;
+  bool have_factors = false;
+  long int nni_prev = -1; // nonlinear iterations at the previous request
+  long int nli_prev = 0; // linear iterations at the previous request
+  realtype fnorm_prev = 0;
+  realtype lin_fresh = 0; // linear iterations per Newton iteration after rebuild
+  double setup_seconds = 0; // cost of the last rebuild
+  double since_rebuild = 0; // time spent iterating since the last rebuild
+  std::chrono::steady_clock::time_point last_request;
+
+  // Statistics of the current solve.
+  long int requests = 0; // setups requested by KINSOL
+  long int rebuilds = 0; // setups that rebuilt the factorization
+};
+
+// Struct for holding the nessesary additional variables for the problem.
+struct UserData {
+  sunindextype N; // number of interior grid points
+  realtype h; // grid spacing
+  realtype lambda; // Bratu parameter
+  realtype mu; // weight of the nonlocal term
+  realtype **P; // dense LU factors of the Jacobian
+  sunindextype *pivots;
+  SetupPolicy policy;
+};
+
+static int f(N_Vector u, N_Vector f_val, void *user_data);
+static int psetup(N_Vector u, N_Vector uscale, N_Vector fval, N_Vector fscale,
+                  void *user_data);
+static int psolve(N_Vector u, N_Vector uscale, N_Vector fval, N_Vector fscale,
+                  N_Vector v, void *user_data);
+static bool needs_rebuild(SetupPolicy *policy, long int nni, long int nli,
+                          realtype fnorm);
+static void reset_policy(SetupPolicy *policy, void *kin_mem);
+static int solve(UserData *data, N_Vector u, long int msbset,
+                 long int *nni, long int *nli, double *seconds);
+static int check_flag(void *flagvalue, const char *funcname, int opt);
+UserData* alloc_user_data(sunindextype N);
+void free_user_data(UserData *data);
+
+
+int main() {
+  // 1. Initialize parallel or multi-threaded environment, if appropriate.
+  // ---------------------------------------------------------------------------
+  // ---------------------------------------------------------------------------
+
+  // 2. Defining the length of the problem.
+  // ---------------------------------------------------------------------------
+  sunindextype N = 400;
+  UserData *data = alloc_user_data(N);
+  if (check_flag((void *)data, "alloc_user_data", 2)) return(1);
+  // ---------------------------------------------------------------------------
+
+  // 3. Set vector with initial guess.
+  // ---------------------------------------------------------------------------
+  N_Vector u = N_VNew_Serial(N);
+  if (check_flag((void *)u, "N_VNew_Serial", 0)) return(1);
+  // ---------------------------------------------------------------------------
+
+  // 4. - 12. Create the solver and solve the problem.
+  // ---------------------------------------------------------------------------
+  // Each solve is run with three setup schedules: a rebuild on every Newton
+  // iteration, KINSOL's default fixed schedule (msbset = 10) and the adaptive
+  // policy. The larger lambda is, the more the Jacobian changes per iteration.
+  realtype lambdas[] = {1.0, 2.0, 3.0, 3.4};
+  struct Schedule { const char *name; bool adaptive; long int msbset; };
+  Schedule schedules[] = {
+    {"every iteration", false, 1},
+    {"fixed msbset=10", false, 10},
+    {"adaptive       ", true, 1},
+  };
+
+  std::cout << "N = " << N << "\n";
+  for (realtype lambda : lambdas) {
+    data->lambda = lambda;
+    std::cout << "\nlambda = " << lambda << "\n";
+    for (const Schedule &s : schedules) {
+      data->policy.adaptive = s.adaptive;
+      long int nni, nli;
+      double seconds;
+      N_VConst(0.0, u);
+      if (solve(data, u, s.msbset, &nni, &nli, &seconds)) return(1);
+
+      // 13. Get optional outputs.
+      const SetupPolicy &p = data->policy;
+      std::cout << "  " << s.name
+                << "  nni: " << nni
+                << "  lin iters: " << nli
+                << "  setups requested: " << p.requests
+                << "  rebuilt: " << p.rebuilds
+                << "  saved: " << p.requests - p.rebuilds
+                << "  time: " << seconds * 1e3 << " ms\n";
+    }
+    std::cout << "  max(u) = " << N_VMaxNorm(u) << "\n";
+  }
+  // ---------------------------------------------------------------------------
+
+  // 14. Deallocate memory for solution vector.
+  // ---------------------------------------------------------------------------
+  N_VDestroy(u);
+  free_user_data(data);
+  // ---------------------------------------------------------------------------
+
+  return(0);
+}
+
+// Runs one KINSOL solve from the initial guess in u. msbset is the maximum
+// number of nonlinear iterations between setup requests.
+static int solve(UserData *data, N_Vector u, long int msbset,
+                 long int *nni, long int *nli, double *seconds) {
+  int flag;
+
+  N_Vector sc = N_VClone(u); // Scaling vector.
+  if (check_flag((void *)sc, "N_VClone", 0)) return(1);
+  N_VConst(1.0, sc);
+
+  // 4. Create KINSOL Object.
+  void *kin_mem = KINCreate();
+  if (check_flag((void *)kin_mem, "KINCreate", 0)) return(1);
+
+  // 5. Set Optional Inputs.
+  flag = KINSetUserData(kin_mem, data);
+  if (check_flag(&flag, "KINSetUserData", 1)) return(1);
+  flag = KINSetMaxSetupCalls(kin_mem, msbset);
+  if (check_flag(&flag, "KINSetMaxSetupCalls", 1)) return(1);
+  flag = KINSetFuncNormTol(kin_mem, feasible_tolerance(1e-9));
+  if (check_flag(&flag, "KINSetFuncNormTol", 1)) return(1);
+
+  // 6. Allocate Internal Memory.
+  flag = KINInit(kin_mem, f, u);
+  if (check_flag(&flag, "KINInit", 1)) return(1);
+
+  // 8. Create Linear Solver Object.
+  SUNLinearSolver LS = SUNSPGMR(u, PREC_RIGHT, 30);
+  if (check_flag((void *)LS, "SUNSPGMR", 0)) return(1);
+
+  // 10. Attach linear solver module.
+  flag = KINSpilsSetLinearSolver(kin_mem, LS);
+  if (check_flag(&flag, "KINSpilsSetLinearSolver", 1)) return(1);
+
+  // 11. Set linear solver interface optional inputs.
+  flag = KINSpilsSetPreconditioner(kin_mem, psetup, psolve);
+  if (check_flag(&flag, "KINSpilsSetPreconditioner", 1)) return(1);
+
+  // 12. Solve problem.
+  reset_policy(&data->policy, kin_mem);
+  auto start = std::chrono::steady_clock::now();
+  flag = KINSol(kin_mem, u, KIN_LINESEARCH, sc, sc);
+  auto stop = std::chrono::steady_clock::now();
+  if (check_flag(&flag, "KINSol", 1)) return(1);
+  *seconds = std::chrono::duration<double>(stop - start).count();
+
+  // 13. Get optional outputs.
+  flag = KINGetNumNonlinSolvIters(kin_mem, nni);
+  if (check_flag(&flag, "KINGetNumNonlinSolvIters", 1)) return(1);
+  flag = KINSpilsGetNumLinIters(kin_mem, nli);
+  if (check_flag(&flag, "KINSpilsGetNumLinIters", 1)) return(1);
+
+  // 14. - 16. Free memory.
+  N_VDestroy(sc);
+  KINFree(&kin_mem);
+  SUNLinSolFree(LS);
+  data->policy.kin_mem = NULL;
+
+  return(0);
+}
+
+// Discretized Bratu problem with the nonlocal term.
+static int f(N_Vector u, N_Vector f_val, void *user_data) {
+  realtype *udata = N_VGetArrayPointer(u);
+  realtype *fdata = N_VGetArrayPointer(f_val);
+
+  UserData *data = (UserData*) user_data;
+  sunindextype N = data->N;
+  realtype inv_h2 = 1.0 / (data->h * data->h);
+
+  realtype integral = 0;
+  for (sunindextype i = 0; i < N; i++) integral += udata[i];
+  integral *= data->h;
+
+  for (sunindextype i = 0; i < N; i++) {
+    realtype left = (i > 0) ? udata[i - 1] : 0;
+    realtype right = (i < N - 1) ? udata[i + 1] : 0;
+    fdata[i] = (left - 2.0 * udata[i] + right) * inv_h2
+               + data->lambda * SUNRexp(udata[i]) + data->mu * integral;
+  }
+
+  return(0);
+}
+
+// Preconditioner setup. KINSOL calls this whenever it wants the
+// preconditioner refreshed. The policy decides whether the dense Jacobian is
+// actually rebuilt and factored, or the previous factors are kept.
+static int psetup(N_Vector u, N_Vector uscale, N_Vector fval, N_Vector fscale,
+                  void *user_data) {
+  UserData *data = (UserData*) user_data;
+  SetupPolicy *policy = &data->policy;
+
+  long int nni, nli;
+  KINGetNumNonlinSolvIters(policy->kin_mem, &nni);
+  KINSpilsGetNumLinIters(policy->kin_mem, &nli);
+  realtype fnorm = N_VWL2Norm(fval, fscale);
+
+  policy->requests++;
+  if (!needs_rebuild(policy, nni, nli, fnorm)) return(0);
+
+  auto start = std::chrono::steady_clock::now();
+
+  realtype *udata = N_VGetArrayPointer(u);
+  sunindextype N = data->N;
+  realtype inv_h2 = 1.0 / (data->h * data->h);
+  realtype **P = data->P;
+
+  // Column j of the Jacobian is stored in P[j]. The nonlocal term adds
+  // mu * h to every entry.
+  for (sunindextype j = 0; j < N; j++) {
+    for (sunindextype i = 0; i < N; i++) P[j][i] = data->mu * data->h;
+    P[j][j] += -2.0 * inv_h2 + data->lambda * SUNRexp(udata[j]);
+    if (j > 0) P[j][j - 1] += inv_h2;
+    if (j < N - 1) P[j][j + 1] += inv_h2;
+  }
+  if (denseGETRF(P, N, N, data->pivots) != 0) return(1);
+
+  auto stop = std::chrono::steady_clock::now();
+  policy->setup_seconds = std::chrono::duration<double>(stop - start).count();
+  policy->since_rebuild = 0;
+  policy->last_request = stop;
+  policy->have_factors = true;
+  policy->rebuilds++;
+
+  return(0);
+}
+
+// Preconditioner solve, v = P^{-1} v with the current LU factors.
+static int psolve(N_Vector u, N_Vector uscale, N_Vector fval, N_Vector fscale,
+                  N_Vector v, void *user_data) {
+  UserData *data = (UserData*) user_data;
+  denseGETRS(data->P, data->N, data->pivots, N_VGetArrayPointer(v));
+  return(0);
+}
+
+// Decides whether a setup request has to rebuild the preconditioner and
+// updates the observed convergence history. nni and nli are the nonlinear
+// and linear iteration counts at the request, fnorm the scaled residual norm.
+static bool needs_rebuild(SetupPolicy *policy, long int nni, long int nli,
+                          realtype fnorm) {
+  auto now = std::chrono::steady_clock::now();
+  bool rebuild;
+
+  if (!policy->have_factors || !policy->adaptive) {
+    rebuild = true;
+  } else if (nni == policy->nni_prev) {
+    // A second request without a Newton step in between means the linear
+    // solve failed with the current factors, so they must be refreshed.
+    rebuild = true;
+  } else {
+    policy->since_rebuild +=
+        std::chrono::duration<double>(now - policy->last_request).count();
+
+    realtype rate = (policy->fnorm_prev > 0) ? fnorm / policy->fnorm_prev : 0;
+    realtype lin_per_iter = (realtype)(nli - policy->nli_prev)
+                            / (realtype)(nni - policy->nni_prev);
+    // Remember how well a fresh preconditioner does on the first iteration.
+    if (policy->lin_fresh < 0) policy->lin_fresh = lin_per_iter;
+
+    rebuild = rate > policy->rate_max
+              || lin_per_iter > policy->lin_growth * policy->lin_fresh + 1
+              || policy->since_rebuild > policy->setup_seconds;
+  }
+
+  if (rebuild) policy->lin_fresh = -1;
+  policy->nni_prev = nni;
+  policy->nli_prev = nli;
+  policy->fnorm_prev = fnorm;
+  policy->last_request = now;
+
+  return rebuild;
+}
+
+// Clears the state and statistics of the policy before a new solve.
+static void reset_policy(SetupPolicy *policy, void *kin_mem) {
+  policy->kin_mem = kin_mem;
+  policy->have_factors = false;
+  policy->nni_prev = -1;
+  policy->nli_prev = 0;
+  policy->fnorm_prev = 0;
+  policy->lin_fresh = -1;
+  policy->setup_seconds = 0;
+  policy->since_rebuild = 0;
+  policy->requests = 0;
+  policy->rebuilds = 0;
+}
+
+// check_flag function is from the cvDiurnals_ky.c example from the CVODE
+// package.
+/* Check function return value...
+     opt == 0 means SUNDIALS function allocates memory so check if
+              returned NULL pointer
+     opt == 1 means SUNDIALS function returns a flag so check if
+              flag >= 0
+     opt == 2 means function allocates memory so check if returned
+              NULL pointer */
+static int check_flag(void *flagvalue, const char *funcname, int opt) {
+  int *errflag;
+
+  /* Check if SUNDIALS function returned NULL pointer - no memory allocated */
+  if (opt == 0 && flagvalue == NULL) {
+    fprintf(stderr, "\nSUNDIALS_ERROR: %s() failed - returned NULL pointer\n\n",
+            funcname);
+    return(1); }
+
+  /* Check if flag < 0 */
+  else if (opt == 1) {
+    errflag = (int *) flagvalue;
+    if (*errflag < 0) {
+      fprintf(stderr, "\nSUNDIALS_ERROR: %s() failed with flag = %d\n\n",
+              funcname, *errflag);
+      return(1); }}
+
+  /* Check if function returned NULL pointer - no memory allocated */
+  else if (opt == 2 && flagvalue == NULL) {
+    fprintf(stderr, "\nMEMORY_ERROR: %s() failed - returned NULL pointer\n\n",
+            funcname);
+    return(1); }
+
+  return(0);
+}
+
+// Initalizes the problem parameters and the preconditioner storage.
+UserData* alloc_user_data(sunindextype N) {
+  UserData *data;
+  data = new UserData();
+
+  data->N = N;
+  data->h = 1.0 / (N + 1);
+  data->lambda = 1.0;
+  data->mu = -1.0;
+  data->P = newDenseMat(N, N);
+  data->pivots = newIndexArray(N);
+  if (data->P == NULL || data->pivots == NULL) return NULL;
+
+  return data;
+}
+
+// Frees the preconditioner storage and the user data.
+void free_user_data(UserData *data) {
+  destroyMat(data->P);
+  destroyArray(data->pivots);
+  delete data;
+}
@@ -0,0 +1,470 @@
+/*
+A scalable nonlinear benchmark for KINSOL: the 2D Bratu problem
+
+  laplace(u) + lambda * exp(u) = 0 on the unit square,  u = 0 on the boundary,
+
+discretized with the 5-point stencil on an n x n grid of interior points
+(N = n^2 unknowns). Each Newton iteration needs a linear solve with the
+Jacobian, which is run through one of four paths:
+
+  dense   - SUNDenseMatrix + SUNDenseLinearSolver
+  band    - SUNBandMatrix + SUNBandLinearSolver (bandwidth n)
+  klu     - SUNSparseMatrix + SUNKLU (needs SUNDIALS built with KLU)
+  gmres   - SUNSPGMR with an analytic Jacobian-times-vector and a line
+            (block tridiagonal) preconditioner
+
+Run without arguments to sweep N from 10^2 to 10^7 over all paths, or as
+"./executable <path> <N>" for a single case.
+*/
+
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <kinsol/kinsol.h> // access to KINSOL func., consts.
+#include <kinsol/kinsol_spils.h> // access to KINSpils interface
+#include <kinsol/kinsol_direct.h> // access to KINDls interface
+#include <nvector/nvector_serial.h>  // access to serial N_Vector
+#include <sunmatrix/sunmatrix_dense.h> // access to dense SUNMatrix
+#include <sunmatrix/sunmatrix_band.h> // access to band SUNMatrix
+#include <sunlinsol/sunlinsol_dense.h> // access to dense SUNLinearSolver
+#include <sunlinsol/sunlinsol_band.h> // access to band SUNLinearSolver
+#include <sunlinsol/sunlinsol_spgmr.h>  //access to SPGMR SUNLinearSolver
+#ifdef USE_KLU
+#include <sunmatrix/sunmatrix_sparse.h> // access to sparse SUNMatrix
+#include <sunlinsol/sunlinsol_klu.h> // access to KLU SUNLinearSolver
+#endif
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+#include <sundials/sundials_math.h>  // contains the macros ABS, SUNSQR, EXP
+#include <kinsol_stats.h> // convergence trace and statistics of KINSol
+#include <sundials_precision.h> // feasible_tolerance
+
+
+// The linear solver paths of the benchmark. max_N keeps the sweep from
+// running cases whose memory or factorization time is out of reach: dense
+// storage grows as N^2, band storage and factorization as N^1.5 and N^2.
+enum class LinearPath { Dense, Band, SparseDirect, Gmres };
+struct PathInfo {
+  LinearPath path;
+  const char *name;
+  sunindextype max_N;
+};
+static const PathInfo paths[] = {
+  {LinearPath::Dense, "dense", 1100},
+  {LinearPath::Band, "band", 110000},
+  {LinearPath::SparseDirect, "klu", 1100000},
+  {LinearPath::Gmres, "gmres", 11000000},
+};
+
+// Struct for holding the nessesary additional variables for the problem.
+struct UserData {
+  sunindextype n; // interior grid points per direction
+  sunindextype N; // number of unknowns, n * n
+  realtype h2lambda; // h^2 * lambda, the equations are scaled by h^2
+  // Inverse pivots of the Thomas factorization of the tridiagonal x-line
+  // blocks of the Jacobian, used by the GMRES preconditioner. The
+  // off-diagonals are 1, so the pivots are all the factorization needs.
+  realtype *inv_pivot;
+};
+
+// Measurements of one benchmark case.
+struct CaseResult {
+  KinSolveStats stats;
+  double total_seconds = 0; // setup and solve
+  long int peak_kb = 0; // peak resident set size
+};
+
+static int f(N_Vector u, N_Vector f_val, void *user_data);
+static int jac_dense(N_Vector u, N_Vector fu, SUNMatrix J, void *user_data,
+                     N_Vector tmp1, N_Vector tmp2);
+static int jac_band(N_Vector u, N_Vector fu, SUNMatrix J, void *user_data,
+                    N_Vector tmp1, N_Vector tmp2);
+#ifdef USE_KLU
+static int jac_sparse(N_Vector u, N_Vector fu, SUNMatrix J, void *user_data,
+                      N_Vector tmp1, N_Vector tmp2);
+#endif
+static int jtv(N_Vector v, N_Vector Jv, N_Vector u, booleantype *new_u,
+               void *user_data);
+static int psetup(N_Vector u, N_Vector uscale, N_Vector fval, N_Vector fscale,
+                  void *user_data);
+static int psolve(N_Vector u, N_Vector uscale, N_Vector fval, N_Vector fscale,
+                  N_Vector v, void *user_data);
+static int run_case(const PathInfo &path, sunindextype n, CaseResult *result);
+static void print_case(const PathInfo &path, sunindextype N,
+                       const CaseResult &result);
+static int check_flag(void *flagvalue, const char *funcname, int opt);
+
+
+int main(int argc, char **argv) {
+  // Single case: ./executable <path> <N>
+  if (argc == 3) {
+    for (const PathInfo &path : paths) {
+      if (std::strcmp(argv[1], path.name) != 0) continue;
+      sunindextype n = std::llround(std::sqrt(std::atof(argv[2])));
+      n = SUNMAX(n, 1);
+      CaseResult result;
+      if (run_case(path, n, &result)) return(1);
+      print_case(path, n * n, result);
+      return(0);
+    }
+    std::cerr << "usage: " << argv[0] << " [dense|band|klu|gmres N]\n";
+    return(1);
+  }
+
+  // Sweep N = 10^2 ... 10^7. Every case runs in its own child process so the
+  // reported peak memory belongs to that case alone.
+  printf("path          N   nni    nli    nfe      time [s]  peak RSS [MB]\n");
+  for (int e = 2; e <= 7; e++) {
+    sunindextype n = (sunindextype) std::llround(std::pow(10.0, e / 2.0));
+    for (const PathInfo &path : paths) {
+#ifndef USE_KLU
+      if (path.path == LinearPath::SparseDirect) continue;
+#endif
+      if (n * n > path.max_N) continue;
+
+      fflush(stdout);
+      pid_t pid = fork();
+      if (pid == 0) {
+        CaseResult result;
+        int status = run_case(path, n, &result);
+        if (status == 0) print_case(path, n * n, result);
+        fflush(stdout);
+        _exit(status);
+      }
+      int status;
+      waitpid(pid, &status, 0);
+      if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        printf("%-6s %9ld   failed\n", path.name, (long int) (n * n));
+    }
+  }
+
+  return(0);
+}
+
+// Sets up KINSOL with the given linear solver path on an n x n grid and
+// solves the problem from u = 0.
+static int run_case(const PathInfo &path, sunindextype n, CaseResult *result) {
+  int flag;
+  auto start = std::chrono::steady_clock::now();
+
+  // 2. Defining the length of the problem.
+  UserData data;
+  data.n = n;
+  data.N = n * n;
+  realtype h = 1.0 / (n + 1);
+  realtype lambda = 6.0; // the problem has no solution past lambda ~ 6.81
+  data.h2lambda = h * h * lambda;
+  data.inv_pivot = NULL;
+  sunindextype N = data.N;
+
+  // 3. Set vector with initial guess.
+  N_Vector u = N_VNew_Serial(N);
+  if (check_flag((void *)u, "N_VNew_Serial", 0)) return(1);
+  N_VConst(0.0, u);
+  N_Vector sc = N_VNew_Serial(N); // Scaling vector.
+  if (check_flag((void *)sc, "N_VNew_Serial", 0)) return(1);
+  N_VConst(1.0, sc);
+
+  // 4. Create KINSOL Object.
+  void *kin_mem = KINCreate();
+  if (check_flag((void *)kin_mem, "KINCreate", 0)) return(1);
+
+  // 5. Set Optional Inputs.
+  flag = KINSetUserData(kin_mem, &data);
+  if (check_flag(&flag, "KINSetUserData", 1)) return(1);
+  // The scaled residual is O(h^2 lambda) at u = 0, so the tolerance is
+  // relative to that to ask for the same accuracy at every N. On the finest
+  // grids, and at any N in single precision, that is below roundoff, so it
+  // is raised to what the precision can resolve.
+  flag = KINSetFuncNormTol(kin_mem, feasible_tolerance(1e-8 * data.h2lambda));
+  if (check_flag(&flag, "KINSetFuncNormTol", 1)) return(1);
+  KinStatsRecorder recorder(kin_mem, path.path == LinearPath::Gmres);
+
+  // 6. Allocate Internal Memory.
+  flag = KINInit(kin_mem, f, u);
+  if (check_flag(&flag, "KINInit", 1)) return(1);
+
+  // 7. - 11. Create and attach the matrix and linear solver of the path.
+  SUNMatrix J = NULL;
+  SUNLinearSolver LS = NULL;
+  switch (path.path) {
+    case LinearPath::Dense:
+      J = SUNDenseMatrix(N, N);
+      if (check_flag((void *)J, "SUNDenseMatrix", 0)) return(1);
+      LS = SUNDenseLinearSolver(u, J);
+      if (check_flag((void *)LS, "SUNDenseLinearSolver", 0)) return(1);
+      flag = KINDlsSetLinearSolver(kin_mem, LS, J);
+      if (check_flag(&flag, "KINDlsSetLinearSolver", 1)) return(1);
+      flag = KINDlsSetJacFn(kin_mem, jac_dense);
+      if (check_flag(&flag, "KINDlsSetJacFn", 1)) return(1);
+      break;
+
+    case LinearPath::Band:
+      // The storage upper bandwidth must hold the fill-in of the pivoting LU.
+      J = SUNBandMatrix(N, n, n, 2 * n);
+      if (check_flag((void *)J, "SUNBandMatrix", 0)) return(1);
+      LS = SUNBandLinearSolver(u, J);
+      if (check_flag((void *)LS, "SUNBandLinearSolver", 0)) return(1);
+      flag = KINDlsSetLinearSolver(kin_mem, LS, J);
+      if (check_flag(&flag, "KINDlsSetLinearSolver", 1)) return(1);
+      flag = KINDlsSetJacFn(kin_mem, jac_band);
+      if (check_flag(&flag, "KINDlsSetJacFn", 1)) return(1);
+      break;
+
+    case LinearPath::SparseDirect:
+#ifdef USE_KLU
+      J = SUNSparseMatrix(N, N, 5 * N, CSC_MAT);
+      if (check_flag((void *)J, "SUNSparseMatrix", 0)) return(1);
+      LS = SUNKLU(u, J);
+      if (check_flag((void *)LS, "SUNKLU", 0)) return(1);
+      flag = KINDlsSetLinearSolver(kin_mem, LS, J);
+      if (check_flag(&flag, "KINDlsSetLinearSolver", 1)) return(1);
+      flag = KINDlsSetJacFn(kin_mem, jac_sparse);
+      if (check_flag(&flag, "KINDlsSetJacFn", 1)) return(1);
+      break;
+#else
+      std::cerr << "klu: rebuild with USE_KLU = true in the Makefile\n";
+      return(1);
+#endif
+
+    case LinearPath::Gmres:
+      data.inv_pivot = new realtype[N];
+      LS = SUNSPGMR(u, PREC_RIGHT, 20);
+      if (check_flag((void *)LS, "SUNSPGMR", 0)) return(1);
+      flag = KINSpilsSetLinearSolver(kin_mem, LS);
+      if (check_flag(&flag, "KINSpilsSetLinearSolver", 1)) return(1);
+      flag = KINSpilsSetJacTimesVecFn(kin_mem, jtv);
+      if (check_flag(&flag, "KINSpilsSetJacTimesVecFn", 1)) return(1);
+      flag = KINSpilsSetPreconditioner(kin_mem, psetup, psolve);
+      if (check_flag(&flag, "KINSpilsSetPreconditioner", 1)) return(1);
+      break;
+  }
+
+  // 12. Solve problem.
+  recorder.begin_solve();
+  flag = KINSol(kin_mem, u, KIN_LINESEARCH, sc, sc);
+  recorder.end_solve(flag);
+  if (check_flag(&flag, "KINSol", 1)) return(1);
+  auto stop = std::chrono::steady_clock::now();
+
+  // 13. Get optional outputs.
+  result->stats = recorder.stats();
+  result->total_seconds = std::chrono::duration<double>(stop - start).count();
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  result->peak_kb = usage.ru_maxrss;
+#ifdef __APPLE__
+  result->peak_kb /= 1024; // macOS reports bytes
+#endif
+
+  // 14. - 16. Free memory.
+  N_VDestroy(u);
+  N_VDestroy(sc);
+  KINFree(&kin_mem);
+  SUNLinSolFree(LS);
+  if (J) SUNMatDestroy(J);
+  delete[] data.inv_pivot;
+
+  return(0);
+}
+
+// Prints one row of the results table. The direct solvers have no linear
+// iterations; their nli column is "-".
+static void print_case(const PathInfo &path, sunindextype N,
+                       const CaseResult &result) {
+  char nli[24] = "-";
+  if (result.stats.iterative)
+    snprintf(nli, sizeof(nli), "%ld", result.stats.nli);
+  printf("%-6s %9ld %5ld %6s %6ld %13.4f %14.1f\n", path.name, (long int) N,
+         result.stats.nni, nli, result.stats.nfe, result.total_seconds,
+         result.peak_kb / 1024.0);
+}
+
+// Residual scaled by h^2: (sum of the 4 neighbours - 4 u) + h^2 lambda e^u.
+static int f(N_Vector u, N_Vector f_val, void *user_data) {
+  UserData *data = (UserData*) user_data;
+  realtype *udata = N_VGetArrayPointer(u);
+  realtype *fdata = N_VGetArrayPointer(f_val);
+  sunindextype n = data->n;
+
+  for (sunindextype j = 0; j < n; j++) {
+    for (sunindextype i = 0; i < n; i++) {
+      sunindextype k = i + j * n;
+      realtype sum = -4.0 * udata[k];
+      if (i > 0) sum += udata[k - 1];
+      if (i < n - 1) sum += udata[k + 1];
+      if (j > 0) sum += udata[k - n];
+      if (j < n - 1) sum += udata[k + n];
+      fdata[k] = sum + data->h2lambda * SUNRexp(udata[k]);
+    }
+  }
+
+  return(0);
+}
+
+// Calls set(row, col, value) for every nonzero of the Jacobian, column by
+// column with increasing rows, which is the order a CSC matrix needs.
+template <typename Setter>
+static void for_each_jac_entry(const UserData *data, const realtype *udata,
+                               Setter set) {
+  sunindextype n = data->n;
+  for (sunindextype k = 0; k < data->N; k++) {
+    sunindextype i = k % n;
+    sunindextype j = k / n;
+    if (j > 0) set(k - n, k, 1.0);
+    if (i > 0) set(k - 1, k, 1.0);
+    set(k, k, -4.0 + data->h2lambda * SUNRexp(udata[k]));
+    if (i < n - 1) set(k + 1, k, 1.0);
+    if (j < n - 1) set(k + n, k, 1.0);
+  }
+}
+
+// Jacobian for the dense path.
+static int jac_dense(N_Vector u, N_Vector fu, SUNMatrix J, void *user_data,
+                     N_Vector tmp1, N_Vector tmp2) {
+  for_each_jac_entry((UserData*) user_data, N_VGetArrayPointer(u),
+                     [J](sunindextype row, sunindextype col, realtype value) {
+                       SM_ELEMENT_D(J, row, col) = value;
+                     });
+  return(0);
+}
+
+// Jacobian for the band path.
+static int jac_band(N_Vector u, N_Vector fu, SUNMatrix J, void *user_data,
+                    N_Vector tmp1, N_Vector tmp2) {
+  for_each_jac_entry((UserData*) user_data, N_VGetArrayPointer(u),
+                     [J](sunindextype row, sunindextype col, realtype value) {
+                       SM_ELEMENT_B(J, row, col) = value;
+                     });
+  return(0);
+}
+
+#ifdef USE_KLU
+// Jacobian for the sparse direct path, stored in compressed sparse columns.
+static int jac_sparse(N_Vector u, N_Vector fu, SUNMatrix J, void *user_data,
+                      N_Vector tmp1, N_Vector tmp2) {
+  UserData *data = (UserData*) user_data;
+  sunindextype *colptrs = SUNSparseMatrix_IndexPointers(J);
+  sunindextype *rowvals = SUNSparseMatrix_IndexValues(J);
+  realtype *values = SUNSparseMatrix_Data(J);
+
+  sunindextype nnz = 0;
+  sunindextype last_col = -1;
+  for_each_jac_entry(data, N_VGetArrayPointer(u),
+                     [&](sunindextype row, sunindextype col, realtype value) {
+                       while (last_col < col) colptrs[++last_col] = nnz;
+                       rowvals[nnz] = row;
+                       values[nnz++] = value;
+                     });
+  colptrs[data->N] = nnz;
+
+  return(0);
+}
+#endif
+
+// Jacobian-times-vector for the GMRES path, Jv = laplace(v) + h^2 lambda e^u v.
+static int jtv(N_Vector v, N_Vector Jv, N_Vector u, booleantype *new_u,
+               void *user_data) {
+  UserData *data = (UserData*) user_data;
+  realtype *udata = N_VGetArrayPointer(u);
+  realtype *vdata = N_VGetArrayPointer(v);
+  realtype *Jvdata = N_VGetArrayPointer(Jv);
+  sunindextype n = data->n;
+
+  for (sunindextype j = 0; j < n; j++) {
+    for (sunindextype i = 0; i < n; i++) {
+      sunindextype k = i + j * n;
+      realtype sum = (-4.0 + data->h2lambda * SUNRexp(udata[k])) * vdata[k];
+      if (i > 0) sum += vdata[k - 1];
+      if (i < n - 1) sum += vdata[k + 1];
+      if (j > 0) sum += vdata[k - n];
+      if (j < n - 1) sum += vdata[k + n];
+      Jvdata[k] = sum;
+    }
+  }
+
+  return(0);
+}
+
+// Preconditioner setup: factors the tridiagonal block of every x-line of the
+// Jacobian (the couplings between lines are dropped) with the Thomas
+// algorithm. Setup and solve are O(N).
+static int psetup(N_Vector u, N_Vector uscale, N_Vector fval, N_Vector fscale,
+                  void *user_data) {
+  UserData *data = (UserData*) user_data;
+  realtype *udata = N_VGetArrayPointer(u);
+  sunindextype n = data->n;
+
+  for (sunindextype j = 0; j < n; j++) {
+    realtype upper_prev = 0; // eliminated upper diagonal of the previous row
+    for (sunindextype i = 0; i < n; i++) {
+      sunindextype k = i + j * n;
+      realtype pivot = -4.0 + data->h2lambda * SUNRexp(udata[k]) - upper_prev;
+      data->inv_pivot[k] = 1.0 / pivot;
+      upper_prev = data->inv_pivot[k];
+    }
+  }
+
+  return(0);
+}
+
+// Preconditioner solve: forward and back substitution on every x-line.
+static int psolve(N_Vector u, N_Vector uscale, N_Vector fval, N_Vector fscale,
+                  N_Vector v, void *user_data) {
+  UserData *data = (UserData*) user_data;
+  realtype *vdata = N_VGetArrayPointer(v);
+  sunindextype n = data->n;
+
+  for (sunindextype j = 0; j < n; j++) {
+    realtype *line = vdata + j * n;
+    const realtype *inv_pivot = data->inv_pivot + j * n;
+
+    line[0] *= inv_pivot[0];
+    for (sunindextype i = 1; i < n; i++)
+      line[i] = (line[i] - line[i - 1]) * inv_pivot[i];
+    for (sunindextype i = n - 2; i >= 0; i--)
+      line[i] -= inv_pivot[i] * line[i + 1];
+  }
+
+  return(0);
+}
+
+// check_flag function is from the cvDiurnals_ky.c example from the CVODE
+// package.
+/* Check function return value...
+     opt == 0 means SUNDIALS function allocates memory so check if
+              returned NULL pointer
+     opt == 1 means SUNDIALS function returns a flag so check if
+              flag >= 0
+     opt == 2 means function allocates memory so check if returned
+              NULL pointer */
+static int check_flag(void *flagvalue, const char *funcname, int opt) {
+  int *errflag;
+
+  /* Check if SUNDIALS function returned NULL pointer - no memory allocated */
+  if (opt == 0 && flagvalue == NULL) {
+    fprintf(stderr, "\nSUNDIALS_ERROR: %s() failed - returned NULL pointer\n\n",
+            funcname);
+    return(1); }
+
+  /* Check if flag < 0 */
+  else if (opt == 1) {
+    errflag = (int *) flagvalue;
+    if (*errflag < 0) {
+      fprintf(stderr, "\nSUNDIALS_ERROR: %s() failed with flag = %d\n\n",
+              funcname, *errflag);
+      return(1); }}
+
+  /* Check if function returned NULL pointer - no memory allocated */
+  else if (opt == 2 && flagvalue == NULL) {
+    fprintf(stderr, "\nMEMORY_ERROR: %s() failed - returned NULL pointer\n\n",
+            funcname);
+    return(1); }
+
+  return(0);
+}
@@ -0,0 +1,435 @@
+/*
+An example using the KINSOL library to find all steady states of a bistable
+system. A single KINSol call from one initial guess finds only one root, so
+this example samples many initial guesses (Latin hypercube or Sobol), solves
+them concurrently on threads and keeps the distinct roots.
+
+The system is the genetic toggle switch
+
+  0 = alpha / (1 + y1^n) - y0
+  0 = alpha / (1 + y0^n) - y1
+
+which for alpha = 3, n = 2 has two stable steady states and one unstable one.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <kinsol/kinsol.h> // access to KINSOL func., consts.
+#include <kinsol/kinsol_spils.h> // access to KINSpils interface
+#include <nvector/nvector_serial.h>  // access to serial N_Vector
+#include <sunlinsol/sunlinsol_spgmr.h>  //access to SPGMR SUNLinearSolver
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+#include <sundials/sundials_math.h>  // contains the macros ABS, SUNSQR, EXP
+#include <kinsol_stats.h> // convergence trace and statistics of KINSol
+#include <sundials_precision.h> // feasible_tolerance
+
+// This macro gives access to the individual components of the data array of an
+// N Vector.
+#define NV_Ith_S(v,i) ( NV_DATA_S(v)[i] )
+
+
+// Struct for holding the nessesary additional variables for the problem.
+struct UserData {
+  realtype alpha;
+  realtype n;
+};
+
+// How the initial guesses are sampled from the search box.
+enum class Sampler { LatinHypercube, Sobol };
+
+// Settings of the multi-start search.
+struct MultiStartOptions {
+  Sampler sampler = Sampler::Sobol;
+  int max_starts = 1024; // upper bound on the number of initial guesses
+  int patience = 64; // stop after this many starts without a new root
+  int threads = 0; // 0 uses std::thread::hardware_concurrency()
+  realtype lower = 0.0; // the search box is [lower, upper]^N
+  realtype upper = 3.0;
+  realtype root_tol = 1e-6; // roots closer than this (max norm) are the same
+  realtype fnorm_tol = feasible_tolerance(1e-10);
+  unsigned int seed = 42; // seed of the Latin hypercube sampler
+  bool trace = false; // include every solve and its trace in the JSON export
+};
+
+// Set of distinct roots. Points are hashed by the grid cell of size tol they
+// fall in, and a lookup also checks the 3^N neighbouring cells, so two roots
+// closer than tol are always found even when they straddle a cell boundary.
+class RootSet {
+ public:
+  RootSet(int dim, realtype tol) : dim_(dim), tol_(tol) {}
+
+  // Adds x if no stored root is within tol of it. Returns true if x is new.
+  bool insert(const realtype *x) {
+    std::vector<int64_t> cell(dim_);
+    for (int i = 0; i < dim_; i++)
+      cell[i] = (int64_t) std::floor(x[i] / tol_);
+
+    // Visit the neighbouring cells by counting in base 3 over the offsets.
+    std::vector<int64_t> probe(dim_);
+    int neighbours = 1;
+    for (int i = 0; i < dim_; i++) neighbours *= 3;
+    for (int k = 0; k < neighbours; k++) {
+      int code = k;
+      for (int i = 0; i < dim_; i++) {
+        probe[i] = cell[i] + (code % 3) - 1;
+        code /= 3;
+      }
+      auto it = buckets_.find(hash(probe.data()));
+      if (it == buckets_.end()) continue;
+      for (size_t r : it->second)
+        if (distance(&roots_[r * dim_], x) <= tol_) return false;
+    }
+
+    buckets_[hash(cell.data())].push_back(size());
+    roots_.insert(roots_.end(), x, x + dim_);
+    return true;
+  }
+
+  size_t size() const { return roots_.size() / dim_; }
+  const realtype *root(size_t i) const { return &roots_[i * dim_]; }
+
+ private:
+  uint64_t hash(const int64_t *cell) const {
+    // FNV-1a over the cell coordinates.
+    uint64_t h = 1469598103934665603ULL;
+    for (int i = 0; i < dim_; i++) {
+      h ^= (uint64_t) cell[i];
+      h *= 1099511628211ULL;
+    }
+    return h;
+  }
+
+  realtype distance(const realtype *a, const realtype *b) const {
+    realtype d = 0;
+    for (int i = 0; i < dim_; i++) d = SUNMAX(d, SUNRabs(a[i] - b[i]));
+    return d;
+  }
+
+  int dim_;
+  realtype tol_;
+  std::vector<realtype> roots_; // row-major, dim_ entries per root
+  std::unordered_map<uint64_t, std::vector<size_t>> buckets_;
+};
+
+// Results of the multi-start search.
+struct MultiStartResult {
+  int starts = 0; // initial guesses solved
+  int failures = 0; // solves that did not end at a root
+  bool stopped_early = false;
+  double seconds = 0;
+};
+
+static int f(N_Vector u, N_Vector f_val, void *user_data);
+static std::vector<realtype> latin_hypercube(int count, int dim,
+                                             unsigned int seed);
+static std::vector<realtype> sobol(int count, int dim);
+static int multi_start(UserData *data, sunindextype N,
+                       const MultiStartOptions &opts, RootSet *roots,
+                       MultiStartResult *result, KinStatsEnsemble *stats);
+static int check_flag(void *flagvalue, const char *funcname, int opt);
+UserData* alloc_user_data();
+
+
+int main() {
+  // Setup User Data Pointer
+  UserData *data = alloc_user_data();
+
+  // 1. Initialize parallel or multi-threaded environment, if appropriate.
+  // ---------------------------------------------------------------------------
+  // Each thread owns its own KINSOL object, see multi_start.
+  MultiStartOptions opts;
+  // ---------------------------------------------------------------------------
+
+  // 2. Defining the length of the problem.
+  // ---------------------------------------------------------------------------
+  sunindextype N = 2;
+  // ---------------------------------------------------------------------------
+
+  // 3. - 12. Sample initial guesses and solve from each of them.
+  // ---------------------------------------------------------------------------
+  Sampler samplers[] = {Sampler::LatinHypercube, Sampler::Sobol};
+  for (Sampler sampler : samplers) {
+    opts.sampler = sampler;
+    RootSet roots(N, opts.root_tol);
+    MultiStartResult result;
+    KinStatsEnsemble stats;
+    if (multi_start(data, N, opts, &roots, &result, &stats)) return(1);
+
+    // 13. Get optional outputs.
+    // The solver statistics of all starts are aggregated into a JSON file.
+    const char *stats_file = (sampler == Sampler::Sobol)
+                                 ? "multistart_sobol_stats.json"
+                                 : "multistart_lhs_stats.json";
+    std::ofstream json(stats_file);
+    stats.write_json(json, opts.trace);
+
+    std::cout << (sampler == Sampler::Sobol ? "Sobol" : "Latin hypercube")
+              << " sampling: " << roots.size() << " distinct roots from "
+              << result.starts << " starts (" << result.failures
+              << " failed" << (result.stopped_early ? ", stopped early" : "")
+              << ") in " << result.seconds * 1e3 << " ms, solver stats in "
+              << stats_file << "\n";
+    for (size_t r = 0; r < roots.size(); r++) {
+      std::cout << "  y = [";
+      for (sunindextype i = 0; i < N; i++)
+        std::cout << (i ? ", " : "") << roots.root(r)[i];
+      std::cout << "]\n";
+    }
+  }
+  // ---------------------------------------------------------------------------
+
+  // 14. Deallocate memory.
+  // ---------------------------------------------------------------------------
+  delete data;
+  // ---------------------------------------------------------------------------
+
+  return(0);
+}
+
+// Solves the problem from opts.max_starts sampled initial guesses on
+// opts.threads threads and collects the distinct roots in roots and the
+// statistics of every solve in stats. The search stops once opts.patience
+// consecutive starts produced no new root.
+static int multi_start(UserData *data, sunindextype N,
+                       const MultiStartOptions &opts, RootSet *roots,
+                       MultiStartResult *result, KinStatsEnsemble *stats) {
+  // Initial guesses scaled to the search box, row-major.
+  std::vector<realtype> starts =
+      (opts.sampler == Sampler::Sobol)
+          ? sobol(opts.max_starts, N)
+          : latin_hypercube(opts.max_starts, N, opts.seed);
+  for (realtype &x : starts) x = opts.lower + (opts.upper - opts.lower) * x;
+
+  int nthreads = opts.threads > 0 ? opts.threads
+                                  : (int) std::thread::hardware_concurrency();
+  nthreads = SUNMAX(nthreads, 1);
+
+  std::atomic<int> next(0); // next start to hand out
+  std::atomic<bool> stop(false);
+  std::atomic<int> error(0);
+  std::mutex mutex; // guards roots, result, stats and since_new
+  int since_new = 0; // consecutive finished starts without a new root
+  *result = MultiStartResult();
+
+  auto worker = [&]() {
+    int flag;
+
+    // 3. Set vector with initial guess.
+    N_Vector u = N_VNew_Serial(N);
+    N_Vector sc = N_VNew_Serial(N); // Scaling vector.
+    if (check_flag((void *)u, "N_VNew_Serial", 0) ||
+        check_flag((void *)sc, "N_VNew_Serial", 0)) { error = 1; return; }
+    N_VConst(1.0, sc);
+
+    // 4. Create KINSOL Object.
+    void *kin_mem = KINCreate();
+    if (check_flag((void *)kin_mem, "KINCreate", 0)) { error = 1; return; }
+
+    // 5. Set Optional Inputs.
+    flag = KINSetUserData(kin_mem, data);
+    if (check_flag(&flag, "KINSetUserData", 1)) { error = 1; return; }
+    flag = KINSetFuncNormTol(kin_mem, opts.fnorm_tol);
+    if (check_flag(&flag, "KINSetFuncNormTol", 1)) { error = 1; return; }
+    // Starts that do not converge are expected, so keep KINSOL quiet.
+    flag = KINSetErrFile(kin_mem, NULL);
+    if (check_flag(&flag, "KINSetErrFile", 1)) { error = 1; return; }
+    KinStatsRecorder recorder(kin_mem, true); // SPGMR below
+
+    // 6. Allocate Internal Memory.
+    flag = KINInit(kin_mem, f, u);
+    if (check_flag(&flag, "KINInit", 1)) { error = 1; return; }
+
+    // 8. Create Linear Solver Object.
+    SUNLinearSolver LS = SUNSPGMR(u, 0, 0);
+    if (check_flag((void *)LS, "SUNSPGMR", 0)) { error = 1; return; }
+
+    // 10. Attach linear solver module.
+    flag = KINSpilsSetLinearSolver(kin_mem, LS);
+    if (check_flag(&flag, "KINSpilsSetLinearSolver", 1)) { error = 1; return; }
+
+    // 12. Solve problem, once per initial guess handed to this thread.
+    realtype *udata = N_VGetArrayPointer(u);
+    while (!stop && !error) {
+      int k = next++;
+      if (k >= opts.max_starts) break;
+      std::copy(&starts[k * N], &starts[(k + 1) * N], udata);
+
+      recorder.begin_solve();
+      flag = KINSol(kin_mem, u, KIN_LINESEARCH, sc, sc);
+      recorder.end_solve(flag);
+
+      std::lock_guard<std::mutex> lock(mutex);
+      stats->add(recorder.stats());
+      result->starts++;
+      // A stalled solve (e.g. KIN_STEP_LT_STPTOL) did not reach fnorm_tol,
+      // so u is not a root.
+      if (!kin_converged(flag)) {
+        result->failures++;
+        since_new++;
+      } else if (roots->insert(udata)) {
+        since_new = 0;
+      } else {
+        since_new++;
+      }
+      if (since_new >= opts.patience) {
+        result->stopped_early = (result->starts < opts.max_starts);
+        stop = true;
+      }
+    }
+
+    // 14. - 16. Free memory.
+    N_VDestroy(u);
+    N_VDestroy(sc);
+    KINFree(&kin_mem);
+    SUNLinSolFree(LS);
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> pool;
+  for (int i = 0; i < nthreads; i++) pool.emplace_back(worker);
+  for (std::thread &t : pool) t.join();
+  auto stop_time = std::chrono::steady_clock::now();
+  result->seconds = std::chrono::duration<double>(stop_time - start).count();
+
+  return error;
+}
+
+// Latin hypercube sample of count points in [0, 1)^dim, row-major. Every
+// coordinate hits each of the count strata exactly once.
+static std::vector<realtype> latin_hypercube(int count, int dim,
+                                             unsigned int seed) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<realtype> jitter(0.0, 1.0);
+  std::vector<realtype> points(count * dim);
+  std::vector<int> strata(count);
+
+  for (int j = 0; j < dim; j++) {
+    for (int i = 0; i < count; i++) strata[i] = i;
+    std::shuffle(strata.begin(), strata.end(), rng);
+    for (int i = 0; i < count; i++)
+      points[i * dim + j] = (strata[i] + jitter(rng)) / count;
+  }
+
+  return points;
+}
+
+// Sobol sequence of count points in [0, 1)^dim, row-major, skipping the
+// initial all-zero point. Uses the Joe-Kuo direction numbers, which are
+// tabulated here for up to 8 dimensions.
+static std::vector<realtype> sobol(int count, int dim) {
+  // Degree s, coefficients a and initial direction numbers m of the
+  // primitive polynomial of dimensions 2 to 8.
+  static const int max_dim = 8;
+  static const unsigned int s[max_dim] = {0, 1, 2, 3, 3, 4, 4, 5};
+  static const unsigned int a[max_dim] = {0, 0, 1, 1, 2, 1, 4, 2};
+  static const unsigned int m[max_dim][5] = {
+    {0}, {1}, {1, 3}, {1, 3, 1}, {1, 1, 1}, {1, 1, 3, 3}, {1, 3, 5, 13},
+    {1, 1, 5, 5, 17}};
+  const int bits = 32;
+
+  if (dim > max_dim) {
+    std::cerr << "sobol: at most " << max_dim << " dimensions supported\n";
+    dim = max_dim;
+  }
+
+  // Direction numbers V[j][k], scaled by 2^32.
+  std::vector<std::vector<uint32_t>> V(dim, std::vector<uint32_t>(bits + 1));
+  for (int k = 1; k <= bits; k++) V[0][k] = 1u << (bits - k);
+  for (int j = 1; j < dim; j++) {
+    for (unsigned int k = 1; k <= (unsigned int) bits; k++) {
+      if (k <= s[j]) {
+        V[j][k] = m[j][k - 1] << (bits - k);
+      } else {
+        V[j][k] = V[j][k - s[j]] ^ (V[j][k - s[j]] >> s[j]);
+        for (unsigned int i = 1; i < s[j]; i++)
+          if ((a[j] >> (s[j] - 1 - i)) & 1) V[j][k] ^= V[j][k - i];
+      }
+    }
+  }
+
+  // Gray code construction, X_i = X_{i-1} ^ V[c] where c is the position of
+  // the lowest zero bit of i - 1.
+  std::vector<realtype> points(count * dim);
+  std::vector<uint32_t> X(dim, 0);
+  for (int i = 1; i <= count; i++) {
+    int c = 1;
+    for (unsigned int value = i - 1; value & 1; value >>= 1) c++;
+    for (int j = 0; j < dim; j++) {
+      X[j] ^= V[j][c];
+      points[(i - 1) * dim + j] = (realtype) X[j] / 4294967296.0;
+    }
+  }
+
+  return points;
+}
+
+// Toggle switch steady state equations.
+static int f(N_Vector u, N_Vector f_val, void *user_data) {
+  realtype *udata = N_VGetArrayPointer(u);
+  realtype *fdata = N_VGetArrayPointer(f_val);
+
+  UserData *data = (UserData*) user_data;
+
+  fdata[0] = data->alpha / (1.0 + SUNRpowerR(SUNRabs(udata[1]), data->n))
+             - udata[0];
+  fdata[1] = data->alpha / (1.0 + SUNRpowerR(SUNRabs(udata[0]), data->n))
+             - udata[1];
+
+  return(0);
+}
+
+// check_flag function is from the cvDiurnals_ky.c example from the CVODE
+// package.
+/* Check function return value...
+     opt == 0 means SUNDIALS function allocates memory so check if
+              returned NULL pointer
+     opt == 1 means SUNDIALS function returns a flag so check if
+              flag >= 0
+     opt == 2 means function allocates memory so check if returned
+              NULL pointer */
+static int check_flag(void *flagvalue, const char *funcname, int opt) {
+  int *errflag;
+
+  /* Check if SUNDIALS function returned NULL pointer - no memory allocated */
+  if (opt == 0 && flagvalue == NULL) {
+    fprintf(stderr, "\nSUNDIALS_ERROR: %s() failed - returned NULL pointer\n\n",
+            funcname);
+    return(1); }
+
+  /* Check if flag < 0 */
+  else if (opt == 1) {
+    errflag = (int *) flagvalue;
+    if (*errflag < 0) {
+      fprintf(stderr, "\nSUNDIALS_ERROR: %s() failed with flag = %d\n\n",
+              funcname, *errflag);
+      return(1); }}
+
+  /* Check if function returned NULL pointer - no memory allocated */
+  else if (opt == 2 && flagvalue == NULL) {
+    fprintf(stderr, "\nMEMORY_ERROR: %s() failed - returned NULL pointer\n\n",
+            funcname);
+    return(1); }
+
+  return(0);
+}
+
+// Initalizes the parameters of the toggle switch.
+UserData* alloc_user_data() {
+  UserData *data;
+  data = new UserData();
+
+  data->alpha = 3.0;
+  data->n = 2.0;
+
+  return data;
+}
@@ -11,6 +11,7 @@ as a stiff system.
 #include <sundials/sundials_dense.h>  // use generic dense solver in precond
 #include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
 #include <sundials/sundials_math.h>  // contains the macros ABS, SUNSQR, EXP
+#include <kinsol_stats.h> // convergence trace and statistics of KINSol
 
 // This macro gives access to the individual components of the data array of an
 // N Vector.
@@ -59,6 +60,9 @@ int main() {
 
   // 5. Set Optional Inputs.
   // ---------------------------------------------------------------------------
+  // The recorder installs an info handler that traces every nonlinear
+  // iteration of KINSol.
+  KinStatsRecorder recorder(kin_mem, true); // SPGMR below
   // ---------------------------------------------------------------------------
 
   // 6. Allocate Internal Memory .
@@ -104,11 +108,13 @@ int main() {
   // ---------------------------------------------------------------------------
 
   /* Call KINSol and print output concentration profile */
+  recorder.begin_solve();
   flag = KINSol(kin_mem,           /* KINSol memory block */
                 y0,             /* initial guess on input; solution vector */
                 KIN_LINESEARCH, /* global strategy choice */
                 sc,             /* scaling vector for the variable cc */
                 sc);            /* scaling vector for function values fval */
+  recorder.end_solve(flag);
   if (check_flag(&flag, "KINSol", 1)) return(1);
 
   // Printing output.
@@ -119,6 +125,9 @@ int main() {
 
   // 13. Get optional outputs.
   // ---------------------------------------------------------------------------
+  // Nonlinear and linear iteration counts, function evaluations, line search
+  // backtracks and the residual norm of every iteration.
+  print_kin_stats(std::cout, recorder.stats(), true);
   // ---------------------------------------------------------------------------
 
   // 14. Deallocate memory for solution vector.
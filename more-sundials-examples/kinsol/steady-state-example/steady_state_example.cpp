@@ -0,0 +1,454 @@
+/*
+An example that uses KINSOL to find the steady state of the CVODE user data
+example directly, instead of integrating to end_time = 50 and reading off the
+final value. The same f and jtv used by CVODE are reused.
+
+The finder starts with a few pseudo-transient continuation (PTC) steps, which
+are implicit Euler steps with a growing step size, then switches to a full
+Newton solve of f(y) = 0. If Newton fails it falls back to integrating the
+system in time with CVODE until the residual is small.
+*/
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <kinsol/kinsol.h> // access to KINSOL func., consts.
+#include <kinsol/kinsol_spils.h> // access to KINSpils interface
+#include <cvode/cvode.h> // prototypes for CVODE fcts., consts.
+#include <cvode/cvode_spils.h> // access to CVSpils interface
+#include <nvector/nvector_serial.h>  // access to serial N_Vector
+#include <sunlinsol/sunlinsol_spgmr.h>  //access to SPGMR SUNLinearSolver
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+#include <sundials/sundials_math.h>  // contains the macros ABS, SUNSQR, EXP
+#include <sundials_precision.h> // feasible_tolerance
+
+// This macro gives access to the individual components of the data array of an
+// N Vector.
+#define NV_Ith_S(v,i) ( NV_DATA_S(v)[i] )
+
+
+// Struct for holding the nessesary additional variables for the problem.
+struct UserData {
+  std::vector < realtype > coeffs;
+};
+
+// Struct holding the state of the steady state finder. It is passed to KINSOL
+// as the user data pointer and wraps the UserData of the ODE problem.
+//
+// KINSOL solves F(y) = inv_dt * (y - y_prev) - f(y) = 0. With inv_dt > 0 this
+// is one implicit Euler step of size 1 / inv_dt from y_prev (a PTC step), and
+// with inv_dt = 0 it is the steady state problem f(y) = 0 itself.
+struct SteadyStateData {
+  UserData *problem;
+  realtype inv_dt;
+  N_Vector y_prev;
+  N_Vector fu; // scratch vectors handed to the CVODE style jtv
+  N_Vector tmp;
+};
+
+// Options and results of a steady state solve.
+struct SteadyStateOptions {
+  realtype dt0 = 1e-2; // first pseudo time step
+  realtype dt_growth_max = 10.0; // largest allowed dt growth per PTC step
+  int ptc_steps = 5; // number of PTC steps before switching to Newton
+  // max norm of f(y) accepted as a steady state
+  realtype ftol = feasible_tolerance(1e-10);
+  realtype fallback_end_time = 1e4; // how far CVODE may integrate on fallback
+};
+
+struct SteadyStateResult {
+  int ptc_steps = 0; // PTC steps taken
+  bool newton_converged = false;
+  bool used_fallback = false;
+  realtype fnorm = 0; // max norm of f at the returned state
+};
+
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data);
+static int jtv(N_Vector v, N_Vector Jv, realtype t, N_Vector u, N_Vector fu,
+               void *user_data, N_Vector tmp);
+static int ss_residual(N_Vector u, N_Vector f_val, void *user_data);
+static int ss_jtv(N_Vector v, N_Vector Jv, N_Vector u, booleantype *new_u,
+                  void *user_data);
+static realtype rhs_norm(N_Vector y, SteadyStateData *ss);
+static int integrate_to_steady_state(N_Vector y, UserData *data, realtype ftol,
+                                     realtype end_time);
+static int integrate_to_end_time(N_Vector y, UserData *data,
+                                 realtype end_time);
+static int find_steady_state(N_Vector y, UserData *data,
+                             const SteadyStateOptions &opts,
+                             SteadyStateResult *result);
+static int check_flag(void *flagvalue, const char *funcname, int opt);
+UserData* alloc_user_data();
+
+
+int main() {
+  // Setup User Data Pointer
+  UserData *data = alloc_user_data();
+
+  // 1. Initialize parallel or multi-threaded environment, if appropriate.
+  // ---------------------------------------------------------------------------
+  // ---------------------------------------------------------------------------
+
+  // 2. Defining the length of the problem.
+  // ---------------------------------------------------------------------------
+  sunindextype N = 2;
+  // ---------------------------------------------------------------------------
+
+  // 3. Set vector with initial guess.
+  // ---------------------------------------------------------------------------
+  // The initial guess is the initial value of the ODE problem.
+  N_Vector y = N_VNew_Serial(N);
+  if (check_flag((void *)y, "N_VNew_Serial", 0)) return(1);
+  NV_Ith_S(y, 0) = 2.0;
+  NV_Ith_S(y, 1) = 1.0;
+  // ---------------------------------------------------------------------------
+
+  // 4. - 12. Create, configure and run KINSOL.
+  // ---------------------------------------------------------------------------
+  // The KINSOL skeleton steps are carried out inside find_steady_state since
+  // the solver is reused for every PTC step and the final Newton solve.
+  SteadyStateOptions opts;
+  SteadyStateResult result;
+  if (find_steady_state(y, data, opts, &result)) return(1);
+
+  std::cout << "Steady state found after " << result.ptc_steps
+            << " PTC steps"
+            << (result.newton_converged ? ", Newton converged"
+                                        : ", Newton failed")
+            << (result.used_fallback ? ", used CVODE fallback" : "")
+            << ", |f|_max = " << result.fnorm << "\ny:";
+  N_VPrint_Serial(y);
+  // ---------------------------------------------------------------------------
+
+  // 13. Get optional outputs.
+  // ---------------------------------------------------------------------------
+  // Benchmark the time to reach the equilibrium against integrating to the
+  // fixed end time used by the CVODE examples.
+  int repeats = 1000;
+  realtype end_time = 50;
+  N_Vector y_int = N_VNew_Serial(N);
+  if (check_flag((void *)y_int, "N_VNew_Serial", 0)) return(1);
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < repeats; i++) {
+    NV_Ith_S(y, 0) = 2.0;
+    NV_Ith_S(y, 1) = 1.0;
+    if (find_steady_state(y, data, opts, &result)) return(1);
+  }
+  auto mid = std::chrono::steady_clock::now();
+  for (int i = 0; i < repeats; i++) {
+    NV_Ith_S(y_int, 0) = 2.0;
+    NV_Ith_S(y_int, 1) = 1.0;
+    if (integrate_to_end_time(y_int, data, end_time)) return(1);
+  }
+  auto stop = std::chrono::steady_clock::now();
+
+  double ss_us = std::chrono::duration<double, std::micro>(mid - start).count()
+                 / repeats;
+  double int_us = std::chrono::duration<double, std::micro>(stop - mid).count()
+                  / repeats;
+  N_VLinearSum(1.0, y, -1.0, y_int, y_int);
+  std::cout << "\nTime to equilibrium (" << repeats << " runs):\n"
+            << "  steady state finder:      " << ss_us << " us/run\n"
+            << "  CVODE to t = " << end_time << ":         " << int_us
+            << " us/run\n"
+            << "  speedup:                  " << int_us / ss_us << "x\n"
+            << "  max difference of states: " << N_VMaxNorm(y_int) << "\n";
+  // ---------------------------------------------------------------------------
+
+  // 14. Deallocate memory for solution vector.
+  // ---------------------------------------------------------------------------
+  N_VDestroy(y);
+  N_VDestroy(y_int);
+  delete data; // Remember to free the user data memory.
+  // ---------------------------------------------------------------------------
+
+  return(0);
+}
+
+// Finds the steady state of the ODE problem starting from the state in y. On
+// return y holds the steady state. Returns 0 on success.
+static int find_steady_state(N_Vector y, UserData *data,
+                             const SteadyStateOptions &opts,
+                             SteadyStateResult *result) {
+  int flag;
+  *result = SteadyStateResult();
+
+  SteadyStateData ss;
+  ss.problem = data;
+  ss.inv_dt = 1.0 / opts.dt0;
+  ss.y_prev = N_VClone(y);
+  ss.fu = N_VClone(y);
+  ss.tmp = N_VClone(y);
+  if (check_flag((void *)ss.tmp, "N_VClone", 0)) return(1);
+
+  N_Vector sc = N_VClone(y); // Scaling vector.
+  if (check_flag((void *)sc, "N_VClone", 0)) return(1);
+  N_VConst(1.0, sc);
+
+  // 4. Create KINSOL Object.
+  void *kin_mem = KINCreate();
+  if (check_flag((void *)kin_mem, "KINCreate", 0)) return(1);
+
+  // 5. Set Optional Inputs.
+  flag = KINSetUserData(kin_mem, &ss);
+  if (check_flag(&flag, "KINSetUserData", 1)) return(1);
+  flag = KINSetFuncNormTol(kin_mem, opts.ftol);
+  if (check_flag(&flag, "KINSetFuncNormTol", 1)) return(1);
+  // Failed Newton solves are handled below, so keep KINSOL quiet about them.
+  flag = KINSetErrFile(kin_mem, NULL);
+  if (check_flag(&flag, "KINSetErrFile", 1)) return(1);
+
+  // 6. Allocate Internal Memory.
+  flag = KINInit(kin_mem, ss_residual, y);
+  if (check_flag(&flag, "KINInit", 1)) return(1);
+
+  // 8. Create Linear Solver Object.
+  SUNLinearSolver LS = SUNSPGMR(y, 0, 0);
+  if (check_flag((void *)LS, "SUNSPGMR", 0)) return(1);
+
+  // 10. Attach linear solver module.
+  flag = KINSpilsSetLinearSolver(kin_mem, LS);
+  if (check_flag(&flag, "KINSpilsSetLinearSolver", 1)) return(1);
+
+  // 11. Set linear solver interface optional inputs.
+  // The Jacobian-times-vector product is built from the CVODE jtv.
+  flag = KINSpilsSetJacTimesVecFn(kin_mem, ss_jtv);
+  if (check_flag(&flag, "KINSpilsSetJacTimesVecFn", 1)) return(1);
+
+  // 12. Solve problem.
+  // Pseudo-transient continuation: implicit Euler steps whose size grows as
+  // the residual drops (switched evolution relaxation), which moves the state
+  // towards the basin of the steady state before Newton is tried.
+  realtype dt = opts.dt0;
+  realtype fnorm_old = rhs_norm(y, &ss);
+  for (int k = 0; k < opts.ptc_steps && fnorm_old > opts.ftol; k++) {
+    N_VScale(1.0, y, ss.y_prev);
+    ss.inv_dt = 1.0 / dt;
+    flag = KINSol(kin_mem, y, KIN_LINESEARCH, sc, sc);
+    if (flag < 0) {
+      // Keep the last good state and let Newton try from there.
+      N_VScale(1.0, ss.y_prev, y);
+      break;
+    }
+    result->ptc_steps++;
+
+    realtype fnorm = rhs_norm(y, &ss);
+    realtype growth = fnorm > 0 ? fnorm_old / fnorm : opts.dt_growth_max;
+    dt *= SUNMIN(growth, opts.dt_growth_max);
+    fnorm_old = fnorm;
+  }
+
+  // Full Newton on f(y) = 0.
+  ss.inv_dt = 0;
+  N_VScale(1.0, y, ss.y_prev);
+  flag = KINSol(kin_mem, y, KIN_LINESEARCH, sc, sc);
+  result->newton_converged = (flag >= 0);
+  result->fnorm = rhs_norm(y, &ss);
+
+  // Fall back to time integration if Newton did not converge.
+  if (!result->newton_converged || result->fnorm > opts.ftol) {
+    N_VScale(1.0, ss.y_prev, y);
+    result->used_fallback = true;
+    if (integrate_to_steady_state(y, data, opts.ftol, opts.fallback_end_time))
+      return(1);
+    result->fnorm = rhs_norm(y, &ss);
+  }
+
+  // 14. - 16. Free memory.
+  N_VDestroy(ss.y_prev);
+  N_VDestroy(ss.fu);
+  N_VDestroy(ss.tmp);
+  N_VDestroy(sc);
+  KINFree(&kin_mem);
+  SUNLinSolFree(LS);
+
+  return(0);
+}
+
+// Integrates y with CVODE until the max norm of f(y) drops below ftol or
+// end_time is reached. Used as the fallback when Newton fails.
+static int integrate_to_steady_state(N_Vector y, UserData *data, realtype ftol,
+                                     realtype end_time) {
+  int flag;
+  N_Vector ydot = N_VClone(y);
+  if (check_flag((void *)ydot, "N_VClone", 0)) return(1);
+
+  void *cvode_mem = CVodeCreate(CV_BDF, CV_NEWTON);
+  if (check_flag((void *)cvode_mem, "CVodeCreate", 0)) return(1);
+  flag = CVodeInit(cvode_mem, f, 0, y);
+  if (check_flag(&flag, "CVodeInit", 1)) return(1);
+  // The tolerances are tighter than ftol so the residual can actually reach it.
+  flag = CVodeSStolerances(cvode_mem, 0.1 * ftol, 0.1 * ftol);
+  if (check_flag(&flag, "CVodeSStolerances", 1)) return(1);
+  flag = CVodeSetUserData(cvode_mem, data);
+  if (check_flag(&flag, "CVodeSetUserData", 1)) return(1);
+  flag = CVodeSetStopTime(cvode_mem, end_time);
+  if (check_flag(&flag, "CVodeSetStopTime", 1)) return(1);
+  SUNLinearSolver LS = SUNSPGMR(y, 0, 0);
+  if (check_flag((void *)LS, "SUNSPGMR", 0)) return(1);
+  flag = CVSpilsSetLinearSolver(cvode_mem, LS);
+  if (check_flag(&flag, "CVSpilsSetLinearSolver", 1)) return(1);
+  flag = CVSpilsSetJacTimes(cvode_mem, NULL, jtv);
+  if (check_flag(&flag, "CVSpilsSetJacTimes", 1)) return(1);
+
+  // Take internal steps and check the residual after each one.
+  realtype t = 0;
+  do {
+    flag = CVode(cvode_mem, end_time, y, &t, CV_ONE_STEP);
+    if (check_flag(&flag, "CVode", 1)) break;
+    f(t, y, ydot, data);
+  } while (N_VMaxNorm(ydot) > ftol && t < end_time);
+
+  N_VDestroy(ydot);
+  CVodeFree(&cvode_mem);
+  SUNLinSolFree(LS);
+
+  return(flag < 0);
+}
+
+// Integrates y from 0 to end_time with the setup of the CVODE user data
+// example. This is the baseline of the benchmark.
+static int integrate_to_end_time(N_Vector y, UserData *data,
+                                 realtype end_time) {
+  int flag;
+  realtype abstol = 1e-5; // real tolerance of system
+  realtype reltol = 1e-5; // absolute tolerance of system
+
+  void *cvode_mem = CVodeCreate(CV_BDF, CV_NEWTON);
+  if (check_flag((void *)cvode_mem, "CVodeCreate", 0)) return(1);
+  flag = CVodeInit(cvode_mem, f, 0, y);
+  if (check_flag(&flag, "CVodeInit", 1)) return(1);
+  flag = CVodeSStolerances(cvode_mem, reltol, abstol);
+  if (check_flag(&flag, "CVodeSStolerances", 1)) return(1);
+  flag = CVodeSetUserData(cvode_mem, data);
+  if (check_flag(&flag, "CVodeSetUserData", 1)) return(1);
+  SUNLinearSolver LS = SUNSPGMR(y, 0, 0);
+  if (check_flag((void *)LS, "SUNSPGMR", 0)) return(1);
+  flag = CVSpilsSetLinearSolver(cvode_mem, LS);
+  if (check_flag(&flag, "CVSpilsSetLinearSolver", 1)) return(1);
+  flag = CVSpilsSetJacTimes(cvode_mem, NULL, jtv);
+  if (check_flag(&flag, "CVSpilsSetJacTimes", 1)) return(1);
+
+  realtype t = 0;
+  flag = CVode(cvode_mem, end_time, y, &t, CV_NORMAL);
+  check_flag(&flag, "CVode", 1);
+
+  CVodeFree(&cvode_mem);
+  SUNLinSolFree(LS);
+
+  return(flag < 0);
+}
+
+// Residual of the PTC step, or of the steady state problem when inv_dt = 0.
+static int ss_residual(N_Vector u, N_Vector f_val, void *user_data) {
+  SteadyStateData *ss = (SteadyStateData*) user_data;
+
+  int flag = f(0, u, f_val, ss->problem);
+  if (flag) return(flag);
+
+  // f_val = inv_dt * (u - y_prev) - f(u)
+  N_VLinearSum(-1.0, f_val, ss->inv_dt, u, f_val);
+  if (ss->inv_dt != 0) N_VLinearSum(1.0, f_val, -ss->inv_dt, ss->y_prev, f_val);
+
+  return(0);
+}
+
+// Jacobian-times-vector of the residual, J_F v = inv_dt * v - J_f v, built
+// from the jtv used by CVODE.
+static int ss_jtv(N_Vector v, N_Vector Jv, N_Vector u, booleantype *new_u,
+                  void *user_data) {
+  SteadyStateData *ss = (SteadyStateData*) user_data;
+
+  int flag = jtv(v, Jv, 0, u, ss->fu, ss->problem, ss->tmp);
+  if (flag) return(flag);
+
+  N_VLinearSum(ss->inv_dt, v, -1.0, Jv, Jv);
+
+  return(0);
+}
+
+// Max norm of the ODE right hand side at y.
+static realtype rhs_norm(N_Vector y, SteadyStateData *ss) {
+  f(0, y, ss->fu, ss->problem);
+  return N_VMaxNorm(ss->fu);
+}
+
+// Simple function that calculates the differential equation.
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data) {
+  // N_VGetArrayPointer returns a pointer to the data in the N_Vector class.
+  realtype *udata  = N_VGetArrayPointer(u); // pointer u vector data
+  realtype *dudata = N_VGetArrayPointer(u_dot); // pointer to udot vector data
+
+  // Access inforation in user_data.
+  UserData *u_data;
+  u_data = (UserData*) user_data;
+
+  dudata[0] = -101.0 * udata[0] - 100.0 * udata[1] + u_data->coeffs[0];
+  dudata[1] = udata[0] + u_data->coeffs[1];
+
+  return(0);
+}
+
+// Jacobian function vector routine.
+static int jtv(N_Vector v, N_Vector Jv, realtype t, N_Vector u, N_Vector fu,
+               void *user_data, N_Vector tmp) {
+  realtype *vdata  = N_VGetArrayPointer(v);
+  realtype *Jvdata = N_VGetArrayPointer(Jv);
+  realtype *fudata = N_VGetArrayPointer(fu);
+
+  Jvdata[0] = -101.0 * vdata[0] + -100.0 * vdata[1];
+  Jvdata[1] = vdata[0] + 0 * vdata[1];
+
+  fudata[0] = 0;
+  fudata[1] = 0;
+
+  return(0);
+}
+
+// check_flag function is from the cvDiurnals_ky.c example from the CVODE
+// package.
+/* Check function return value...
+     opt == 0 means SUNDIALS function allocates memory so check if
+              returned NULL pointer
+     opt == 1 means SUNDIALS function returns a flag so check if
+              flag >= 0
+     opt == 2 means function allocates memory so check if returned
+              NULL pointer */
+static int check_flag(void *flagvalue, const char *funcname, int opt) {
+  int *errflag;
+
+  /* Check if SUNDIALS function returned NULL pointer - no memory allocated */
+  if (opt == 0 && flagvalue == NULL) {
+    fprintf(stderr, "\nSUNDIALS_ERROR: %s() failed - returned NULL pointer\n\n",
+            funcname);
+    return(1); }
+
+  /* Check if flag < 0 */
+  else if (opt == 1) {
+    errflag = (int *) flagvalue;
+    if (*errflag < 0) {
+      fprintf(stderr, "\nSUNDIALS_ERROR: %s() failed with flag = %d\n\n",
+              funcname, *errflag);
+      return(1); }}
+
+  /* Check if function returned NULL pointer - no memory allocated */
+  else if (opt == 2 && flagvalue == NULL) {
+    fprintf(stderr, "\nMEMORY_ERROR: %s() failed - returned NULL pointer\n\n",
+            funcname);
+    return(1); }
+
+  return(0);
+}
+
+// Initalizes the coefficients for the user data pointer.
+UserData* alloc_user_data() {
+  // Setup User Data.
+  UserData *data;
+  data = new UserData();
+
+  data->coeffs.push_back(0.01);
+  data->coeffs.push_back(0.02);
+
+  return data;
+}
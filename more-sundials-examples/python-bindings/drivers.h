@@ -0,0 +1,254 @@
+/*
+The solver drivers behind the Python bindings, free of any Python API.
+
+UserDataIntegrator is the setup and stepping logic of the CVODE user data
+example and SteadyStateSolver that of the simple KINSOL example. Both work
+on caller-owned memory: parameters, initial conditions and outputs are raw
+pointers, so the bindings can hand in NumPy buffers as they are. The
+initial condition and every output row are wrapped in N_Vectors with
+N_VMake_Serial instead of being copied.
+
+The many-parameter-set functions split the sets over threads, each with its
+own solver object.
+*/
+
+#ifndef PYTHON_BINDINGS_DRIVERS_H
+#define PYTHON_BINDINGS_DRIVERS_H
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cvode/cvode.h> // prototypes for CVODE fcts., consts.
+#include <kinsol/kinsol.h> // access to KINSOL func., consts.
+#include <kinsol/kinsol_spils.h> // access to KINSpils interface
+#include <nvector/nvector_serial.h>  // access to serial N_Vector
+#include <sunlinsol/sunlinsol_spgmr.h>  //access to SPGMR SUNLinearSolver
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+#include <sundials_raii.h> // move-only owners and CVodeIntegrator
+
+// Dimension and parameter count of the user data problem.
+const int problem_dim = 2;
+const int problem_params = 2;
+
+// Struct for holding the nessesary additional variables for the problem.
+// The coefficients are read from caller memory, not copied.
+struct UserData {
+  const realtype *coeffs;
+};
+
+// Simple function that calculates the differential equation.
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data) {
+  // N_VGetArrayPointer returns a pointer to the data in the N_Vector class.
+  realtype *udata  = N_VGetArrayPointer(u); // pointer u vector data
+  realtype *dudata = N_VGetArrayPointer(u_dot); // pointer to udot vector data
+
+  // Access inforation in user_data.
+  UserData *u_data = (UserData*) user_data;
+
+  dudata[0] = -101.0 * udata[0] - 100.0 * udata[1] + u_data->coeffs[0];
+  dudata[1] = udata[0] + u_data->coeffs[1];
+
+  return(0);
+}
+
+// Jacobian function vector routine.
+static int jtv(N_Vector v, N_Vector Jv, realtype t, N_Vector u, N_Vector fu,
+               void *user_data, N_Vector tmp) {
+  realtype *vdata  = N_VGetArrayPointer(v);
+  realtype *Jvdata = N_VGetArrayPointer(Jv);
+
+  Jvdata[0] = -101.0 * vdata[0] + -100.0 * vdata[1];
+  Jvdata[1] = vdata[0];
+
+  return(0);
+}
+
+// The steady state residual of the user data problem for KINSOL.
+static int kin_f(N_Vector u, N_Vector f_val, void *user_data) {
+  return f(0, u, f_val, user_data);
+}
+
+// An N_Vector over caller memory. Its data pointer can be moved to the next
+// output row without touching the heap.
+inline NVectorOwner wrap_vector(realtype *data) {
+  NVectorOwner v(N_VMake_Serial(problem_dim, data));
+  sundials_check(v.get(), "N_VMake_Serial");
+  return v;
+}
+
+// The CVODE user data example as a reusable integrator. Not thread safe;
+// the bindings serialize calls on one object.
+class UserDataIntegrator {
+ public:
+  UserDataIntegrator(realtype reltol, realtype abstol)
+      : cv_(CVodeIntegrator::spgmr(problem_dim, f, jtv, reltol, abstol,
+                                   &data_)),
+        y0_(wrap_vector(NULL)),
+        yout_(wrap_vector(NULL)) {}
+
+  // Integrates from (t0, y0) with coefficients params and writes y at each
+  // of the ntimes increasing times into out (ntimes x 2, row-major).
+  // Returns the CVode flag; on failure the rows from the failing one on are
+  // left untouched.
+  int integrate(const realtype *params, const realtype *y0, realtype t0,
+                const realtype *times, long int ntimes, realtype *out) {
+    data_.coeffs = params;
+    NV_DATA_S(y0_.get()) = const_cast<realtype*>(y0); // only read
+    int flag = CVodeReInit(cv_.mem(), t0, y0_);
+    if (flag < 0) return flag;
+    realtype t;
+    for (long int k = 0; k < ntimes; k++) {
+      // CVODE writes the solution straight into row k of out.
+      NV_DATA_S(yout_.get()) = out + k * problem_dim;
+      flag = CVode(cv_.mem(), times[k], yout_, &t, CV_NORMAL);
+      if (flag < 0) break;
+    }
+    CVodeGetNumSteps(cv_.mem(), &steps_);
+    return flag;
+  }
+
+  // Internal steps of the last integrate call.
+  long int steps() const { return steps_; }
+
+ private:
+  UserData data_ = {NULL};
+  CVodeIntegrator cv_;
+  NVectorOwner y0_, yout_;
+  long int steps_ = 0;
+};
+
+struct KinMemFree {
+  void operator()(void *mem) const { KINFree(&mem); }
+};
+typedef SunOwner<void*, KinMemFree> KinMemOwner;
+
+// The simple KINSOL example as a reusable steady state solver. Not thread
+// safe; the bindings serialize calls on one object.
+class SteadyStateSolver {
+ public:
+  explicit SteadyStateSolver(realtype fnormtol)
+      : u_(wrap_vector(NULL)), scale_(make_serial_vector(problem_dim)) {
+    N_VConst(1, scale_);
+    // KINInit needs a template vector with data for its workspace clones.
+    realtype guess[problem_dim] = {0, 0};
+    NV_DATA_S(u_.get()) = guess;
+    kin_mem_.reset(KINCreate());
+    sundials_check(kin_mem_.get(), "KINCreate");
+    sundials_check(KINInit(kin_mem_, kin_f, u_), "KINInit");
+    sundials_check(KINSetUserData(kin_mem_, &data_), "KINSetUserData");
+    sundials_check(KINSetFuncNormTol(kin_mem_, fnormtol),
+                   "KINSetFuncNormTol");
+    LS_.reset(SUNSPGMR(u_, PREC_NONE, 0));
+    sundials_check(LS_.get(), "SUNSPGMR");
+    sundials_check(KINSpilsSetLinearSolver(kin_mem_, LS_),
+                   "KINSpilsSetLinearSolver");
+    NV_DATA_S(u_.get()) = NULL;
+  }
+
+  // Solves 0 = f(u) with coefficients params. out holds the initial guess
+  // on input and the solution on output. Returns the KINSol flag.
+  int solve(const realtype *params, realtype *out) {
+    data_.coeffs = params;
+    NV_DATA_S(u_.get()) = out;
+    int flag = KINSol(kin_mem_, u_, KIN_LINESEARCH, scale_, scale_);
+    KINGetNumNonlinSolvIters(kin_mem_, &iterations_);
+    return flag;
+  }
+
+  // Nonlinear iterations of the last solve call.
+  long int iterations() const { return iterations_; }
+
+ private:
+  UserData data_ = {NULL};
+  NVectorOwner u_, scale_;
+  SUNLinearSolverOwner LS_;
+  KinMemOwner kin_mem_; // freed before the linear solver it refers to
+  long int iterations_ = 0;
+};
+
+// Runs body(thread_index, i) for i in [0, n) on nthreads threads (0 uses
+// one per core). Each thread takes the next index until none are left. body
+// must not throw.
+template <typename Body>
+void parallel_for(long int n, int nthreads, Body body) {
+  if (nthreads <= 0)
+    nthreads = (int) std::max(1u, std::thread::hardware_concurrency());
+  nthreads = (int) std::min<long int>(nthreads, std::max(1L, n));
+  std::atomic<long int> next(0);
+  auto worker = [&](int tid) {
+    for (long int i = next++; i < n; i = next++) body(tid, i);
+  };
+  std::vector<std::thread> threads;
+  for (int k = 1; k < nthreads; k++) threads.emplace_back(worker, k);
+  worker(0);
+  for (std::thread &th : threads) th.join();
+}
+
+// Integrates nsets parameter sets: params is nsets x 2, y0 is nsets x 2 or
+// a single row shared by all sets (y0_stride 0), out is nsets x ntimes x 2.
+// Returns the first failing CVode flag, or 0.
+inline int integrate_many(const realtype *params, const realtype *y0,
+                          long int y0_stride, long int nsets, realtype t0,
+                          const realtype *times, long int ntimes,
+                          realtype *out, realtype reltol, realtype abstol,
+                          int nthreads, long int *steps) {
+  std::atomic<int> failure(0);
+  std::atomic<long int> total_steps(0);
+  std::mutex setup;
+  std::vector<std::unique_ptr<UserDataIntegrator>> integrators;
+  parallel_for(nsets, nthreads, [&](int tid, long int i) {
+    int flag;
+    try {
+      UserDataIntegrator *cv;
+      {
+        std::lock_guard<std::mutex> lock(setup);
+        if ((int) integrators.size() <= tid) integrators.resize(tid + 1);
+        if (!integrators[tid])
+          integrators[tid].reset(new UserDataIntegrator(reltol, abstol));
+        cv = integrators[tid].get();
+      }
+      flag = cv->integrate(params + i * problem_params, y0 + i * y0_stride,
+                           t0, times, ntimes, out + i * ntimes * problem_dim);
+      total_steps += cv->steps();
+    } catch (const SundialsError &e) {
+      flag = e.flag() < 0 ? e.flag() : -1;
+    }
+    int expected = 0;
+    if (flag < 0) failure.compare_exchange_strong(expected, flag);
+  });
+  if (steps) *steps = total_steps;
+  return failure;
+}
+
+// Solves nsets steady state problems: params is nsets x 2, out is nsets x 2
+// and holds the initial guesses on input. Returns the first failing KINSol
+// flag, or 0.
+inline int steady_state_many(const realtype *params, long int nsets,
+                             realtype *out, realtype fnormtol, int nthreads) {
+  std::atomic<int> failure(0);
+  std::mutex setup;
+  std::vector<std::unique_ptr<SteadyStateSolver>> solvers;
+  parallel_for(nsets, nthreads, [&](int tid, long int i) {
+    int flag;
+    try {
+      SteadyStateSolver *kin;
+      {
+        std::lock_guard<std::mutex> lock(setup);
+        if ((int) solvers.size() <= tid) solvers.resize(tid + 1);
+        if (!solvers[tid]) solvers[tid].reset(new SteadyStateSolver(fnormtol));
+        kin = solvers[tid].get();
+      }
+      flag = kin->solve(params + i * problem_params, out + i * problem_dim);
+    } catch (const SundialsError &e) {
+      flag = e.flag() < 0 ? e.flag() : -1;
+    }
+    int expected = 0;
+    if (flag < 0) failure.compare_exchange_strong(expected, flag);
+  });
+  return failure;
+}
+
+#endif
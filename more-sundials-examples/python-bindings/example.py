@@ -0,0 +1,68 @@
+"""
+Uses the sundials_py bindings: single solves, a parameter sweep with
+integrate_many and Python threads sharing the solvers. Run "make" first,
+then "python3 example.py" from this folder.
+"""
+
+import threading
+import time
+
+import numpy as np
+
+import sundials_py
+
+times = np.arange(1, 101) * 0.5  # the output grid of the CVODE examples
+y0 = np.array([2.0, 1.0])
+
+# One run. The result is allocated once by the bindings; CVODE writes into
+# it directly.
+cv = sundials_py.UserDataIntegrator(reltol=1e-5, abstol=1e-5)
+params = np.array([0.01, 0.02])
+y = cv.integrate(params, y0, times)
+print("y(50) = %s after %d steps" % (y[-1], cv.steps))
+
+# Reusing an output array: no allocation at all on the Python side.
+out = np.empty((len(times), 2))
+cv.integrate(np.array([0.02, 0.01]), y0, times, out=out)
+print("y(50) = %s with out=" % out[-1])
+
+# Arrays that would need a conversion are rejected instead of copied.
+try:
+    cv.integrate(params.astype(np.float32), y0, times)
+except TypeError:
+    print("float32 params rejected")
+
+# The steady state of the same system, solved in place.
+kin = sundials_py.SteadyStateSolver(fnormtol=1e-10)
+u = np.zeros(2)
+kin.solve(params, u, out=u)
+print("steady state %s after %d iterations" % (u, kin.iterations))
+
+# A parameter sweep on all cores, one call.
+m = 2000
+sweep = np.column_stack([np.linspace(0, 0.1, m), np.linspace(0.05, 0, m)])
+start = time.perf_counter()
+ys = sundials_py.integrate_many(sweep, y0, times)
+elapsed = time.perf_counter() - start
+print("integrate_many: %d sets, shape %s, %.3f s" % (m, ys.shape, elapsed))
+steady = sundials_py.steady_state_many(sweep, np.zeros(2))
+print("largest deviation of y(50) from the steady state: %g"
+      % np.abs(ys[:, -1, :] - steady).max())
+
+# The GIL is released while solving, so Python threads run in parallel,
+# each with its own integrator.
+def work(rows, result):
+    own = sundials_py.UserDataIntegrator()
+    for i in rows:
+        own.integrate(sweep[i], y0, times, out=result[i])
+
+result = np.empty((m, len(times), 2))
+start = time.perf_counter()
+threads = [threading.Thread(target=work, args=(range(k, m, 4), result))
+           for k in range(4)]
+for th in threads:
+    th.start()
+for th in threads:
+    th.join()
+print("4 Python threads: %.3f s, same result: %s"
+      % (time.perf_counter() - start, np.allclose(result, ys)))
@@ -0,0 +1,246 @@
+/*
+Python bindings of the CVODE user data example and the simple KINSOL
+example, built with pybind11.
+
+Arrays are passed without copies. Inputs must be C-contiguous NumPy arrays
+of float64 (realtype); anything else is rejected instead of being silently
+converted. Outputs are written straight into NumPy memory: into the out
+array if one is given, otherwise into a newly allocated array that is
+returned. The GIL is released while the solvers run, so other Python
+threads keep going and several solver objects can run in parallel.
+
+  import sundials_py
+  cv = sundials_py.UserDataIntegrator(reltol=1e-5, abstol=1e-5)
+  y = cv.integrate(params, y0, times)  # shape (len(times), 2)
+*/
+
+#include <algorithm>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+#include <sundials_raii.h> // move-only owners and CVodeIntegrator
+#include "drivers.h"
+
+namespace py = pybind11;
+
+// A C-contiguous array of realtype. With noconvert() arguments, pybind11
+// only accepts arrays that already have this layout, so no copy is made.
+typedef py::array_t<realtype, py::array::c_style> RealArray;
+
+// Throws ValueError unless a has the given shape.
+static void check_shape(const RealArray &a, const char *name,
+                        std::initializer_list<py::ssize_t> shape) {
+  bool ok = a.ndim() == (py::ssize_t) shape.size();
+  py::ssize_t i = 0;
+  for (py::ssize_t n : shape) ok = ok && a.shape(i++) == n;
+  if (!ok) {
+    std::string expected;
+    for (py::ssize_t n : shape)
+      expected += (expected.empty() ? "" : ", ") + std::to_string(n);
+    throw py::value_error(std::string(name) + " must have shape (" +
+                          expected + ")");
+  }
+}
+
+// Throws ValueError unless times is a non-empty increasing 1d array after t0.
+static void check_times(const RealArray &times, realtype t0) {
+  if (times.ndim() != 1 || times.shape(0) < 1)
+    throw py::value_error("times must be a non-empty 1d array");
+  const realtype *t = times.data();
+  for (py::ssize_t k = 0; k < times.shape(0); k++)
+    if (t[k] <= (k == 0 ? t0 : t[k - 1]))
+      throw py::value_error("times must be increasing and after t0");
+}
+
+// The output array: out itself if given, checked for shape and
+// writeability, otherwise a new array of that shape.
+static RealArray output_array(py::object out,
+                              std::initializer_list<py::ssize_t> shape) {
+  if (out.is_none()) return RealArray(std::vector<py::ssize_t>(shape));
+  if (!py::isinstance<RealArray>(out))
+    throw py::type_error("out must be a C-contiguous float64 array");
+  RealArray a = out.cast<RealArray>();
+  check_shape(a, "out", shape);
+  if (!a.writeable()) throw py::value_error("out is read-only");
+  return a;
+}
+
+static void check_flag(int flag, const char *funcname) {
+  if (flag < 0) throw SundialsError(funcname, flag);
+}
+
+// UserDataIntegrator with a lock, as Python threads may share one object.
+class PyIntegrator {
+ public:
+  PyIntegrator(realtype reltol, realtype abstol) : cv_(reltol, abstol) {}
+
+  RealArray integrate(const RealArray &params, const RealArray &y0,
+                      const RealArray &times, py::object out, realtype t0) {
+    check_shape(params, "params", {problem_params});
+    check_shape(y0, "y0", {problem_dim});
+    check_times(times, t0);
+    py::ssize_t ntimes = times.shape(0);
+    RealArray result = output_array(out, {ntimes, problem_dim});
+    realtype *out_data = result.mutable_data();
+    int flag;
+    {
+      py::gil_scoped_release release;
+      std::lock_guard<std::mutex> lock(mutex_);
+      flag = cv_.integrate(params.data(), y0.data(), t0, times.data(),
+                           ntimes, out_data);
+      steps_ = cv_.steps();
+    }
+    check_flag(flag, "CVode");
+    return result;
+  }
+
+  long int steps() const { return steps_; }
+
+ private:
+  UserDataIntegrator cv_;
+  std::mutex mutex_;
+  long int steps_ = 0;
+};
+
+// SteadyStateSolver with a lock, as Python threads may share one object.
+class PySteadyStateSolver {
+ public:
+  explicit PySteadyStateSolver(realtype fnormtol) : kin_(fnormtol) {}
+
+  RealArray solve(const RealArray &params, const RealArray &guess,
+                  py::object out) {
+    check_shape(params, "params", {problem_params});
+    check_shape(guess, "guess", {problem_dim});
+    RealArray result = output_array(out, {problem_dim});
+    realtype *out_data = result.mutable_data();
+    int flag;
+    {
+      py::gil_scoped_release release;
+      std::lock_guard<std::mutex> lock(mutex_);
+      // KINSOL solves in place, starting from the guess.
+      if (out_data != guess.data())
+        std::copy(guess.data(), guess.data() + problem_dim, out_data);
+      flag = kin_.solve(params.data(), out_data);
+      iterations_ = kin_.iterations();
+    }
+    check_flag(flag, "KINSol");
+    return result;
+  }
+
+  long int iterations() const { return iterations_; }
+
+ private:
+  SteadyStateSolver kin_;
+  std::mutex mutex_;
+  long int iterations_ = 0;
+};
+
+// params is (m, 2); y0 is (m, 2) or (2,), shared by all sets.
+static RealArray py_integrate_many(const RealArray &params,
+                                   const RealArray &y0,
+                                   const RealArray &times, py::object out,
+                                   realtype t0, realtype reltol,
+                                   realtype abstol, int threads) {
+  if (params.ndim() != 2)
+    throw py::value_error("params must have shape (m, 2)");
+  py::ssize_t m = params.shape(0);
+  check_shape(params, "params", {m, problem_params});
+  long int y0_stride = problem_dim;
+  if (y0.ndim() == 1) {
+    check_shape(y0, "y0", {problem_dim});
+    y0_stride = 0;
+  } else {
+    check_shape(y0, "y0", {m, problem_dim});
+  }
+  check_times(times, t0);
+  py::ssize_t ntimes = times.shape(0);
+  RealArray result = output_array(out, {m, ntimes, problem_dim});
+  realtype *out_data = result.mutable_data();
+  int flag;
+  {
+    py::gil_scoped_release release;
+    flag = integrate_many(params.data(), y0.data(), y0_stride, m, t0,
+                          times.data(), ntimes, out_data, reltol, abstol,
+                          threads, NULL);
+  }
+  check_flag(flag, "CVode");
+  return result;
+}
+
+// params is (m, 2); guess is (m, 2) or (2,), shared by all sets.
+static RealArray py_steady_state_many(const RealArray &params,
+                                      const RealArray &guess,
+                                      py::object out, realtype fnormtol,
+                                      int threads) {
+  if (params.ndim() != 2)
+    throw py::value_error("params must have shape (m, 2)");
+  py::ssize_t m = params.shape(0);
+  check_shape(params, "params", {m, problem_params});
+  bool shared = guess.ndim() == 1;
+  if (shared) check_shape(guess, "guess", {problem_dim});
+  else check_shape(guess, "guess", {m, problem_dim});
+  RealArray result = output_array(out, {m, problem_dim});
+  realtype *out_data = result.mutable_data();
+  int flag;
+  {
+    py::gil_scoped_release release;
+    const realtype *g = guess.data();
+    if (g != out_data)
+      for (py::ssize_t i = 0; i < m; i++)
+        std::copy(g + (shared ? 0 : i * problem_dim),
+                  g + (shared ? 0 : i * problem_dim) + problem_dim,
+                  out_data + i * problem_dim);
+    flag = steady_state_many(params.data(), m, out_data, fnormtol, threads);
+  }
+  check_flag(flag, "KINSol");
+  return result;
+}
+
+PYBIND11_MODULE(sundials_py, m) {
+  m.doc() = "Zero-copy bindings of the CVODE user data example and the "
+            "simple KINSOL example.";
+  py::register_exception<SundialsError>(m, "SundialsError");
+
+  py::class_<PyIntegrator>(m, "UserDataIntegrator",
+      "CVODE (SPGMR) for y0' = -101 y0 - 100 y1 + c0, y1' = y0 + c1.")
+    .def(py::init<realtype, realtype>(),
+         py::arg("reltol") = 1e-5, py::arg("abstol") = 1e-5)
+    .def("integrate", &PyIntegrator::integrate,
+         "Integrates from (t0, y0) with params = (c0, c1) and returns y at "
+         "each time, shape (len(times), 2).",
+         py::arg("params").noconvert(), py::arg("y0").noconvert(),
+         py::arg("times").noconvert(), py::arg("out") = py::none(),
+         py::arg("t0") = 0.0)
+    .def_property_readonly("steps", &PyIntegrator::steps,
+                           "Internal steps of the last integrate call.");
+
+  py::class_<PySteadyStateSolver>(m, "SteadyStateSolver",
+      "KINSOL (SPGMR, line search) for the steady state of the same "
+      "system.")
+    .def(py::init<realtype>(), py::arg("fnormtol") = 1e-10)
+    .def("solve", &PySteadyStateSolver::solve,
+         "Solves 0 = f(y) with params = (c0, c1) from guess. Pass "
+         "out=guess to solve in place.",
+         py::arg("params").noconvert(), py::arg("guess").noconvert(),
+         py::arg("out") = py::none())
+    .def_property_readonly("iterations", &PySteadyStateSolver::iterations,
+                           "Nonlinear iterations of the last solve call.");
+
+  m.def("integrate_many", &py_integrate_many,
+        "Integrates m parameter sets on threads (0: one per core) and "
+        "returns y, shape (m, len(times), 2).",
+        py::arg("params").noconvert(), py::arg("y0").noconvert(),
+        py::arg("times").noconvert(), py::arg("out") = py::none(),
+        py::arg("t0") = 0.0, py::arg("reltol") = 1e-5,
+        py::arg("abstol") = 1e-5, py::arg("threads") = 0);
+  m.def("steady_state_many", &py_steady_state_many,
+        "Solves m steady state problems on threads (0: one per core) and "
+        "returns the solutions, shape (m, 2).",
+        py::arg("params").noconvert(), py::arg("guess").noconvert(),
+        py::arg("out") = py::none(), py::arg("fnormtol") = 1e-10,
+        py::arg("threads") = 0);
+}
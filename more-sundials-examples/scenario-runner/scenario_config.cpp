@@ -0,0 +1,298 @@
+/*
+Problem registry and scenario file parser of the scenario runner.
+
+The parser is a single pass over the file text without regular expressions
+or stream extraction, so reading a file of a few hundred scenarios takes
+microseconds.
+*/
+
+#include "scenario_config.h"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+// The 2d stiff system of the CVODE examples, with the user data
+// coefficients as parameters:
+//   y0' = -101 y0 - 100 y1 + p0
+//   y1' = y0 + p1
+static void stiff2d_rhs(const realtype *p, const realtype *y, realtype *f) {
+  f[0] = -101.0 * y[0] - 100.0 * y[1] + p[0];
+  f[1] = y[0] + p[1];
+}
+
+static void stiff2d_jac(const realtype *p, const realtype *y, realtype *J) {
+  J[0] = -101.0;
+  J[1] = -100.0;
+  J[2] = 1.0;
+  J[3] = 0.0;
+}
+
+// The genetic toggle switch of the KINSOL multi-start example, with
+// p = (alpha, n):
+//   y0' = alpha / (1 + |y1|^n) - y0
+//   y1' = alpha / (1 + |y0|^n) - y1
+// The absolute value keeps the powers real when a step or Newton iterate
+// goes below zero; d|y|^n/dy = n |y|^(n-1) sign(y).
+static void toggle_rhs(const realtype *p, const realtype *y, realtype *f) {
+  f[0] = p[0] / (1 + std::pow(std::fabs(y[1]), p[1])) - y[0];
+  f[1] = p[0] / (1 + std::pow(std::fabs(y[0]), p[1])) - y[1];
+}
+
+static void toggle_jac(const realtype *p, const realtype *y, realtype *J) {
+  realtype d0 = 1 + std::pow(std::fabs(y[0]), p[1]);
+  realtype d1 = 1 + std::pow(std::fabs(y[1]), p[1]);
+  realtype g0 = std::copysign(std::pow(std::fabs(y[0]), p[1] - 1), y[0]);
+  realtype g1 = std::copysign(std::pow(std::fabs(y[1]), p[1] - 1), y[1]);
+  J[0] = -1.0;
+  J[1] = -p[0] * p[1] * g1 / (d1 * d1);
+  J[2] = -p[0] * p[1] * g0 / (d0 * d0);
+  J[3] = -1.0;
+}
+
+static const Problem problems[] = {
+  {"stiff2d", 2, 2, {0.0, 0.0}, {2.0, 1.0}, stiff2d_rhs, stiff2d_jac},
+  {"toggle", 2, 2, {3.0, 2.0}, {2.0, 0.5}, toggle_rhs, toggle_jac},
+};
+
+const Problem *find_problem(const std::string &name) {
+  for (const Problem &p : problems)
+    if (name == p.name) return &p;
+  return NULL;
+}
+
+std::string problem_names() {
+  std::string names;
+  for (const Problem &p : problems) {
+    if (!names.empty()) names += ", ";
+    names += p.name;
+  }
+  return names;
+}
+
+const char *solver_name(SolverKind s) {
+  switch (s) {
+    case SolverKind::Cvode: return "cvode";
+    case SolverKind::CvodesAdjoint: return "cvodes_adjoint";
+    case SolverKind::Kinsol: return "kinsol";
+  }
+  return "?";
+}
+
+const char *linear_solver_name(LinearSolverKind ls) {
+  return ls == LinearSolverKind::Dense ? "dense" : "spgmr";
+}
+
+long int Scenario::num_outputs() const {
+  // The small offset keeps end_time itself when (end_time - t0) is a
+  // multiple of step_length up to rounding.
+  return (long int) std::floor((end_time - t0) / step_length +
+                               std::sqrt(UNIT_ROUNDOFF));
+}
+
+namespace {
+
+// Parser state for one file.
+class Parser {
+ public:
+  Parser(const std::string &path) : path_(path) {}
+
+  ScenarioFile parse(const std::string &text) {
+    size_t pos = 0;
+    while (pos < text.size()) {
+      size_t end = text.find('\n', pos);
+      if (end == std::string::npos) end = text.size();
+      line_++;
+      parse_line(text.data() + pos, text.data() + end);
+      pos = end + 1;
+    }
+    for (Scenario &s : file_.scenarios) finish(s);
+    return file_;
+  }
+
+ private:
+  void parse_line(const char *b, const char *e) {
+    const char *hash = (const char*) std::memchr(b, '#', e - b);
+    if (hash) e = hash;
+    trim(b, e);
+    if (b == e) return;
+
+    if (*b == '[') {
+      if (e[-1] != ']') fail("missing ']' after the section name");
+      const char *nb = b + 1, *ne = e - 1;
+      trim(nb, ne);
+      if (nb == ne) fail("empty section name");
+      Scenario s = defaults_;
+      s.name.assign(nb, ne);
+      s.line = line_;
+      for (const Scenario &other : file_.scenarios)
+        if (other.name == s.name) fail("duplicate scenario '" + s.name + "'");
+      file_.scenarios.push_back(s);
+      return;
+    }
+
+    const char *eq = (const char*) std::memchr(b, '=', e - b);
+    if (!eq) fail("expected 'key = value' or '[name]'");
+    const char *kb = b, *ke = eq, *vb = eq + 1, *ve = e;
+    trim(kb, ke);
+    trim(vb, ve);
+    if (kb == ke) fail("missing key before '='");
+    if (vb == ve) fail("missing value for '" + std::string(kb, ke) + "'");
+    set(std::string(kb, ke), std::string(vb, ve));
+  }
+
+  void set(const std::string &key, const std::string &value) {
+    bool global = file_.scenarios.empty();
+    Scenario &s = global ? defaults_ : file_.scenarios.back();
+
+    if (key == "threads" || key == "cache_dir" || key == "cache_limit_mb") {
+      if (!global)
+        fail("'" + key + "' must be set before the first scenario");
+      if (key == "threads") file_.threads = (int) to_long(value, 0);
+      else if (key == "cache_dir") file_.cache_dir = value;
+      else file_.cache_limit_mb = to_long(value, 1);
+    } else if (key == "problem") {
+      s.problem = find_problem(value);
+      if (!s.problem)
+        fail("unknown problem '" + value + "' (known: " + problem_names() +
+             ")");
+    } else if (key == "solver") {
+      if (value == "cvode") s.solver = SolverKind::Cvode;
+      else if (value == "cvodes_adjoint") s.solver = SolverKind::CvodesAdjoint;
+      else if (value == "kinsol") s.solver = SolverKind::Kinsol;
+      else fail("unknown solver '" + value +
+                "' (known: cvode, cvodes_adjoint, kinsol)");
+    } else if (key == "linear_solver") {
+      if (value == "spgmr") s.linear_solver = LinearSolverKind::Spgmr;
+      else if (value == "dense") s.linear_solver = LinearSolverKind::Dense;
+      else fail("unknown linear solver '" + value + "' (known: spgmr, dense)");
+    } else if (key == "reltol") {
+      s.reltol = to_real(value);
+    } else if (key == "abstol") {
+      s.abstol = to_real(value);
+    } else if (key == "t0") {
+      s.t0 = to_real(value);
+    } else if (key == "end_time") {
+      s.end_time = to_real(value);
+    } else if (key == "step_length") {
+      s.step_length = to_real(value);
+    } else if (key == "y0") {
+      s.y0 = to_list(value);
+    } else if (key == "params") {
+      s.params = to_list(value);
+    } else if (key == "sink") {
+      set_sink(s, value);
+    } else if (key == "repeat") {
+      s.repeat = (int) to_long(value, 1);
+    } else if (key == "cache") {
+      if (value == "on") s.cache = true;
+      else if (value == "off") s.cache = false;
+      else fail("cache must be 'on' or 'off'");
+    } else {
+      fail("unknown key '" + key + "'");
+    }
+  }
+
+  void set_sink(Scenario &s, const std::string &value) {
+    s.sink_path.clear();
+    if (value == "none") s.sink = SinkKind::None;
+    else if (value == "stdout") s.sink = SinkKind::Stdout;
+    else if (value.compare(0, 4, "csv:") == 0) s.sink = SinkKind::Csv;
+    else if (value.compare(0, 7, "binary:") == 0) s.sink = SinkKind::Binary;
+    else fail("unknown sink '" + value +
+              "' (known: none, stdout, csv:<path>, binary:<path>)");
+    if (s.sink == SinkKind::Csv || s.sink == SinkKind::Binary) {
+      s.sink_path = value.substr(value.find(':') + 1);
+      if (s.sink_path.empty()) fail("missing path of the sink");
+    }
+  }
+
+  // Validates a scenario once all of its keys are known.
+  void finish(Scenario &s) {
+    line_ = s.line;
+    if (!s.problem) fail("scenario '" + s.name + "' has no problem");
+    const Problem &p = *s.problem;
+    if (s.y0.empty()) s.y0.assign(p.default_y0, p.default_y0 + p.n);
+    if (s.params.empty())
+      s.params.assign(p.default_params, p.default_params + p.nparams);
+    if ((int) s.y0.size() != p.n)
+      fail("scenario '" + s.name + "': y0 needs " + std::to_string(p.n) +
+           " values for problem " + p.name);
+    if ((int) s.params.size() != p.nparams)
+      fail("scenario '" + s.name + "': params needs " +
+           std::to_string(p.nparams) + " values for problem " + p.name);
+    if (s.reltol < 0 || s.abstol <= 0)
+      fail("scenario '" + s.name + "': tolerances must be positive");
+    if (s.solver != SolverKind::Kinsol) {
+      if (s.step_length <= 0)
+        fail("scenario '" + s.name + "': step_length must be positive");
+      if (s.num_outputs() < 1)
+        fail("scenario '" + s.name + "': end_time must be at least "
+             "t0 + step_length");
+    }
+  }
+
+  realtype to_real(const std::string &value) {
+    const char *b = value.c_str();
+    char *e;
+    double x = strtod(b, &e);
+    if (e == b || *e != '\0' || !std::isfinite(x))
+      fail("'" + value + "' is not a number");
+    return (realtype) x;
+  }
+
+  long int to_long(const std::string &value, long int min) {
+    const char *b = value.c_str();
+    char *e;
+    long int x = strtol(b, &e, 10);
+    if (e == b || *e != '\0') fail("'" + value + "' is not an integer");
+    if (x < min) fail("'" + value + "' is less than " + std::to_string(min));
+    return x;
+  }
+
+  std::vector<realtype> to_list(const std::string &value) {
+    std::vector<realtype> list;
+    size_t pos = 0;
+    while (true) {
+      size_t end = value.find(',', pos);
+      if (end == std::string::npos) end = value.size();
+      const char *b = value.data() + pos, *e = value.data() + end;
+      trim(b, e);
+      list.push_back(to_real(std::string(b, e)));
+      if ((int) list.size() > max_dim) fail("too many values");
+      if (end == value.size()) break;
+      pos = end + 1;
+    }
+    return list;
+  }
+
+  static void trim(const char *&b, const char *&e) {
+    while (b < e && (*b == ' ' || *b == '\t' || *b == '\r')) b++;
+    while (e > b && (e[-1] == ' ' || e[-1] == '\t' || e[-1] == '\r')) e--;
+  }
+
+  void fail(const std::string &message) const {
+    throw ConfigError(path_ + ":" + std::to_string(line_) + ": " + message);
+  }
+
+  std::string path_;
+  int line_ = 0;
+  Scenario defaults_;
+  ScenarioFile file_;
+};
+
+}  // namespace
+
+ScenarioFile parse_scenarios(const std::string &text,
+                             const std::string &path) {
+  return Parser(path).parse(text);
+}
+
+ScenarioFile parse_scenario_file(const std::string &path) {
+  std::ifstream in(path);
+  if (!in) throw ConfigError(path + ": can not open the file");
+  std::stringstream text;
+  text << in.rdbuf();
+  return parse_scenarios(text.str(), path);
+}
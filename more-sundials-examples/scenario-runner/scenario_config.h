@@ -0,0 +1,100 @@
+/*
+Scenario files for the scenario runner.
+
+A scenario file is a list of "key = value" lines, grouped into sections that
+start with "[name]". Each section is one scenario. Keys before the first
+section set the defaults of all scenarios, plus the runner-wide settings
+(threads, cache_dir, cache_limit_mb). Everything after a '#' is a comment.
+
+  threads = 4
+  reltol = 1e-5
+
+  [stiff-spgmr]
+  problem = stiff2d
+  solver = cvode
+  linear_solver = spgmr
+  y0 = 2, 1
+  sink = csv:stiff_spgmr.csv
+
+Errors are thrown as ConfigError with a "file:line: message" text.
+*/
+
+#ifndef SCENARIO_CONFIG_H
+#define SCENARIO_CONFIG_H
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+
+// Largest problem dimension and parameter count in the registry.
+const int max_dim = 8;
+const int max_params = 8;
+
+// A right hand side y' = rhs(p, y) with its Jacobian. The same function is
+// the residual of the steady state problem 0 = rhs(p, y) for KINSOL.
+struct Problem {
+  const char *name;
+  int n; // dimension
+  int nparams;
+  realtype default_params[max_params];
+  realtype default_y0[max_dim];
+  void (*rhs)(const realtype *p, const realtype *y, realtype *f);
+  // Dense Jacobian d rhs / d y, row-major: J[i * n + j] = d f_i / d y_j.
+  void (*jac)(const realtype *p, const realtype *y, realtype *J);
+};
+
+// Returns the registered problem of that name, or NULL.
+const Problem *find_problem(const std::string &name);
+// Comma-separated names of all registered problems, for error messages.
+std::string problem_names();
+
+enum class SolverKind { Cvode, CvodesAdjoint, Kinsol };
+enum class LinearSolverKind { Spgmr, Dense };
+enum class SinkKind { None, Stdout, Csv, Binary };
+
+struct Scenario {
+  std::string name;
+  int line = 0; // line of the section header
+  const Problem *problem = NULL;
+  SolverKind solver = SolverKind::Cvode;
+  LinearSolverKind linear_solver = LinearSolverKind::Spgmr;
+  realtype reltol = 1e-5;
+  realtype abstol = 1e-5;
+  realtype t0 = 0;
+  realtype end_time = 50;
+  realtype step_length = 0.5; // distance of the output times
+  std::vector<realtype> y0; // problem defaults if empty
+  std::vector<realtype> params; // problem defaults if empty
+  SinkKind sink = SinkKind::None;
+  std::string sink_path; // for the csv and binary sinks
+  int repeat = 1; // runs of the scenario, for timing
+  bool cache = true; // use the result cache, if one is configured
+
+  // Number of output times t0 + k * step_length, k = 1, 2, ..., up to
+  // end_time.
+  long int num_outputs() const;
+};
+
+struct ScenarioFile {
+  int threads = 1; // 0 uses std::thread::hardware_concurrency()
+  std::string cache_dir; // result cache directory, none if empty
+  long int cache_limit_mb = 256; // size limit of the result cache
+  std::vector<Scenario> scenarios;
+};
+
+class ConfigError : public std::runtime_error {
+ public:
+  explicit ConfigError(const std::string &what) : std::runtime_error(what) {}
+};
+
+// Parses a scenario file. Missing y0 and params are filled in from the
+// problem, and every scenario is validated.
+ScenarioFile parse_scenario_file(const std::string &path);
+// Parses scenario file text; path is only used in error messages.
+ScenarioFile parse_scenarios(const std::string &text, const std::string &path);
+
+const char *solver_name(SolverKind s);
+const char *linear_solver_name(LinearSolverKind ls);
+
+#endif
@@ -0,0 +1,500 @@
+/*
+A config-driven runner for the CVODE, CVODES and KINSOL examples.
+
+The examples hard-code their tolerances, output grid, linear solver and
+initial conditions, so every experiment needs a recompile. This runner reads
+them from a scenario file instead (see scenario_config.h and scenarios.ini)
+and dispatches each scenario to one of three solver paths:
+
+  cvode           - integrates the problem and records y at every output time
+  cvodes_adjoint  - integrates forward with checkpointing, then solves the
+                    adjoint problem yB' = -J^T yB from yB(T) = e_0 back to t0.
+                    yB(t0) is the gradient of y_0(T) with respect to y(t0).
+  kinsol          - solves the steady state problem 0 = rhs(y) from y0
+
+Scenarios run on a pool of threads, each with its own solver objects. The
+CVODE path goes through CVodeIntegrator (include/sundials_raii.h), built on
+the CVODES library, which contains the whole CVODE API; linking CVODE as
+well would define every CVode symbol twice.
+
+With cache_dir set, results are looked up in a content-addressed cache
+(include/result_cache.h) before solving and stored after a successful
+solve, so repeated scenarios are served from disk.
+
+Run as "./executable <scenario file>".
+*/
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <thread>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#define SUNDIALS_RAII_CVODES
+#include <sundials_raii.h> // move-only owners and CVodeIntegrator
+#include <cvodes/cvodes.h> // prototypes for CVODES fcts., consts.
+#include <kinsol/kinsol.h> // access to KINSOL func., consts.
+#include <kinsol/kinsol_spils.h> // access to KINSpils interface
+#include <kinsol/kinsol_direct.h> // access to KINDls interface
+#include <nvector/nvector_serial.h>  // access to serial N_Vector
+#include <sunmatrix/sunmatrix_dense.h> // access to dense SUNMatrix
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+#include <sundials/sundials_math.h>  // contains the macros ABS, SUNSQR, EXP
+#include <kinsol_stats.h> // convergence trace and statistics of KINSol
+#include <result_cache.h> // content-addressed result cache
+#include "scenario_config.h"
+
+
+// The problem and parameters of one scenario, passed to the callbacks as
+// user data.
+struct UserData {
+  const Problem *problem;
+  const realtype *params;
+};
+
+// The outcome of one scenario.
+struct ScenarioResult {
+  int flag = 0; // last solver flag, see succeeded()
+  std::string error; // setup error, if any
+  int columns = 0; // values per row
+  std::vector<realtype> rows; // row-major output of the last run
+  std::vector<realtype> gradient; // cvodes_adjoint: d y_0(T) / d y(t0)
+  double seconds = 0; // wall time of all runs
+  long int work = 0; // steps (CVODE paths) or nonlinear iterations (KINSOL)
+  bool hit = false; // served from the result cache
+  CachedResult cached; // the mapped cache file on a hit
+
+  // The output values, from the cache file on a hit.
+  const realtype *values() const {
+    return hit ? cached.data() : rows.data();
+  }
+  size_t num_values() const {
+    return hit ? cached.rows() * cached.columns() : rows.size();
+  }
+};
+
+struct KinMemFree {
+  void operator()(void *mem) const { KINFree(&mem); }
+};
+typedef SunOwner<void*, KinMemFree> KinMemOwner;
+
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data);
+static int jtv(N_Vector v, N_Vector Jv, realtype t, N_Vector u, N_Vector fu,
+               void *user_data, N_Vector tmp);
+static int jac(realtype t, N_Vector u, N_Vector fu, SUNMatrix J,
+               void *user_data, N_Vector tmp1, N_Vector tmp2, N_Vector tmp3);
+static int fb(realtype t, N_Vector y, N_Vector yB, N_Vector yBdot,
+              void *user_data);
+static int kin_f(N_Vector u, N_Vector f_val, void *user_data);
+static int kin_jtv(N_Vector v, N_Vector Jv, N_Vector u, booleantype *new_u,
+                   void *user_data);
+static int kin_jac(N_Vector u, N_Vector fu, SUNMatrix J, void *user_data,
+                   N_Vector tmp1, N_Vector tmp2);
+
+static CVodeIntegrator make_integrator(const Scenario &s, UserData *data) {
+  sunindextype N = s.problem->n;
+  if (s.linear_solver == LinearSolverKind::Dense)
+    return CVodeIntegrator::dense(N, f, jac, s.reltol, s.abstol, data);
+  return CVodeIntegrator::spgmr(N, f, jtv, s.reltol, s.abstol, data);
+}
+
+// Appends the row (t, y) to the result.
+static void add_row(ScenarioResult &r, realtype t, const realtype *y, int n) {
+  r.rows.push_back(t);
+  r.rows.insert(r.rows.end(), y, y + n);
+}
+
+// Integrates the scenario repeat times, reinitializing the same integrator.
+static void run_cvode(const Scenario &s, ScenarioResult &r) {
+  UserData data = {s.problem, s.params.data()};
+  CVodeIntegrator cv = make_integrator(s, &data);
+  const int n = s.problem->n;
+  const long int nout = s.num_outputs();
+  r.columns = n + 1;
+  r.rows.reserve(nout * r.columns);
+
+  for (int run = 0; run < s.repeat; run++) {
+    r.rows.clear();
+    cv.reset(s.t0, s.y0.data());
+    realtype t = s.t0;
+    for (long int k = 1; k <= nout; k++) {
+      r.flag = cv.advance(s.t0 + k * s.step_length, &t);
+      if (r.flag < 0) return;
+      add_row(r, t, cv.y_data(), n);
+    }
+  }
+  CVodeGetNumSteps(cv.mem(), &r.work);
+}
+
+// Forward integration with checkpoints and the adjoint solve for the
+// gradient of y_0(T). The adjoint memory is set up on the first run and
+// reinitialized on the later ones.
+static void run_cvodes_adjoint(const Scenario &s, ScenarioResult &r) {
+  UserData data = {s.problem, s.params.data()};
+  const int n = s.problem->n;
+  const long int nout = s.num_outputs();
+  const realtype T = s.t0 + nout * s.step_length;
+  r.columns = n + 1;
+  r.rows.reserve(nout * r.columns);
+
+  // Declared before the integrator so that they outlive the CVODES memory.
+  NVectorOwner yB = make_serial_vector(n);
+  SUNLinearSolverOwner LSB;
+  CVodeIntegrator cv = make_integrator(s, &data);
+  sundials_check(CVodeAdjInit(cv.mem(), 1000, CV_HERMITE), "CVodeAdjInit");
+  int indexB = -1;
+
+  for (int run = 0; run < s.repeat; run++) {
+    r.rows.clear();
+    cv.reset(s.t0, s.y0.data());
+    if (run > 0) sundials_check(CVodeAdjReInit(cv.mem()), "CVodeAdjReInit");
+    realtype t = s.t0;
+    int ncheck;
+    for (long int k = 1; k <= nout; k++) {
+      r.flag = CVodeF(cv.mem(), s.t0 + k * s.step_length, cv.y(), &t,
+                      CV_NORMAL, &ncheck);
+      if (r.flag < 0) return;
+      add_row(r, t, cv.y_data(), n);
+    }
+
+    // yB(T) = e_0 selects the first component of y(T).
+    N_VConst(0, yB);
+    NV_DATA_S(yB.get())[0] = 1;
+    if (indexB < 0) {
+      // CVodeInitB checks tB0 against the forward interval, so the backward
+      // problem can only be created after the first forward pass.
+      sundials_check(CVodeCreateB(cv.mem(), CV_BDF, CV_NEWTON, &indexB),
+                     "CVodeCreateB");
+      sundials_check(CVodeInitB(cv.mem(), indexB, fb, T, yB), "CVodeInitB");
+      sundials_check(CVodeSStolerancesB(cv.mem(), indexB, s.reltol, s.abstol),
+                     "CVodeSStolerancesB");
+      sundials_check(CVodeSetUserDataB(cv.mem(), indexB, &data),
+                     "CVodeSetUserDataB");
+      LSB.reset(SUNSPGMR(yB, PREC_NONE, 0));
+      sundials_check(LSB.get(), "SUNSPGMR");
+      sundials_check(CVSpilsSetLinearSolverB(cv.mem(), indexB, LSB),
+                     "CVSpilsSetLinearSolverB");
+    } else {
+      sundials_check(CVodeReInitB(cv.mem(), indexB, T, yB), "CVodeReInitB");
+    }
+
+    r.flag = CVodeB(cv.mem(), s.t0, CV_NORMAL);
+    if (r.flag < 0) return;
+    r.flag = CVodeGetB(cv.mem(), indexB, &t, yB);
+    if (r.flag < 0) return;
+  }
+  r.gradient.assign(NV_DATA_S(yB.get()), NV_DATA_S(yB.get()) + n);
+  CVodeGetNumSteps(cv.mem(), &r.work);
+}
+
+// Solves 0 = rhs(y) from y0 repeat times. The tolerances map to the KINSOL
+// stopping tests: abstol on the residual norm, reltol on the scaled step.
+static void run_kinsol(const Scenario &s, ScenarioResult &r) {
+  UserData data = {s.problem, s.params.data()};
+  const int n = s.problem->n;
+  r.columns = n + 1;
+
+  NVectorOwner u = make_serial_vector(n);
+  NVectorOwner scale = make_serial_vector(n);
+  N_VConst(1, scale);
+  std::copy(s.y0.begin(), s.y0.end(), NV_DATA_S(u.get()));
+  SUNMatrixOwner A;
+  SUNLinearSolverOwner LS;
+  KinMemOwner kin_mem(KINCreate());
+  sundials_check(kin_mem.get(), "KINCreate");
+  sundials_check(KINInit(kin_mem, kin_f, u), "KINInit");
+  sundials_check(KINSetUserData(kin_mem, &data), "KINSetUserData");
+  sundials_check(KINSetFuncNormTol(kin_mem, s.abstol), "KINSetFuncNormTol");
+  sundials_check(KINSetScaledStepTol(kin_mem, s.reltol),
+                 "KINSetScaledStepTol");
+  if (s.linear_solver == LinearSolverKind::Dense) {
+    A.reset(SUNDenseMatrix(n, n));
+    sundials_check(A.get(), "SUNDenseMatrix");
+    LS.reset(SUNDenseLinearSolver(u, A));
+    sundials_check(LS.get(), "SUNDenseLinearSolver");
+    sundials_check(KINDlsSetLinearSolver(kin_mem, LS, A),
+                   "KINDlsSetLinearSolver");
+    sundials_check(KINDlsSetJacFn(kin_mem, kin_jac), "KINDlsSetJacFn");
+  } else {
+    LS.reset(SUNSPGMR(u, PREC_NONE, 0));
+    sundials_check(LS.get(), "SUNSPGMR");
+    sundials_check(KINSpilsSetLinearSolver(kin_mem, LS),
+                   "KINSpilsSetLinearSolver");
+    sundials_check(KINSpilsSetJacTimesVecFn(kin_mem, kin_jtv),
+                   "KINSpilsSetJacTimesVecFn");
+  }
+  KinStatsRecorder recorder(
+      kin_mem, s.linear_solver != LinearSolverKind::Dense);
+
+  for (int run = 0; run < s.repeat; run++) {
+    std::copy(s.y0.begin(), s.y0.end(), NV_DATA_S(u.get()));
+    recorder.begin_solve();
+    r.flag = KINSol(kin_mem, u, KIN_LINESEARCH, scale, scale);
+    recorder.end_solve(r.flag);
+    if (r.flag < 0) return;
+  }
+  // One row: the final residual norm, then the steady state.
+  r.rows.clear();
+  add_row(r, recorder.stats().fnorm, NV_DATA_S(u.get()), n);
+  r.work = recorder.stats().nni;
+}
+
+// True if the run reached its result. KINSOL also returns non-negative
+// flags when it stalls short of the tolerance, e.g. KIN_STEP_LT_STPTOL.
+static bool succeeded(const Scenario &s, const ScenarioResult &r) {
+  return s.solver == SolverKind::Kinsol ? kin_converged(r.flag) : r.flag >= 0;
+}
+
+// Everything a result depends on. The repeat count and the sink do not
+// change the result and are left out.
+static CacheKey cache_key(const Scenario &s) {
+  CacheKey key;
+  key.add(s.problem->name).add(solver_name(s.solver))
+     .add(linear_solver_name(s.linear_solver));
+  key.add(s.reltol).add(s.abstol).add(s.t0).add(s.end_time)
+     .add(s.step_length);
+  key.add(s.y0.data(), s.y0.size()).add(s.params.data(), s.params.size());
+  return key;
+}
+
+static ScenarioResult run_scenario(const Scenario &s, ResultCache *cache) {
+  ScenarioResult r;
+  auto start = std::chrono::steady_clock::now();
+  CacheKey key;
+  if (cache && s.cache) {
+    key = cache_key(s);
+    if (cache->lookup(key, &r.cached)) {
+      r.hit = true;
+      r.columns = r.cached.columns();
+      r.gradient.assign(r.cached.extra(),
+                        r.cached.extra() + r.cached.extra_size());
+      r.work = r.cached.work();
+      r.seconds = std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - start).count();
+      return r;
+    }
+  }
+  try {
+    switch (s.solver) {
+      case SolverKind::Cvode: run_cvode(s, r); break;
+      case SolverKind::CvodesAdjoint: run_cvodes_adjoint(s, r); break;
+      case SolverKind::Kinsol: run_kinsol(s, r); break;
+    }
+  } catch (const SundialsError &e) {
+    r.flag = e.flag() < 0 ? e.flag() : -1;
+    r.error = e.what();
+  }
+  r.seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  if (cache && s.cache && succeeded(s, r))
+    cache->store(key, r.columns, r.rows.data(), r.rows.size() / r.columns,
+                 r.gradient.data(), r.gradient.size(), r.work);
+  return r;
+}
+
+// Writes the rows as CSV with a header line.
+static bool write_csv(const Scenario &s, const ScenarioResult &r) {
+  FILE *out = fopen(s.sink_path.c_str(), "w");
+  if (!out) return false;
+  fprintf(out, s.solver == SolverKind::Kinsol ? "fnorm" : "t");
+  for (int i = 1; i < r.columns; i++) fprintf(out, ",y%d", i - 1);
+  fprintf(out, "\n");
+  const realtype *v = r.values();
+  for (size_t k = 0; k < r.num_values(); k += r.columns) {
+    for (int i = 0; i < r.columns; i++)
+      fprintf(out, i ? ",%.17g" : "%.17g", (double) v[k + i]);
+    fprintf(out, "\n");
+  }
+  return fclose(out) == 0;
+}
+
+// Writes the rows as binary: int32 columns, int64 rows, then the values as
+// doubles in row-major order, all in native byte order.
+static bool write_binary(const Scenario &s, const ScenarioResult &r) {
+  FILE *out = fopen(s.sink_path.c_str(), "wb");
+  if (!out) return false;
+  int32_t columns = r.columns;
+  int64_t rows = r.columns ? (int64_t) (r.num_values() / r.columns) : 0;
+  std::vector<double> values(r.values(), r.values() + r.num_values());
+  bool ok = fwrite(&columns, sizeof(columns), 1, out) == 1 &&
+            fwrite(&rows, sizeof(rows), 1, out) == 1 &&
+            fwrite(values.data(), sizeof(double), values.size(), out) ==
+                values.size();
+  return fclose(out) == 0 && ok;
+}
+
+static void print_rows(const Scenario &s, const ScenarioResult &r) {
+  std::cout << "[" << s.name << "]\n";
+  const realtype *v = r.values();
+  for (size_t k = 0; k < r.num_values(); k += r.columns) {
+    printf(s.solver == SolverKind::Kinsol ? "fnorm: %g\ny:" : "t: %g\ny:",
+           (double) v[k]);
+    for (int i = 1; i < r.columns; i++) printf(" %.6e", (double) v[k + i]);
+    printf("\n");
+  }
+  std::cout << "\n";
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <scenario file>\n", argv[0]);
+    return(1);
+  }
+
+  ScenarioFile file;
+  auto parse_start = std::chrono::steady_clock::now();
+  try {
+    file = parse_scenario_file(argv[1]);
+  } catch (const ConfigError &e) {
+    fprintf(stderr, "%s\n", e.what());
+    return(1);
+  }
+  double parse_seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - parse_start).count();
+
+  // Each worker takes the next scenario until none are left. File sinks are
+  // written by the worker; stdout is printed in file order at the end.
+  const std::vector<Scenario> &scenarios = file.scenarios;
+  std::vector<ScenarioResult> results(scenarios.size());
+  std::vector<char> sink_ok(scenarios.size(), 1);
+  std::unique_ptr<ResultCache> cache;
+  if (!file.cache_dir.empty()) {
+    cache.reset(new ResultCache(file.cache_dir,
+                                (int64_t) file.cache_limit_mb << 20));
+    if (!cache->ok())
+      fprintf(stderr, "can not use the cache directory %s, running without\n",
+              file.cache_dir.c_str());
+  }
+  std::atomic<size_t> next(0);
+  auto worker = [&]() {
+    for (size_t i = next++; i < scenarios.size(); i = next++) {
+      results[i] = run_scenario(scenarios[i], cache.get());
+      if (scenarios[i].sink == SinkKind::Csv)
+        sink_ok[i] = write_csv(scenarios[i], results[i]);
+      else if (scenarios[i].sink == SinkKind::Binary)
+        sink_ok[i] = write_binary(scenarios[i], results[i]);
+    }
+  };
+  int nthreads = file.threads;
+  if (nthreads == 0)
+    nthreads = SUNMAX(1, (int) std::thread::hardware_concurrency());
+  nthreads = SUNMIN(nthreads, SUNMAX(1, (int) scenarios.size()));
+
+  auto run_start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int k = 1; k < nthreads; k++) threads.emplace_back(worker);
+  worker();
+  for (std::thread &th : threads) th.join();
+  double run_seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - run_start).count();
+
+  int failures = 0;
+  for (size_t i = 0; i < scenarios.size(); i++)
+    if (scenarios[i].sink == SinkKind::Stdout &&
+        succeeded(scenarios[i], results[i]))
+      print_rows(scenarios[i], results[i]);
+
+  printf("scenario              problem  solver          ls     runs"
+         "   ms/run    steps/iters  flag  cache\n");
+  for (size_t i = 0; i < scenarios.size(); i++) {
+    const Scenario &s = scenarios[i];
+    const ScenarioResult &r = results[i];
+    // A hit does not run the scenario; its time is that of the lookup.
+    int runs = r.hit ? 0 : s.repeat;
+    printf("%-20s  %-7s  %-14s  %-5s  %4d  %8.3f  %13ld  %4d  %s\n",
+           s.name.c_str(), s.problem->name, solver_name(s.solver),
+           linear_solver_name(s.linear_solver), runs,
+           r.seconds * 1e3 / SUNMAX(runs, 1), r.work, r.flag,
+           !cache || !s.cache ? "-" : r.hit ? "hit" : "miss");
+    if (!r.error.empty()) printf("  error: %s\n", r.error.c_str());
+    if (!sink_ok[i]) printf("  error: can not write %s\n", s.sink_path.c_str());
+    if (!r.gradient.empty()) {
+      printf("  d y0(T) / d y(t0) =");
+      for (realtype g : r.gradient) printf(" %.6e", (double) g);
+      printf("\n");
+    }
+    if (!succeeded(s, r) || !sink_ok[i]) failures++;
+  }
+  printf("\n%zu scenarios on %d threads in %.3f s, parsed in %.1f us\n",
+         scenarios.size(), nthreads, run_seconds, parse_seconds * 1e6);
+  if (cache) {
+    ResultCacheStats cs = cache->stats();
+    printf("cache %s: %ld hits, %ld misses, %ld stored, %ld evicted, "
+           "%.3f MB in use\n", file.cache_dir.c_str(), cs.hits, cs.misses,
+           cs.stores, cs.evictions, cache->usage() / 1048576.0);
+  }
+  return failures ? 1 : 0;
+}
+
+// Simple function that calculates the differential equation.
+static int f(realtype t, N_Vector u, N_Vector u_dot, void *user_data) {
+  UserData *data = (UserData*) user_data;
+  data->problem->rhs(data->params, N_VGetArrayPointer(u),
+                     N_VGetArrayPointer(u_dot));
+  return(0);
+}
+
+// Jacobian function vector routine, from the dense Jacobian of the problem.
+static int jtv(N_Vector v, N_Vector Jv, realtype t, N_Vector u, N_Vector fu,
+               void *user_data, N_Vector tmp) {
+  UserData *data = (UserData*) user_data;
+  const int n = data->problem->n;
+  realtype J[max_dim * max_dim];
+  data->problem->jac(data->params, N_VGetArrayPointer(u), J);
+  realtype *vdata  = N_VGetArrayPointer(v);
+  realtype *Jvdata = N_VGetArrayPointer(Jv);
+  for (int i = 0; i < n; i++) {
+    Jvdata[i] = 0;
+    for (int j = 0; j < n; j++) Jvdata[i] += J[i * n + j] * vdata[j];
+  }
+  return(0);
+}
+
+// Dense Jacobian routine.
+static int jac(realtype t, N_Vector u, N_Vector fu, SUNMatrix J,
+               void *user_data, N_Vector tmp1, N_Vector tmp2, N_Vector tmp3) {
+  UserData *data = (UserData*) user_data;
+  const int n = data->problem->n;
+  realtype Jrow[max_dim * max_dim];
+  data->problem->jac(data->params, N_VGetArrayPointer(u), Jrow);
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++) SM_ELEMENT_D(J, i, j) = Jrow[i * n + j];
+  return(0);
+}
+
+// The right hand side of the backward problem, yB' = -J(y)^T yB.
+static int fb(realtype t, N_Vector y, N_Vector yB, N_Vector yBdot,
+              void *user_data) {
+  UserData *data = (UserData*) user_data;
+  const int n = data->problem->n;
+  realtype J[max_dim * max_dim];
+  data->problem->jac(data->params, N_VGetArrayPointer(y), J);
+  realtype *yBdata = N_VGetArrayPointer(yB);
+  realtype *dyBdata = N_VGetArrayPointer(yBdot);
+  for (int j = 0; j < n; j++) {
+    dyBdata[j] = 0;
+    for (int i = 0; i < n; i++) dyBdata[j] -= J[i * n + j] * yBdata[i];
+  }
+  return(0);
+}
+
+// The steady state residual is the right hand side itself.
+static int kin_f(N_Vector u, N_Vector f_val, void *user_data) {
+  return f(0, u, f_val, user_data);
+}
+
+static int kin_jtv(N_Vector v, N_Vector Jv, N_Vector u, booleantype *new_u,
+                   void *user_data) {
+  *new_u = SUNFALSE;
+  return jtv(v, Jv, 0, u, NULL, user_data, NULL);
+}
+
+static int kin_jac(N_Vector u, N_Vector fu, SUNMatrix J, void *user_data,
+                   N_Vector tmp1, N_Vector tmp2) {
+  return jac(0, u, fu, J, user_data, tmp1, tmp2, NULL);
+}
@@ -0,0 +1,171 @@
+/*
+A C client of libsimplesundials.
+
+It integrates the system of the CVODE user data example,
+
+  y0' = -101 y0 - 100 y1 + c0
+  y1' = y0 + c1
+
+through the library and prints a few rows and the statistics. It then
+measures the cost per call of ss_integrate against the same integration
+through the CVODE C API directly, with the CVODE object created once and
+reinitialized for every run, and the cost of creating and destroying a
+problem per request, which the solver pool makes cheap.
+
+Build the library with make, then the client with
+
+  cc -O2 example_client.c -I . -L . -lsimplesundials -lsundials_cvode \
+     -lsundials_nvecserial -lm -Wl,-rpath,'$ORIGIN' -o client
+
+and run "./client [calls]".
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <cvode/cvode.h> // prototypes for CVODE fcts., consts.
+#include <cvode/cvode_direct.h> // access to CVDls interface
+#include <nvector/nvector_serial.h>  // access to serial N_Vector
+#include <sunmatrix/sunmatrix_dense.h> // access to dense SUNMatrix
+#include <sunlinsol/sunlinsol_dense.h> // access to dense SUNLinearSolver
+#include "simplesundials.h"
+
+#define NTIMES 4
+
+// Simple function that calculates the differential equation.
+static int rhs(double t, const double *y, double *ydot, void *user_data) {
+  const double *c = (const double*) user_data;
+  ydot[0] = -101.0 * y[0] - 100.0 * y[1] + c[0];
+  ydot[1] = y[0] + c[1];
+  return(0);
+}
+
+// Row-major Jacobian of rhs.
+static int jac(double t, const double *y, double *J, void *user_data) {
+  J[0] = -101.0;
+  J[1] = -100.0;
+  J[2] = 1.0;
+  J[3] = 0.0;
+  return(0);
+}
+
+// The same problem for the CVODE C API.
+static int cv_rhs(realtype t, N_Vector y, N_Vector ydot, void *user_data) {
+  return rhs(t, NV_DATA_S(y), NV_DATA_S(ydot), user_data);
+}
+
+static int cv_jac(realtype t, N_Vector y, N_Vector fy, SUNMatrix J,
+                  void *user_data, N_Vector tmp1, N_Vector tmp2,
+                  N_Vector tmp3) {
+  SM_ELEMENT_D(J, 0, 0) = -101.0;
+  SM_ELEMENT_D(J, 0, 1) = -100.0;
+  SM_ELEMENT_D(J, 1, 0) = 1.0;
+  SM_ELEMENT_D(J, 1, 1) = 0.0;
+  return(0);
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static int check(int flag, ss_problem *p, const char *funcname) {
+  if (flag != SS_SUCCESS) {
+    fprintf(stderr, "\nSUNDIALS_ERROR: %s() failed with code %d: %s\n\n",
+            funcname, flag, ss_last_error(p));
+    return(1);
+  }
+  return(0);
+}
+
+int main(int argc, char *argv[]) {
+  long calls = argc > 1 ? atol(argv[1]) : 100000;
+  double c[2] = {0.01, 0.02};
+  const double y0[2] = {2, 1};
+  const double times[NTIMES] = {0.5, 1.0, 1.5, 2.0};
+  double out[NTIMES * 2];
+  ss_stats stats;
+  double start, lib_time, raw_time, pooled_time;
+  long k;
+  int i, flag = 0;
+
+  if (ss_abi_version() != SS_ABI_VERSION) {
+    fprintf(stderr, "library ABI %d, client built for %d\n",
+            ss_abi_version(), SS_ABI_VERSION);
+    return(1);
+  }
+
+  // One problem, reused for every call.
+  ss_problem *p = ss_problem_create(2, rhs, c);
+  if (p == NULL) return(1);
+  if (check(ss_set_tolerances(p, 1e-5, 1e-5), p, "ss_set_tolerances"))
+    return(1);
+  if (check(ss_set_jacobian(p, jac), p, "ss_set_jacobian")) return(1);
+  if (check(ss_integrate(p, 0, y0, times, NTIMES, out), p, "ss_integrate"))
+    return(1);
+  for (i = 0; i < NTIMES; i++)
+    printf("t = %4.2f  y = %10.6f %10.6f\n", times[i], out[2 * i],
+           out[2 * i + 1]);
+  ss_get_stats(p, &stats, sizeof(stats));
+  printf("steps %ld, rhs evals %ld, jac evals %ld, newton iters %ld\n\n",
+         stats.steps, stats.rhs_evals, stats.jac_evals, stats.nonlin_iters);
+
+  start = now();
+  for (k = 0; k < calls; k++)
+    flag |= ss_integrate(p, 0, y0, times, NTIMES, out);
+  lib_time = (now() - start) / calls;
+  if (check(flag, p, "ss_integrate")) return(1);
+  ss_problem_destroy(p);
+
+  // The same runs through the CVODE C API, set up once.
+  {
+    N_Vector y = N_VNew_Serial(2);
+    SUNMatrix A = SUNDenseMatrix(2, 2);
+    SUNLinearSolver LS = SUNDenseLinearSolver(y, A);
+    void *cvode_mem = CVodeCreate(CV_BDF, CV_NEWTON);
+    realtype t;
+    NV_Ith_S(y, 0) = y0[0];
+    NV_Ith_S(y, 1) = y0[1];
+    CVodeInit(cvode_mem, cv_rhs, 0, y);
+    CVodeSStolerances(cvode_mem, 1e-5, 1e-5);
+    CVodeSetUserData(cvode_mem, c);
+    CVDlsSetLinearSolver(cvode_mem, LS, A);
+    CVDlsSetJacFn(cvode_mem, cv_jac);
+    start = now();
+    for (k = 0; k < calls; k++) {
+      NV_Ith_S(y, 0) = y0[0];
+      NV_Ith_S(y, 1) = y0[1];
+      CVodeReInit(cvode_mem, 0, y);
+      for (i = 0; i < NTIMES; i++) {
+        flag |= CVode(cvode_mem, times[i], y, &t, CV_NORMAL) < 0;
+        out[2 * i] = NV_Ith_S(y, 0);
+        out[2 * i + 1] = NV_Ith_S(y, 1);
+      }
+    }
+    raw_time = (now() - start) / calls;
+    CVodeFree(&cvode_mem);
+    SUNLinSolFree(LS);
+    SUNMatDestroy(A);
+    N_VDestroy(y);
+  }
+
+  // A problem per request. After the first, the solver comes from the pool.
+  start = now();
+  for (k = 0; k < calls; k++) {
+    ss_problem *q = ss_problem_create(2, rhs, c);
+    ss_set_jacobian(q, jac);
+    flag |= ss_integrate(q, 0, y0, times, NTIMES, out);
+    ss_problem_destroy(q);
+  }
+  pooled_time = (now() - start) / calls;
+
+  printf("%ld calls of %d output times each:\n", calls, NTIMES);
+  printf("  CVODE C API         %8.3f us per call\n", 1e6 * raw_time);
+  printf("  ss_integrate        %8.3f us per call (%+.3f us)\n",
+         1e6 * lib_time, 1e6 * (lib_time - raw_time));
+  printf("  create + integrate  %8.3f us per call (%+.3f us)\n",
+         1e6 * pooled_time, 1e6 * (pooled_time - raw_time));
+  printf("idle solvers in the pool: %d\n", ss_pool_clear());
+  return flag != 0;
+}
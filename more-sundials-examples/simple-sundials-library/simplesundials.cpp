@@ -0,0 +1,379 @@
+/*
+Implementation of libsimplesundials (see simplesundials.h).
+
+Each problem owns at most one Solver: a CVodeIntegrator of the problem's
+size and linear solver, plus two N_Vectors without data of their own that
+are pointed at the caller's y0 and output rows. The caller's callbacks are
+reached through trampolines with the SUNDIALS signatures.
+
+A Solver outlives its problem in the pool. It remembers the options it
+was last configured with, so ss_integrate only calls the CVodeSet*
+functions for options that differ; on the common path of repeated calls
+with unchanged options, a call costs the argument checks, CVodeReInit and
+the statistics getters on top of the CVode calls themselves.
+
+No exception leaves the library: setup errors become SS_SETUP_FAIL and
+allocation failures SS_MEM_FAIL.
+*/
+
+#include "simplesundials.h"
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <cvode/cvode.h> // prototypes for CVODE fcts., consts.
+#include <cvode/cvode_direct.h> // access to CVDls interface
+#include <cvode/cvode_spils.h> // access to CVSpils interface
+#include <nvector/nvector_serial.h>  // access to serial N_Vector
+#include <sunmatrix/sunmatrix_dense.h> // access to dense SUNMatrix
+#include <sundials/sundials_types.h>  // defs. of realtype, sunindextype
+#include <sundials_raii.h> // move-only owners and CVodeIntegrator
+
+// The ABI passes doubles; the state vectors are wrapped around them.
+static_assert(std::is_same<realtype, double>::value,
+              "libsimplesundials needs SUNDIALS built with double precision");
+
+namespace {
+
+// Options that can change between calls without a new solver.
+struct Options {
+  double reltol = 1e-5;
+  double abstol = 1e-5;
+  ss_jac_fn jac = NULL;
+  long max_steps = 500;
+};
+
+// What the trampolines need; CVODE's user data points here.
+struct Callbacks {
+  sunindextype n;
+  ss_rhs_fn rhs;
+  ss_jac_fn jac;
+  void *user_data;
+  std::vector<double> jac_rows; // n x n scratch for the user Jacobian
+};
+
+int rhs_trampoline(realtype t, N_Vector y, N_Vector ydot, void *data) {
+  Callbacks *cb = (Callbacks*) data;
+  return cb->rhs(t, NV_DATA_S(y), NV_DATA_S(ydot), cb->user_data);
+}
+
+// The user Jacobian is row-major; SUNDIALS dense matrices are column-major.
+int dense_jac_trampoline(realtype t, N_Vector y, N_Vector fy, SUNMatrix J,
+                         void *data, N_Vector tmp1, N_Vector tmp2,
+                         N_Vector tmp3) {
+  Callbacks *cb = (Callbacks*) data;
+  double *rows = cb->jac_rows.data();
+  int flag = cb->jac(t, NV_DATA_S(y), rows, cb->user_data);
+  if (flag != 0) return flag;
+  sunindextype n = cb->n;
+  for (sunindextype j = 0; j < n; j++) {
+    realtype *col = SM_COLUMN_D(J, j);
+    for (sunindextype i = 0; i < n; i++) col[i] = rows[i * n + j];
+  }
+  return(0);
+}
+
+// For SPGMR the user Jacobian is evaluated once per linear solver setup,
+// not once per Krylov iteration. The products until the next setup use it,
+// as the dense path uses its matrix.
+int jtsetup_trampoline(realtype t, N_Vector y, N_Vector fy, void *data) {
+  Callbacks *cb = (Callbacks*) data;
+  return cb->jac(t, NV_DATA_S(y), cb->jac_rows.data(), cb->user_data);
+}
+
+// Jacobian-vector product with the Jacobian of the last setup, for SPGMR.
+int jtv_trampoline(N_Vector v, N_Vector Jv, realtype t, N_Vector y,
+                   N_Vector fy, void *data, N_Vector tmp) {
+  Callbacks *cb = (Callbacks*) data;
+  const double *rows = cb->jac_rows.data();
+  sunindextype n = cb->n;
+  const realtype *vdata = NV_DATA_S(v);
+  realtype *Jvdata = NV_DATA_S(Jv);
+  for (sunindextype i = 0; i < n; i++) {
+    realtype sum = 0;
+    for (sunindextype j = 0; j < n; j++) sum += rows[i * n + j] * vdata[j];
+    Jvdata[i] = sum;
+  }
+  return(0);
+}
+
+// A CVODE object of one size and linear solver, reusable by any problem
+// with the same two.
+class Solver {
+ public:
+  Solver(int n, int linear_solver)
+      : linear_solver_(linear_solver),
+        cb_{n, NULL, NULL, NULL, std::vector<double>()},
+        cv_(linear_solver == SS_SPGMR
+                ? CVodeIntegrator::spgmr(n, rhs_trampoline, NULL,
+                                         applied_.reltol, applied_.abstol,
+                                         &cb_)
+                : CVodeIntegrator::dense(n, rhs_trampoline, NULL,
+                                         applied_.reltol, applied_.abstol,
+                                         &cb_)),
+        y0_(N_VMake_Serial(n, NULL)),
+        yout_(N_VMake_Serial(n, NULL)) {
+    sundials_check(y0_.get(), "N_VMake_Serial");
+    sundials_check(yout_.get(), "N_VMake_Serial");
+  }
+
+  sunindextype size() const { return cb_.n; }
+  int linear_solver() const { return linear_solver_; }
+
+  // Applies the options that differ from the last call.
+  void configure(const Options &o) {
+    void *mem = cv_.mem();
+    if (o.reltol != applied_.reltol || o.abstol != applied_.abstol) {
+      sundials_check(CVodeSStolerances(mem, o.reltol, o.abstol),
+                     "CVodeSStolerances");
+    }
+    if (o.max_steps != applied_.max_steps) {
+      sundials_check(CVodeSetMaxNumSteps(mem, o.max_steps),
+                     "CVodeSetMaxNumSteps");
+    }
+    if (o.jac != applied_.jac) {
+      if (o.jac != NULL) cb_.jac_rows.resize(cb_.n * cb_.n);
+      if (linear_solver_ == SS_SPGMR) {
+        sundials_check(CVSpilsSetJacTimes(mem,
+                                          o.jac ? jtsetup_trampoline : NULL,
+                                          o.jac ? jtv_trampoline : NULL),
+                       "CVSpilsSetJacTimes");
+      } else {
+        sundials_check(CVDlsSetJacFn(mem,
+                                     o.jac ? dense_jac_trampoline : NULL),
+                       "CVDlsSetJacFn");
+      }
+    }
+    applied_ = o;
+    cb_.jac = o.jac;
+  }
+
+  // One ss_integrate call after the argument checks.
+  int integrate(ss_rhs_fn rhs, void *user_data, double t0, const double *y0,
+                const double *times, long ntimes, double *out) {
+    cb_.rhs = rhs;
+    cb_.user_data = user_data;
+    NV_DATA_S(y0_.get()) = const_cast<double*>(y0); // only read
+    int flag = CVodeReInit(cv_.mem(), t0, y0_);
+    if (flag < 0) return flag;
+    realtype t;
+    for (long k = 0; k < ntimes; k++) {
+      // CVODE writes the solution straight into row k of out.
+      NV_DATA_S(yout_.get()) = out + k * cb_.n;
+      flag = CVode(cv_.mem(), times[k], yout_, &t, CV_NORMAL);
+      if (flag < 0) break;
+    }
+    return flag;
+  }
+
+  void read_stats(ss_stats *s) const {
+    void *mem = cv_.mem();
+    CVodeGetNumSteps(mem, &s->steps);
+    CVodeGetNumRhsEvals(mem, &s->rhs_evals);
+    if (linear_solver_ == SS_SPGMR)
+      CVSpilsGetNumJtimesEvals(mem, &s->jac_evals);
+    else
+      CVDlsGetNumJacEvals(mem, &s->jac_evals);
+    CVodeGetNumLinSolvSetups(mem, &s->lin_setups);
+    CVodeGetNumErrTestFails(mem, &s->err_test_fails);
+    CVodeGetNumNonlinSolvIters(mem, &s->nonlin_iters);
+    CVodeGetNumNonlinSolvConvFails(mem, &s->nonlin_conv_fails);
+    realtype h, t;
+    CVodeGetLastStep(mem, &h);
+    CVodeGetCurrentTime(mem, &t);
+    s->last_step = h;
+    s->last_time = t;
+  }
+
+ private:
+  // Initialized before cv_, which is created with them.
+  int linear_solver_;
+  Options applied_;
+  Callbacks cb_;
+  CVodeIntegrator cv_;
+  NVectorOwner y0_, yout_;
+};
+
+// Idle solvers, oldest first.
+const size_t max_idle = 64;
+std::mutex pool_mutex;
+std::deque<std::unique_ptr<Solver>> pool;
+
+// An idle solver of this size and linear solver, or a new one.
+std::unique_ptr<Solver> take_solver(int n, int linear_solver) {
+  {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    for (auto it = pool.rbegin(); it != pool.rend(); ++it) {
+      if ((*it)->size() == n && (*it)->linear_solver() == linear_solver) {
+        std::unique_ptr<Solver> s = std::move(*it);
+        pool.erase(std::next(it).base());
+        return s;
+      }
+    }
+  }
+  return std::unique_ptr<Solver>(new Solver(n, linear_solver));
+}
+
+void give_back(std::unique_ptr<Solver> s) {
+  std::unique_ptr<Solver> evicted;
+  {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    pool.push_back(std::move(s));
+    if (pool.size() > max_idle) {
+      evicted = std::move(pool.front());
+      pool.pop_front();
+    }
+  }
+  // evicted is freed here, outside the lock.
+}
+
+}  // namespace
+
+struct ss_problem {
+  int n;
+  ss_rhs_fn rhs;
+  void *user_data;
+  int linear_solver = SS_DENSE;
+  Options options;
+  std::unique_ptr<Solver> solver;
+  ss_stats stats = ss_stats();
+  char error[128] = ""; // fixed size, so recording an error can not throw
+
+  // Records an error message and returns code.
+  int fail(int code, const char *message) {
+    snprintf(error, sizeof(error), "%s", message);
+    return code;
+  }
+};
+
+extern "C" {
+
+int ss_abi_version(void) { return SS_ABI_VERSION; }
+
+ss_problem *ss_problem_create(int n, ss_rhs_fn rhs, void *user_data) {
+  if (n < 1 || rhs == NULL) return NULL;
+  ss_problem *p = new (std::nothrow) ss_problem;
+  if (p == NULL) return NULL;
+  p->n = n;
+  p->rhs = rhs;
+  p->user_data = user_data;
+  return p;
+}
+
+void ss_problem_destroy(ss_problem *p) {
+  if (p == NULL) return;
+  if (p->solver) {
+    try {
+      give_back(std::move(p->solver));
+    } catch (const std::bad_alloc &) {
+      // The pool could not grow; the solver is freed instead.
+    }
+  }
+  delete p;
+}
+
+int ss_set_tolerances(ss_problem *p, double reltol, double abstol) {
+  if (p == NULL) return SS_ILL_INPUT;
+  if (reltol < 0 || abstol < 0)
+    return p->fail(SS_ILL_INPUT, "tolerances must not be negative");
+  p->options.reltol = reltol;
+  p->options.abstol = abstol;
+  return SS_SUCCESS;
+}
+
+int ss_set_linear_solver(ss_problem *p, int linear_solver) {
+  if (p == NULL) return SS_ILL_INPUT;
+  if (linear_solver != SS_DENSE && linear_solver != SS_SPGMR)
+    return p->fail(SS_ILL_INPUT, "unknown linear solver");
+  if (linear_solver != p->linear_solver && p->solver) {
+    // The next integration takes a solver of the new kind.
+    try {
+      give_back(std::move(p->solver));
+    } catch (const std::bad_alloc &) {
+      // Freed instead, as in ss_problem_destroy.
+    }
+  }
+  p->linear_solver = linear_solver;
+  return SS_SUCCESS;
+}
+
+int ss_set_jacobian(ss_problem *p, ss_jac_fn jac) {
+  if (p == NULL) return SS_ILL_INPUT;
+  p->options.jac = jac;
+  return SS_SUCCESS;
+}
+
+int ss_set_max_steps(ss_problem *p, long max_steps) {
+  if (p == NULL) return SS_ILL_INPUT;
+  if (max_steps < 1)
+    return p->fail(SS_ILL_INPUT, "max_steps must be positive");
+  p->options.max_steps = max_steps;
+  return SS_SUCCESS;
+}
+
+int ss_set_user_data(ss_problem *p, void *user_data) {
+  if (p == NULL) return SS_ILL_INPUT;
+  p->user_data = user_data;
+  return SS_SUCCESS;
+}
+
+int ss_integrate(ss_problem *p, double t0, const double *y0,
+                 const double *times, long ntimes, double *out) {
+  if (p == NULL) return SS_ILL_INPUT;
+  p->error[0] = '\0';
+  if (y0 == NULL || times == NULL || out == NULL || ntimes < 1)
+    return p->fail(SS_ILL_INPUT, "y0, times and out are required");
+  // CVODE would interpolate backwards within its last step instead of
+  // failing, so the order is checked here.
+  for (long k = 0; k < ntimes; k++) {
+    if (!(times[k] > (k == 0 ? t0 : times[k - 1])))
+      return p->fail(SS_ILL_INPUT, "times must be increasing and after t0");
+  }
+
+  p->stats.calls++;
+  int flag;
+  try {
+    if (!p->solver) p->solver = take_solver(p->n, p->linear_solver);
+    p->solver->configure(p->options);
+    flag = p->solver->integrate(p->rhs, p->user_data, t0, y0, times, ntimes,
+                                out);
+  } catch (const SundialsError &e) {
+    p->solver.reset(); // possibly half configured
+    return p->fail(SS_SETUP_FAIL, e.what());
+  } catch (const std::bad_alloc &) {
+    p->solver.reset();
+    return p->fail(SS_MEM_FAIL, "out of memory");
+  }
+  p->solver->read_stats(&p->stats);
+  p->stats.last_flag = flag;
+  if (flag < 0)
+    return p->fail(SS_SOLVE_FAIL, "CVode failed; see ss_stats.last_flag");
+  return SS_SUCCESS;
+}
+
+int ss_get_stats(const ss_problem *p, ss_stats *stats, size_t size) {
+  if (p == NULL || stats == NULL) return SS_ILL_INPUT;
+  if (size > sizeof(ss_stats)) size = sizeof(ss_stats);
+  std::memcpy(stats, &p->stats, size);
+  return SS_SUCCESS;
+}
+
+const char *ss_last_error(const ss_problem *p) {
+  return p == NULL ? "NULL problem" : p->error;
+}
+
+int ss_pool_clear(void) {
+  std::deque<std::unique_ptr<Solver>> idle;
+  {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    idle.swap(pool);
+  }
+  return (int) idle.size();
+}
+
+}  // extern "C"
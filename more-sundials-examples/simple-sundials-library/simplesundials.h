@@ -0,0 +1,132 @@
+/*
+libsimplesundials: CVODE behind a small, stable C ABI.
+
+A service that needs to integrate an ODE links this library instead of
+forking an example or copying its setup code. The caller registers its
+right hand side (and optionally its Jacobian) as plain C callbacks, sets
+the solver options, and integrates into its own output buffer:
+
+  ss_problem *p = ss_problem_create(2, rhs, &params);
+  ss_set_tolerances(p, 1e-5, 1e-5);
+  ss_integrate(p, 0.0, y0, times, ntimes, out);  // out is ntimes x 2
+  ss_stats stats;
+  ss_get_stats(p, &stats, sizeof(stats));
+  ss_problem_destroy(p);
+
+Solver objects are pooled. A problem takes a CVODE object of its size and
+linear solver from the pool on its first integration and gives it back
+when it is destroyed, so creating problems per request allocates only on
+the first requests. Every further integration on the same problem
+reinitializes the solver with CVodeReInit. The state vectors are wrapped
+around the caller's y0 and output rows, so nothing is copied either.
+
+ABI rules: only C types cross the boundary, the problem is an opaque
+handle, and ss_stats is filled up to the size the caller passes, so fields
+can be appended without breaking older callers. SS_ABI_VERSION changes
+only when an existing function or field changes.
+
+A problem may be used by one thread at a time; different problems may be
+used from different threads at the same time.
+*/
+
+#ifndef SIMPLESUNDIALS_H
+#define SIMPLESUNDIALS_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define SS_API __attribute__((visibility("default")))
+#else
+#define SS_API
+#endif
+
+#define SS_ABI_VERSION 1
+
+// Return codes. Solver failures keep the CVODE flag in ss_stats.last_flag.
+#define SS_SUCCESS 0
+#define SS_ILL_INPUT -1 // a NULL handle, bad size or non-increasing times
+#define SS_MEM_FAIL -2 // out of memory
+#define SS_SETUP_FAIL -3 // a SUNDIALS setup call failed
+#define SS_SOLVE_FAIL -4 // CVode failed; the rows from the failing one on
+                         // are left untouched
+
+// Linear solvers of the Newton iteration.
+#define SS_DENSE 0 // dense direct solver (the default)
+#define SS_SPGMR 1 // GMRES without preconditioning
+
+typedef struct ss_problem ss_problem;
+
+// dy/dt = f(t, y): writes f into ydot (n values). Returns 0 on success, a
+// positive value for a recoverable error (CVODE retries with a smaller
+// step) and a negative value to stop the integration.
+typedef int (*ss_rhs_fn)(double t, const double *y, double *ydot,
+                         void *user_data);
+
+// The Jacobian df/dy at (t, y), written row-major into jac (n x n):
+// jac[i * n + j] = df_i/dy_j. Same return convention as ss_rhs_fn.
+typedef int (*ss_jac_fn)(double t, const double *y, double *jac,
+                         void *user_data);
+
+// Counters of the last ss_integrate call, except calls.
+typedef struct {
+  long steps; // internal steps
+  long rhs_evals; // right hand side evaluations
+  long jac_evals; // Jacobian evaluations (dense) or products (SPGMR)
+  long lin_setups; // linear solver setups
+  long err_test_fails; // local error test failures
+  long nonlin_iters; // Newton iterations
+  long nonlin_conv_fails; // Newton convergence failures
+  double last_step; // size of the last internal step
+  double last_time; // time reached
+  int last_flag; // last CVode flag
+  long calls; // ss_integrate calls on this problem so far
+} ss_stats;
+
+// The SS_ABI_VERSION the library was built with.
+SS_API int ss_abi_version(void);
+
+// A problem of n equations with right hand side rhs. user_data is passed
+// to the callbacks unchanged. Returns NULL for n < 1, rhs == NULL or when
+// out of memory. The options default to reltol = abstol = 1e-5, SS_DENSE
+// with a difference quotient Jacobian and 500 steps per output time.
+SS_API ss_problem *ss_problem_create(int n, ss_rhs_fn rhs, void *user_data);
+
+// Gives the solver back to the pool and frees the problem. NULL is a
+// no-op.
+SS_API void ss_problem_destroy(ss_problem *p);
+
+// Options. They take effect at the next ss_integrate call.
+SS_API int ss_set_tolerances(ss_problem *p, double reltol, double abstol);
+SS_API int ss_set_linear_solver(ss_problem *p, int linear_solver);
+// jac == NULL uses difference quotients. With SS_SPGMR, jac is called once
+// per linear solver setup and the products until the next setup use it.
+SS_API int ss_set_jacobian(ss_problem *p, ss_jac_fn jac);
+SS_API int ss_set_max_steps(ss_problem *p, long max_steps);
+SS_API int ss_set_user_data(ss_problem *p, void *user_data);
+
+// Integrates from (t0, y0) and writes y at each of the ntimes increasing
+// times, all after t0, into out (ntimes x n, row-major). y0 and times are
+// only read. Returns SS_SUCCESS or one of the error codes above.
+SS_API int ss_integrate(ss_problem *p, double t0, const double *y0,
+                        const double *times, long ntimes, double *out);
+
+// Copies the first size bytes of the statistics into stats. Pass
+// sizeof(ss_stats).
+SS_API int ss_get_stats(const ss_problem *p, ss_stats *stats, size_t size);
+
+// A message for the last error on p, or "" if the last call succeeded.
+SS_API const char *ss_last_error(const ss_problem *p);
+
+// Frees the idle solvers in the pool and returns how many there were.
+// The pool holds at most 64 idle solvers; the oldest are freed beyond that.
+SS_API int ss_pool_clear(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -4,6 +4,9 @@ as a stiff system.
 */
 
 #include <iostream>
+#ifdef NO_ALLOC
+#include <alloc_guard.h> // heap allocation guard for the step loop
+#endif
 #include <cvode/cvode.h> // prototypes for CVODE fcts., consts.
 #include <nvector/nvector_serial.h>  // access to serial N_Vector
 #include <sunlinsol/sunlinsol_spgmr.h>  //access to SPGMR SUNLinearSolver
@@ -114,14 +117,30 @@ int main() {
   realtype end_time = 50;
   realtype step_length = 0.5;
   realtype t = 0;
+#ifdef NO_ALLOC
+  // In no-alloc mode the results go into a table allocated up front and are
+  // printed after the loop, which runs under the heap allocation guard.
+  StepLoopGuard<realtype> guard((size_t) (end_time / step_length + 1), 2);
+#endif
   // loop over output points, call CVode, print results, test for error
   for (tout = step_length; tout <= end_time; tout += step_length) {
     flag = CVode(cvode_mem, tout, y, &t, CV_NORMAL);
+#ifdef NO_ALLOC
+    // The flag is reported after the guard is disarmed, as the error message
+    // allocates.
+    guard.record(t, NV_DATA_S(y));
+    if (flag < 0) break;
+#else
     std::cout << "t: " << t;
     std::cout << "\ny:";
     N_VPrint_Serial(y);
     if(check_flag(&flag, "CVode", 1)) break;
+#endif
   }
+#ifdef NO_ALLOC
+  guard.finish();
+  check_flag(&flag, "CVode", 1);
+#endif
   // ---------------------------------------------------------------------------
 
   // 15. Get optional outputs.
@@ -143,6 +162,11 @@ int main() {
   SUNLinSolFree(LS);
   // ---------------------------------------------------------------------------
 
+#ifdef NO_ALLOC
+  // A non-zero exit status reports allocations in the step loop.
+  if (guard.violations() > 0) return(1);
+#endif
+
   // return(0);
 }
 